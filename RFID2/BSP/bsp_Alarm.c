@@ -1,7 +1,7 @@
 #include "bsp_Alarm.h"
 
 
-void Alarm_Init(void)//ʼ
+void Alarm_Init(void)//蜂鸣器初始化函数
 {
 	GPIO_InitTypeDef GPIO_InitStructure;
 	
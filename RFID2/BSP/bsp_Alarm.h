@@ -3,15 +3,15 @@
 
 #include "stm32f10x.h"
 
-#define FMQ_GPIO_PORT    	GPIOB			            /* GPIO˿ */
-#define FMQ_GPIO_CLK 	    RCC_APB2Periph_GPIOB		/* GPIO˿ʱ */
-#define FMQ_GPIO_PIN			GPIO_Pin_8			        /* ӵSCLʱߵGPIO */
+#define FMQ_GPIO_PORT    	GPIOB			            /* GPIO端口 */
+#define FMQ_GPIO_CLK 	    RCC_APB2Periph_GPIOB		/* GPIO端口时钟 */
+#define FMQ_GPIO_PIN			GPIO_Pin_8			        /* 连接到SCL时钟线的GPIO */
 
 #define LED_GPIO_PORT			GPIOB
 #define LED_GPIO_CLK  		RCC_APB2Periph_GPIOB
 #define LED_GPIO_PIN  		GPIO_Pin_9
 
-void Alarm_Init(void);//ʼ
+void Alarm_Init(void);//蜂鸣器初始化函数
 void Alarm_OFF();
 void Alarm_ON();
 
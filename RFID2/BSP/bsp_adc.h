@@ -3,8 +3,8 @@
 #include "stm32f10x.h"
 
 
-// ע⣺ADCɼIOûиãɼѹӰ
-/********************ADC1ͨţ**************************/
+// 注意：用作ADC采集的IO必须没有复用，否则采集电压会有影响
+/********************ADC1输入通道（引脚）配置**************************/
 #define    ADC_APBxClock_FUN             RCC_APB2PeriphClockCmd
 #define    ADC_CLK                       RCC_APB2Periph_ADC1
 
@@ -12,12 +12,12 @@
 #define    ADC_GPIO_CLK                  RCC_APB2Periph_GPIOB  
 #define    ADC_PORT                      GPIOB
 
-// ע
-// 1-PC0 ڰԵӵǷĬϱ
-// 2-PC0 ָӵSPI FLASH ƬѡĬϱ
-//  PC0  ADC תͨʱ򣬽ܻ
+// 注意
+// 1-PC0 在霸道里面接的是蜂鸣器，默认被拉低
+// 2-PC0 在指南者里面接的是SPI FLASH的 片选，默认被拉高
+// 所以 PC0 做 ADC 转换通道的时候，结果可能会有误差
 
-// תͨ
+// 转换通道个数
 #define    NOFCHANEL										 1
 
 
@@ -26,13 +26,13 @@
 
 
 
-// ADC1 Ӧ DMA1ͨ1ADC3ӦDMA2ͨ5ADC2ûDMA
+// ADC1 对应 DMA1通道1，ADC3对应DMA2通道5，ADC2没有DMA功能
 #define    ADC_x                         ADC1
 #define    ADC_DMA_CHANNEL               DMA1_Channel1
 #define    ADC_DMA_CLK                   RCC_AHBPeriph_DMA1
 
 
-/**********************************************************/
+/**************************函数声明********************************/
 void               ADCx_Init                               (void);
 
 
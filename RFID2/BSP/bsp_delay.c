@@ -1,116 +1,76 @@
 #include "bsp_delay.h"
+#include "delay.h"
 
 
-//ʱϵ
-unsigned char UsCount = 0;
-unsigned short MsCount = 0;
-
 /*
 ************************************************************
-*	ƣ	Delay_Init
+*	函数名称：	Delay_Init
 *
-*	ܣ	systickʼ
+*	函数功能：	延时初始化
 *
-*	ڲ	
+*	入口参数：	无
 *
-*	ز	
+*	返回参数：	无
 *
-*	˵		
+*	说明：		
 ************************************************************
 */
 void Delay_Init(void)
 {
 
-	SysTick->CTRL &= ~(1 << 2);		//ѡʱΪHCLK(72MHz)/8		103--9MHz
-	
-	UsCount = 9;					//΢뼶ʱϵ
-	
-	MsCount = UsCount * 1000;		//뼶ʱϵ
+	delay_init(72);				//SysTick作为1ms节拍由delay.c管理，这里不再改动
 
 }
 /*
 ************************************************************
-*	ƣ	DelayUs
+*	函数名称：	DelayUs
 *
-*	ܣ	΢뼶ʱ
+*	函数功能：	微秒级延时
 *
-*	ڲ	usʱʱ
+*	入口参数：	us：延时的时长
 *
-*	ز	
+*	返回参数：	无
 *
-*	˵		ʱ(21MHz)ʱ798915us
+*	说明：		
 ************************************************************
 */
 void DelayUs(unsigned short us)
 {
 
-	unsigned int ctrlResult = 0;
-	
-	us &= 0x00FFFFFF;											//ȡ24λ
-	
-	SysTick->LOAD = us * UsCount;								//װ
-	SysTick->VAL = 0;
-	SysTick->CTRL = 1;											//ʹܵ
-	
-	do
-	{
-		ctrlResult = SysTick->CTRL;
-	}
-	while((ctrlResult & 0x01) && !(ctrlResult & (1 << 16)));	//֤СǷ񵹼0
-	
-	SysTick->CTRL = 0;											//رյ
-	SysTick->VAL = 0;
+	delay_us(us);				//DWT周期计数忙等
 
 }
 /*
 ************************************************************
-*	ƣ	DelayXms
+*	函数名称：	DelayXms
 *
-*	ܣ	뼶ʱ
+*	函数功能：	毫秒级延时
 *
-*	ڲ	msʱʱ
+*	入口参数：	ms：延时的时长
 *
-*	ز	
+*	返回参数：	无
 *
-*	˵		
+*	说明：		
 ************************************************************
 */
 void DelayXms(unsigned short ms)
 {
 
-	unsigned int ctrlResult = 0;
-	
-	if(ms == 0)
-		return;
-	
-	ms &= 0x00FFFFFF;											//ȡ24λ
-	
-	SysTick->LOAD = ms * MsCount;								//װ
-	SysTick->VAL = 0;
-	SysTick->CTRL = 1;											//ʹܵ
-	
-	do
-	{
-		ctrlResult = SysTick->CTRL;
-	}
-	while((ctrlResult & 0x01) && !(ctrlResult & (1 << 16)));	//֤СǷ񵹼0
-	
-	SysTick->CTRL = 0;											//رյ
-	SysTick->VAL = 0;
+	delay_ms(ms);				//等待期间WFI休眠
 
 }
 
 /*
 ************************************************************
-*	ƣ	DelayMs
+*	函数名称：	DelayMs
 *
-*	ܣ	뼶ʱ
+*	函数功能：	毫秒级长延时
 *
-*	ڲ	msʱʱ
+*	入口参数：	ms：延时的时长
 *
-*	ز	
+*	返回参数：	无
 *
-*	˵		εDelayXmsʱ
+*	说明：		多次调用DelayXms，做到长延时
 ************************************************************
 */
 void DelayMs(unsigned short ms)
@@ -15,9 +15,9 @@
 #define KEY3_PORT	     GPIOB
 #define KEY3_PORT_PIN  GPIO_Pin_14
 
-#define KEY1    GPIO_ReadInputDataBit(GPIOB,GPIO_Pin_12) //ȡ1
-#define KEY2    GPIO_ReadInputDataBit(GPIOB,GPIO_Pin_13) //ȡ1
-#define KEY3    GPIO_ReadInputDataBit(GPIOB,GPIO_Pin_14) //ȡ1
+#define KEY1    GPIO_ReadInputDataBit(GPIOB,GPIO_Pin_12) //读取按键1
+#define KEY2    GPIO_ReadInputDataBit(GPIOB,GPIO_Pin_13) //读取按键1
+#define KEY3    GPIO_ReadInputDataBit(GPIOB,GPIO_Pin_14) //读取按键1
 
 void Key_Init(void);
 uint8_t Key_Scan(uint8_t mode);
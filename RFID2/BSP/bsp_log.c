@@ -0,0 +1,144 @@
+#include "bsp_log.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+
+#define LOG_MASK           (LOG_BUF_SIZE - 1)
+#define LOG_LINE_SIZE      160                        // Log_Printf一次最多格式化这么长
+
+static char log_buf[LOG_BUF_SIZE];
+static volatile unsigned short log_head;              // 主循环写
+static volatile unsigned short log_tail;              // DMA发完一段后在中断里推进
+static volatile unsigned short log_dmaLen;            // 正在发送的长度，0=DMA空闲
+static unsigned int log_drop;                         // 缓冲满丢弃的条数
+
+static unsigned short Log_Free(void)
+{
+	return LOG_MASK - ((log_head - log_tail) & LOG_MASK);
+}
+
+// DMA空闲时调用：从tail起发一段连续的数据，回绕时剩下的在完成中断里接着发
+static void Log_Kick(void)
+{
+	unsigned short head = log_head, tail = log_tail;
+	unsigned short len;
+
+	if(head == tail)
+		return;
+	len = head > tail ? head - tail : LOG_BUF_SIZE - tail;
+	log_dmaLen = len;
+	DMA_Cmd(DMA1_Channel4, DISABLE);
+	DMA1_Channel4->CMAR = (uint32_t)&log_buf[tail];
+	DMA_SetCurrDataCounter(DMA1_Channel4, len);
+	DMA_Cmd(DMA1_Channel4, ENABLE);
+}
+
+// USART1已由USART1_Config配置好，这里只接上TX DMA
+void Log_Init(void)
+{
+	DMA_InitTypeDef dmaInitStruct;
+	NVIC_InitTypeDef nvicInitStruct;
+
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+	DMA_DeInit(DMA1_Channel4);
+	dmaInitStruct.DMA_PeripheralBaseAddr = (uint32_t)&USART1->DR;
+	dmaInitStruct.DMA_MemoryBaseAddr = (uint32_t)log_buf;
+	dmaInitStruct.DMA_DIR = DMA_DIR_PeripheralDST;
+	dmaInitStruct.DMA_BufferSize = 0;
+	dmaInitStruct.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	dmaInitStruct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	dmaInitStruct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	dmaInitStruct.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	dmaInitStruct.DMA_Mode = DMA_Mode_Normal;
+	dmaInitStruct.DMA_Priority = DMA_Priority_Low;
+	dmaInitStruct.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init(DMA1_Channel4, &dmaInitStruct);
+	DMA_ITConfig(DMA1_Channel4, DMA_IT_TC, ENABLE);
+	USART_DMACmd(USART1, USART_DMAReq_Tx, ENABLE);
+
+	nvicInitStruct.NVIC_IRQChannel = DMA1_Channel4_IRQn;
+	nvicInitStruct.NVIC_IRQChannelCmd = ENABLE;
+	nvicInitStruct.NVIC_IRQChannelPreemptionPriority = 1;
+	nvicInitStruct.NVIC_IRQChannelSubPriority = 3;
+	NVIC_Init(&nvicInitStruct);
+
+	log_head = log_tail = 0;
+	log_dmaLen = 0;
+}
+
+// 整条写入，放不下时丢弃整条并计数，不等待
+void Log_Write(const char *data, unsigned short len)
+{
+	unsigned short head = log_head;
+	unsigned short part;
+
+	if(len == 0)
+		return;
+	if(len > Log_Free())
+	{
+		log_drop++;
+		return;
+	}
+	part = LOG_BUF_SIZE - head;
+	if(part > len)
+		part = len;
+	memcpy(&log_buf[head], data, part);
+	memcpy(log_buf, data + part, len - part);
+	log_head = (head + len) & LOG_MASK;
+	if(log_dmaLen == 0)
+		Log_Kick();
+}
+
+void Log_Printf(const char *fmt, ...)
+{
+	char line[LOG_LINE_SIZE];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+	if(n < 0)
+		return;
+	if(n > (int)sizeof(line) - 1)
+		n = sizeof(line) - 1;
+	Log_Write(line, n);
+}
+
+// printf(fputc)逐字节写入：缓冲满时等DMA腾出空间，统计报告等大段输出不丢字
+void Log_Putc(char c)
+{
+	while(Log_Free() == 0)
+	{
+		if(log_dmaLen == 0)
+			Log_Kick();
+		__WFI();
+	}
+	log_buf[log_head] = c;
+	log_head = (log_head + 1) & LOG_MASK;
+	if(log_dmaLen == 0)
+		Log_Kick();
+}
+
+unsigned int Log_Dropped(void)
+{
+	return log_drop;
+}
+
+// 缓冲里的都已发完(USART1 DMA空闲)
+_Bool Log_Idle(void)
+{
+	return log_head == log_tail && log_dmaLen == 0;
+}
+
+void DMA1_Channel4_IRQHandler(void)
+{
+	if(DMA_GetITStatus(DMA1_IT_TC4) != RESET)
+	{
+		DMA_ClearITPendingBit(DMA1_IT_TC4);
+		log_tail = (log_tail + log_dmaLen) & LOG_MASK;
+		log_dmaLen = 0;
+		Log_Kick();
+	}
+}
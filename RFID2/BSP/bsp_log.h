@@ -0,0 +1,59 @@
+#ifndef BSP_LOG_H
+#define BSP_LOG_H
+
+
+#include "stm32f10x.h"
+
+
+// 调试日志：先写进环形缓冲，由USART1 TX DMA(DMA1通道4)在后台发出，调用处不等串口
+// 只在主循环里调用(单生产者)，中断里不要打日志
+// 高于LOG_LEVEL的级别编译时整条去掉，参数也不求值
+#define            LOG_LEVEL_NONE                0
+#define            LOG_LEVEL_ERR                 1
+#define            LOG_LEVEL_WARN                2
+#define            LOG_LEVEL_INFO                3
+#define            LOG_LEVEL_DEBUG               4        // 每次刷卡的块数据、卡号比对等
+
+#ifndef LOG_LEVEL
+#define            LOG_LEVEL                     LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_BUF_SIZE
+#define            LOG_BUF_SIZE                  1024     // 必须是2的幂
+#endif
+
+
+#if LOG_LEVEL >= LOG_LEVEL_ERR
+#define LOG_E(...)         Log_Printf(__VA_ARGS__)
+#else
+#define LOG_E(...)         ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_W(...)         Log_Printf(__VA_ARGS__)
+#else
+#define LOG_W(...)         ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_I(...)         Log_Printf(__VA_ARGS__)
+#else
+#define LOG_I(...)         ((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_D(...)         Log_Printf(__VA_ARGS__)
+#else
+#define LOG_D(...)         ((void)0)
+#endif
+
+
+void Log_Init(void);
+void Log_Write(const char *data, unsigned short len);
+void Log_Printf(const char *fmt, ...);
+void Log_Putc(char c);
+unsigned int Log_Dropped(void);
+_Bool Log_Idle(void);
+
+
+#endif
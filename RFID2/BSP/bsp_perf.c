@@ -0,0 +1,161 @@
+#include "bsp_perf.h"
+#include <stdio.h>
+
+#ifdef ENABLE_BSP_PERF
+
+static const char *const PERF_StageName[PERF_STAGE_NUM] =
+{
+	"request", "anticoll", "select", "auth", "read", "write",
+	"halt", "oled", "mqtt_pack", "at_send", "tap",
+};
+
+static unsigned int PERF_Start[PERF_STAGE_NUM];             // 本次开始时的周期数
+static unsigned char PERF_Running[PERF_STAGE_NUM];          // 已Begin还没End
+static unsigned int PERF_Sample[PERF_STAGE_NUM][PERF_SAMPLES];   // 最近的耗时，单位周期
+static unsigned int PERF_Count[PERF_STAGE_NUM];
+static unsigned int PERF_Reported;                          // 上次打印时的刷卡次数
+
+void PERF_Init(void)
+{
+#ifdef PERF_DWT_CTRL
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;          // 打开DWT，不清零CYCCNT(micros也在用)
+	PERF_DWT_CTRL |= 1;                                      // CYCCNTENA
+#endif
+}
+
+unsigned int PERF_Now(void)
+{
+	return PERF_CYCLES();
+}
+
+void PERF_Begin(unsigned char stage)
+{
+	PERF_BeginAt(stage, PERF_CYCLES());
+}
+
+// start：之前用PERF_Now取的时间，阶段起点早于确定要统计的时刻时用
+void PERF_BeginAt(unsigned char stage, unsigned int start)
+{
+	PERF_Start[stage] = start;
+	PERF_Running[stage] = 1;
+}
+
+// 没有Begin的End不记录，失败后不再End的阶段下次Begin时覆盖
+void PERF_End(unsigned char stage)
+{
+	unsigned int cycles = PERF_CYCLES() - PERF_Start[stage];   // 32位回绕相减仍正确
+
+	if(!PERF_Running[stage])
+		return;
+	PERF_Running[stage] = 0;
+	PERF_Sample[stage][PERF_Count[stage] % PERF_SAMPLES] = cycles;
+	PERF_Count[stage]++;
+}
+
+// 窗口内样本排序后取最近秩百分位
+_Bool PERF_Stat(unsigned char stage, PERF_STAT *st)
+{
+	static unsigned int sorted[PERF_SAMPLES];
+	unsigned int n, i, j, v;
+
+	st->count = PERF_Count[stage];
+	n = st->count < PERF_SAMPLES ? st->count : PERF_SAMPLES;
+	st->n = n;
+	if(n == 0)
+		return 0;
+
+	for(i = 0; i < n; i++)                                   // 插入排序，窗口不大
+	{
+		v = PERF_Sample[stage][i];
+		for(j = i; j > 0 && sorted[j - 1] > v; j--)
+			sorted[j] = sorted[j - 1];
+		sorted[j] = v;
+	}
+	st->min_us = sorted[0] / PERF_CPU_MHZ;
+	st->p50_us = sorted[(n * 50 + 99) / 100 - 1] / PERF_CPU_MHZ;
+	st->p99_us = sorted[(n * 99 + 99) / 100 - 1] / PERF_CPU_MHZ;
+	st->max_us = sorted[n - 1] / PERF_CPU_MHZ;
+	return 1;
+}
+
+const char *PERF_Name(unsigned char stage)
+{
+	return stage < PERF_STAGE_NUM ? PERF_StageName[stage] : "?";
+}
+
+void PERF_Report(void)
+{
+	PERF_STAT st;
+	unsigned char i;
+
+	printf("perf(us)   count  p50     max\r\n");
+	for(i = 0; i < PERF_STAGE_NUM; i++)
+	{
+		if(PERF_Stat(i, &st))
+			printf("%-10s %-6u %-7u %u\r\n", PERF_Name(i), st.count, st.p50_us, st.max_us);
+	}
+}
+
+// 主循环调用：每完成PERF_SAMPLES次刷卡打印一次
+void PERF_Process(void)
+{
+	if(PERF_Count[PERF_TAP] - PERF_Reported >= PERF_SAMPLES)
+	{
+		PERF_Reported = PERF_Count[PERF_TAP];
+		PERF_Report();
+	}
+}
+
+#else
+
+void PERF_Init(void)
+{
+	/* Perf disabled: no-op */
+}
+
+unsigned int PERF_Now(void)
+{
+	return 0;
+}
+
+void PERF_Begin(unsigned char stage)
+{
+	(void)stage;
+}
+
+void PERF_BeginAt(unsigned char stage, unsigned int start)
+{
+	(void)stage;
+	(void)start;
+}
+
+void PERF_End(unsigned char stage)
+{
+	(void)stage;
+}
+
+_Bool PERF_Stat(unsigned char stage, PERF_STAT *st)
+{
+	(void)stage;
+	st->count = 0;
+	st->n = 0;
+	return 0;
+}
+
+const char *PERF_Name(unsigned char stage)
+{
+	(void)stage;
+	return "?";
+}
+
+void PERF_Report(void)
+{
+	/* Perf disabled: no-op */
+}
+
+void PERF_Process(void)
+{
+	/* Perf disabled: no-op */
+}
+
+#endif
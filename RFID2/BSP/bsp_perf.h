@@ -0,0 +1,63 @@
+#ifndef BSP_PERF_H
+#define BSP_PERF_H
+
+
+#include "stm32f10x.h"
+
+
+// 刷卡各阶段耗时统计(DWT周期计数器)，注释掉即关闭，函数变成空操作
+#define            ENABLE_BSP_PERF
+
+
+#define            PERF_CPU_MHZ                  72
+#ifndef PERF_SAMPLES
+#define            PERF_SAMPLES                  16       // 每个阶段保留最近多少次，p50/p99在这个窗口里算
+#endif
+// 窗口不到100个样本时p99就是最大值，PERF_Report只打印p50和max
+
+// 仿真等没有DWT的环境在编译选项里给出PERF_CYCLES()
+#ifndef PERF_CYCLES
+#define            PERF_DWT_CTRL                 (*(volatile uint32_t *)0xE0001000)
+#define            PERF_DWT_CYCCNT               (*(volatile uint32_t *)0xE0001004)
+#define            PERF_CYCLES()                 PERF_DWT_CYCCNT
+#endif
+
+
+// 阶段
+#define            PERF_REQUEST                  0        // 寻卡(成功的)
+#define            PERF_ANTICOLL                 1        // 防冲突，每个级联级别一次
+#define            PERF_SELECT                   2        // 选卡，每个级联级别一次
+#define            PERF_AUTH                     3        // 认证
+#define            PERF_READ                     4        // 读余额块
+#define            PERF_WRITE                    5        // 写余额块，含卡片ACK确认
+#define            PERF_HALT                     6        // 卡片休眠
+#define            PERF_OLED                     7        // OLED刷新
+#define            PERF_MQTT_PACK                8        // 打包PUBLISH
+#define            PERF_AT_SEND                  9        // 进入AT队列到SEND OK
+#define            PERF_TAP                      10       // 寻卡成功到发布完成
+#define            PERF_STAGE_NUM                11
+
+
+typedef struct
+{
+	unsigned int count;          // 累计次数
+	unsigned int n;              // 窗口里的样本数
+	unsigned int min_us;
+	unsigned int p50_us;
+	unsigned int p99_us;
+	unsigned int max_us;
+} PERF_STAT;
+
+
+void PERF_Init(void);
+unsigned int PERF_Now(void);
+void PERF_Begin(unsigned char stage);
+void PERF_BeginAt(unsigned char stage, unsigned int start);
+void PERF_End(unsigned char stage);
+_Bool PERF_Stat(unsigned char stage, PERF_STAT *st);
+const char *PERF_Name(unsigned char stage);
+void PERF_Report(void);
+void PERF_Process(void);
+
+
+#endif
@@ -0,0 +1,125 @@
+#include "bsp_power.h"
+#include "bsp_perf.h"
+#include "delay.h"
+#include <stdio.h>
+
+
+static volatile unsigned char power_rxWake;              // EXTI3来过
+static unsigned int power_wakes[POWER_WAKE_NUM];
+static unsigned int power_stopMs;                        // 累计在STOP里的时间
+static unsigned int power_stopUs;                        // 不足1ms的部分
+static unsigned int power_skipUs;                        // 还没补进节拍的不足1ms的部分
+static unsigned int power_wakeSum;                       // 恢复时钟的耗时us
+static unsigned int power_wakeMax;
+static unsigned int power_hseRetry;                      // HSE重试后才起振的次数
+
+// USART2 RX引脚同时接到EXTI3，只在STOP期间打开
+static void Power_RxWake(FunctionalState state)
+{
+	EXTI_InitTypeDef extiInitStruct;
+
+	extiInitStruct.EXTI_Line = POWER_RX_EXTI_LINE;
+	extiInitStruct.EXTI_Mode = EXTI_Mode_Interrupt;
+	extiInitStruct.EXTI_Trigger = EXTI_Trigger_Falling;      // 起始位
+	extiInitStruct.EXTI_LineCmd = state;
+	EXTI_Init(&extiInitStruct);
+}
+
+// STOP唤醒后系统时钟是HSI，重新打开HSE和PLL；分频系数和Flash等待周期都还是SystemInit配的
+// SysTick、串口波特率和DWT延时都按72MHz算，不能留在HSI上返回：HSE一直起不来就复位
+// 返回SUCCESS：第一次就起振；ERROR：重试后才起振，晶振不可靠
+static ErrorStatus Power_ClockRestore(void)
+{
+	unsigned char tries = 0;
+
+	RCC_HSEConfig(RCC_HSE_ON);
+	while(RCC_WaitForHSEStartUp() != SUCCESS)
+	{
+		if(++tries >= POWER_HSE_TRIES)
+			NVIC_SystemReset();
+	}
+	RCC_PLLCmd(ENABLE);
+	while(RCC_GetFlagStatus(RCC_FLAG_PLLRDY) == RESET);
+	RCC_SYSCLKConfig(RCC_SYSCLKSource_PLLCLK);
+	while(RCC_GetSYSCLKSource() != 0x08);
+	return tries ? ERROR : SUCCESS;
+}
+
+void Power_Init(void)
+{
+	NVIC_InitTypeDef nvicInitStruct;
+
+	RCC_APB1PeriphClockCmd(RCC_APB1Periph_PWR, ENABLE);
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_AFIO, ENABLE);
+	GPIO_EXTILineConfig(POWER_RX_PORT_SOURCE, POWER_RX_PIN_SOURCE);
+	Power_RxWake(DISABLE);
+
+	nvicInitStruct.NVIC_IRQChannel = POWER_RX_IRQn;
+	nvicInitStruct.NVIC_IRQChannelCmd = ENABLE;
+	nvicInitStruct.NVIC_IRQChannelPreemptionPriority = 1;
+	nvicInitStruct.NVIC_IRQChannelSubPriority = 2;
+	NVIC_Init(&nvicInitStruct);
+}
+
+// 进入STOP，唤醒并恢复时钟后返回；唤醒源计入Power_Report
+// elapsed_us：恢复时钟后调用，返回进入STOP以来经过的us(由一直在跑的外部计时器给出)，
+// 按它补上SysTick节拍
+// 返回ERROR：HSE重试了才起振，调用者不应再进STOP
+ErrorStatus Power_Stop(unsigned int (*elapsed_us)(void))
+{
+	unsigned int start, us;
+	unsigned char src;
+	ErrorStatus clock;
+
+	power_rxWake = 0;
+	USART_ITConfig(USART2, USART_IT_RXNE, DISABLE);      // 恢复时钟前波特率不对，收到的不进接收缓冲
+	EXTI_ClearITPendingBit(POWER_RX_EXTI_LINE);
+	Power_RxWake(ENABLE);
+
+	PWR_EnterSTOPMode(PWR_Regulator_LowPower, PWR_STOPEntry_WFI);
+
+	start = PERF_CYCLES();                               // 此时DWT按HSI计数
+	clock = Power_ClockRestore();
+	us = (PERF_CYCLES() - start) / POWER_HSI_MHZ;
+	Power_RxWake(DISABLE);
+	if(USART_GetFlagStatus(USART2, USART_FLAG_RXNE) != RESET)
+		(void)USART_ReceiveData(USART2);                 // 读SR再读DR，同时清掉ORE
+	USART_ITConfig(USART2, USART_IT_RXNE, ENABLE);
+
+	src = power_rxWake ? POWER_WAKE_USART2 : POWER_WAKE_TIMER;
+	power_wakes[src]++;
+	power_wakeSum += us;
+	if(us > power_wakeMax)
+		power_wakeMax = us;
+
+	us = elapsed_us();
+	power_stopUs += us;
+	power_stopMs += power_stopUs / 1000;
+	power_stopUs %= 1000;
+	power_skipUs += us;
+	delay_skip(power_skipUs / 1000);
+	power_skipUs %= 1000;
+	if(clock != SUCCESS)
+		power_hseRetry++;
+	return clock;
+}
+
+void Power_Report(void)
+{
+	unsigned int up = millis();
+	unsigned int wakes = power_wakes[POWER_WAKE_TIMER] + power_wakes[POWER_WAKE_USART2];
+	unsigned int permille = up ? (unsigned int)((unsigned long long)power_stopMs * 1000 / up) : 0;
+
+	printf("power: stop %u.%u%% of %u s, wakes timer %u usart2 %u, clock restore avg %u max %u us, hse retry %u\r\n",
+		   permille / 10, permille % 10, up / 1000, power_wakes[POWER_WAKE_TIMER], power_wakes[POWER_WAKE_USART2],
+		   wakes ? power_wakeSum / wakes : 0, power_wakeMax, power_hseRetry);
+}
+
+void POWER_RX_IRQHandler(void)
+{
+	if(EXTI_GetITStatus(POWER_RX_EXTI_LINE) != RESET)
+	{
+		power_rxWake = 1;
+		EXTI_ClearITPendingBit(POWER_RX_EXTI_LINE);
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef BSP_POWER_H
+#define BSP_POWER_H
+
+
+#include "stm32f10x.h"
+
+
+// STOP模式：HSE/PLL、SysTick和DWT都停止，只有EXTI中断能唤醒
+// 唤醒源：调用者配置的定时中断(例如RC522定时器接的EXTI1)，和USART2 RX线上的起始位(PA3，EXTI3)
+// 唤醒后重新起HSE和PLL要几ms，这期间USART2收到的字节丢弃，调用者要先让对方停发(ESP8266_Hold)；
+// 调用前DMA发送要已经结束
+#define            POWER_WAKE_TIMER              0        // 调用者配置的定时中断
+#define            POWER_WAKE_USART2             1        // ESP8266发来数据
+#define            POWER_WAKE_NUM                2
+
+#define            POWER_RX_PORT_SOURCE          GPIO_PortSourceGPIOA
+#define            POWER_RX_PIN_SOURCE           GPIO_PinSource3
+#define            POWER_RX_EXTI_LINE            EXTI_Line3
+#define            POWER_RX_IRQn                 EXTI3_IRQn
+#define            POWER_RX_IRQHandler           EXTI3_IRQHandler
+
+#define            POWER_HSI_MHZ                 8        // 唤醒后恢复时钟之前的系统时钟
+#define            POWER_HSE_TRIES               10       // 每次等HSE_STARTUP_TIMEOUT，这么多次都起不来就复位
+
+
+void Power_Init(void);
+ErrorStatus Power_Stop(unsigned int (*elapsed_us)(void));
+void Power_Report(void);
+
+
+#endif
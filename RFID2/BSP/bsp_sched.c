@@ -0,0 +1,88 @@
+#include "bsp_sched.h"
+#include "delay.h"
+#include <stdio.h>
+
+static SCHED_TASK *SCHED_Tasks;
+static unsigned char SCHED_TaskNum;
+
+void SCHED_Init(SCHED_TASK *tasks, unsigned char num)
+{
+	unsigned int now = millis();
+	unsigned char i;
+
+	SCHED_Tasks = tasks;
+	SCHED_TaskNum = num;
+	for(i = 0; i < num; i++)
+	{
+		tasks[i].next = now;
+		tasks[i].runs = 0;
+		tasks[i].late = 0;
+		tasks[i].max_delay = 0;
+		tasks[i].running = 0;
+	}
+}
+
+// 按优先级运行一遍到期的任务，返回运行的个数
+static unsigned char SCHED_Pass(void)
+{
+	SCHED_TASK *t;
+	unsigned int now, delay;
+	unsigned char i, ran = 0;
+
+	for(i = 0; i < SCHED_TaskNum; i++)
+	{
+		t = &SCHED_Tasks[i];
+		if(t->running)
+			continue;
+		now = millis();
+		if((int)(now - t->next) < 0)
+			continue;
+
+		delay = now - t->next;
+		if(delay > t->max_delay)
+			t->max_delay = delay;
+		if(delay > t->deadline)
+			t->late++;
+		// 按周期对齐下次到期时间；落后一个周期以上时从现在算起，不补跑
+		t->next += t->period;
+		if((int)(now - t->next) >= 0)
+			t->next = now + t->period;
+
+		t->running = 1;
+		t->func();
+		t->running = 0;
+		t->runs++;
+		ran++;
+	}
+	return ran;
+}
+
+// 主循环和等待外设的地方调用；没有到期任务时休眠到下一个中断(至少有1ms节拍)
+void SCHED_Run(void)
+{
+	if(SCHED_Pass() == 0)
+		__WFI();
+}
+
+// 节拍停过一段时间(STOP模式)、补上之后调用：停着期间到期的任务马上运行，不算迟到
+void SCHED_Resume(void)
+{
+	unsigned int now = millis();
+	unsigned char i;
+
+	for(i = 0; i < SCHED_TaskNum; i++)
+	{
+		if((int)(now - SCHED_Tasks[i].next) > 0)
+			SCHED_Tasks[i].next = now;
+	}
+}
+
+void SCHED_Report(void)
+{
+	unsigned char i;
+
+	printf("task       runs    late  max_delay(ms)\r\n");
+	for(i = 0; i < SCHED_TaskNum; i++)
+		printf("%-10s %-7u %-5u %u\r\n", SCHED_Tasks[i].name, SCHED_Tasks[i].runs,
+			   SCHED_Tasks[i].late, SCHED_Tasks[i].max_delay);
+}
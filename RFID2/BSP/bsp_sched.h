@@ -0,0 +1,33 @@
+#ifndef BSP_SCHED_H
+#define BSP_SCHED_H
+
+
+#include "stm32f10x.h"
+
+
+// 协作式调度：任务按表中顺序排优先级，到期就运行，都没到期时WFI等中断
+// 任务函数不能阻塞；需要等待外设时在任务里调用SCHED_Run让其它任务先跑，
+// 正在运行的任务不会被重入
+
+
+typedef struct
+{
+	const char *name;
+	void (*func)(void);
+	unsigned short period;       // 运行间隔ms，0=每轮都运行
+	unsigned short deadline;     // 到期后最迟多少ms开始运行，超过计一次late
+	unsigned int next;           // 下次到期的节拍
+	unsigned int runs;
+	unsigned int late;
+	unsigned int max_delay;      // 到期到开始运行的最大延迟ms
+	unsigned char running;
+} SCHED_TASK;
+
+
+void SCHED_Init(SCHED_TASK *tasks, unsigned char num);
+void SCHED_Run(void);
+void SCHED_Resume(void);
+void SCHED_Report(void);
+
+
+#endif
@@ -1,20 +0,0 @@
-#ifndef BSP_TIMER_H
-#define BSP_TIMER_H
-
-
-#include "stm32f10x.h"
-
-
-#define            GENERAL_TIM                   TIM4
-#define            GENERAL_TIM_APBxClock_FUN     RCC_APB1PeriphClockCmd
-#define            GENERAL_TIM_CLK               RCC_APB1Periph_TIM4
-#define            GENERAL_TIM_Period            1000
-#define            GENERAL_TIM_Prescaler         71
-#define            GENERAL_TIM_IRQ               TIM4_IRQn
-#define            GENERAL_TIM_IRQHandler        TIM4_IRQHandler
-
-
-void GENERAL_TIM_Init(void);
-
-
-#endif
\ No newline at end of file
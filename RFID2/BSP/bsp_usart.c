@@ -1,9 +1,14 @@
 #include "bsp_usart.h"
+#include "bsp_log.h"
 
 #include <stdarg.h>
 #include <string.h>
 #include <stdio.h>
 
+
+static volatile _Bool usart2_txBusy = 0;		//DMA1通道7正在发送
+static USART_TX_CB usart2_txCb = NULL;
+
 void Usart1_Init(unsigned int baud)
 {
 
@@ -27,16 +32,16 @@ void Usart1_Init(unsigned int baud)
 	GPIO_Init(GPIOA, &gpioInitStruct);
 	
 	usartInitStruct.USART_BaudRate = baud;
-	usartInitStruct.USART_HardwareFlowControl = USART_HardwareFlowControl_None;		//Ӳ
-	usartInitStruct.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;						//պͷ
-	usartInitStruct.USART_Parity = USART_Parity_No;									//У
-	usartInitStruct.USART_StopBits = USART_StopBits_1;								//1λֹͣλ
-	usartInitStruct.USART_WordLength = USART_WordLength_8b;							//8λλ
+	usartInitStruct.USART_HardwareFlowControl = USART_HardwareFlowControl_None;		//无硬件流控
+	usartInitStruct.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;						//接收和发送
+	usartInitStruct.USART_Parity = USART_Parity_No;									//无校验
+	usartInitStruct.USART_StopBits = USART_StopBits_1;								//1位停止位
+	usartInitStruct.USART_WordLength = USART_WordLength_8b;							//8位数据位
 	USART_Init(USART1, &usartInitStruct);
 	
-	USART_Cmd(USART1, ENABLE);														//ʹܴ
+	USART_Cmd(USART1, ENABLE);														//使能串口
 	
-	USART_ITConfig(USART1, USART_IT_RXNE, ENABLE);									//ʹܽж
+	USART_ITConfig(USART1, USART_IT_RXNE, ENABLE);									//使能接收中断
 	
 	nvicInitStruct.NVIC_IRQChannel = USART1_IRQn;
 	nvicInitStruct.NVIC_IRQChannelCmd = ENABLE;
@@ -48,15 +53,16 @@ void Usart1_Init(unsigned int baud)
 
 /*
 ************************************************************
-*	ƣ	Usart2_Init
+*	函数名称：	Usart2_Init
 *
-*	ܣ	2ʼ
+*	函数功能：	串口2初始化
 *
-*	ڲ	baud趨Ĳ
+*	入口参数：	baud：设定的波特率
 *
-*	ز	
+*	返回参数：	无
 *
-*	˵		TX-PA2		RX-PA3
+*	说明：		TX-PA2		RX-PA3
+*				发送用DMA1通道7，见Usart2_SendDma
 ************************************************************
 */
 void Usart2_Init(unsigned int baud)
@@ -65,9 +71,11 @@ void Usart2_Init(unsigned int baud)
 	GPIO_InitTypeDef gpioInitStruct;
 	USART_InitTypeDef usartInitStruct;
 	NVIC_InitTypeDef nvicInitStruct;
+	DMA_InitTypeDef dmaInitStruct;
 	
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA, ENABLE);
 	RCC_APB1PeriphClockCmd(RCC_APB1Periph_USART2, ENABLE);
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
 	
 	//PA2	TXD
 	gpioInitStruct.GPIO_Mode = GPIO_Mode_AF_PP;
@@ -82,58 +90,199 @@ void Usart2_Init(unsigned int baud)
 	GPIO_Init(GPIOA, &gpioInitStruct);
 	
 	usartInitStruct.USART_BaudRate = baud;
-	usartInitStruct.USART_HardwareFlowControl = USART_HardwareFlowControl_None;		//Ӳ
-	usartInitStruct.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;						//պͷ
-	usartInitStruct.USART_Parity = USART_Parity_No;									//У
-	usartInitStruct.USART_StopBits = USART_StopBits_1;								//1λֹͣλ
-	usartInitStruct.USART_WordLength = USART_WordLength_8b;							//8λλ
+	usartInitStruct.USART_HardwareFlowControl = USART_HardwareFlowControl_None;		//无硬件流控
+	usartInitStruct.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;						//接收和发送
+	usartInitStruct.USART_Parity = USART_Parity_No;									//无校验
+	usartInitStruct.USART_StopBits = USART_StopBits_1;								//1位停止位
+	usartInitStruct.USART_WordLength = USART_WordLength_8b;							//8位数据位
 	USART_Init(USART2, &usartInitStruct);
 	
-	USART_Cmd(USART2, ENABLE);														//ʹܴ
+	USART_Cmd(USART2, ENABLE);														//使能串口
 	
-	USART_ITConfig(USART2, USART_IT_RXNE, ENABLE);									//ʹܽж
+	USART_ITConfig(USART2, USART_IT_RXNE, ENABLE);									//使能接收中断
 	
 	nvicInitStruct.NVIC_IRQChannel = USART2_IRQn;
 	nvicInitStruct.NVIC_IRQChannelCmd = ENABLE;
 	nvicInitStruct.NVIC_IRQChannelPreemptionPriority = 0;
 	nvicInitStruct.NVIC_IRQChannelSubPriority = 0;
 	NVIC_Init(&nvicInitStruct);
+	
+	//TX DMA：内存到USART2->DR，每次发送时再填地址和长度
+	DMA_DeInit(DMA1_Channel7);
+	dmaInitStruct.DMA_PeripheralBaseAddr = (uint32_t)&USART2->DR;
+	dmaInitStruct.DMA_MemoryBaseAddr = 0;
+	dmaInitStruct.DMA_DIR = DMA_DIR_PeripheralDST;
+	dmaInitStruct.DMA_BufferSize = 0;
+	dmaInitStruct.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	dmaInitStruct.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	dmaInitStruct.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	dmaInitStruct.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	dmaInitStruct.DMA_Mode = DMA_Mode_Normal;
+	dmaInitStruct.DMA_Priority = DMA_Priority_Medium;
+	dmaInitStruct.DMA_M2M = DMA_M2M_Disable;
+	DMA_Init(DMA1_Channel7, &dmaInitStruct);
+	DMA_ITConfig(DMA1_Channel7, DMA_IT_TC, ENABLE);
+	USART_DMACmd(USART2, USART_DMAReq_Tx, ENABLE);
+	usart2_txBusy = 0;
+	
+	nvicInitStruct.NVIC_IRQChannel = DMA1_Channel7_IRQn;
+	nvicInitStruct.NVIC_IRQChannelCmd = ENABLE;
+	nvicInitStruct.NVIC_IRQChannelPreemptionPriority = 0;
+	nvicInitStruct.NVIC_IRQChannelSubPriority = 1;
+	NVIC_Init(&nvicInitStruct);
 
 }
 
 /*
 ************************************************************
-*	ƣ	Usart_Init()
+*	函数名称：	Usart2_SetBaud
+*
+*	函数功能：	修改串口2波特率
 *
-*	ܣ	1ʹ2ʼ
+*	入口参数：	baud：新的波特率
 *
-*	ڲ	
+*	返回参数：	无
+*
+*	说明：		等正在发送的数据(包括移位寄存器里的最后一个字节)发完再改
+************************************************************
+*/
+void Usart2_SetBaud(unsigned int baud)
+{
+
+	USART_InitTypeDef usartInitStruct;
+	
+	while(usart2_txBusy)
+		__WFI();													//等DMA发送完成中断
+	while(USART_GetFlagStatus(USART2, USART_FLAG_TC) == RESET);
+	
+	usartInitStruct.USART_BaudRate = baud;
+	usartInitStruct.USART_HardwareFlowControl = USART_HardwareFlowControl_None;
+	usartInitStruct.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;
+	usartInitStruct.USART_Parity = USART_Parity_No;
+	usartInitStruct.USART_StopBits = USART_StopBits_1;
+	usartInitStruct.USART_WordLength = USART_WordLength_8b;
+	USART_Init(USART2, &usartInitStruct);
+
+}
+
+/*
+************************************************************
+*	函数名称：	Usart2_SendDma
+*
+*	函数功能：	串口2用DMA发送
+*
+*	入口参数：	data：要发送的数据，发完之前不能修改或释放
+*				len：数据长度
+*				cb：发完后在中断里调用，可为NULL
+*
+*	返回参数：	0-已开始发送	1-上一次还没发完
+*
+*	说明：		不等待，用Usart2_TxBusy查询是否发完
+************************************************************
+*/
+_Bool Usart2_SendDma(const unsigned char *data, unsigned short len, USART_TX_CB cb)
+{
+
+	if(usart2_txBusy)
+		return 1;
+	if(len == 0)
+		return 0;
+	
+	usart2_txBusy = 1;
+	usart2_txCb = cb;
+	DMA_Cmd(DMA1_Channel7, DISABLE);
+	DMA1_Channel7->CMAR = (uint32_t)data;
+	DMA_SetCurrDataCounter(DMA1_Channel7, len);
+	DMA_Cmd(DMA1_Channel7, ENABLE);
+	
+	return 0;
+
+}
+
+/*
+************************************************************
+*	函数名称：	Usart2_TxBusy
+*
+*	函数功能：	查询串口2的DMA发送是否还没完成
+*
+*	入口参数：	无
+*
+*	返回参数：	1-正在发送	0-空闲
+*
+*	说明：		
+************************************************************
+*/
+_Bool Usart2_TxBusy(void)
+{
+
+	return usart2_txBusy;
+
+}
+
+/*
+************************************************************
+*	函数名称：	DMA1_Channel7_IRQHandler
+*
+*	函数功能：	串口2 DMA发送完成中断
+*
+*	入口参数：	无
+*
+*	返回参数：	无
+*
+*	说明：		回调里可以再调用Usart2_SendDma接着发
+************************************************************
+*/
+void DMA1_Channel7_IRQHandler(void)
+{
+
+	USART_TX_CB cb;
+	
+	if(DMA_GetITStatus(DMA1_IT_TC7) != RESET)
+	{
+		DMA_ClearITPendingBit(DMA1_IT_TC7);
+		DMA_Cmd(DMA1_Channel7, DISABLE);
+		cb = usart2_txCb;
+		usart2_txCb = NULL;
+		usart2_txBusy = 0;
+		if(cb != NULL)
+			cb();
+	}
+
+}
+
+/*
+************************************************************
+*	函数名称：	Usart_Init()
+*
+*	函数功能：	串口1和串口2初始化
+*
+*	入口参数：	无
 *				
-*	ز	
+*	返回参数：	无
 *
-*	˵		
+*	说明：		
 ************************************************************
 */
 
 void Usart_Init()
 {
-	Usart1_Init(115200);//debug
-	Usart2_Init(115200);//ESP8266ͨ
+	Usart1_Init(115200);//debug串口
+	Usart2_Init(115200);//ESP8266串口通信
 	return;
 }
 /*
 ************************************************************
-*	ƣ	Usart_SendString
+*	函数名称：	Usart_SendString
 *
-*	ܣ	ݷ
+*	函数功能：	串口数据发送
 *
-*	ڲ	USARTx
-*				strҪ͵
-*				lenݳ
+*	入口参数：	USARTx：串口组
+*				str：要发送的数据
+*				len：数据长度
 *
-*	ز	
+*	返回参数：	无
 *
-*	˵		
+*	说明：		查询方式；串口2有DMA发送在进行时先等它发完
 ************************************************************
 */
 void Usart_SendString(USART_TypeDef *USARTx, unsigned char *str, unsigned short len)
@@ -141,26 +290,31 @@ void Usart_SendString(USART_TypeDef *USARTx, unsigned char *str, unsigned short
 
 	unsigned short count = 0;
 	
+	if(USARTx == USART2)
+		while(usart2_txBusy)
+			__WFI();
+	
 	for(; count < len; count++)
 	{
-		USART_SendData(USARTx, *str++);									//
-		while(USART_GetFlagStatus(USARTx, USART_FLAG_TC) == RESET);		//ȴ
+		while(USART_GetFlagStatus(USARTx, USART_FLAG_TXE) == RESET);	//发送寄存器空就写下一个字节
+		USART_SendData(USARTx, *str++);									//发送数据
 	}
+	while(USART_GetFlagStatus(USARTx, USART_FLAG_TC) == RESET);			//等最后一个字节发完
 
 }
 
 /*
 ************************************************************
-*	ƣ	UsartPrintf
+*	函数名称：	UsartPrintf
 *
-*	ܣ	ʽӡ
+*	函数功能：	格式化打印
 *
-*	ڲ	USARTx
-*				fmt
+*	入口参数：	USARTx：串口组
+*				fmt：不定长参
 *
-*	ز	
+*	返回参数：	无
 *
-*	˵		
+*	说明：		USART_DEBUG的内容交给bsp_log，缓冲满时整条丢弃
 ************************************************************
 */
 void UsartPrintf(USART_TypeDef *USARTx, char *fmt,...)
@@ -171,9 +325,15 @@ void UsartPrintf(USART_TypeDef *USARTx, char *fmt,...)
 	unsigned char *pStr = UsartPrintfBuf;
 	
 	va_start(ap, fmt);
-	vsnprintf((char *)UsartPrintfBuf, sizeof(UsartPrintfBuf), fmt, ap);							//ʽ
+	vsnprintf((char *)UsartPrintfBuf, sizeof(UsartPrintfBuf), fmt, ap);							//格式化
 	va_end(ap);
 	
+	if(USARTx == USART_DEBUG)														//调试串口走日志缓冲，不等发送
+	{
+		Log_Write((const char *)UsartPrintfBuf, strlen((const char *)UsartPrintfBuf));
+		return;
+	}
+	
 	while(*pStr != 0)
 	{
 		USART_SendData(USARTx, *pStr++);
@@ -184,21 +344,21 @@ void UsartPrintf(USART_TypeDef *USARTx, char *fmt,...)
 
 /*
 ************************************************************
-*	ƣ	USART1_IRQHandler
+*	函数名称：	USART1_IRQHandler
 *
-*	ܣ	1շж
+*	函数功能：	串口1收发中断
 *
-*	ڲ	
+*	入口参数：	无
 *
-*	ز	
+*	返回参数：	无
 *
-*	˵		
+*	说明：		
 ************************************************************
 */
 void USART1_IRQHandler(void)
 {
 
-	if(USART_GetITStatus(USART1, USART_IT_RXNE) != RESET) //ж
+	if(USART_GetITStatus(USART1, USART_IT_RXNE) != RESET) //接收中断
 	{
 		USART_ClearFlag(USART1, USART_FLAG_RXNE);
 	}
@@ -7,13 +7,22 @@
 
 
 
-#define USART_DEBUG		USART1		//ԴӡʹõĴ
+#define USART_DEBUG		USART1		//调试打印所使用的串口组
+
+
+typedef void (*USART_TX_CB)(void);	//DMA发送完成回调，在中断里调用
 
 
 void Usart1_Init(unsigned int baud);
 
 void Usart2_Init(unsigned int baud);
 
+void Usart2_SetBaud(unsigned int baud);
+
+_Bool Usart2_SendDma(const unsigned char *data, unsigned short len, USART_TX_CB cb);
+
+_Bool Usart2_TxBusy(void);
+
 void Usart_SendString(USART_TypeDef *USARTx, unsigned char *str, unsigned short len);
 
 void UsartPrintf(USART_TypeDef *USARTx, char *fmt,...);
@@ -3,10 +3,10 @@
 
 void LED_Init(void)
 {
-	//GPIOBʱ
+	//开启GPIOB时钟
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOC, ENABLE);
 	
-	//LEDΪģģʽ
+	//配置LED引脚为模拟输出模式
 	GPIO_InitTypeDef GPIO_InitStructure;
 	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
 	GPIO_InitStructure.GPIO_Pin = LED_GPIO_PIN;
@@ -17,7 +17,7 @@ void LED_Init(void)
 
 void LED_Toggle(void)
 {
-	GPIO_WriteBit(LED_GPIO_PROT, LED_GPIO_PIN, (BitAction)((1-GPIO_ReadOutputDataBit(LED_GPIO_PROT, LED_GPIO_PIN))));//ledƽת
+	GPIO_WriteBit(LED_GPIO_PROT, LED_GPIO_PIN, (BitAction)((1-GPIO_ReadOutputDataBit(LED_GPIO_PROT, LED_GPIO_PIN))));//led电平翻转
 }
 void LED_On()
 {
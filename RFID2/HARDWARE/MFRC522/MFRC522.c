@@ -1,178 +1,402 @@
 #include "MFRC522.h"
+#include "bsp_perf.h"
 
-/*****************絥Ƭ******************
+/*****************辰哥单片机设计******************
 											STM32
- * ļ			:	MFRC522Ƶģcļ                   
- * 汾			: V1.0
- * 			: 2024.9.2
+ * 文件			:	MFRC522射频模块c文件                   
+ * 版本			: V1.0
+ * 日期			: 2024.9.2
  * MCU			:	STM32F103C8T6
- * ӿ			:								
- * BILIBILI	:	絥Ƭ
- * CSDN			:	絥Ƭ
- * 			:	
+ * 接口			:	见代码							
+ * BILIBILI	:	辰哥单片机设计
+ * CSDN			:	辰哥单片机设计
+ * 作者			:	辰哥
 
 **********************BEGIN***********************/
 
 #define 	MAXRLEN 18
+#if MFRC522_CRC == MFRC522_CRC_AUTO
+#define   RC522_ERR_MASK 0x1F    //BufferOvfl CollErr CRCErr ParityErr ProtocolErr
+#else
+#define   RC522_ERR_MASK 0x1B    //不收CRC时CRCErr不会置位
+#endif
 #define   RC522_DELAY()  delay_us(2)
 
+//FIFO突发缓冲：地址字节+最多64字节数据，收发共用(全双工时接收字节总是晚于对应的发送字节)
+static unsigned char RC522_BurstBuf[DEF_FIFO_LENGTH+1];
+
+//当前进行中的卡片通讯
+static volatile unsigned char RC522_IrqFlag;     //IRQ中断置1
+static unsigned char RC522_Command;
+static unsigned char RC522_IrqEn;
+static unsigned char RC522_WaitFor;
+static unsigned int  RC522_Deadline;     //超时的节拍
+static void (*RC522_WaitHook)(void);
+
+//天线开着的时间，统计射频占空比
+static unsigned char RC522_Field;        //天线开着
+static unsigned int  RC522_FieldSince;   //开场时的micros
+static unsigned int  RC522_FieldMs;      //之前各次开场累计的ms
+static unsigned int  RC522_FieldUs;      //不足1ms的部分
+static unsigned short RC522_WakeReload;  //唤醒定时器的重装值
+
+#if MFRC522_CRC == MFRC522_CRC_SOFT
+//CRC_A(ISO14443-3)：多项式x^16+x^12+x^5+1，低位先算(0x8408)，按字节查表
+static const unsigned short RC522_CrcTable[256] =
+{
+    0x0000,0x1189,0x2312,0x329B,0x4624,0x57AD,0x6536,0x74BF,
+    0x8C48,0x9DC1,0xAF5A,0xBED3,0xCA6C,0xDBE5,0xE97E,0xF8F7,
+    0x1081,0x0108,0x3393,0x221A,0x56A5,0x472C,0x75B7,0x643E,
+    0x9CC9,0x8D40,0xBFDB,0xAE52,0xDAED,0xCB64,0xF9FF,0xE876,
+    0x2102,0x308B,0x0210,0x1399,0x6726,0x76AF,0x4434,0x55BD,
+    0xAD4A,0xBCC3,0x8E58,0x9FD1,0xEB6E,0xFAE7,0xC87C,0xD9F5,
+    0x3183,0x200A,0x1291,0x0318,0x77A7,0x662E,0x54B5,0x453C,
+    0xBDCB,0xAC42,0x9ED9,0x8F50,0xFBEF,0xEA66,0xD8FD,0xC974,
+    0x4204,0x538D,0x6116,0x709F,0x0420,0x15A9,0x2732,0x36BB,
+    0xCE4C,0xDFC5,0xED5E,0xFCD7,0x8868,0x99E1,0xAB7A,0xBAF3,
+    0x5285,0x430C,0x7197,0x601E,0x14A1,0x0528,0x37B3,0x263A,
+    0xDECD,0xCF44,0xFDDF,0xEC56,0x98E9,0x8960,0xBBFB,0xAA72,
+    0x6306,0x728F,0x4014,0x519D,0x2522,0x34AB,0x0630,0x17B9,
+    0xEF4E,0xFEC7,0xCC5C,0xDDD5,0xA96A,0xB8E3,0x8A78,0x9BF1,
+    0x7387,0x620E,0x5095,0x411C,0x35A3,0x242A,0x16B1,0x0738,
+    0xFFCF,0xEE46,0xDCDD,0xCD54,0xB9EB,0xA862,0x9AF9,0x8B70,
+    0x8408,0x9581,0xA71A,0xB693,0xC22C,0xD3A5,0xE13E,0xF0B7,
+    0x0840,0x19C9,0x2B52,0x3ADB,0x4E64,0x5FED,0x6D76,0x7CFF,
+    0x9489,0x8500,0xB79B,0xA612,0xD2AD,0xC324,0xF1BF,0xE036,
+    0x18C1,0x0948,0x3BD3,0x2A5A,0x5EE5,0x4F6C,0x7DF7,0x6C7E,
+    0xA50A,0xB483,0x8618,0x9791,0xE32E,0xF2A7,0xC03C,0xD1B5,
+    0x2942,0x38CB,0x0A50,0x1BD9,0x6F66,0x7EEF,0x4C74,0x5DFD,
+    0xB58B,0xA402,0x9699,0x8710,0xF3AF,0xE226,0xD0BD,0xC134,
+    0x39C3,0x284A,0x1AD1,0x0B58,0x7FE7,0x6E6E,0x5CF5,0x4D7C,
+    0xC60C,0xD785,0xE51E,0xF497,0x8028,0x91A1,0xA33A,0xB2B3,
+    0x4A44,0x5BCD,0x6956,0x78DF,0x0C60,0x1DE9,0x2F72,0x3EFB,
+    0xD68D,0xC704,0xF59F,0xE416,0x90A9,0x8120,0xB3BB,0xA232,
+    0x5AC5,0x4B4C,0x79D7,0x685E,0x1CE1,0x0D68,0x3FF3,0x2E7A,
+    0xE70E,0xF687,0xC41C,0xD595,0xA12A,0xB0A3,0x8238,0x93B1,
+    0x6B46,0x7ACF,0x4854,0x59DD,0x2D62,0x3CEB,0x0E70,0x1FF9,
+    0xF78F,0xE606,0xD49D,0xC514,0xB1AB,0xA022,0x92B9,0x8330,
+    0x7BC7,0x6A4E,0x58D5,0x495C,0x3DE3,0x2C6A,0x1EF1,0x0F78
+};
+#endif
+
+//配置寄存器的影子：这些寄存器的可写位只由单片机改，写的时候同时记下，
+//置位/清位直接用记下的值，只写一次不先读；中断、错误、FIFO、命令等状态寄存器不缓存
+//Status2Reg的MFCrypto1On由芯片置位，驱动只清它，写1无效，所以也可以缓存
+#define   RC522_REG(r)          (1ULL << (r))
+#define   RC522_SHADOW_REGS     (RC522_REG(ComIEnReg) | RC522_REG(DivlEnReg) | RC522_REG(Status2Reg) | \
+                                 RC522_REG(BitFramingReg) | RC522_REG(CollReg) | RC522_REG(ModeReg) | \
+                                 RC522_REG(TxModeReg) | RC522_REG(RxModeReg) | RC522_REG(TxControlReg) | \
+                                 RC522_REG(TxAutoReg) | RC522_REG(TxSelReg) | RC522_REG(RxSelReg) | \
+                                 RC522_REG(RxThresholdReg) | RC522_REG(DemodReg) | RC522_REG(MifareReg) | \
+                                 RC522_REG(ModWidthReg) | RC522_REG(RFCfgReg) | RC522_REG(GsNReg) | \
+                                 RC522_REG(CWGsCfgReg) | RC522_REG(ModGsCfgReg) | RC522_REG(TModeReg) | \
+                                 RC522_REG(TPrescalerReg) | RC522_REG(TReloadRegH) | RC522_REG(TReloadRegL))
+static unsigned char RC522_Shadow[0x40];
+static unsigned long long RC522_ShadowValid;     //位r=RC522_Shadow[r]和芯片里一致，复位后清零
+
 
 void MFRC522_Init(void)
 {
 	GPIO_InitTypeDef GPIO_InitStructure;
+	EXTI_InitTypeDef EXTI_InitStructure;
+	NVIC_InitTypeDef NVIC_InitStructure;
+#if MFRC522_USE_HW_SPI
+	SPI_InitTypeDef  SPI_InitStructure;
+	DMA_InitTypeDef  DMA_InitStructure;
+#endif
 	
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA|RCC_APB2Periph_GPIOB, ENABLE);
 	
-	/*  SPI_RC522_SPI ţSDA */
+	/* 配置 SPI_RC522_SPI 引脚：SDA */
 	GPIO_InitStructure.GPIO_Pin = MFRC522_GPIO_SDA_PIN;
 	GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
 	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
 	GPIO_Init(MFRC522_GPIO_SDA_PORT, &GPIO_InitStructure);
+	MFRC522_SDA_H;
 	
-	/*  SPI_RC522_SPI ţSCK */
+#if MFRC522_USE_HW_SPI
+	/* 配置 SPI_RC522_SPI 引脚：SCK、MOSI 交给SPI1(复用推挽) */
+	GPIO_InitStructure.GPIO_Pin = MFRC522_GPIO_SCK_PIN | MFRC522_GPIO_MOSI_PIN;
+	GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
+	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF_PP;
+	GPIO_Init(MFRC522_GPIO_SCK_PORT, &GPIO_InitStructure);
+#else
+	/* 配置 SPI_RC522_SPI 引脚：SCK */
 	GPIO_InitStructure.GPIO_Pin = MFRC522_GPIO_SCK_PIN;
 	GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
 	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
 	GPIO_Init(MFRC522_GPIO_SCK_PORT, &GPIO_InitStructure);
 	
-	/*  SPI_RC522_SPI ţMOSI */
+	/* 配置 SPI_RC522_SPI 引脚：MOSI */
   GPIO_InitStructure.GPIO_Pin = MFRC522_GPIO_MOSI_PIN;
   GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
   GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
   GPIO_Init(MFRC522_GPIO_MOSI_PORT, &GPIO_InitStructure);
+#endif
 	
-	/*  SPI_RC522_SPI ţMISO */
+	/* 配置 SPI_RC522_SPI 引脚：MISO */
   GPIO_InitStructure.GPIO_Pin = MFRC522_GPIO_MISO_PIN;
   GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
   GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN_FLOATING;
   GPIO_Init(MFRC522_GPIO_MISO_PORT, &GPIO_InitStructure);
 	
-	/*  SPI_RC522_SPI ţRST */
+	/* 配置 SPI_RC522_SPI 引脚：RST */
   GPIO_InitStructure.GPIO_Pin = MFRC522_GPIO_RST_PIN;
   GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
   GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_PP;
   GPIO_Init(MFRC522_GPIO_RST_PORT, &GPIO_InitStructure);
 	
+	/* 配置 SPI_RC522_SPI 引脚：IRQ(RC522侧开漏，这里上拉输入) */
+  GPIO_InitStructure.GPIO_Pin = MFRC522_GPIO_IRQ_PIN;
+  GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IPU;
+  GPIO_Init(MFRC522_GPIO_IRQ_PORT, &GPIO_InitStructure);
+	
+	RCC_APB2PeriphClockCmd(RCC_APB2Periph_AFIO, ENABLE);
+	GPIO_EXTILineConfig(MFRC522_IRQ_PORT_SOURCE, MFRC522_IRQ_PIN_SOURCE);
+	EXTI_InitStructure.EXTI_Line = MFRC522_IRQ_EXTI_LINE;
+	EXTI_InitStructure.EXTI_Mode = EXTI_Mode_Interrupt;
+	EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Falling;
+	EXTI_InitStructure.EXTI_LineCmd = ENABLE;
+	EXTI_Init(&EXTI_InitStructure);
+	
+	NVIC_InitStructure.NVIC_IRQChannel = MFRC522_IRQ_IRQn;
+	NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+	NVIC_InitStructure.NVIC_IRQChannelSubPriority = 1;
+	NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+	NVIC_Init(&NVIC_InitStructure);
+	
+#if MFRC522_USE_HW_SPI
+	/* SPI1：主机、模式0、8位、高位先出，片选由软件控制SDA引脚 */
+	RCC_APB2PeriphClockCmd(MFRC522_SPI_CLK, ENABLE);
+	SPI_InitStructure.SPI_Direction = SPI_Direction_2Lines_FullDuplex;
+	SPI_InitStructure.SPI_Mode = SPI_Mode_Master;
+	SPI_InitStructure.SPI_DataSize = SPI_DataSize_8b;
+	SPI_InitStructure.SPI_CPOL = SPI_CPOL_Low;
+	SPI_InitStructure.SPI_CPHA = SPI_CPHA_1Edge;
+	SPI_InitStructure.SPI_NSS = SPI_NSS_Soft;
+	SPI_InitStructure.SPI_BaudRatePrescaler = MFRC522_SPI_BAUD;
+	SPI_InitStructure.SPI_FirstBit = SPI_FirstBit_MSB;
+	SPI_InitStructure.SPI_CRCPolynomial = 7;
+	SPI_Init(MFRC522_SPI, &SPI_InitStructure);
+	
+	/* DMA：收发通道的外设地址固定为SPI1->DR，内存地址都指向RC522_BurstBuf，每次突发只改长度 */
+	RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+	DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&MFRC522_SPI->DR;
+	DMA_InitStructure.DMA_MemoryBaseAddr = (uint32_t)RC522_BurstBuf;
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralSRC;
+	DMA_InitStructure.DMA_BufferSize = 1;
+	DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+	DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+	DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Byte;
+	DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_Byte;
+	DMA_InitStructure.DMA_Mode = DMA_Mode_Normal;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_VeryHigh;
+	DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+	DMA_DeInit(MFRC522_SPI_DMA_RX);
+	DMA_Init(MFRC522_SPI_DMA_RX, &DMA_InitStructure);
+	
+	DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+	DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+	DMA_DeInit(MFRC522_SPI_DMA_TX);
+	DMA_Init(MFRC522_SPI_DMA_TX, &DMA_InitStructure);
+	
+	SPI_I2S_DMACmd(MFRC522_SPI, SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx, ENABLE);
+	SPI_Cmd(MFRC522_SPI, ENABLE);
+#endif
+}
+
+
+#if MFRC522_USE_HW_SPI
+/////////////////////////////////////////////////////////////////////
+//功    能：SPI1收发一个字节(查询方式)
+/////////////////////////////////////////////////////////////////////
+static unsigned char RC522_SPI_ReadWriteByte(unsigned char dat)
+{
+	while(SPI_I2S_GetFlagStatus(MFRC522_SPI, SPI_I2S_FLAG_TXE) == RESET);
+	SPI_I2S_SendData(MFRC522_SPI, dat);
+	while(SPI_I2S_GetFlagStatus(MFRC522_SPI, SPI_I2S_FLAG_RXNE) == RESET);
+	return (unsigned char)SPI_I2S_ReceiveData(MFRC522_SPI);
+}
+
+/////////////////////////////////////////////////////////////////////
+//功    能：用DMA完成一段SPI1全双工突发传输
+//说    明：收发都在RC522_BurstBuf中进行，片选由调用者控制
+/////////////////////////////////////////////////////////////////////
+static void RC522_SPI_DmaBurst(unsigned char len)
+{
+	DMA_SetCurrDataCounter(MFRC522_SPI_DMA_RX, len);
+	DMA_SetCurrDataCounter(MFRC522_SPI_DMA_TX, len);
+	DMA_Cmd(MFRC522_SPI_DMA_RX, ENABLE);          //先开接收，避免丢第一个字节
+	DMA_Cmd(MFRC522_SPI_DMA_TX, ENABLE);
+	while(DMA_GetFlagStatus(MFRC522_SPI_DMA_RX_TC) == RESET);  //接收完成即整段传输完成
+	DMA_Cmd(MFRC522_SPI_DMA_TX, DISABLE);
+	DMA_Cmd(MFRC522_SPI_DMA_RX, DISABLE);
+	DMA_ClearFlag(MFRC522_SPI_DMA_FLAGS);
 }
+#else
+/////////////////////////////////////////////////////////////////////
+//功    能：GPIO模拟SPI收发一个字节(模式0，高位先出)
+/////////////////////////////////////////////////////////////////////
+static unsigned char RC522_SPI_ReadWriteByte(unsigned char dat)
+{
+	unsigned char i, ucResult = 0;
 	
+	for(i=8;i>0;i--)
+	{
+		if(dat&0x80)
+		{
+			MFRC522_MOSI_H;
+		}
+		else
+		{
+			MFRC522_MOSI_L;
+		}
+		RC522_DELAY();
+		MFRC522_SCK_H;
+		RC522_DELAY();
+		ucResult <<= 1;
+		ucResult |= MFRC522_MISO_READ;
+		dat <<= 1;
+		MFRC522_SCK_L;
+		RC522_DELAY();
+	}
+	return ucResult;
+}
+#endif
 
 /////////////////////////////////////////////////////////////////////
-//MFRC522ĳһĴһֽ
-//˵Address[IN]:Ĵַ
-//    أֵ
+//功    能：在一次片选内完成一段SPI收发(查询方式)
+//参数说明：pBuf[IN/OUT]:发送数据，收到的数据原位写回  len:字节数
 /////////////////////////////////////////////////////////////////////
-unsigned char Read_MFRC522(unsigned char Address)
+static void RC522_SPI_Transfer(unsigned char *pBuf, unsigned char len)
 {
-     unsigned char i, ucAddr;
-     unsigned char ucResult=0;
-
-     MFRC522_SCK_L;
-		 RC522_DELAY();
-     MFRC522_SDA_L;
-		 RC522_DELAY();
-     ucAddr = ((Address<<1)&0x7E)|0x80;
-
-     for(i=8;i>0;i--)
-     {
-			 
-         if(ucAddr&0x80)
-				 {
-						MFRC522_MOSI_H;
-				 }
-				 else
-				 {
-						MFRC522_MOSI_L;
-				 }
-				 RC522_DELAY();
-         MFRC522_SCK_H;
-				 RC522_DELAY();
-         ucAddr <<= 1;
-         MFRC522_SCK_L;
-				 RC522_DELAY();
-     }
+	unsigned char i;
+	
+#if MFRC522_USE_HW_SPI
+	MFRC522_SDA_L;
+	for(i=0;i<len;i++)
+	{	pBuf[i] = RC522_SPI_ReadWriteByte(pBuf[i]);	}
+	while(SPI_I2S_GetFlagStatus(MFRC522_SPI, SPI_I2S_FLAG_BSY) != RESET);   //等最后一个字节移出再释放片选
+	MFRC522_SDA_H;
+#else
+	MFRC522_SCK_L;
+	RC522_DELAY();
+	MFRC522_SDA_L;
+	RC522_DELAY();
+	for(i=0;i<len;i++)
+	{	pBuf[i] = RC522_SPI_ReadWriteByte(pBuf[i]);	}
+	MFRC522_SDA_H;
+	RC522_DELAY();
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////
+//功    能：在一次片选内收发RC522_BurstBuf中的len个字节
+//说    明：硬件SPI时长度达到MFRC522_SPI_DMA_THRESHOLD用DMA，
+//          短传输用查询方式，省去DMA启动开销
+/////////////////////////////////////////////////////////////////////
+static void RC522_SPI_Burst(unsigned char len)
+{
+#if MFRC522_USE_HW_SPI
+	if(len >= MFRC522_SPI_DMA_THRESHOLD)
+	{
+		MFRC522_SDA_L;
+		RC522_SPI_DmaBurst(len);
+		while(SPI_I2S_GetFlagStatus(MFRC522_SPI, SPI_I2S_FLAG_BSY) != RESET);
+		MFRC522_SDA_H;
+		return;
+	}
+#endif
+	RC522_SPI_Transfer(RC522_BurstBuf, len);
+}
 
-     for(i=8;i>0;i--)
-     {
-         MFRC522_SCK_H;
-			 RC522_DELAY();
-         ucResult <<= 1;
-         ucResult|= MFRC522_MISO_READ;
-         MFRC522_SCK_L;
-			 RC522_DELAY();
-     }
 
-     MFRC522_SCK_H;
-		 RC522_DELAY();
-     MFRC522_SDA_H;
-		 RC522_DELAY();
-     return ucResult;
+/////////////////////////////////////////////////////////////////////
+//功能描述〈覯FRC522的某一寄存器读一个字节数据
+//参数说明：Address[IN]:寄存器地址
+//返    回：读出的值
+/////////////////////////////////////////////////////////////////////
+unsigned char Read_MFRC522(unsigned char Address)
+{
+	unsigned char ucBuf[2];
+	
+	ucBuf[0] = ((Address<<1)&0x7E)|0x80;
+	ucBuf[1] = macDummy_Data;
+	RC522_SPI_Transfer(ucBuf, 2);
+	return ucBuf[1];
 }
 
 
 
 /////////////////////////////////////////////////////////////////////
-//MFRC522ĳһĴдһֽ
-//˵Address[IN]:Ĵַ
-//          value[IN]:дֵ
+//功能描述∠騇FRC522的某一寄存器写一个字节数据
+//参数说明：Address[IN]:寄存器地址
+//          value[IN]:写入的值
 /////////////////////////////////////////////////////////////////////
 void Write_MFRC522(unsigned char Address, unsigned char value)
-{  
-    unsigned char i, ucAddr;
+{
+	unsigned char ucBuf[2];
+	
+	if (RC522_SHADOW_REGS & RC522_REG(Address & 0x3F))
+	{
+		RC522_Shadow[Address & 0x3F] = value;
+		RC522_ShadowValid |= RC522_REG(Address & 0x3F);
+	}
+	ucBuf[0] = (Address<<1)&0x7E;
+	ucBuf[1] = value;
+	RC522_SPI_Transfer(ucBuf, 2);
+}
 
-     MFRC522_SCK_L;
-     MFRC522_SDA_L;
-    ucAddr = ((Address<<1)&0x7E);
 
-    for(i=8;i>0;i--)
-    {
-			   if(ucAddr&0x80)
-				 {
-						MFRC522_MOSI_H;
-				 }
-				 else
-				 {
-						MFRC522_MOSI_L;
-				 }
-				 RC522_DELAY();
-         MFRC522_SCK_H;
-				 RC522_DELAY();
-         ucAddr <<= 1;
-         MFRC522_SCK_L;
-				 RC522_DELAY();
-    }
+/////////////////////////////////////////////////////////////////////
+//功    能：向FIFO连续写入多个字节
+//参数说明：pData[IN]:要写入的数据  len[IN]:字节数(最多64)
+//说    明：一次片选内只发一个地址字节，后面的数据都写入FIFODataReg
+/////////////////////////////////////////////////////////////////////
+void MFRC522_WriteFIFO(unsigned char *pData, unsigned char len)
+{
+	unsigned char i;
+	
+	if(len > DEF_FIFO_LENGTH)
+	{	len = DEF_FIFO_LENGTH;	}
+	RC522_BurstBuf[0] = (FIFODataReg<<1)&0x7E;
+	for(i=0;i<len;i++)
+	{	RC522_BurstBuf[i+1] = pData[i];	}
+	RC522_SPI_Burst(len+1);
+}
 
-    for(i=8;i>0;i--)
-    {
-			   if(value&0x80)
-				 {
-						MFRC522_MOSI_H;
-				 }
-				 else
-				 {
-						MFRC522_MOSI_L;
-				 }
-				 RC522_DELAY();
-         MFRC522_SCK_H;
-				 RC522_DELAY();
-         value <<= 1;
-         MFRC522_SCK_L;
-				 RC522_DELAY();
-    }
 
-		 MFRC522_SCK_H;
-		RC522_DELAY();
-     MFRC522_SDA_H;
-		RC522_DELAY();
+/////////////////////////////////////////////////////////////////////
+//功    能：从FIFO连续读出多个字节
+//参数说明：pData[OUT]:读出的数据  len[IN]:字节数(最多64)
+//说    明：一次片选内重复发送读地址，每个地址字节换回上一个数据，
+//          最后补一个0x00结束
+/////////////////////////////////////////////////////////////////////
+void MFRC522_ReadFIFO(unsigned char *pData, unsigned char len)
+{
+	unsigned char i;
+	
+	if(len > DEF_FIFO_LENGTH)
+	{	len = DEF_FIFO_LENGTH;	}
+	for(i=0;i<len;i++)
+	{	RC522_BurstBuf[i] = ((FIFODataReg<<1)&0x7E)|0x80;	}
+	RC522_BurstBuf[len] = macDummy_Data;
+	RC522_SPI_Burst(len+1);
+	for(i=0;i<len;i++)
+	{	pData[i] = RC522_BurstBuf[i+1];	}
 }
 
 
 /////////////////////////////////////////////////////////////////////
-//    ܣλRC522
-//    : ɹMI_OK
+//功    能：复位RC522
+//返    回: 成功返回MI_OK
 /////////////////////////////////////////////////////////////////////
+static void RC522_FieldAccount(unsigned char on);
+
 char MFRC522_Reset(void) 
 {
 	//unsigned char i;
+    RC522_FieldAccount(0);                  //复位后天线关闭
     MFRC522_RST_H;
 		delay_us (1);             
     MFRC522_RST_L;
@@ -183,11 +407,12 @@ char MFRC522_Reset(void)
     //MFRC522_RST_H;
     Write_MFRC522(CommandReg,0x0F); //soft reset
     while(Read_MFRC522(CommandReg) & 0x10); //wait chip start ok
+    RC522_ShadowValid = 0;                  //寄存器都回到复位值
 
 		delay_us (1);            
 
     
-    Write_MFRC522(ModeReg,0x3D);            //MifareͨѶCRCʼֵ0x6363
+    Write_MFRC522(ModeReg,0x3D);            //和Mifare卡通讯，CRC初始值0x6363
     Write_MFRC522(TReloadRegL,30);           
     Write_MFRC522(TReloadRegH,0);
     Write_MFRC522(TModeReg,0x8D);
@@ -197,103 +422,133 @@ char MFRC522_Reset(void)
 }
 
 /////////////////////////////////////////////////////////////////////
-//    ܣRC522Ĵλ
-//˵reg[IN]:Ĵַ
-//          mask[IN]:λֵ
+//功    能：读寄存器，配置寄存器有影子时不访问SPI
+//参数说明：reg[IN]:寄存器地址
+//返    回：寄存器的值
+/////////////////////////////////////////////////////////////////////
+static unsigned char RC522_ReadShadow(unsigned char reg)
+{
+    unsigned char v;
+    
+    if (RC522_ShadowValid & RC522_REG(reg))
+    {   return RC522_Shadow[reg];   }
+    v = Read_MFRC522(reg);
+    if (RC522_SHADOW_REGS & RC522_REG(reg))
+    {
+        RC522_Shadow[reg] = v;
+        RC522_ShadowValid |= RC522_REG(reg);
+    }
+    return v;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：置RC522寄存器位
+//参数说明：reg[IN]:寄存器地址
+//          mask[IN]:置位值
+//说    明：有影子的配置寄存器只写一次，其它寄存器先读再写
 /////////////////////////////////////////////////////////////////////
 void SetBitMask(unsigned char reg,unsigned char mask)  
 {
-    char tmp = 0x0;
-    tmp = Read_MFRC522(reg);
-    Write_MFRC522(reg,tmp | mask);  // set bit mask
+    Write_MFRC522(reg, RC522_ReadShadow(reg) | mask);  // set bit mask
 }
 
 
 
 /////////////////////////////////////////////////////////////////////
-//    ܣRC522Ĵλ
-//˵reg[IN]:Ĵַ
-//          mask[IN]:λֵ
+//功    能：清RC522寄存器位
+//参数说明：reg[IN]:寄存器地址
+//          mask[IN]:清位值
+//说    明：同SetBitMask
 /////////////////////////////////////////////////////////////////////
 void ClearBitMask(unsigned char reg,unsigned char mask)  
 {
-    char tmp = 0x0;
-    tmp = Read_MFRC522(reg);
-    Write_MFRC522(reg, tmp & ~mask);  // clear bit mask
+    Write_MFRC522(reg, RC522_ReadShadow(reg) & ~mask);  // clear bit mask
 } 
 
 
 /////////////////////////////////////////////////////////////////////
-//    ܣͨRC522ISO14443ͨѶ
-//˵Command[IN]:RC522
-//          pInData[IN]:ͨRC522͵Ƭ
-//          InLenByte[IN]:ݵֽڳ
-//          pOutData[OUT]:յĿƬ
-//          *pOutLenBit[OUT]:ݵλ
+//功    能：启动一次RC522和ISO14443卡的通讯，不等待结果
+//参数说明：Command[IN]:RC522命令字
+//          pInData[IN]:通过RC522发送到卡片的数据
+//          InLenByte[IN]:发送数据的字节长度
+//说    明：完成(或RC522定时器超时)时IRQ引脚拉低，EXTI1置位完成标志，
+//          之后用MFRC522_ToCardPoll取结果
 /////////////////////////////////////////////////////////////////////
-char MFRC522_ToCard(unsigned char Command, 
+void MFRC522_ToCardStart(unsigned char Command, 
                  unsigned char *pInData, 
-                 unsigned char InLenByte,
-                 unsigned char *pOutData, 
-                 unsigned int  *pOutLenBit)
+                 unsigned char InLenByte)
 {
-    char status = MI_ERR;
-    unsigned char irqEn   = 0x00;
-    unsigned char waitFor = 0x00;
-    unsigned char lastBits;
-    unsigned char n;
-    unsigned int i;
+    RC522_Command = Command;
     switch (Command)
     {
        case PCD_AUTHENT:
-          irqEn   = 0x12;
-          waitFor = 0x10;
+          RC522_IrqEn   = 0x12;
+          RC522_WaitFor = 0x10;
           break;
        case PCD_TRANSCEIVE:
-          irqEn   = 0x77;
-          waitFor = 0x30;
+          RC522_IrqEn   = 0x77;
+          RC522_WaitFor = 0x30;
           break;
        default:
+          RC522_IrqEn   = 0x00;
+          RC522_WaitFor = 0x00;
          break;
     }
    
-    Write_MFRC522(ComIEnReg,irqEn|0x80);	//PCD_TRANSCEIVEģʽ ı
-    ClearBitMask(ComIrqReg,0x80);			//IRQ©
-    Write_MFRC522(CommandReg,PCD_IDLE);  //ȡǰ
-    SetBitMask(FIFOLevelReg,0x80);		//FIFO Flash ErrReg  BufferOvfl־
-    
-    for (i=0; i<InLenByte; i++)
-    {   
-				Write_MFRC522(FIFODataReg, pInData[i]);    //ݴ浽FIFO
-		}
-    Write_MFRC522(CommandReg, Command);   //FIFO
-   
+    //IRQ引脚只反映结束条件和定时器超时，IRqInv=1使引脚低有效
+    Write_MFRC522(ComIEnReg,0x80|RC522_WaitFor|0x01);
+    Write_MFRC522(ComIrqReg,0x7F);			//清除全部中断请求位，IRQ引脚释放
+    RC522_IrqFlag = 0;
+    Write_MFRC522(CommandReg,PCD_IDLE);  //取消当前命令
+    Write_MFRC522(FIFOLevelReg,0x80);		//FlushBuffer，同时清ErrorReg的BufferOvfl；其余位只读，不用先读
     
+    MFRC522_WriteFIFO(pInData, InLenByte);    //把数据存到FIFO
+    RC522_Deadline = deadline_ms(MFRC522_TIMEOUT_MS);
+    Write_MFRC522(CommandReg, Command);   //发送FIFO内容
+   
     if (Command == PCD_TRANSCEIVE)
     {    
-				SetBitMask(BitFramingReg,0x80);  //ֹͣʱ
+				SetBitMask(BitFramingReg,0x80);  //开始发送
 		}
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：查询MFRC522_ToCardStart启动的通讯是否完成
+//参数说明：pOutData[OUT]:接收到的卡片返回数据
+//          *pOutLenBit[OUT]:返回数据的位长度
+//返    回: MI_BUSY表示还在进行；其它为通讯结果
+//说    明：IRQ没来之前不访问SPI，只比较定时器节拍；
+//          超过MFRC522_TIMEOUT_MS仍无结果按MI_ERR结束；
+//          收发时只有位冲突返回MI_COLLERR，收到的数据照样读出
+/////////////////////////////////////////////////////////////////////
+char MFRC522_ToCardPoll(unsigned char *pOutData, 
+                 unsigned int  *pOutLenBit)
+{
+    char status = MI_ERR;
+    unsigned char lastBits;
+    unsigned char n,err;
     
-		n = Read_MFRC522(ComIrqReg);
-    i = 1500;//ʱƵʵM1ȴʱ25ms
-    do 
+    if (!RC522_IrqFlag && !deadline_passed(RC522_Deadline))
+    {   return MI_BUSY;   }
+    
+    RC522_IrqFlag = 0;		//先清标志再读寄存器，读后到来的中断不会丢
+    n = Read_MFRC522(ComIrqReg);
+    if (!(n&0x01) && !(n&RC522_WaitFor))
     {
-         n = Read_MFRC522(ComIrqReg);
-			
-         i--;
-			
+        if (!deadline_passed(RC522_Deadline))
+        {   return MI_BUSY;   }		//上一次命令残留的中断，继续等
     }
-    while ((i!=0) && !(n&0x01) && !(n&waitFor));
-    ClearBitMask(BitFramingReg,0x80);
-	      
-    if (i!=0)
+    else
     {    
-         if(!(Read_MFRC522(ErrorReg)&0x1B))
+         err = Read_MFRC522(ErrorReg) & RC522_ERR_MASK;
+         if (!err || ((err == 0x08) && (RC522_Command == PCD_TRANSCEIVE)))
          {
-             status = MI_OK;
-             if (n & irqEn & 0x01)
+             status = err ? MI_COLLERR : MI_OK;
+             if (n & RC522_IrqEn & 0x01)
              {   status = MI_NOTAGERR;   }
-             if (Command == PCD_TRANSCEIVE)
+             if (RC522_Command == PCD_TRANSCEIVE)
              {
                	n = Read_MFRC522(FIFOLevelReg);
               	lastBits = Read_MFRC522(ControlReg) & 0x07;
@@ -305,8 +560,7 @@ char MFRC522_ToCard(unsigned char Command,
                 {   n = 1;    }
                 if (n > MAXRLEN)
                 {   n = MAXRLEN;   }
-                for (i=0; i<n; i++)
-                {   pOutData[i] = Read_MFRC522(FIFODataReg);    }
+                MFRC522_ReadFIFO(pOutData, n);
             }
          }
          else
@@ -316,60 +570,288 @@ char MFRC522_ToCard(unsigned char Command,
         
    }
    
-
-   SetBitMask(ControlReg,0x80);           // stop timer now
+   ClearBitMask(BitFramingReg,0x80);
+   Write_MFRC522(ControlReg,0x80);        // stop timer now，其余可写位也是触发位
    Write_MFRC522(CommandReg,PCD_IDLE); 
    return status;
 }
 
 
+/////////////////////////////////////////////////////////////////////
+//功    能：通过RC522和ISO14443卡通讯(阻塞)
+//参数说明：Command[IN]:RC522命令字
+//          pInData[IN]:通过RC522发送到卡片的数据
+//          InLenByte[IN]:发送数据的字节长度
+//          pOutData[OUT]:接收到的卡片返回数据
+//          *pOutLenBit[OUT]:返回数据的位长度
+//说    明：等待期间调用MFRC522_SetWaitHook注册的函数，未注册则WFI休眠
+/////////////////////////////////////////////////////////////////////
+char MFRC522_ToCard(unsigned char Command, 
+                 unsigned char *pInData, 
+                 unsigned char InLenByte,
+                 unsigned char *pOutData, 
+                 unsigned int  *pOutLenBit)
+{
+    char status;
+    
+    MFRC522_ToCardStart(Command, pInData, InLenByte);
+    while ((status = MFRC522_ToCardPoll(pOutData, pOutLenBit)) == MI_BUSY)
+    {
+        if (RC522_WaitHook)
+        {   RC522_WaitHook();   }
+        else
+        {   __WFI();   }		//IRQ或1ms节拍中断唤醒
+    }
+    return status;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：注册等待卡片应答期间调用的函数(例如处理ESP8266数据)
+//说    明：hook里不能再访问RC522
+/////////////////////////////////////////////////////////////////////
+void MFRC522_SetWaitHook(void (*hook)(void))
+{
+	RC522_WaitHook = hook;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：RC522 IRQ引脚下降沿中断
+/////////////////////////////////////////////////////////////////////
+void MFRC522_IRQHandler(void)
+{
+	if(EXTI_GetITStatus(MFRC522_IRQ_EXTI_LINE) != RESET)
+	{
+		RC522_IrqFlag = 1;
+		EXTI_ClearITPendingBit(MFRC522_IRQ_EXTI_LINE);
+	}
+}
+
+
 
-//  
-//ÿر߷֮Ӧ1msļ
+//记录天线开关，关场时把这次开着的时间累计起来
+static void RC522_FieldAccount(unsigned char on)
+{
+    unsigned int us;
+
+    if (on && !RC522_Field)
+    {
+        RC522_FieldSince = micros();
+    }
+    else if (!on && RC522_Field)
+    {
+        us = RC522_FieldUs + (micros() - RC522_FieldSince);
+        RC522_FieldMs += us / 1000;
+        RC522_FieldUs = us % 1000;
+    }
+    RC522_Field = on;
+}
+
+
+//开启天线  
+//每次启动或关闭天线发射之间应至少有1ms的间隔
 void MFRC522_AntennaOn(void)
 {
     unsigned char i;
-    i = Read_MFRC522(TxControlReg);
+    i = RC522_ReadShadow(TxControlReg);
     if (!(i & 0x03))
     {
         SetBitMask(TxControlReg, 0x03);
     }
+    RC522_FieldAccount(1);
 }
 
 
-//ر
+//关闭天线
 void MFRC522_AntennaOff(void)
 {
     ClearBitMask(TxControlReg, 0x03);
+    RC522_FieldAccount(0);
+}
+
+
+//天线是否开着
+_Bool MFRC522_FieldOn(void)
+{
+    return RC522_Field;
+}
+
+
+//上电以来天线累计开着的ms数，含正在开着的这一段
+unsigned int MFRC522_FieldTime(void)
+{
+    if (RC522_Field)
+    {   return RC522_FieldMs + (RC522_FieldUs + (micros() - RC522_FieldSince)) / 1000;   }
+    return RC522_FieldMs;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：低功耗寻卡：开场，等卡片上电后发一次REQA/WUPA
+//参数说明: req_code[IN]、pTagType[OUT]：同MFRC522_Request
+//返    回: 同MFRC522_Request；不是MI_OK时已经关场
+//说    明：等卡片上电期间调用MFRC522_SetWaitHook注册的函数；
+//          没有卡时开场时间主要是上电等待(等ATQA只要约2ms)
+/////////////////////////////////////////////////////////////////////
+char MFRC522_LpcdProbe(unsigned char req_code,unsigned char *pTagType)
+{
+    char status;
+    unsigned int t;
+
+    MFRC522_AntennaOn();
+    t = deadline_us(MFRC522_LPCD_SETTLE_US);
+    while (!deadline_us_passed(t))
+    {
+        if (RC522_WaitHook)
+        {   RC522_WaitHook();   }
+        else
+        {   __WFI();   }
+    }
+
+    status = MFRC522_Request(req_code, pTagType);
+    if (status != MI_OK)
+    {   MFRC522_AntennaOff();   }
+    return status;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：用RC522定时器计时，到时IRQ引脚拉低(EXTI1)，可以唤醒STOP模式
+//参数说明: ms[IN]:间隔，1~32767
+//说    明：定时器自动重装一直计下去，MFRC522_WakeTimerStop读出经过的时间；
+//          期间不能和卡片通讯(定时器被占用)，天线可以关着
+/////////////////////////////////////////////////////////////////////
+void MFRC522_WakeTimerStart(unsigned short ms)
+{
+    RC522_WakeReload = ms * (1000 / MFRC522_TIMER_TICK_US) - 1;
+    Write_MFRC522(TModeReg,0x1D);           //TAuto=0，TAutoRestart=1，预分频不变
+    Write_MFRC522(TReloadRegH,RC522_WakeReload >> 8);
+    Write_MFRC522(TReloadRegL,RC522_WakeReload & 0xFF);
+    Write_MFRC522(ComIEnReg,0x80|0x01);     //IRQ引脚只反映TimerIRq，低有效
+    Write_MFRC522(ComIrqReg,0x7F);
+    RC522_IrqFlag = 0;
+    Write_MFRC522(ControlReg,0x40);         //TStartNow
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：停止唤醒定时器，恢复寻卡用的定时器配置
+//返    回: MFRC522_WakeTimerStart以来经过的us
+//说    明：TimerIRq置位说明已经到过一次0并重装，再加一个周期；
+//          间隔远大于唤醒后恢复时钟的时间，不会到两次
+/////////////////////////////////////////////////////////////////////
+unsigned int MFRC522_WakeTimerStop(void)
+{
+    unsigned char hi, lo;
+    unsigned int ticks;
+
+    do                                      //计数器高低字节分两次读，中间低字节回绕时重读
+    {
+        hi = Read_MFRC522(TCounterValueRegH);
+        lo = Read_MFRC522(TCounterValueRegL);
+    }
+    while (hi != Read_MFRC522(TCounterValueRegH));
+    ticks = RC522_WakeReload - (((unsigned short)hi << 8) | lo);
+    if (Read_MFRC522(ComIrqReg) & 0x01)
+    {   ticks += RC522_WakeReload + 1;   }
+
+    Write_MFRC522(ControlReg,0x80);         //TStopNow
+    Write_MFRC522(TModeReg,0x8D);           //以下同MFRC522_Reset
+    Write_MFRC522(TReloadRegH,0);
+    Write_MFRC522(TReloadRegL,30);
+    Write_MFRC522(ComIrqReg,0x7F);
+    RC522_IrqFlag = 0;
+    return ticks * MFRC522_TIMER_TICK_US + MFRC522_TIMER_TICK_US / 2;   //计数只到整节拍，补半个节拍
 }
 
 
-//MF522CRC
-//pIndata--ҪCRCݪlen--ݳȪpOutData--CRC
+/////////////////////////////////////////////////////////////////////
+//功    能：计算CRC_A
+//参数说明：pIndata[IN]:数据  len[IN]:字节数  pOutData[OUT]:CRC，低字节在前
+//说    明：查表方式只在单片机上算，不访问RC522；其它方式用RC522协处理器
+/////////////////////////////////////////////////////////////////////
 void CalulateCRC(unsigned char *pIndata,unsigned char len,unsigned char *pOutData)
 {
-    unsigned char i,n;
-    ClearBitMask(DivIrqReg,0x04);
+#if MFRC522_CRC == MFRC522_CRC_SOFT
+    unsigned short crc = 0x6363;            //同ModeReg的CRCPreset
+    while (len--)
+    {   crc = (crc >> 8) ^ RC522_CrcTable[(crc ^ *pIndata++) & 0xFF];   }
+    pOutData[0] = (unsigned char)crc;
+    pOutData[1] = (unsigned char)(crc >> 8);
+#else
+    unsigned char n;
+    unsigned int t;
+    Write_MFRC522(DivIrqReg,0x04);          //Set2=0：写1的位清零，即只清CRCIRq
     Write_MFRC522(CommandReg,PCD_IDLE);
-    SetBitMask(FIFOLevelReg,0x80);
-    for (i=0; i<len; i++)
-    {   Write_MFRC522(FIFODataReg, *(pIndata+i));   }
+    Write_MFRC522(FIFOLevelReg,0x80);
+    MFRC522_WriteFIFO(pIndata, len);
     Write_MFRC522(CommandReg, PCD_CALCCRC);
-    i = 0xFF;
+    t = deadline_us(MFRC522_CRC_TIMEOUT_US);		//按实际时间等，不按循环次数
     do 
     {
         n = Read_MFRC522(DivIrqReg);
-        i--;
     }
-    while ((i!=0) && !(n&0x04));
+    while (!deadline_us_passed(t) && !(n&0x04));
     pOutData[0] = Read_MFRC522(CRCResultRegL);
     pOutData[1] = Read_MFRC522(CRCResultRegM);
+#endif
+}
+
+
+#if MFRC522_CRC == MFRC522_CRC_AUTO
+//设置RC522收发时是否自动处理CRC，和影子里的设置相同时不访问SPI
+static void RC522_CrcEnable(unsigned char tx,unsigned char rx)
+{
+    if (((RC522_ReadShadow(TxModeReg) & 0x80) != 0) != (tx != 0))
+    {   Write_MFRC522(TxModeReg, RC522_Shadow[TxModeReg] ^ 0x80);   }
+    if (((RC522_ReadShadow(RxModeReg) & 0x80) != 0) != (rx != 0))
+    {   Write_MFRC522(RxModeReg, RC522_Shadow[RxModeReg] ^ 0x80);   }
 }
+#endif
 
 
 /////////////////////////////////////////////////////////////////////
-//    ܣƬ״̬
-//    : ɹMI_OK
+//功    能：和卡片交换一帧带CRC_A的数据
+//参数说明：pBuf[IN/OUT]:发送的数据(不含CRC，后面留2字节)，收到的数据写回
+//          len[IN]:发送的字节数，不含CRC
+//          rxCrc[IN]:应答带CRC(READ的数据、SELECT的SAK)；ACK/NAK只有4位，不带
+//          *pOutLenBit[OUT]:应答的位长度，不含CRC
+//返    回: 同MFRC522_ToCard；应答CRC错返回MI_ERR
+/////////////////////////////////////////////////////////////////////
+static char RC522_TransceiveCrc(unsigned char *pBuf,unsigned char len,unsigned char rxCrc,unsigned int *pOutLenBit)
+{
+    char status;
+#if MFRC522_CRC == MFRC522_CRC_AUTO
+    RC522_CrcEnable(1, rxCrc);
+    status = MFRC522_ToCard(PCD_TRANSCEIVE,pBuf,len,pBuf,pOutLenBit);
+#else
+#if MFRC522_CRC == MFRC522_CRC_SOFT
+    unsigned char n,crc[2];
+#endif
+    CalulateCRC(pBuf,len,&pBuf[len]);
+    status = MFRC522_ToCard(PCD_TRANSCEIVE,pBuf,len+2,pBuf,pOutLenBit);
+    if ((status == MI_OK) && rxCrc)
+    {
+        if ((*pOutLenBit < 24) || (*pOutLenBit & 0x07))
+        {   return MI_ERR;   }
+#if MFRC522_CRC == MFRC522_CRC_SOFT
+        n = *pOutLenBit / 8 - 2;
+        CalulateCRC(pBuf,n,crc);
+        if ((crc[0] != pBuf[n]) || (crc[1] != pBuf[n+1]))
+        {   return MI_ERR;   }
+#endif
+        *pOutLenBit -= 16;
+    }
+#endif
+    return status;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：命令卡片进入休眠状态
+//返    回: 成功返回MI_OK
+//说    明：卡片休眠不应答，超时就是成功，等待缩短到约2ms
 /////////////////////////////////////////////////////////////////////
 char MFRC522_Halt(void)
 {
@@ -379,9 +861,10 @@ char MFRC522_Halt(void)
 		char status;
     ucComMF522Buf[0] = PICC_HALT;
     ucComMF522Buf[1] = 0;
-    CalulateCRC(ucComMF522Buf,2,&ucComMF522Buf[2]);
  
-    status = MFRC522_ToCard(PCD_TRANSCEIVE,ucComMF522Buf,4,ucComMF522Buf,&unLen);
+    Write_MFRC522(TReloadRegL,MFRC522_SHORT_RELOAD);
+    status = RC522_TransceiveCrc(ucComMF522Buf,2,0,&unLen);
+    Write_MFRC522(TReloadRegL,30);          //恢复MFRC522_Reset里的超时
 
     return MI_OK;
 }
@@ -390,17 +873,21 @@ char MFRC522_Halt(void)
 
 
 /////////////////////////////////////////////////////////////////////
-//    ܣѰ
-//˵: req_code[IN]:Ѱʽ
-//                0x52 = ѰӦз14443A׼Ŀ
-//                0x26 = Ѱδ״̬Ŀ
-//          pTagType[OUT]Ƭʹ
+//功    能：寻卡
+//参数说明: req_code[IN]:寻卡方式
+//                0x52 = 寻感应区内所有符合14443A标准的卡
+//                0x26 = 寻未进入休眠状态的卡
+//          pTagType[OUT]：卡片类型代码
 //                0x4400 = Mifare_UltraLight
 //                0x0400 = Mifare_One(S50)
 //                0x0200 = Mifare_One(S70)
 //                0x0800 = Mifare_Pro(X)
 //                0x4403 = Mifare_DESFire
-//    : ɹMI_OK
+//返    回: 成功返回MI_OK；定时器超时没有应答(天线区内没有卡)返回MI_NOTAGERR；
+//          应答出错或RC522没有响应返回MI_ERR
+//说    明：不动天线配置，复位后调用一次MFRC522_AntennaOn即可反复寻卡；
+//          ATQA在约90us内应答，等待缩短到约2ms；
+//          不同类型的卡同时应答时ATQA会冲突，仍算寻到卡，类型代码是各卡的或
 /////////////////////////////////////////////////////////////////////
 char MFRC522_Request(unsigned char req_code,unsigned char *pTagType)
 {
@@ -410,18 +897,23 @@ char MFRC522_Request(unsigned char req_code,unsigned char *pTagType)
 
    ClearBitMask(Status2Reg,0x08);
    Write_MFRC522(BitFramingReg,0x07);
-   SetBitMask(TxControlReg,0x03);
+#if MFRC522_CRC == MFRC522_CRC_AUTO
+   RC522_CrcEnable(0, 0);                 //REQA/WUPA、防冲突帧不带CRC
+#endif
  
    ucComMF522Buf[0] = req_code;
 
+   Write_MFRC522(TReloadRegL,MFRC522_SHORT_RELOAD);
    status = MFRC522_ToCard(PCD_TRANSCEIVE,ucComMF522Buf,1,ucComMF522Buf,&unLen);
+   Write_MFRC522(TReloadRegL,30);
    
-   if ((status == MI_OK) && (unLen == 0x10))
+   if (((status == MI_OK) || (status == MI_COLLERR)) && (unLen == 0x10))
    {    
+       status = MI_OK;
        *pTagType     = ucComMF522Buf[0];
        *(pTagType+1) = ucComMF522Buf[1];
    }
-   else
+   else if (status != MI_NOTAGERR)
    {   status = MI_ERR;  
 
 	 }
@@ -431,47 +923,104 @@ char MFRC522_Request(unsigned char req_code,unsigned char *pTagType)
 
 
 
-//    ܣͻ⪡ȡѡпƬĿк
-//˵: pSnr[OUT]:Ƭкţ4ֽ
-//    : ɹMI_OK 
-char MFRC522_Anticoll(unsigned char *pSnr)
+/////////////////////////////////////////////////////////////////////
+//功    能：一级防冲突，按位解决冲突
+//参数说明: sel[IN]:这一级的SEL码，0x93/0x95/0x97
+//          pCln[OUT]:这一级的4字节UID和BCC，共5字节
+//          pColl[OUT]:遇到冲突时置1，没有冲突不改
+//返    回: 成功返回MI_OK
+//说    明：冲突位取1，已知的位数写进NVB重发，只有前缀相同的卡继续应答；
+//          已知位不是整字节时最后一个字节只发TxLastBits位，应答按RxAlign
+//          接在这个字节的后面。CollPos从FIFO第一个字节的第0位数起(含RxAlign)，
+//          CollReg的ValuesAfterColl清0，冲突位之后收到的都是0
+/////////////////////////////////////////////////////////////////////
+static char RC522_AnticollLevel(unsigned char sel,unsigned char *pCln,unsigned char *pColl)
 {
     char status;
-    unsigned char i,snr_check=0;
+    unsigned char known = 0;                //已经确定的位数
+    unsigned char nBytes,nBits,mask,pos,i;
     unsigned int  unLen;
     unsigned char ucComMF522Buf[MAXRLEN]; 
     
-
     ClearBitMask(Status2Reg,0x08);
-    Write_MFRC522(BitFramingReg,0x00);
     ClearBitMask(CollReg,0x80);
+#if MFRC522_CRC == MFRC522_CRC_AUTO
+    RC522_CrcEnable(0, 0);
+#endif
+    for (i=0; i<5; i++)
+    {   pCln[i] = 0;   }
  
-    ucComMF522Buf[0] = PICC_ANTICOLL1;
-    ucComMF522Buf[1] = 0x20;
+    while (1)
+    {
+        nBytes = known / 8;
+        nBits  = known % 8;
+        ucComMF522Buf[0] = sel;
+        ucComMF522Buf[1] = 0x20 + (nBytes << 4) + nBits;      //NVB：高4位字节数，低4位余下的位数
+        for (i=0; i<nBytes+(nBits?1:0); i++)
+        {   ucComMF522Buf[i+2] = pCln[i];   }
+        Write_MFRC522(BitFramingReg,(nBits << 4) | nBits);   //RxAlign，TxLastBits
+
+        status = MFRC522_ToCard(PCD_TRANSCEIVE,ucComMF522Buf,i+2,ucComMF522Buf,&unLen);
+        if (((status != MI_OK) && (status != MI_COLLERR)) || (unLen <= nBits))
+        {   status = MI_ERR;   break;   }
+
+        mask = (unsigned char)(0xFF << nBits);               //第一个字节里收到的位
+        pCln[nBytes] = (pCln[nBytes] & ~mask) | (ucComMF522Buf[0] & mask);
+        for (i=1; (i<(unLen+7)/8) && (nBytes+i<5); i++)
+        {   pCln[nBytes+i] = ucComMF522Buf[i];   }
+
+        if (status == MI_OK)
+        {
+            if ((nBytes*8 + unLen != 40) ||
+                ((pCln[0] ^ pCln[1] ^ pCln[2] ^ pCln[3]) != pCln[4]))
+            {   status = MI_ERR;   }
+            break;
+        }
+
+        pos = Read_MFRC522(CollReg);
+        if (pos & 0x20)
+        {   status = MI_ERR;   break;   }                   //CollPosNotValid
+        pos &= 0x1F;
+        if (pos == 0)
+        {   pos = 32;   }
+        pos += nBytes * 8;                                  //在CLn里是第pos位(从1数)
+        if ((pos <= known) || (pos >= 40))
+        {   status = MI_ERR;   break;   }
+        pCln[(pos-1)/8] |= 1 << ((pos-1)%8);
+        known = pos;
+        *pColl = 1;
+    }
+    
+    Write_MFRC522(BitFramingReg,0x00);
+    SetBitMask(CollReg,0x80);
+    return status;
+}
 
-    status = MFRC522_ToCard(PCD_TRANSCEIVE,ucComMF522Buf,2,ucComMF522Buf,&unLen);
 
+//功    能：防冲突检测《寥⊙≈锌ㄆ的卡序列号
+//参数说明: pSnr[OUT]:卡片序列号，4字节
+//返    回: 成功返回MI_OK 
+//说    明：只做第一级，遇到冲突时取其中一张卡
+char MFRC522_Anticoll(unsigned char *pSnr)
+{
+    char status;
+    unsigned char i,coll;
+    unsigned char cln[5];
+    
+    status = RC522_AnticollLevel(PICC_ANTICOLL1,cln,&coll);
     if (status == MI_OK)
     {
     	 for (i=0; i<4; i++)
-         {   
-             *(pSnr+i)  = ucComMF522Buf[i];
-             snr_check ^= ucComMF522Buf[i];
-
-         }
-         if (snr_check != ucComMF522Buf[i])
-         {   status = MI_ERR;    }
+         {   *(pSnr+i) = cln[i];   }
     }
-    
-    SetBitMask(CollReg,0x80);
     return status;
 }
 
 
 /////////////////////////////////////////////////////////////////////
-//    ܣѡƬ
-//˵: pSnr[IN]:Ƭкţ4ֽ
-//    : ɹMI_OK
+//功    能：选定卡片
+//参数说明: pSnr[IN]:卡片序列号，4字节
+//返    回: 成功返回MI_OK
 /////////////////////////////////////////////////////////////////////
 char MFRC522_SelectTag(unsigned char *pSnr)
 {
@@ -488,13 +1037,11 @@ char MFRC522_SelectTag(unsigned char *pSnr)
     	ucComMF522Buf[i+2] = *(pSnr+i);
     	ucComMF522Buf[6]  ^= *(pSnr+i);
     }
-    CalulateCRC(ucComMF522Buf,7,&ucComMF522Buf[7]);
-  
     ClearBitMask(Status2Reg,0x08);
 
-    status = MFRC522_ToCard(PCD_TRANSCEIVE,ucComMF522Buf,9,ucComMF522Buf,&unLen);
+    status = RC522_TransceiveCrc(ucComMF522Buf,7,1,&unLen);
     
-    if ((status == MI_OK) && (unLen == 0x18))
+    if ((status == MI_OK) && (unLen == 0x08))
     {   status = MI_OK;  }
     else
     {   status = MI_ERR;    }
@@ -505,14 +1052,72 @@ char MFRC522_SelectTag(unsigned char *pSnr)
 
 
 /////////////////////////////////////////////////////////////////////
-//    ܣ֤Ƭ
-//˵: auth_mode[IN]: ֤ģʽ
-//                 0x60 = ֤AԿ
-//                 0x61 = ֤BԿ 
-//          addr[IN]ַ
-//          pKey[IN]
-//          pSnr[IN]Ƭкţ4ֽ
-//    : ɹMI_OK
+//功    能：防冲突并选定一张卡，4/7/10字节UID逐级完成
+//参数说明: pUid[OUT]:卡片UID、长度、SAK，以及防冲突时是否遇到冲突
+//返    回: 成功返回MI_OK，卡片进入ACTIVE状态
+//说    明：每一级先防冲突得到CLn再SELECT；SAK的0x04位表示UID还没完，
+//          这时CLn第一个字节是级联标志0x88，后3字节是UID。
+//          没选中的卡回到IDLE，选中的卡HALT后再用REQA寻卡可以找下一张；
+//          pUid->multi为0说明天线区里只有这一张卡(处于HALT的卡不算)；
+//          防冲突和SELECT每一级各记一次耗时
+/////////////////////////////////////////////////////////////////////
+char MFRC522_Select(MFRC522_Uid *pUid)
+{
+    char status = MI_ERR;
+    unsigned char level,i;
+    unsigned int  unLen;
+    unsigned char cln[5];
+    unsigned char ucComMF522Buf[MAXRLEN]; 
+    
+    pUid->size  = 0;
+    pUid->multi = 0;
+    for (level=0; level<3; level++)
+    {
+        PERF_Begin(PERF_ANTICOLL);
+        status = RC522_AnticollLevel(PICC_ANTICOLL1 + level*2,cln,&pUid->multi);
+        if (status != MI_OK)
+        {   break;   }
+        PERF_End(PERF_ANTICOLL);
+
+        ucComMF522Buf[0] = PICC_ANTICOLL1 + level*2;
+        ucComMF522Buf[1] = 0x70;
+        for (i=0; i<5; i++)
+        {   ucComMF522Buf[i+2] = cln[i];   }
+        PERF_Begin(PERF_SELECT);
+        status = RC522_TransceiveCrc(ucComMF522Buf,7,1,&unLen);
+        if ((status != MI_OK) || (unLen != 0x08))
+        {   status = MI_ERR;   break;   }
+        PERF_End(PERF_SELECT);
+        pUid->sak = ucComMF522Buf[0];
+
+        if (!(pUid->sak & 0x04))
+        {
+            for (i=0; i<4; i++)
+            {   pUid->uid[pUid->size++] = cln[i];   }
+            return MI_OK;
+        }
+        if (cln[0] != PICC_CT)
+        {   status = MI_ERR;   break;   }
+        for (i=1; i<4; i++)
+        {   pUid->uid[pUid->size++] = cln[i];   }
+    }
+    
+    if (status == MI_OK)
+    {   status = MI_ERR;   }                //第三级SAK还说没完
+    return status;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：验证卡片密码
+//参数说明: auth_mode[IN]: 密码验证模式
+//                 0x60 = 验证A密钥
+//                 0x61 = 验证B密钥 
+//          addr[IN]：块地址
+//          pKey[IN]：密码
+//          pSnr[IN]：卡片序列号，4字节
+//返    回: 成功返回MI_OK
 /////////////////////////////////////////////////////////////////////               
 char MFRC522_AuthState(unsigned char auth_mode,unsigned char addr,unsigned char *pKey,unsigned char *pSnr)
 {
@@ -538,10 +1143,10 @@ char MFRC522_AuthState(unsigned char auth_mode,unsigned char addr,unsigned char
 
 
 /////////////////////////////////////////////////////////////////////
-//    ܣȡM1һ
-//˵: addr[IN]ַ
-//          pData[OUT]ݣ16ֽ
-//    : ɹMI_OK
+//功    能：读取M1卡一块数据
+//参数说明: addr[IN]：块地址
+//          pData[OUT]：读出的数据，16字节
+//返    回: 成功返回MI_OK
 ///////////////////////////////////////////////////////////////////// 
 char MFRC522_Read(unsigned char addr,unsigned char *pData)
 {
@@ -551,10 +1156,9 @@ char MFRC522_Read(unsigned char addr,unsigned char *pData)
 
     ucComMF522Buf[0] = PICC_READ;
     ucComMF522Buf[1] = addr;
-    CalulateCRC(ucComMF522Buf,2,&ucComMF522Buf[2]);
    
-    status = MFRC522_ToCard(PCD_TRANSCEIVE,ucComMF522Buf,4,ucComMF522Buf,&unLen);
-    if ((status == MI_OK) && (unLen == 0x90))
+    status = RC522_TransceiveCrc(ucComMF522Buf,2,1,&unLen);
+    if ((status == MI_OK) && (unLen == 0x80))
  //   {   memcpy(pData, ucComMF522Buf, 16);   }
     {
         for (i=0; i<16; i++)
@@ -568,10 +1172,10 @@ char MFRC522_Read(unsigned char addr,unsigned char *pData)
 
 
 /////////////////////////////////////////////////////////////////////
-//    ܣдݵM1һ
-//˵: addr[IN]ַ
-//          pData[IN]дݣ16ֽ
-//    : ɹMI_OK
+//功    能：写数据到M1卡一块
+//参数说明: addr[IN]：块地址
+//          pData[IN]：写入的数据，16字节
+//返    回: 成功返回MI_OK
 /////////////////////////////////////////////////////////////////////                  
 char MFRC522_Write(unsigned char addr,unsigned char *pData)
 {
@@ -581,9 +1185,7 @@ char MFRC522_Write(unsigned char addr,unsigned char *pData)
     
     ucComMF522Buf[0] = PICC_WRITE;
     ucComMF522Buf[1] = addr;
-    CalulateCRC(ucComMF522Buf,2,&ucComMF522Buf[2]);
- 
-    status = MFRC522_ToCard(PCD_TRANSCEIVE,ucComMF522Buf,4,ucComMF522Buf,&unLen);
+    status = RC522_TransceiveCrc(ucComMF522Buf,2,0,&unLen);
 
     if ((status != MI_OK) || (unLen != 4) || ((ucComMF522Buf[0] & 0x0F) != 0x0A))
     {   status = MI_ERR;   }
@@ -593,9 +1195,7 @@ char MFRC522_Write(unsigned char addr,unsigned char *pData)
         //memcpy(ucComMF522Buf, pData, 16);
         for (i=0; i<16; i++)
         {    ucComMF522Buf[i] = *(pData+i);   }
-        CalulateCRC(ucComMF522Buf,16,&ucComMF522Buf[16]);
-
-        status = MFRC522_ToCard(PCD_TRANSCEIVE,ucComMF522Buf,18,ucComMF522Buf,&unLen);
+        status = RC522_TransceiveCrc(ucComMF522Buf,16,0,&unLen);
         if ((status != MI_OK) || (unLen != 4) || ((ucComMF522Buf[0] & 0x0F) != 0x0A))
         {   status = MI_ERR;   }
     }
@@ -604,3 +1204,179 @@ char MFRC522_Write(unsigned char addr,unsigned char *pData)
 }
 
 
+
+/////////////////////////////////////////////////////////////////////
+//功    能：按值块格式生成一块数据
+//参数说明: value[IN]：值(有符号32位，低字节在前)
+//          addr[IN]：值块地址字节(通常取块地址，备份管理用)
+//          pBlock[OUT]：16字节值块
+//说    明：格式为 值 ~值 值 地址 ~地址 地址 ~地址
+/////////////////////////////////////////////////////////////////////
+void MFRC522_FormatValueBlock(int32_t value,unsigned char addr,unsigned char *pBlock)
+{
+    unsigned char i;
+    
+    for (i=0; i<4; i++)
+    {
+        pBlock[i]    = (unsigned char)(value >> (i*8));
+        pBlock[i+4]  = ~pBlock[i];
+        pBlock[i+8]  = pBlock[i];
+    }
+    pBlock[12] = addr;
+    pBlock[13] = ~addr;
+    pBlock[14] = addr;
+    pBlock[15] = ~addr;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：检查一块数据是否为值块并取出值
+//参数说明: pBlock[IN]：16字节块数据
+//          pValue[OUT]：值
+//返    回: 是合法值块返回MI_OK
+/////////////////////////////////////////////////////////////////////
+char MFRC522_ParseValueBlock(unsigned char *pBlock,int32_t *pValue)
+{
+    unsigned char i;
+    
+    for (i=0; i<4; i++)
+    {
+        if ((pBlock[i] != pBlock[i+8]) || ((unsigned char)~pBlock[i] != pBlock[i+4]))
+        {   return MI_ERR;   }
+    }
+    if ((pBlock[12] != pBlock[14]) || (pBlock[13] != pBlock[15]) || ((unsigned char)~pBlock[12] != pBlock[13]))
+    {   return MI_ERR;   }
+    
+    *pValue = (int32_t)((uint32_t)pBlock[0] | ((uint32_t)pBlock[1] << 8) |
+                        ((uint32_t)pBlock[2] << 16) | ((uint32_t)pBlock[3] << 24));
+    return MI_OK;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：读值块
+//参数说明: addr[IN]：块地址
+//          pValue[OUT]：值
+//返    回: 读成功且为合法值块返回MI_OK
+/////////////////////////////////////////////////////////////////////
+char MFRC522_ReadValue(unsigned char addr,int32_t *pValue)
+{
+    char status;
+    unsigned char ucBlock[16];
+    
+    status = MFRC522_Read(addr, ucBlock);
+    if (status == MI_OK)
+    {   status = MFRC522_ParseValueBlock(ucBlock, pValue);   }
+    
+    return status;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：把一块写成值块
+//参数说明: addr[IN]：块地址
+//          value[IN]：初始值
+//返    回: 成功返回MI_OK
+/////////////////////////////////////////////////////////////////////
+char MFRC522_WriteValue(unsigned char addr,int32_t value)
+{
+    unsigned char ucBlock[16];
+    
+    MFRC522_FormatValueBlock(value, addr, ucBlock);
+    return MFRC522_Write(addr, ucBlock);
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：值块运算，结果只放在卡片内部传送缓冲区
+//参数说明: dd_mode[IN]：PICC_INCREMENT / PICC_DECREMENT / PICC_RESTORE
+//          addr[IN]：值块地址
+//          pValue[IN]：4字节操作数(低字节在前)，RESTORE时内容无关
+//返    回: 成功返回MI_OK
+//说    明：需要再调用MFRC522_Transfer写回，掉电或拿走卡片前不影响原值
+/////////////////////////////////////////////////////////////////////
+char MFRC522_Value(unsigned char dd_mode,unsigned char addr,unsigned char *pValue)
+{
+    char status;
+    unsigned int  unLen;
+    unsigned char i,ucComMF522Buf[MAXRLEN]; 
+    
+    ucComMF522Buf[0] = dd_mode;
+    ucComMF522Buf[1] = addr;
+    status = RC522_TransceiveCrc(ucComMF522Buf,2,0,&unLen);
+
+    if ((status != MI_OK) || (unLen != 4) || ((ucComMF522Buf[0] & 0x0F) != 0x0A))
+    {   status = MI_ERR;   }
+        
+    if (status == MI_OK)
+    {
+        for (i=0; i<4; i++)
+        {    ucComMF522Buf[i] = *(pValue+i);   }
+        //操作成功时卡片不应答(定时器超时)；有应答时只认4位的ACK(0xA)，NAK和其它长度都算失败
+        unLen = 0;
+        status = RC522_TransceiveCrc(ucComMF522Buf,4,0,&unLen);
+        if (status == MI_NOTAGERR)
+        {   status = MI_OK;   }
+        else if ((status == MI_OK) && ((unLen != 4) || ((ucComMF522Buf[0] & 0x0F) != 0x0A)))
+        {   status = MI_ERR;   }
+    }
+    
+    return status;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：把卡片传送缓冲区写入值块
+//参数说明: addr[IN]：目标块地址
+//返    回: 成功返回MI_OK
+/////////////////////////////////////////////////////////////////////
+char MFRC522_Transfer(unsigned char addr)
+{
+    char status;
+    unsigned int  unLen;
+    unsigned char ucComMF522Buf[MAXRLEN]; 
+    
+    ucComMF522Buf[0] = PICC_TRANSFER;
+    ucComMF522Buf[1] = addr;
+    status = RC522_TransceiveCrc(ucComMF522Buf,2,0,&unLen);
+
+    if ((status != MI_OK) || (unLen != 4) || ((ucComMF522Buf[0] & 0x0F) != 0x0A))
+    {   status = MI_ERR;   }
+    
+    return status;
+}
+
+
+/////////////////////////////////////////////////////////////////////
+//功    能：值块加/减一个数并写回
+//参数说明: addr[IN]：值块地址
+//          delta[IN]：正数增值，负数减值
+//返    回: 成功返回MI_OK
+//说    明：卡片内部完成读-改-写，Transfer应答即确认写入
+/////////////////////////////////////////////////////////////////////
+char MFRC522_ValueAdd(unsigned char addr,int32_t delta)
+{
+    char status;
+    unsigned char dd_mode = PICC_INCREMENT;
+    unsigned char ucValue[4];
+    uint32_t operand;
+    unsigned char i;
+    
+    if (delta < 0)
+    {
+        dd_mode = PICC_DECREMENT;
+        operand = (uint32_t)0 - (uint32_t)delta;
+    }
+    else
+    {   operand = (uint32_t)delta;   }
+    for (i=0; i<4; i++)
+    {   ucValue[i] = (unsigned char)(operand >> (i*8));   }
+    
+    status = MFRC522_Value(dd_mode, addr, ucValue);
+    if (status == MI_OK)
+    {   status = MFRC522_Transfer(addr);   }
+    
+    return status;
+}
+
+
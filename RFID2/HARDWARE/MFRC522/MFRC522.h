@@ -4,24 +4,24 @@
 #include "delay.h"
 #include "math.h"
 
-/*****************絥Ƭ******************
+/*****************辰哥单片机设计******************
 											STM32
- * ļ			:	MFRC522Ƶģhļ                   
- * 汾			: V1.0
- * 			: 2024.9.2
+ * 文件			:	MFRC522射频模块h文件                   
+ * 版本			: V1.0
+ * 日期			: 2024.9.2
  * MCU			:	STM32F103C8T6
- * ӿ			:								
- * BILIBILI	:	絥Ƭ
- * CSDN			:	絥Ƭ
- * 			:	
+ * 接口			:	见代码							
+ * BILIBILI	:	辰哥单片机设计
+ * CSDN			:	辰哥单片机设计
+ * 作者			:	辰哥
 
 **********************BEGIN***********************/
 
-/***************Լ****************/
-// MFRC522Ƶģ GPIO궨
+/***************根据自己需求更改****************/
+// MFRC522射频模块 GPIO宏定义
 
  
-/*********************************** RC522 Ŷ *********************************************/
+/*********************************** RC522 引脚定义 *********************************************/
 #define               MFRC522_GPIO_SDA_PORT    	               		GPIOA			   
 #define               MFRC522_GPIO_SDA_PIN		                   	GPIO_Pin_4
 											
@@ -36,9 +36,66 @@
 											
 #define               MFRC522_GPIO_RST_PORT    	              		GPIOB		   
 #define               MFRC522_GPIO_RST_PIN		                  	GPIO_Pin_0
+											
+#define               MFRC522_GPIO_IRQ_PORT    	              		GPIOB		   
+#define               MFRC522_GPIO_IRQ_PIN		                  	GPIO_Pin_1
 
 /*********************END**********************/
 
+/*********************************** RC522 传输方式 *********************************************/
+// 1：PA5/PA6/PA7 交给硬件SPI1，SDA(PA4)仍作软件片选，FIFO多字节突发走DMA
+// 0：GPIO模拟SPI(原方式)
+#ifndef MFRC522_USE_HW_SPI
+#define               MFRC522_USE_HW_SPI                          1
+#endif
+
+#define               MFRC522_SPI                                 SPI1
+#define               MFRC522_SPI_CLK                             RCC_APB2Periph_SPI1
+#define               MFRC522_SPI_BAUD                            SPI_BaudRatePrescaler_8    // 72MHz/8=9MHz，RC522最高10MHz
+#define               MFRC522_SPI_DMA_RX                          DMA1_Channel2              // SPI1_RX
+#define               MFRC522_SPI_DMA_TX                          DMA1_Channel3              // SPI1_TX
+#define               MFRC522_SPI_DMA_RX_TC                       DMA1_FLAG_TC2
+#define               MFRC522_SPI_DMA_FLAGS                       (DMA1_FLAG_GL2 | DMA1_FLAG_GL3)
+#define               MFRC522_SPI_DMA_THRESHOLD                   4                          // 达到该长度才启用DMA
+
+/*********************************** RC522 IRQ *********************************************/
+// IRQ引脚开漏、低有效(ComIEnReg.IRqInv=1)，下降沿触发EXTI1
+#define               MFRC522_IRQ_PORT_SOURCE                     GPIO_PortSourceGPIOB
+#define               MFRC522_IRQ_PIN_SOURCE                      GPIO_PinSource1
+#define               MFRC522_IRQ_EXTI_LINE                       EXTI_Line1
+#define               MFRC522_IRQ_IRQn                            EXTI1_IRQn
+#define               MFRC522_IRQHandler                          EXTI1_IRQHandler
+#define               MFRC522_TIMEOUT_MS                          25                         // 操作M1卡最大等待时间
+#define               MFRC522_CRC_TIMEOUT_US                      1000                       // 协处理器计算CRC最大等待时间
+
+/*********************************** RC522 CRC_A *********************************************/
+// 发给卡片的帧(SELECT、READ、WRITE、HALT、值块命令)和READ/SELECT的应答带CRC_A
+// 0：RC522协处理器计算(原方式：数据写进FIFO、CalcCRC、读结果寄存器)，应答不校验
+// 1：单片机查表计算，应答同时校验
+// 2：RC522收发时自动追加和校验(TxModeReg.TxCRCEn、RxModeReg.RxCRCEn)
+#define               MFRC522_CRC_COPROC                          0
+#define               MFRC522_CRC_SOFT                            1
+#define               MFRC522_CRC_AUTO                            2
+#ifndef MFRC522_CRC
+#define               MFRC522_CRC                                 MFRC522_CRC_SOFT
+#endif
+
+/*********************************** RC522 低功耗寻卡 *********************************************/
+// 1：天线平时关着，每隔MFRC522_LPCD_INTERVAL_MS开一下场发WUPA，没有卡马上关场；
+//    两次之间可以用RC522定时器计时(天线关着也能跑)，IRQ引脚唤醒STOP模式的单片机
+// 0：天线一直开着，每次寻卡直接发WUPA(原方式)
+#ifndef MFRC522_LPCD
+#define               MFRC522_LPCD                                0
+#endif
+#ifndef MFRC522_LPCD_INTERVAL_MS
+#define               MFRC522_LPCD_INTERVAL_MS                    250        // 开场间隔，卡片最长要等这么久才被发现
+#endif
+#ifndef MFRC522_LPCD_SETTLE_US
+#define               MFRC522_LPCD_SETTLE_US                      5000       // 开场到发WUPA，卡片上电时间(ISO14443-3最长5ms)
+#endif
+#define               MFRC522_SHORT_RELOAD                        3          // REQA/WUPA、HLTA等应答很快(或本来就不应答)的帧，等待的定时器重装值，约2ms
+#define               MFRC522_TIMER_TICK_US                       500        // TPrescaler=0xD3E时定时器一个计数的时间
+
 #define          MFRC522_SDA_L          		GPIO_ResetBits ( MFRC522_GPIO_SDA_PORT, MFRC522_GPIO_SDA_PIN )
 #define          MFRC522_SDA_H          		GPIO_SetBits ( MFRC522_GPIO_SDA_PORT, MFRC522_GPIO_SDA_PIN )
 
@@ -62,42 +119,44 @@ void MFRC522_Init(void);
 
 
 /////////////////////////////////////////////////////////////////////
-//MF522
+//MF522命令字
 /////////////////////////////////////////////////////////////////////
-#define PCD_IDLE              0x00               //ȡǰ
-#define PCD_AUTHENT           0x0E               //֤Կ
-#define PCD_RECEIVE           0x08               //
-#define PCD_TRANSMIT          0x04               //
-#define PCD_TRANSCEIVE        0x0C               //Ͳ
-#define PCD_RESETPHASE        0x0F               //λ
+#define PCD_IDLE              0x00               //取消当前命令
+#define PCD_AUTHENT           0x0E               //验证密钥
+#define PCD_RECEIVE           0x08               //接收数据
+#define PCD_TRANSMIT          0x04               //发送数据
+#define PCD_TRANSCEIVE        0x0C               //发送并接收数据
+#define PCD_RESETPHASE        0x0F               //复位
 
-#define PCD_CALCCRC           0x03               //CRC
+#define PCD_CALCCRC           0x03               //CRC计算
 
 /////////////////////////////////////////////////////////////////////
-//Mifare_OneƬ
+//Mifare_One卡片命令字
 /////////////////////////////////////////////////////////////////////
-#define PICC_REQIDL           0x26               //Ѱδ״̬
-#define PICC_REQALL           0x52               //Ѱȫ
-#define PICC_ANTICOLL1        0x93               //ײ
-#define PICC_ANTICOLL2        0x95               //ײ
-#define PICC_AUTHENT1A        0x60               //֤AԿ
-#define PICC_AUTHENT1B        0x61               //֤BԿ
-#define PICC_READ             0x30               //
-#define PICC_WRITE            0xA0               //д
-#define PICC_DECREMENT        0xC0               //ۿ
-#define PICC_INCREMENT        0xC1               //ֵ
-#define PICC_RESTORE          0xC2               //ݵ
-#define PICC_TRANSFER         0xB0               //滺
-#define PICC_HALT             0x50               //
+#define PICC_REQIDL           0x26               //寻天线区内未进入休眠状态
+#define PICC_REQALL           0x52               //寻天线区内全部卡
+#define PICC_ANTICOLL1        0x93               //防冲撞
+#define PICC_ANTICOLL2        0x95               //防冲撞
+#define PICC_ANTICOLL3        0x97               //防冲撞
+#define PICC_CT               0x88               //级联标志，CLn第一个字节，表示UID还没完
+#define PICC_AUTHENT1A        0x60               //验证A密钥
+#define PICC_AUTHENT1B        0x61               //验证B密钥
+#define PICC_READ             0x30               //读块
+#define PICC_WRITE            0xA0               //写块
+#define PICC_DECREMENT        0xC0               //扣款
+#define PICC_INCREMENT        0xC1               //充值
+#define PICC_RESTORE          0xC2               //调块数据到缓冲区
+#define PICC_TRANSFER         0xB0               //保存缓冲区中数据
+#define PICC_HALT             0x50               //休眠
 
 /////////////////////////////////////////////////////////////////////
-//MF522 FIFOȶ
+//MF522 FIFO长度定义
 /////////////////////////////////////////////////////////////////////
 #define DEF_FIFO_LENGTH       64                 //FIFO size=64byte
 #define MAXRLEN  18
 
 /////////////////////////////////////////////////////////////////////
-//MF522Ĵ
+//MF522寄存器定义
 /////////////////////////////////////////////////////////////////////
 // PAGE 0
 #define     RFU00                 0x00    
@@ -169,32 +228,68 @@ void MFRC522_Init(void);
 #define     RFU3F		  		        0x3F
 
 /////////////////////////////////////////////////////////////////////
-//MF522ͨѶʱصĴ
+//和MF522通讯时返回的错误代码
 /////////////////////////////////////////////////////////////////////
 #define 	MI_OK                 0x26
 #define 	MI_NOTAGERR           0xcc
 #define 	MI_ERR                0xbb
+#define 	MI_BUSY               0xdd      //命令尚未完成，继续调用MFRC522_ToCardPoll
+#define 	MI_COLLERR            0xaa      //多张卡同时应答，位冲突；冲突位之前的数据有效
 
 
 /////////////////////////////////////////////////////////////////////
-//MF522ͨѶʱصĴ
+//和MF522通讯时返回的错误代码
 /////////////////////////////////////////////////////////////////////
 
 
 #define          macDummy_Data              0x00
 
+/////////////////////////////////////////////////////////////////////
+//卡片UID，防冲突和选卡的结果
+/////////////////////////////////////////////////////////////////////
+#define          MFRC522_UID_MAX            10      //三重UID
+
+typedef struct
+{
+    unsigned char size;                     //UID字节数：4、7或10
+    unsigned char uid[MFRC522_UID_MAX];
+    unsigned char sak;                      //最后一级SELECT的应答，0x08表示Mifare_One
+    unsigned char multi;                    //防冲突时遇到过冲突，天线区里还有别的卡
+} MFRC522_Uid;
+
+//认证用的4字节UID：4字节UID就是它本身，7字节UID取后4字节(第二级的UID)
+#define          MFRC522_UID_AUTH(p)        (&(p)->uid[(p)->size - 4])
+
 char MFRC522_Reset(void);
+void MFRC522_SetWaitHook(void (*hook)(void));
+void MFRC522_ToCardStart(unsigned char Command,unsigned char *pInData,unsigned char InLenByte);
+char MFRC522_ToCardPoll(unsigned char *pOutData,unsigned int *pOutLenBit);
 void Write_MFRC522(unsigned char Address, unsigned char value);
 unsigned char Read_MFRC522(unsigned char Address);  
+void MFRC522_WriteFIFO(unsigned char *pData, unsigned char len);
+void MFRC522_ReadFIFO(unsigned char *pData, unsigned char len);
 void MFRC522_AntennaOn(void);
 void MFRC522_AntennaOff(void);
+_Bool MFRC522_FieldOn(void);
+unsigned int MFRC522_FieldTime(void);
+char MFRC522_LpcdProbe(unsigned char req_code,unsigned char *pTagType);
+void MFRC522_WakeTimerStart(unsigned short ms);
+unsigned int MFRC522_WakeTimerStop(void);
 char MFRC522_Request(unsigned char req_code,unsigned char *pTagType);
 char MFRC522_Anticoll(unsigned char *pSnr);
 char MFRC522_SelectTag(unsigned char *pSnr);
+char MFRC522_Select(MFRC522_Uid *pUid);
 char MFRC522_AuthState(unsigned char auth_mode,unsigned char addr,unsigned char *pKey,unsigned char *pSnr);
 char MFRC522_Read(unsigned char addr,unsigned char *pData);
 char MFRC522_Halt(void);
 char MFRC522_Write(unsigned char addr,unsigned char *pData);
+void MFRC522_FormatValueBlock(int32_t value,unsigned char addr,unsigned char *pBlock);
+char MFRC522_ParseValueBlock(unsigned char *pBlock,int32_t *pValue);
+char MFRC522_ReadValue(unsigned char addr,int32_t *pValue);
+char MFRC522_WriteValue(unsigned char addr,int32_t value);
+char MFRC522_Value(unsigned char dd_mode,unsigned char addr,unsigned char *pValue);
+char MFRC522_Transfer(unsigned char addr);
+char MFRC522_ValueAdd(unsigned char addr,int32_t delta);
 #endif /* __MFRC522__H */
 
 
@@ -3,57 +3,62 @@
 #include "oledfont.h"
 #include "delay.h"
 
-/*****************絥Ƭ******************
+/*****************辰哥单片机设计******************
 											STM32
- * ļ			:	OLEDʾcļ                     
- * 汾			: V1.0
- * 			: 2024.8.7
+ * 文件			:	OLED显示屏c文件                     
+ * 版本			: V1.0
+ * 日期			: 2024.8.7
  * MCU			:	STM32F103C8T6
- * ӿ			:								
- * BILIBILI	:	絥Ƭ
- * CSDN			:	絥Ƭ
- * 			:	 
+ * 接口			:	见代码							
+ * BILIBILI	:	辰哥单片机设计
+ * CSDN			:	辰哥单片机设计
+ * 作者			:	辰哥 
 
 **********************BEGIN***********************/
 
 u8 OLED_GRAM[144][8];
 
-//Ժ
+//脏页记录：每页(8行)记录自上次刷新以来被改动的列范围
+//起始列>结束列表示该页无改动
+static u8 OLED_DirtyStart[8]={0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF,0xFF};
+static u8 OLED_DirtyEnd[8];
+
+//反显函数
 void OLED_ColorTurn(u8 i)
 {
 	if(i==0)
 		{
-			OLED_WR_Byte(0xA6,OLED_CMD);//ʾ
+			OLED_WR_Byte(0xA6,OLED_CMD);//正常显示
 		}
 	if(i==1)
 		{
-			OLED_WR_Byte(0xA7,OLED_CMD);//ɫʾ
+			OLED_WR_Byte(0xA7,OLED_CMD);//反色显示
 		}
 }
 
-//Ļת180
+//屏幕旋转180度
 void OLED_DisplayTurn(u8 i)
 {
 	if(i==0)
 		{
-			OLED_WR_Byte(0xC8,OLED_CMD);//ʾ
+			OLED_WR_Byte(0xC8,OLED_CMD);//正常显示
 			OLED_WR_Byte(0xA1,OLED_CMD);
 		}
 	if(i==1)
 		{
-			OLED_WR_Byte(0xC0,OLED_CMD);//תʾ
+			OLED_WR_Byte(0xC0,OLED_CMD);//反转显示
 			OLED_WR_Byte(0xA0,OLED_CMD);
 		}
 }
 
-//ʱ
+//延时
 void IIC_delay(void)
 {
 	u8 t=3;
 	while(t--);
 }
 
-//ʼź
+//起始信号
 void OLED_I2C_Start(void)
 {
 	OLED_SDA_Set();
@@ -65,7 +70,7 @@ void OLED_I2C_Start(void)
 	IIC_delay();
 }
 
-//ź
+//结束信号
 void OLED_I2C_Stop(void)
 {
 	OLED_SDA_Clr();
@@ -74,8 +79,8 @@ void OLED_I2C_Stop(void)
 	OLED_SDA_Set();
 }
 
-//ȴźӦ
-void OLED_I2C_WaitAck(void) //źŵĵƽ
+//等待信号响应
+void OLED_I2C_WaitAck(void) //测数据信号的电平
 {
 	OLED_SDA_Set();
 	IIC_delay();
@@ -85,13 +90,13 @@ void OLED_I2C_WaitAck(void) //
 	IIC_delay();
 }
 
-//дһֽ
+//写入一个字节
 void OLED_Send_Byte(u8 dat)
 {
 	u8 i;
 	for(i=0;i<8;i++)
 	{
-		if(dat&0x80)//dat8λλд
+		if(dat&0x80)//将dat的8位从最高位依次写入
 		{
 			OLED_SDA_Set();
     }
@@ -102,13 +107,13 @@ void OLED_Send_Byte(u8 dat)
 		IIC_delay();
 		OLED_SCL_Set();
 		IIC_delay();
-		OLED_SCL_Clr();//ʱźΪ͵ƽ
+		OLED_SCL_Clr();//将时钟信号设置为低电平
 		dat<<=1;
   }
 }
 
-//һֽ
-//mode:/־ 0,ʾ;1,ʾ;
+//发送一个字节
+//mode:数据/命令标志 0,表示命令;1,表示数据;
 void OLED_WR_Byte(u8 dat,u8 mode)
 {
 	OLED_I2C_Start();
@@ -122,101 +127,160 @@ void OLED_WR_Byte(u8 dat,u8 mode)
 	OLED_I2C_Stop();
 }
 
-//OLEDʾ 
+//开启OLED显示 
 void OLED_DisPlay_On(void)
 {
-	OLED_WR_Byte(0x8D,OLED_CMD);//ɱʹ
-	OLED_WR_Byte(0x14,OLED_CMD);//ɱ
-	OLED_WR_Byte(0xAF,OLED_CMD);//Ļ
+	OLED_WR_Byte(0x8D,OLED_CMD);//电荷泵使能
+	OLED_WR_Byte(0x14,OLED_CMD);//开启电荷泵
+	OLED_WR_Byte(0xAF,OLED_CMD);//点亮屏幕
 }
 
-//رOLEDʾ 
+//关闭OLED显示 
 void OLED_DisPlay_Off(void)
 {
-	OLED_WR_Byte(0x8D,OLED_CMD);//ɱʹ
-	OLED_WR_Byte(0x10,OLED_CMD);//رյɱ
-	OLED_WR_Byte(0xAE,OLED_CMD);//رĻ
+	OLED_WR_Byte(0x8D,OLED_CMD);//电荷泵使能
+	OLED_WR_Byte(0x10,OLED_CMD);//关闭电荷泵
+	OLED_WR_Byte(0xAE,OLED_CMD);//关闭屏幕
 }
 
-//Դ浽OLED	
-void OLED_Refresh(void)
+//标记显存某页某列已改动
+//x:0~143，超出128的列只在显存中使用(滚动缓冲)，不送屏
+static void OLED_MarkDirty(u8 x,u8 page)
+{
+	if(x>=128)return;
+	if(OLED_DirtyStart[page]>OLED_DirtyEnd[page])
+	{
+		OLED_DirtyStart[page]=x;
+		OLED_DirtyEnd[page]=x;
+	}
+	else if(x<OLED_DirtyStart[page])OLED_DirtyStart[page]=x;
+	else if(x>OLED_DirtyEnd[page])OLED_DirtyEnd[page]=x;
+}
+
+//设置页地址和列起始地址
+//三条命令放在同一次I2C传输中发送(控制字节0x00后连续跟命令)
+static void OLED_SetPos(u8 x,u8 page)
+{
+	OLED_I2C_Start();
+	OLED_Send_Byte(0x78);
+	OLED_I2C_WaitAck();
+	OLED_Send_Byte(0x00);
+	OLED_I2C_WaitAck();
+	OLED_Send_Byte(0xb0+page);      //设置页地址
+	OLED_I2C_WaitAck();
+	OLED_Send_Byte(x&0x0F);         //设置低列起始地址
+	OLED_I2C_WaitAck();
+	OLED_Send_Byte(0x10|(x>>4));    //设置高列起始地址
+	OLED_I2C_WaitAck();
+	OLED_I2C_Stop();
+}
+
+//把显存中改动过的部分送到OLED
+//只发送脏页中被改动的列范围，未改动的页不产生任何I2C传输
+//绘图函数只修改显存，需要在一屏内容画完后调用一次本函数
+void OLED_Flush(void)
 {
 	u8 i,n;
 	for(i=0;i<8;i++)
 	{
-		OLED_WR_Byte(0xb0+i,OLED_CMD); //ʼַ
-		OLED_WR_Byte(0x00,OLED_CMD);   //õʼַ
-		OLED_WR_Byte(0x10,OLED_CMD);   //øʼַ
+		if(OLED_DirtyStart[i]>OLED_DirtyEnd[i])continue;
+		OLED_SetPos(OLED_DirtyStart[i],i);
 		OLED_I2C_Start();
 		OLED_Send_Byte(0x78);
 		OLED_I2C_WaitAck();
 		OLED_Send_Byte(0x40);
 		OLED_I2C_WaitAck();
-		for(n=0;n<128;n++)
+		for(n=OLED_DirtyStart[i];n<=OLED_DirtyEnd[i];n++)
 		{
 			OLED_Send_Byte(OLED_GRAM[n][i]);
 			OLED_I2C_WaitAck();
 		}
 		OLED_I2C_Stop();
-  }
+		OLED_DirtyStart[i]=0xFF;
+		OLED_DirtyEnd[i]=0;
+	}
 }
-//
+
+//显存里是否还有没刷到OLED的改动
+u8 OLED_Dirty(void)
+{
+	u8 i;
+	for(i=0;i<8;i++)
+	{
+		if(OLED_DirtyStart[i]<=OLED_DirtyEnd[i])return 1;
+	}
+	return 0;
+}
+
+//更新整个显存到OLED
+//用于上电初始化等屏幕内容与显存不一致的场合
+void OLED_Refresh(void)
+{
+	u8 i;
+	for(i=0;i<8;i++)
+	{
+		OLED_DirtyStart[i]=0;
+		OLED_DirtyEnd[i]=127;
+	}
+	OLED_Flush();
+}
+//清屏函数
+//只清显存，随后画的内容与原内容相同的列不会被重新发送
 void OLED_Clear(void)
 {
 	u8 i,n;
 	for(i=0;i<8;i++)
 	{
-	   for(n=0;n<128;n++)
+	   for(n=0;n<144;n++)
 			{
-			 OLED_GRAM[n][i]=0;//
+			 if(OLED_GRAM[n][i])
+				{
+				 OLED_GRAM[n][i]=0;//清除所有数据
+				 OLED_MarkDirty(n,i);
+				}
 			}
   }
-	OLED_Refresh();//ʾ
 }
 
-// 
+//画点 
 //x:0~127
 //y:0~63
-//t:1  0,	
+//t:1 填充 0,清空	
 void OLED_DrawPoint(u8 x,u8 y,u8 t)
 {
-	u8 i,m,n;
+	u8 i,n,old;
+	if(x>=144||y>=64)return;
 	i=y/8;
-	m=y%8;
-	n=1<<m;
+	n=1<<(y%8);
+	old=OLED_GRAM[x][i];
 	if(t){OLED_GRAM[x][i]|=n;}
-	else
-	{
-		OLED_GRAM[x][i]=~OLED_GRAM[x][i];
-		OLED_GRAM[x][i]|=n;
-		OLED_GRAM[x][i]=~OLED_GRAM[x][i];
-	}
-//	OLED_Refresh();
+	else {OLED_GRAM[x][i]&=~n;}
+	if(OLED_GRAM[x][i]!=old)OLED_MarkDirty(x,i);  //只有像素真正改变才记脏
 }
 
-//
-//x1,y1:
-//x2,y2:
+//画线
+//x1,y1:起点坐标
+//x2,y2:结束坐标
 void OLED_DrawLine(u8 x1,u8 y1,u8 x2,u8 y2,u8 mode)
 {
 	u16 t; 
 	int xerr=0,yerr=0,delta_x,delta_y,distance;
 	int incx,incy,uRow,uCol;
-	delta_x=x2-x1; // 
+	delta_x=x2-x1; //计算坐标增量 
 	delta_y=y2-y1;
-	uRow=x1;//
+	uRow=x1;//画线起点坐标
 	uCol=y1;
-	if(delta_x>0)incx=1; //õ 
-	else if (delta_x==0)incx=0;//ֱ 
+	if(delta_x>0)incx=1; //设置单步方向 
+	else if (delta_x==0)incx=0;//垂直线 
 	else {incx=-1;delta_x=-delta_x;}
 	if(delta_y>0)incy=1;
-	else if (delta_y==0)incy=0;//ˮƽ 
+	else if (delta_y==0)incy=0;//水平线 
 	else {incy=-1;delta_y=-delta_x;}
-	if(delta_x>delta_y)distance=delta_x; //ѡȡ 
+	if(delta_x>delta_y)distance=delta_x; //选取基本增量坐标轴 
 	else distance=delta_y;
 	for(t=0;t<distance+1;t++)
 	{
-		OLED_DrawPoint(uRow,uCol,mode);//
+		OLED_DrawPoint(uRow,uCol,mode);//画点
 		xerr+=delta_x;
 		yerr+=delta_y;
 		if(xerr>distance)
@@ -232,8 +296,8 @@ void OLED_DrawLine(u8 x1,u8 y1,u8 x2,u8 y2,u8 mode)
 	}
 //	OLED_Refresh();
 }
-//x,y:Բ
-//r:Բİ뾶
+//x,y:圆心坐标
+//r:圆的半径
 void OLED_DrawCircle(u8 x,u8 y,u8 r)
 {
 	int a, b,num;
@@ -252,7 +316,7 @@ void OLED_DrawCircle(u8 x,u8 y,u8 r)
         OLED_DrawPoint(x - b, y + a,1);
         
         a++;
-        num = (a * a + b * b) - r*r;//㻭ĵԲĵľ
+        num = (a * a + b * b) - r*r;//计算画的点离圆心的距离
         if(num > 0)
         {
             b--;
@@ -264,28 +328,28 @@ void OLED_DrawCircle(u8 x,u8 y,u8 r)
 
 
 
-//ָλʾһַ,ַ
+//在指定位置显示一个字符,包括部分字符
 //x:0~127
 //y:0~63
-//size1:ѡ 6x8/6x12/8x16/12x24
-//mode:0,ɫʾ;1,ʾ
+//size1:选择字体 6x8/6x12/8x16/12x24
+//mode:0,反色显示;1,正常显示
 void OLED_ShowChar(u8 x,u8 y,u8 chr,u8 size1,u8 mode)
 {
 	u8 i,m,temp,size2,chr1;
 	u8 x0=x,y0=y;
 	if(size1==8)size2=6;
-	else size2=(size1/8+((size1%8)?1:0))*(size1/2);  //õһַӦռֽ
-	chr1=chr-' ';  //ƫƺֵ
+	else size2=(size1/8+((size1%8)?1:0))*(size1/2);  //得到字体一个字符对应点阵集所占的字节数
+	chr1=chr-' ';  //计算偏移后的值
 	for(i=0;i<size2;i++)
 	{
 		if(size1==8)
-			  {temp=asc2_0806[chr1][i];} //0806
+			  {temp=asc2_0806[chr1][i];} //调用0806字体
 		else if(size1==12)
-        {temp=asc2_1206[chr1][i];} //1206
+        {temp=asc2_1206[chr1][i];} //调用1206字体
 		else if(size1==16)
-        {temp=asc2_1608[chr1][i];} //1608
+        {temp=asc2_1608[chr1][i];} //调用1608字体
 		else if(size1==24)
-        {temp=asc2_2412[chr1][i];} //2412
+        {temp=asc2_2412[chr1][i];} //调用2412字体
 		else return;
 		for(m=0;m<8;m++)
 		{
@@ -299,25 +363,23 @@ void OLED_ShowChar(u8 x,u8 y,u8 chr,u8 size1,u8 mode)
 		{x=x0;y0=y0+8;}
 		y=y0;
   }
-	OLED_Refresh();
 }
 
 
-//ʾַ
-//x,y:  
-//size1:С 
-//*chr:ַʼַ 
-//mode:0,ɫʾ;1,ʾ
-void OLED_ShowString(u8 x,u8 y,u8 *chr,u8 size1,u8 mode)
+//显示字符串
+//x,y:起点坐标  
+//size1:字体大小 
+//*chr:字符串起始地址 
+//mode:0,反色显示;1,正常显示
+void OLED_ShowString(u8 x,u8 y,const char *chr,u8 size1,u8 mode)
 {
-	while((*chr>=' ')&&(*chr<='~'))//жǲǷǷַ!
+	while((*chr>=' ')&&(*chr<='~'))//判断是不是非法字符!
 	{
 		OLED_ShowChar(x,y,*chr,size1,mode);
 		if(size1==8)x+=6;
 		else x+=size1/2;
 		chr++;
   }
-	OLED_Refresh();
 }
 
 //m^n
@@ -331,12 +393,12 @@ u32 OLED_Pow(u8 m,u8 n)
 	return result;
 }
 
-//ʾ
-//x,y :
-//num :Ҫʾ
-//len :ֵλ
-//size:С
-//mode:0,ɫʾ;1,ʾ
+//显示数字
+//x,y :起点坐标
+//num :要显示的数字
+//len :数字的位数
+//size:字体大小
+//mode:0,反色显示;1,正常显示
 void OLED_ShowNum(u8 x,u8 y,u32 num,u8 len,u8 size1,u8 mode)
 {
 	u8 t,temp,m=0;
@@ -353,28 +415,27 @@ void OLED_ShowNum(u8 x,u8 y,u32 num,u8 len,u8 size1,u8 mode)
 			  OLED_ShowChar(x+(size1/2+m)*t,y,temp+'0',size1,mode);
 			}
   }
-	OLED_Refresh();
 }
 
-//ʾ
-//x,y:
-//num:ֶӦ
-//mode:0,ɫʾ;1,ʾ
+//显示汉字
+//x,y:起点坐标
+//num:汉字对应的序号
+//mode:0,反色显示;1,正常显示
 void OLED_ShowChinese(u8 x,u8 y,u8 num,u8 size1,u8 mode)
 {
 	u8 m,temp;
 	u8 x0=x,y0=y;
-	u16 i,size3=(size1/8+((size1%8)?1:0))*size1;  //õһַӦռֽ
+	u16 i,size3=(size1/8+((size1%8)?1:0))*size1;  //得到字体一个字符对应点阵集所占的字节数
 	for(i=0;i<size3;i++)
 	{
 		if(size1==16)
-				{temp=Hzk1[num][i];}//16*16
+				{temp=Hzk1[num][i];}//调用16*16字体
 		else if(size1==24)
-				{temp=Hzk2[num][i];}//24*24
+				{temp=Hzk2[num][i];}//调用24*24字体
 		else if(size1==32)       
-				{temp=Hzk3[num][i];}//32*32
+				{temp=Hzk3[num][i];}//调用32*32字体
 		else if(size1==64)
-				{temp=Hzk4[num][i];}//64*64
+				{temp=Hzk4[num][i];}//调用64*64字体
 		else return;
 		for(m=0;m<8;m++)
 		{
@@ -388,12 +449,11 @@ void OLED_ShowChinese(u8 x,u8 y,u8 num,u8 size1,u8 mode)
 		{x=x0;y0=y0+8;}
 		y=y0;
 	}
-	OLED_Refresh();
 }
 
-//num ʾֵĸ
-//space ÿһʾļ
-//mode:0,ɫʾ;1,ʾ
+//num 显示汉字的个数
+//space 每一遍显示的间隔
+//mode:0,反色显示;1,正常显示
 void OLED_ScrollDisplay(u8 num,u8 space,u8 mode)
 {
 	u8 i,n,t=0,m=0,r;
@@ -401,12 +461,12 @@ void OLED_ScrollDisplay(u8 num,u8 space,u8 mode)
 	{
 		if(m==0)
 		{
-	    OLED_ShowChinese(128,24,t,16,mode); //дһֱOLED_GRAM[][]
+	    OLED_ShowChinese(128,24,t,16,mode); //写入一个汉字保存在OLED_GRAM[][]数组中
 			t++;
 		}
 		if(t==num)
 			{
-				for(r=0;r<16*space;r++)      //ʾ
+				for(r=0;r<16*space;r++)      //显示间隔
 				 {
 					for(i=1;i<144;i++)
 						{
@@ -421,7 +481,7 @@ void OLED_ScrollDisplay(u8 num,u8 space,u8 mode)
       }
 		m++;
 		if(m==16){m=0;}
-		for(i=1;i<144;i++)   //ʵ
+		for(i=1;i<144;i++)   //实现左移
 		{
 			for(n=0;n<8;n++)
 			{
@@ -432,10 +492,10 @@ void OLED_ScrollDisplay(u8 num,u8 space,u8 mode)
 	}
 }
 
-//x,y
-//sizex,sizey,ͼƬ
-//BMP[]ҪдͼƬ
-//mode:0,ɫʾ;1,ʾ
+//x,y：起点坐标
+//sizex,sizey,图片长宽
+//BMP[]：要写入的图片数组
+//mode:0,反色显示;1,正常显示
 void OLED_ShowPicture(u8 x,u8 y,u8 sizex,u8 sizey,u8 BMP[],u8 mode)
 {
 	u16 j=0;
@@ -464,21 +524,20 @@ void OLED_ShowPicture(u8 x,u8 y,u8 sizex,u8 sizey,u8 BMP[],u8 mode)
 				y=y0;
      }
 	 }
-	OLED_Refresh();
 }
-//OLEDĳʼ
+//OLED的初始化
 void OLED_Init(void)
 {
 	GPIO_InitTypeDef  GPIO_InitStructure;
- 	RCC_APB2PeriphClockCmd(OLED_SCL_GPIO_CLK|OLED_SDA_GPIO_CLK, ENABLE);	 //ʹA˿ʱ
+ 	RCC_APB2PeriphClockCmd(OLED_SCL_GPIO_CLK|OLED_SDA_GPIO_CLK, ENABLE);	 //使能A端口时钟
 	GPIO_InitStructure.GPIO_Pin = OLED_SCL_PIN;	 
- 	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_OD; 		 //
-	GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;//ٶ50MHz
- 	GPIO_Init(OLED_SCL_PROT, &GPIO_InitStructure);	  //ʼPA0,1
+ 	GPIO_InitStructure.GPIO_Mode = GPIO_Mode_Out_OD; 		 //推挽输出
+	GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;//速度50MHz
+ 	GPIO_Init(OLED_SCL_PROT, &GPIO_InitStructure);	  //初始化PA0,1
  	GPIO_SetBits(OLED_SCL_PROT,OLED_SCL_PIN);
 	
 	GPIO_InitStructure.GPIO_Pin = OLED_SDA_PIN;	
-	GPIO_Init(OLED_SDA_PROT, &GPIO_InitStructure);	  //ʼPA0,1
+	GPIO_Init(OLED_SDA_PROT, &GPIO_InitStructure);	  //初始化PA0,1
  	GPIO_SetBits(OLED_SDA_PROT,OLED_SDA_PIN);
 
 	delay_ms(200);
@@ -489,8 +548,8 @@ void OLED_Init(void)
 	OLED_WR_Byte(0x40,OLED_CMD);//--set start line address  Set Mapping RAM Display Start Line (0x00~0x3F)
 	OLED_WR_Byte(0x81,OLED_CMD);//--set contrast control register
 	OLED_WR_Byte(0xCF,OLED_CMD);// Set SEG Output Current Brightness
-	OLED_WR_Byte(0xA1,OLED_CMD);//--Set SEG/Column Mapping     0xa0ҷ 0xa1
-	OLED_WR_Byte(0xC8,OLED_CMD);//Set COM/Row Scan Direction   0xc0· 0xc8
+	OLED_WR_Byte(0xA1,OLED_CMD);//--Set SEG/Column Mapping     0xa0左右反置 0xa1正常
+	OLED_WR_Byte(0xC8,OLED_CMD);//Set COM/Row Scan Direction   0xc0上下反置 0xc8正常
 	OLED_WR_Byte(0xA6,OLED_CMD);//--set normal display
 	OLED_WR_Byte(0xA8,OLED_CMD);//--set multiplex ratio(1 to 64)
 	OLED_WR_Byte(0x3f,OLED_CMD);//--1/64 duty
@@ -509,6 +568,7 @@ void OLED_Init(void)
 	OLED_WR_Byte(0x8D,OLED_CMD);//--set Charge Pump enable/disable
 	OLED_WR_Byte(0x14,OLED_CMD);//--set(0x10) disable
 	OLED_Clear();
+	OLED_Refresh();//上电后屏内RAM内容不确定，整屏刷新一次
 	OLED_WR_Byte(0xAF,OLED_CMD);
 }
 
@@ -3,21 +3,21 @@
 #include "sys.h"
 #include "stdlib.h"	
 
-/*****************絥Ƭ******************
+/*****************辰哥单片机设计******************
 											STM32
- * ļ			:	OLEDʾhļ                     
- * 汾			: V1.0
- * 			: 2024.8.7
+ * 文件			:	OLED显示屏h文件                     
+ * 版本			: V1.0
+ * 日期			: 2024.8.7
  * MCU			:	STM32F103C8T6
- * ӿ			:								
- * BILIBILI	:	絥Ƭ
- * CSDN			:	絥Ƭ
- * 			:	 
+ * 接口			:	见代码							
+ * BILIBILI	:	辰哥单片机设计
+ * CSDN			:	辰哥单片机设计
+ * 作者			:	辰哥 
 
 **********************BEGIN***********************/
 
-//----------------OLED˿ڶ----------------- 
-/***************Լ****************/
+//----------------OLED端口定义----------------- 
+/***************根据自己需求更改****************/
 #define OLED_SCL_PROT  			GPIOB
 #define OLED_SCL_PIN				GPIO_Pin_11
 #define OLED_SCL_GPIO_CLK   RCC_APB2Periph_GPIOB
@@ -32,8 +32,8 @@
 #define OLED_SDA_Clr() GPIO_ResetBits(OLED_SDA_PROT,OLED_SDA_PIN)//DIN
 #define OLED_SDA_Set() GPIO_SetBits(OLED_SDA_PROT,OLED_SDA_PIN)
 
-#define OLED_CMD  0	//д
-#define OLED_DATA 1	//д
+#define OLED_CMD  0	//写命令
+#define OLED_DATA 1	//写数据
 
 void OLED_ClearPoint(u8 x,u8 y);
 void OLED_ColorTurn(u8 i);
@@ -46,13 +46,15 @@ void OLED_WR_Byte(u8 dat,u8 mode);
 void OLED_DisPlay_On(void);
 void OLED_DisPlay_Off(void);
 void OLED_Refresh(void);
+void OLED_Flush(void);
+u8 OLED_Dirty(void);
 void OLED_Clear(void);
 void OLED_DrawPoint(u8 x,u8 y,u8 t);
 void OLED_DrawLine(u8 x1,u8 y1,u8 x2,u8 y2,u8 mode);
 void OLED_DrawCircle(u8 x,u8 y,u8 r);
 void OLED_ShowChar(u8 x,u8 y,u8 chr,u8 size1,u8 mode);
 void OLED_ShowChar6x8(u8 x,u8 y,u8 chr,u8 mode);
-void OLED_ShowString(u8 x,u8 y,u8 *chr,u8 size1,u8 mode);
+void OLED_ShowString(u8 x,u8 y,const char *chr,u8 size1,u8 mode);
 void OLED_ShowNum(u8 x,u8 y,u32 num,u8 len,u8 size1,u8 mode);
 void OLED_ShowChinese(u8 x,u8 y,u8 num,u8 size1,u8 mode);
 void OLED_ScrollDisplay(u8 num,u8 space,u8 mode);
@@ -0,0 +1,79 @@
+#ifndef _SIM_H_
+#define _SIM_H_
+
+//==========================================================
+//	主机仿真内部接口
+//
+//	时间单位ns。固件每调用一次外设库函数就按下面的开销推进
+//	虚拟时钟，推进过程中到期的设备事件和中断依次执行
+//==========================================================
+
+#define SIM_INTERNAL
+#include "sim_periph.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#define SIM_NS_PER_US		1000ULL
+#define SIM_NS_PER_MS		1000000ULL
+
+#define SIM_NS_GPIO			140			//一次GPIO库函数调用(约10个72MHz周期)
+#define SIM_NS_SPI_BYTE		889			//SPI1 9MHz移出一个字节
+#define SIM_NS_TICK			1000		//一次取节拍，含主循环一圈的调度开销
+
+typedef void (*Sim_EventFn)(void *p, int a);
+
+extern uint64_t sim_now;
+extern int sim_verbose;
+
+void Sim_Advance(uint64_t ns);
+void Sim_Schedule(uint64_t at, Sim_EventFn fn, void *p, int a);
+void Sim_Cancel(Sim_EventFn fn);
+void Sim_Log(const char *fmt, ...);
+void Sim_ExtiEdge(uint32_t line);
+
+//USART2：ESP8266发给单片机的数据，按波特率逐字节进中断
+void Sim_Usart2_Rx(const void *data, unsigned int len);
+unsigned int Sim_Usart2_RxPending(void);
+unsigned int Sim_Usart2_Baud(void);
+
+//MFRC522和卡片
+#define SIM_CARD_KEEP		0			//已有的卡保持原内容，新卡按空白卡处理
+#define SIM_CARD_BLANK		1
+#define SIM_CARD_LEGACY		2
+#define SIM_CARD_VALUE		3
+
+void Sim_Rc522_Spi(int cs, int sck, int mosi);
+int Sim_Rc522_Miso(void);
+void Sim_Rc522_Rst(int level);
+void Sim_Card_Enter(const unsigned char *uid, int len, int fmt, int32_t value);
+void Sim_Card_Remove(const unsigned char *uid, int len);
+void Sim_Card_DropReqa(int n);
+int Sim_Card_Balance(const unsigned char *uid, int len, int32_t *value);
+void Sim_Rc522_Report(void);
+
+//ESP8266和MQTT服务器
+void Sim_Esp_Tx(unsigned char c);
+void Sim_Esp_Downlink(const char *json);
+void Sim_Esp_TcpClose(void);
+void Sim_Esp_WifiDrop(unsigned int ms);
+void Sim_Esp_SetJoinDelay(unsigned int ms);
+void Sim_Esp_SetBaudMax(unsigned int baud);
+unsigned int Sim_Esp_Baud(void);
+void Sim_Esp_Cts(int level);
+int Sim_Esp_CanSend(void);
+int Sim_Esp_Published(const char *text);
+int Sim_Esp_Online(void);
+void Sim_Esp_Report(void);
+
+//OLED
+void Sim_Oled_I2c(int scl, int sda);
+void Sim_Oled_Dump(void);
+void Sim_Oled_Report(void);
+
+//HAL
+void Sim_Hal_Report(void);
+double Sim_StopPercent(void);
+void Sim_HseSlow(int n);
+unsigned int Sim_Mhz(void);
+
+#endif
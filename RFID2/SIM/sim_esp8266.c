@@ -0,0 +1,616 @@
+//==========================================================
+//	主机仿真：ESP8266 AT固件和MQTT服务器
+//
+//	AT部分：回显命令，AT/CWMODE/CWDHCP直接OK，CWJAP和CIPSTART按设定
+//	延时应答，CIPSEND给出"> "后收满指定字节回SEND OK(这期间TCP断了回SEND FAIL)；断网/断TCP时
+//	输出"WIFI DISCONNECT"/"CLOSED"，断网结束后像真模块一样自动重新加入
+//	服务器部分：进程内的MQTT服务器，应答CONNECT/SUBSCRIBE/PINGREQ和QoS1的
+//	PUBLISH，记录设备发布的消息；服务器发出的数据经过网络延时后以
+//	"+IPD,<len>:"送回，同一时间窗内的多个报文合并在一个+IPD里
+//	透传：AT+CIPMODE=1后AT+CIPSEND(不带长度)给出'>'进入透传，之后
+//	双向都是原始字节，设备数据空闲ESP_RAW_IDLE_MS后打包发出，单独的
+//	"+++"退出透传；透传时断TCP/断网不输出任何状态行，模块自己重连TCP
+//	服务器在CONNECT之前收到其它报文时断开TCP
+//	AT+UART_CUR：不超过esp_baudMax时回OK，OK发完后模块换到新波特率；
+//	流控参数为2或3时打开CTS，CTS(单片机的RTS)为高时发完当前字节就停下
+//==========================================================
+
+#include "sim.h"
+#include "MqttKit.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ESP_LINE_SIZE		256
+#define ESP_DATA_SIZE		2048
+#define ESP_PUB_MAX			256
+
+static unsigned int esp_joinMs = 1500;		//AT+CWJAP到拿到IP
+static unsigned int esp_tcpMs = 80;			//AT+CIPSTART到CONNECT
+static unsigned int esp_sendMs = 5;			//数据收满到SEND OK
+static unsigned int esp_netMs = 20;			//单程网络延时
+static unsigned int esp_baud = 115200;
+static unsigned int esp_baudMax = 921600;	//AT+UART_CUR能接受的最高波特率，0=不支持
+static _Bool esp_ctsFlow = 0, esp_cts = 0;	//CTS流控打开 / CTS线为高
+#define ESP_RAW_IDLE_MS		10				//透传时设备数据空闲多久打包发出
+
+static char esp_line[ESP_LINE_SIZE];
+static unsigned int esp_lineLen = 0;
+static unsigned char esp_data[ESP_DATA_SIZE];
+static unsigned int esp_dataLen = 0, esp_dataWant = 0;	//esp_dataWant非0表示在CIPSEND数据阶段
+static _Bool esp_wifi = 0, esp_tcp = 0, esp_joining = 0;
+static uint64_t esp_wifiDownUntil = 0;
+static unsigned int esp_tcpGen = 0;			//每次建立TCP加1，丢弃上一条连接的在途数据
+static _Bool esp_cipmode = 0, esp_raw = 0;	//AT+CIPMODE=1 / 正在透传
+
+//MQTT服务器
+static unsigned char mq_in[ESP_DATA_SIZE];
+static unsigned int mq_inLen = 0;
+static unsigned char mq_out[ESP_DATA_SIZE];
+static unsigned int mq_outLen = 0;
+static _Bool mq_flushPending = 0;
+static _Bool mq_connected = 0;
+static char mq_subTopic[128];
+static char *mq_pub[ESP_PUB_MAX];
+static unsigned int mq_pubNum = 0;
+static unsigned long mq_pubTotal = 0, mq_downTotal = 0, mq_ipdTotal = 0;
+
+static void Esp_Emit(const char *s)
+{
+	Sim_Usart2_Rx(s, strlen(s));
+}
+
+static void Esp_EmitEv(void *p, int a)
+{
+	(void)a;
+	Esp_Emit(p);
+	free(p);
+}
+
+static void Esp_EmitLater(unsigned int ms, const char *s)
+{
+	Sim_Schedule(sim_now + ms * SIM_NS_PER_MS, Esp_EmitEv, strdup(s), 0);
+}
+
+static void Esp_RawReconnect(void *p, int a);
+
+//TCP断开：AT模式输出CLOSED，透传时不输出，网络还在就自动重连
+static void Esp_TcpDown(void)
+{
+	esp_tcp = 0;
+	mq_connected = 0;
+	if(!esp_raw)
+		Esp_Emit("CLOSED\r\n");
+	else if(esp_wifi)
+		Sim_Schedule(sim_now + esp_tcpMs * SIM_NS_PER_MS, Esp_RawReconnect, NULL, 0);
+}
+
+//==========================================================
+//	MQTT服务器
+//==========================================================
+static void Mq_Flush(void *p, int gen)
+{
+	char head[24];
+
+	(void)p;
+	mq_flushPending = 0;
+	if(!esp_tcp || gen != (int)esp_tcpGen)
+	{
+		mq_outLen = 0;
+		return;
+	}
+	if(!esp_raw)
+	{
+		snprintf(head, sizeof(head), "\r\n+IPD,%u:", mq_outLen);
+		Esp_Emit(head);
+		mq_ipdTotal++;
+	}
+	Sim_Usart2_Rx(mq_out, mq_outLen);
+	mq_outLen = 0;
+}
+
+static void Mq_Send(const unsigned char *d, unsigned int len)
+{
+	if(mq_outLen + len > sizeof(mq_out))
+		return;
+	memcpy(mq_out + mq_outLen, d, len);
+	mq_outLen += len;
+	if(!mq_flushPending)
+	{
+		mq_flushPending = 1;
+		Sim_Schedule(sim_now + esp_netMs * SIM_NS_PER_MS, Mq_Flush, NULL, esp_tcpGen);
+	}
+}
+
+static unsigned int Mq_PutLen(unsigned char *d, unsigned int len)
+{
+	unsigned int n = 0;
+
+	do
+	{
+		d[n] = len % 128;
+		len /= 128;
+		if(len)
+			d[n] |= 0x80;
+		n++;
+	} while(len);
+	return n;
+}
+
+static void Mq_Packet(const unsigned char *pkt, unsigned int hdr, unsigned int len)
+{
+	const unsigned char *body = pkt + hdr;
+	unsigned char resp[8];
+	unsigned int topicLen, pos, qos;
+	char *msg;
+
+	if(!mq_connected && (pkt[0] >> 4) != MQTT_PKT_CONNECT)
+	{
+		Sim_Log("broker: packet type %d before CONNECT, closing", pkt[0] >> 4);
+		Esp_TcpDown();
+		return;
+	}
+
+	switch(pkt[0] >> 4)
+	{
+		case MQTT_PKT_CONNECT:
+			mq_connected = 1;
+			mq_subTopic[0] = 0;
+			Sim_Log("broker: CONNECT");
+			resp[0] = MQTT_PKT_CONNACK << 4; resp[1] = 2; resp[2] = 0; resp[3] = 0;
+			Mq_Send(resp, 4);
+			break;
+
+		case MQTT_PKT_SUBSCRIBE:
+			if(len >= 5)
+			{
+				topicLen = (body[2] << 8) | body[3];
+				if(topicLen > len - 4)
+					topicLen = len - 4;
+				if(topicLen >= sizeof(mq_subTopic))
+					topicLen = sizeof(mq_subTopic) - 1;
+				memcpy(mq_subTopic, body + 4, topicLen);
+				mq_subTopic[topicLen] = 0;
+				Sim_Log("broker: SUBSCRIBE %s", mq_subTopic);
+				resp[0] = MQTT_PKT_SUBACK << 4; resp[1] = 3; resp[2] = body[0]; resp[3] = body[1]; resp[4] = 0;
+				Mq_Send(resp, 5);
+			}
+			break;
+
+		case MQTT_PKT_PUBLISH:
+			if(len < 2)
+				break;
+			qos = (pkt[0] >> 1) & 3;
+			topicLen = (body[0] << 8) | body[1];
+			pos = 2 + topicLen + (qos ? 2 : 0);
+			if(pos > len)
+				break;
+			msg = malloc(len - pos + 1);
+			memcpy(msg, body + pos, len - pos);
+			msg[len - pos] = 0;
+			Sim_Log("broker: PUBLISH %.*s %s", (int)topicLen, body + 2, msg);
+			if(mq_pubNum == ESP_PUB_MAX)
+			{
+				free(mq_pub[0]);
+				memmove(mq_pub, mq_pub + 1, sizeof(mq_pub[0]) * (ESP_PUB_MAX - 1));
+				mq_pubNum--;
+			}
+			mq_pub[mq_pubNum++] = msg;
+			mq_pubTotal++;
+			if(qos == 1)
+			{
+				resp[0] = MQTT_PKT_PUBACK << 4; resp[1] = 2;
+				resp[2] = body[2 + topicLen]; resp[3] = body[3 + topicLen];
+				Mq_Send(resp, 4);
+			}
+			break;
+
+		case MQTT_PKT_PINGREQ:
+			resp[0] = MQTT_PKT_PINGRESP << 4; resp[1] = 0;
+			Mq_Send(resp, 2);
+			break;
+
+		case MQTT_PKT_DISCONNECT:
+			mq_connected = 0;
+			Sim_Log("broker: DISCONNECT");
+			break;
+
+		default:
+			Sim_Log("broker: packet type %d ignored", pkt[0] >> 4);
+			break;
+	}
+}
+
+//设备发来的TCP数据按MQTT报文切分
+static void Mq_Receive(void *p, int len)
+{
+	unsigned int pos, hdr, rem, mul;
+	unsigned char *d = p, b;
+	_Bool done;
+
+	if((unsigned int)len > sizeof(mq_in) - mq_inLen)
+		len = sizeof(mq_in) - mq_inLen;
+	memcpy(mq_in + mq_inLen, d, len);
+	mq_inLen += len;
+	free(p);
+
+	while(mq_inLen >= 2)
+	{
+		rem = 0;
+		mul = 1;
+		hdr = 1;
+		done = 0;
+		while(hdr < mq_inLen && hdr <= 4)
+		{
+			b = mq_in[hdr++];
+			rem += (b & 0x7F) * mul;
+			mul *= 128;
+			if(!(b & 0x80))
+			{
+				done = 1;
+				break;
+			}
+		}
+		if(!done)
+		{
+			if(hdr > 4)												//剩余长度超过4字节，丢弃
+				mq_inLen = 0;
+			break;
+		}
+		pos = hdr + rem;
+		if(pos > mq_inLen)
+			break;
+		Mq_Packet(mq_in, hdr, rem);
+		if(!esp_tcp)
+		{
+			mq_inLen = 0;
+			break;
+		}
+		memmove(mq_in, mq_in + pos, mq_inLen - pos);
+		mq_inLen -= pos;
+	}
+}
+
+//==========================================================
+//	AT命令
+//==========================================================
+static void Esp_JoinDone(void *p, int a)
+{
+	(void)p; (void)a;
+	esp_joining = 0;
+	if(sim_now < esp_wifiDownUntil)
+	{
+		Esp_Emit("+CWJAP:3\r\n\r\nFAIL\r\n");
+		return;
+	}
+	esp_wifi = 1;
+	Esp_Emit("WIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n");
+}
+
+//模块保存了AP，断网恢复后自动重新加入，主动输出状态行
+static void Esp_AutoJoin(void *p, int a)
+{
+	(void)p; (void)a;
+	if(esp_wifi || esp_joining)
+		return;
+	esp_wifi = 1;
+	Sim_Log("esp: WiFi back");
+	if(esp_raw)
+		Sim_Schedule(sim_now + esp_tcpMs * SIM_NS_PER_MS, Esp_RawReconnect, NULL, 0);
+	else
+		Esp_Emit("WIFI CONNECTED\r\nWIFI GOT IP\r\n");
+}
+
+static void Esp_TcpUp(void)
+{
+	esp_tcp = 1;
+	esp_tcpGen++;
+	mq_inLen = 0;
+	mq_outLen = 0;
+	mq_connected = 0;
+}
+
+//透传时模块自己重连TCP，不通知单片机
+static void Esp_RawReconnect(void *p, int a)
+{
+	(void)p; (void)a;
+	if(!esp_raw || esp_tcp || !esp_wifi)
+		return;
+	Esp_TcpUp();
+	Sim_Log("esp: TCP reconnected silently (passthrough)");
+}
+
+static void Esp_ConnectDone(void *p, int a)
+{
+	(void)p; (void)a;
+	if(!esp_wifi)
+	{
+		Esp_Emit("\r\nERROR\r\nCLOSED\r\n");
+		return;
+	}
+	Esp_TcpUp();
+	Sim_Log("esp: TCP connected");
+	Esp_Emit("CONNECT\r\n\r\nOK\r\n");
+}
+
+static void Esp_SetBaud(void *p, int baud)
+{
+	(void)p;
+	esp_baud = baud;
+	Sim_Log("esp: UART %d baud", baud);
+}
+
+static void Esp_Command(const char *cmd)
+{
+	unsigned int baud;
+
+	char buf[64];
+
+	if(strcmp(cmd, "AT") == 0 || strncmp(cmd, "AT+CWMODE=", 10) == 0 || strncmp(cmd, "AT+CWDHCP=", 10) == 0)
+		Esp_EmitLater(1, "\r\nOK\r\n");
+	else if(strncmp(cmd, "AT+CWJAP=", 9) == 0)
+	{
+		if(esp_joining)
+			Esp_Emit("busy p...\r\n");
+		else
+		{
+			esp_joining = 1;
+			esp_wifi = 0;
+			Sim_Schedule(sim_now + esp_joinMs * SIM_NS_PER_MS, Esp_JoinDone, NULL, 0);
+		}
+	}
+	else if(strncmp(cmd, "AT+CIPSTART=", 12) == 0)
+	{
+		if(esp_tcp)
+			Esp_EmitLater(1, "ALREADY CONNECTED\r\n\r\nERROR\r\n");
+		else if(!esp_wifi)
+			Esp_EmitLater(1, "\r\nERROR\r\nCLOSED\r\n");
+		else
+			Sim_Schedule(sim_now + esp_tcpMs * SIM_NS_PER_MS, Esp_ConnectDone, NULL, 0);
+	}
+	else if(strncmp(cmd, "AT+UART_CUR=", 12) == 0)
+	{
+		baud = strtoul(cmd + 12, NULL, 10);
+		if(baud < 9600 || baud > esp_baudMax)
+			Esp_EmitLater(1, "\r\nERROR\r\n");
+		else
+		{
+			const char *flow = cmd;
+			int i;
+
+			for(i = 0; i < 4 && flow; i++)						//<baud>,<databits>,<stopbits>,<parity>,<flow>
+				flow = strchr(flow + 1, ',');
+			esp_ctsFlow = flow && (atoi(flow + 1) & 2);
+			Esp_Emit("\r\nOK\r\n");									//旧波特率发完OK才切换
+			Sim_Schedule(sim_now + (uint64_t)Sim_Usart2_RxPending() * 10 * 1000000000ULL / esp_baud,
+						 Esp_SetBaud, NULL, baud);
+		}
+	}
+	else if(strncmp(cmd, "AT+CIPMODE=", 11) == 0)
+	{
+		esp_cipmode = (cmd[11] == '1');
+		Esp_EmitLater(1, "\r\nOK\r\n");
+	}
+	else if(strcmp(cmd, "AT+CIPSEND") == 0)
+	{
+		if(!esp_cipmode || !esp_tcp)
+			Esp_EmitLater(1, "\r\nERROR\r\n");
+		else
+		{
+			esp_raw = 1;
+			esp_dataLen = 0;
+			Sim_Log("esp: passthrough on");
+			Esp_Emit("\r\nOK\r\n\r\n>");
+		}
+	}
+	else if(strncmp(cmd, "AT+CIPSEND=", 11) == 0)
+	{
+		esp_dataWant = atoi(cmd + 11);
+		if(!esp_tcp)
+		{
+			esp_dataWant = 0;
+			Esp_EmitLater(1, "\r\nlink is not valid\r\n\r\nERROR\r\n");
+		}
+		else if(esp_dataWant == 0 || esp_dataWant > ESP_DATA_SIZE)
+		{
+			esp_dataWant = 0;
+			Esp_EmitLater(1, "\r\nERROR\r\n");
+		}
+		else
+		{
+			esp_dataLen = 0;
+			Esp_Emit("\r\nOK\r\n> ");
+		}
+	}
+	else if(strcmp(cmd, "AT+CIPCLOSE") == 0)
+	{
+		Sim_Cancel(Esp_RawReconnect);
+		esp_tcp = 0;
+		mq_connected = 0;
+		Esp_EmitLater(1, "CLOSED\r\n\r\nOK\r\n");
+	}
+	else
+	{
+		snprintf(buf, sizeof(buf), "%.40s", cmd);
+		Sim_Log("esp: unsupported command %s", buf);
+		Esp_EmitLater(1, "\r\nERROR\r\n");
+	}
+}
+
+static void Esp_DataDone(void)
+{
+	char buf[40];
+	unsigned char *copy;
+
+	snprintf(buf, sizeof(buf), "\r\nRecv %u bytes\r\n", esp_dataLen);
+	Esp_Emit(buf);
+	esp_dataWant = 0;
+	if(!esp_tcp)													//给出'>'之后TCP断了
+	{
+		Esp_EmitLater(esp_sendMs, "\r\nSEND FAIL\r\n");
+		return;
+	}
+	copy = malloc(esp_dataLen);
+	memcpy(copy, esp_data, esp_dataLen);
+	Sim_Schedule(sim_now + esp_netMs * SIM_NS_PER_MS, Mq_Receive, copy, esp_dataLen);
+	Esp_EmitLater(esp_sendMs, "\r\nSEND OK\r\n");
+}
+
+//透传：设备数据空闲一段时间后作为一包发出，单独的"+++"退出透传
+static void Esp_RawFlush(void *p, int a)
+{
+	unsigned char *copy;
+
+	(void)p; (void)a;
+	if(esp_dataLen == 3 && memcmp(esp_data, "+++", 3) == 0)
+	{
+		esp_raw = 0;
+		Sim_Cancel(Esp_RawReconnect);
+		Sim_Log("esp: passthrough off");
+	}
+	else if(esp_tcp)
+	{
+		copy = malloc(esp_dataLen);
+		memcpy(copy, esp_data, esp_dataLen);
+		Sim_Schedule(sim_now + esp_netMs * SIM_NS_PER_MS, Mq_Receive, copy, esp_dataLen);
+	}
+	else
+		Sim_Log("esp: %u bytes dropped, TCP down", esp_dataLen);
+	esp_dataLen = 0;
+}
+
+//单片机经USART2发来的一个字节
+void Sim_Esp_Tx(unsigned char c)
+{
+	if(esp_raw)
+	{
+		if(esp_dataLen < ESP_DATA_SIZE)
+			esp_data[esp_dataLen++] = c;
+		Sim_Cancel(Esp_RawFlush);
+		Sim_Schedule(sim_now + ESP_RAW_IDLE_MS * SIM_NS_PER_MS, Esp_RawFlush, NULL, 0);
+		return;
+	}
+	if(esp_dataWant)
+	{
+		esp_data[esp_dataLen++] = c;
+		if(esp_dataLen == esp_dataWant)
+			Esp_DataDone();
+		return;
+	}
+
+	if(c == '\n')
+	{
+		if(esp_lineLen > 0 && esp_line[esp_lineLen - 1] == '\r')
+			esp_lineLen--;
+		esp_line[esp_lineLen] = 0;
+		esp_lineLen = 0;
+		if(esp_line[0] == 0)
+			return;
+		Esp_Emit(esp_line);											//回显
+		Esp_Emit("\r\n");
+		Esp_Command(esp_line);
+		return;
+	}
+	if(esp_lineLen < ESP_LINE_SIZE - 1)
+		esp_line[esp_lineLen++] = c;
+}
+
+//==========================================================
+//	脚本事件
+//==========================================================
+void Sim_Esp_Downlink(const char *json)
+{
+	unsigned char pkt[ESP_DATA_SIZE];
+	unsigned int topicLen = strlen(mq_subTopic), msgLen = strlen(json);
+	unsigned int rem = 2 + topicLen + msgLen, n;
+
+	if(!esp_tcp || !mq_connected || topicLen == 0 || rem + 5 > sizeof(pkt))
+	{
+		Sim_Log("broker: downlink dropped, device not subscribed");
+		return;
+	}
+	pkt[0] = MQTT_PKT_PUBLISH << 4;
+	n = 1 + Mq_PutLen(pkt + 1, rem);
+	pkt[n++] = topicLen >> 8;
+	pkt[n++] = topicLen & 0xFF;
+	memcpy(pkt + n, mq_subTopic, topicLen);
+	n += topicLen;
+	memcpy(pkt + n, json, msgLen);
+	n += msgLen;
+	Sim_Log("broker: downlink %s", json);
+	mq_downTotal++;
+	Mq_Send(pkt, n);
+}
+
+void Sim_Esp_TcpClose(void)
+{
+	if(!esp_tcp)
+		return;
+	Sim_Log("esp: TCP closed by peer");
+	Esp_TcpDown();
+}
+
+void Sim_Esp_WifiDrop(unsigned int ms)
+{
+	esp_wifiDownUntil = sim_now + ms * SIM_NS_PER_MS;
+	Sim_Log("esp: WiFi lost for %u ms", ms);
+	if(esp_tcp && !esp_raw)
+		Esp_Emit("CLOSED\r\n");
+	esp_tcp = 0;
+	mq_connected = 0;
+	if(esp_wifi && !esp_raw)
+		Esp_Emit("WIFI DISCONNECT\r\n");
+	esp_wifi = 0;
+	Sim_Cancel(Esp_RawReconnect);
+	Sim_Cancel(Esp_AutoJoin);
+	Sim_Schedule(esp_wifiDownUntil + esp_joinMs * SIM_NS_PER_MS, Esp_AutoJoin, NULL, 0);
+}
+
+void Sim_Esp_SetJoinDelay(unsigned int ms)
+{
+	esp_joinMs = ms;
+}
+
+void Sim_Esp_SetBaudMax(unsigned int baud)
+{
+	esp_baudMax = baud;
+}
+
+unsigned int Sim_Esp_Baud(void)
+{
+	return esp_baud;
+}
+
+//单片机的RTS(PA1)接模块的CTS
+void Sim_Esp_Cts(int level)
+{
+	esp_cts = level;
+}
+
+//模块现在能开始发下一个字节
+int Sim_Esp_CanSend(void)
+{
+	return !esp_ctsFlow || !esp_cts;
+}
+
+int Sim_Esp_Published(const char *text)
+{
+	unsigned int i;
+
+	for(i = 0; i < mq_pubNum; i++)
+	{
+		if(strstr(mq_pub[i], text) != NULL)
+			return 1;
+	}
+	return 0;
+}
+
+int Sim_Esp_Online(void)
+{
+	return esp_tcp && mq_connected && mq_subTopic[0] != 0;
+}
+
+void Sim_Esp_Report(void)
+{
+	printf("broker  : %lu publish received, %lu downlink sent, %lu +IPD frames\n",
+		   mq_pubTotal, mq_downTotal, mq_ipdTotal);
+}
@@ -0,0 +1,927 @@
+//==========================================================
+//	主机仿真：虚拟时钟、事件队列、中断和外设库替身
+//
+//	只实现固件用到的StdPeriph函数。GPIO引脚变化转给挂在该引脚上的
+//	仿真设备(PA4/5/6/7 RC522 SPI，PB0 RC522复位，PB10/11 OLED I2C)
+//	硬件SPI1(含DMA1通道2/3突发)按字节换算成同样的引脚时序交给RC522
+//	USART2两端波特率不一致时，收发的每个字节都变成0xFF
+//	STOP模式：时钟全停，只有使能的EXTI能唤醒；唤醒后按HSI运行，直到固件重新切到PLL，
+//	这段时间SysTick节拍不走，固件用delay_skip补
+//==========================================================
+
+#include "sim.h"
+#include "bsp_log.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+GPIO_TypeDef Sim_GPIOA, Sim_GPIOB, Sim_GPIOC;
+USART_TypeDef Sim_USART1 = {USART_FLAG_TXE | USART_FLAG_TC};
+USART_TypeDef Sim_USART2 = {USART_FLAG_TXE | USART_FLAG_TC};
+SPI_TypeDef Sim_SPI1 = {.SR = SPI_I2S_FLAG_TXE};
+DMA_Channel_TypeDef Sim_DMA1_Channel2, Sim_DMA1_Channel3, Sim_DMA1_Channel4, Sim_DMA1_Channel7;
+
+uint64_t sim_now = 0;
+int sim_verbose = 0;
+
+//固件中断服务函数
+void USART2_IRQHandler(void);
+void DMA1_Channel4_IRQHandler(void);
+void DMA1_Channel7_IRQHandler(void);
+void EXTI1_IRQHandler(void);
+void EXTI3_IRQHandler(void);
+
+//==========================================================
+//	事件队列(按时间排序的最小堆，同一时刻按加入顺序)
+//==========================================================
+typedef struct
+{
+	uint64_t at;
+	uint32_t seq;
+	Sim_EventFn fn;
+	void *p;
+	int a;
+} Sim_Event;
+
+static Sim_Event *sim_ev = NULL;
+static int sim_evNum = 0, sim_evCap = 0;
+static uint32_t sim_evSeq = 0;
+static int sim_busy = 0;							//正在执行事件或中断，期间只推进时间
+
+static int Sim_EvLess(const Sim_Event *x, const Sim_Event *y)
+{
+	return x->at < y->at || (x->at == y->at && x->seq < y->seq);
+}
+
+static void Sim_EvDown(int i)
+{
+	Sim_Event t;
+	int c;
+
+	while((c = i * 2 + 1) < sim_evNum)
+	{
+		if(c + 1 < sim_evNum && Sim_EvLess(&sim_ev[c + 1], &sim_ev[c]))
+			c++;
+		if(!Sim_EvLess(&sim_ev[c], &sim_ev[i]))
+			break;
+		t = sim_ev[c]; sim_ev[c] = sim_ev[i]; sim_ev[i] = t;
+		i = c;
+	}
+}
+
+void Sim_Schedule(uint64_t at, Sim_EventFn fn, void *p, int a)
+{
+	Sim_Event t;
+	int i;
+
+	if(sim_evNum == sim_evCap)
+	{
+		sim_evCap = sim_evCap ? sim_evCap * 2 : 64;
+		sim_ev = realloc(sim_ev, sim_evCap * sizeof(Sim_Event));
+	}
+	i = sim_evNum++;
+	sim_ev[i].at = at < sim_now ? sim_now : at;
+	sim_ev[i].seq = sim_evSeq++;
+	sim_ev[i].fn = fn;
+	sim_ev[i].p = p;
+	sim_ev[i].a = a;
+	while(i > 0 && Sim_EvLess(&sim_ev[i], &sim_ev[(i - 1) / 2]))
+	{
+		t = sim_ev[i]; sim_ev[i] = sim_ev[(i - 1) / 2]; sim_ev[(i - 1) / 2] = t;
+		i = (i - 1) / 2;
+	}
+}
+
+//取消某类事件(用于设备命令被中止)
+void Sim_Cancel(Sim_EventFn fn)
+{
+	int i, n = 0;
+
+	for(i = 0; i < sim_evNum; i++)
+	{
+		if(sim_ev[i].fn != fn)
+			sim_ev[n++] = sim_ev[i];
+	}
+	sim_evNum = n;
+	for(i = sim_evNum / 2 - 1; i >= 0; i--)
+		Sim_EvDown(i);
+}
+
+//==========================================================
+//	中断
+//==========================================================
+static uint32_t sim_nvicEn[2];
+static uint32_t sim_extiEn = 0, sim_extiPending = 0;
+
+static int Sim_NvicEnabled(int irq)
+{
+	return (sim_nvicEn[irq >> 5] >> (irq & 31)) & 1;
+}
+
+static _Bool sim_stopWake = 0;
+
+void Sim_ExtiEdge(uint32_t line)
+{
+	if(sim_extiEn & line)
+	{
+		sim_extiPending |= line;
+		sim_stopWake = 1;
+	}
+}
+
+static void Sim_ServiceIrq(void)
+{
+	int n = 8;
+
+	while((sim_extiPending & EXTI_Line1) && Sim_NvicEnabled(EXTI1_IRQn) && n--)
+		EXTI1_IRQHandler();
+	n = 8;
+	while((sim_extiPending & EXTI_Line3) && Sim_NvicEnabled(EXTI3_IRQn) && n--)
+		EXTI3_IRQHandler();
+}
+
+//==========================================================
+//	虚拟时钟
+//==========================================================
+static uint64_t sim_idleNs = 0;
+
+//系统时钟：72=PLL，8=HSI(STOP唤醒后)，0=STOP；DWT按它计数，不是PLL时SysTick节拍不走
+static unsigned int sim_mhz = 72;
+static uint64_t sim_clkAt = 0;						//上次切换时钟的时刻
+static uint64_t sim_cycBase = 0;					//那时的DWT计数
+static int64_t sim_tickLost = 0;					//节拍比虚拟时钟少走的ns(STOP期间)，delay_skip补回
+static uint64_t sim_stopNs = 0, sim_hsiNs = 0;
+static unsigned long sim_stops = 0;
+
+static void Sim_RunUntil(uint64_t t)
+{
+	Sim_Event ev;
+
+	if(sim_busy)
+	{
+		if(t > sim_now)
+			sim_now = t;
+		return;
+	}
+
+	sim_busy = 1;
+	Sim_ServiceIrq();
+	while(sim_evNum > 0 && sim_ev[0].at <= t)
+	{
+		ev = sim_ev[0];
+		sim_ev[0] = sim_ev[--sim_evNum];
+		Sim_EvDown(0);
+		if(ev.at > sim_now)
+			sim_now = ev.at;
+		ev.fn(ev.p, ev.a);
+		Sim_ServiceIrq();
+	}
+	if(t > sim_now)
+		sim_now = t;
+	sim_busy = 0;
+}
+
+void Sim_Advance(uint64_t ns)
+{
+	Sim_RunUntil(sim_now + ns);
+}
+
+//休眠到下一个设备事件或下一个1ms节拍中断
+void Sim_WFI(void)
+{
+	uint64_t next = (sim_now / SIM_NS_PER_MS + 1) * SIM_NS_PER_MS;
+
+	if(sim_evNum > 0 && sim_ev[0].at < next)
+		next = sim_ev[0].at;
+	if(sim_extiPending)
+		next = sim_now;
+	if(next < sim_now)
+		next = sim_now;
+	sim_idleNs += next - sim_now;
+	Sim_RunUntil(next);
+}
+
+void Sim_Log(const char *fmt, ...)
+{
+	va_list ap;
+
+	printf("[%9.3f] ", sim_now / 1e6);
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+	printf("\n");
+}
+
+//==========================================================
+//	系统、延时和1ms节拍(替代system_stm32f10x.c、delay.c)
+//==========================================================
+void SystemInit(void)
+{
+}
+
+void delay_init(u8 SYSCLK)
+{
+	(void)SYSCLK;
+}
+
+void delay_us(u32 nus)
+{
+	Sim_Advance(nus * SIM_NS_PER_US);
+}
+
+void delay_ms(u16 nms)
+{
+	Sim_Advance(nms * SIM_NS_PER_MS);
+}
+
+//节拍时间：虚拟时钟减去STOP以来没补回的部分
+static uint64_t Sim_TickNs(void)
+{
+	int64_t lost = sim_tickLost;
+
+	if(sim_mhz != 72)
+		lost += sim_now - sim_clkAt;
+	return sim_now - lost;
+}
+
+//SysTick节拍；取时间也算一点主循环开销，否则按节拍等待的循环会停在同一时刻
+u32 millis(void)
+{
+	Sim_Advance(SIM_NS_TICK);
+	return (u32)(Sim_TickNs() / SIM_NS_PER_MS);
+}
+
+u32 micros(void)
+{
+	Sim_Advance(SIM_NS_TICK);
+	return (u32)(Sim_TickNs() / SIM_NS_PER_US);
+}
+
+void delay_skip(u32 nms)
+{
+	sim_tickLost -= (int64_t)nms * SIM_NS_PER_MS;
+}
+
+//DWT->CYCCNT：按当前系统时钟计数，32位回绕
+unsigned int Sim_Cycles(void)
+{
+	return (unsigned int)(sim_cycBase + (sim_now - sim_clkAt) * sim_mhz / 1000);
+}
+
+static void Sim_Clock(unsigned int mhz)
+{
+	if(sim_mhz == 0)
+		sim_stopNs += sim_now - sim_clkAt;
+	else if(sim_mhz != 72)
+		sim_hsiNs += sim_now - sim_clkAt;
+	if(sim_mhz != 72)
+		sim_tickLost += sim_now - sim_clkAt;
+	sim_cycBase += (sim_now - sim_clkAt) * sim_mhz / 1000;
+	sim_clkAt = sim_now;
+	sim_mhz = mhz;
+}
+
+//==========================================================
+//	PWR / RCC：STOP模式和唤醒后恢复HSE、PLL
+//==========================================================
+#define SIM_NS_STOP_WAKE	5400				//低功耗调压器下STOP唤醒时间
+#define SIM_NS_HSE_START	1500000				//8MHz晶振起振
+#define SIM_NS_HSE_TIMEOUT	1600000				//RCC_WaitForHSEStartUp在HSI上等满HSE_STARTUP_TIMEOUT
+#define SIM_NS_PLL_LOCK		200000
+
+static uint64_t sim_hseReady = 0, sim_pllReady = 0;
+static _Bool sim_hseOn = 1, sim_pllOn = 1;
+static int sim_hseSlow = 0;						//接下来这么多次等HSE超时
+
+void Sim_HseSlow(int n)
+{
+	sim_hseSlow = n;
+}
+
+unsigned int Sim_Mhz(void)
+{
+	return sim_mhz;
+}
+
+//仿真不能复位重来，当作失败退出
+void Sim_SystemReset(void)
+{
+	Sim_Log("sim: NVIC_SystemReset");
+	exit(1);
+}
+
+//时钟停着，只执行设备事件，直到有使能的EXTI边沿
+void PWR_EnterSTOPMode(uint32_t PWR_Regulator, uint8_t PWR_STOPEntry)
+{
+	(void)PWR_Regulator; (void)PWR_STOPEntry;
+	sim_stops++;
+	sim_stopWake = 0;
+	sim_hseOn = sim_pllOn = 0;
+	Sim_Clock(0);
+	while(!sim_stopWake && !sim_extiPending && sim_evNum > 0)
+		Sim_RunUntil(sim_ev[0].at);
+	Sim_Advance(SIM_NS_STOP_WAKE);
+	Sim_Clock(8);
+}
+
+void RCC_HSEConfig(uint32_t RCC_HSE)
+{
+	if(RCC_HSE == RCC_HSE_ON && !sim_hseOn)
+	{
+		sim_hseOn = 1;
+		sim_hseReady = sim_now + SIM_NS_HSE_START;
+	}
+}
+
+ErrorStatus RCC_WaitForHSEStartUp(void)
+{
+	if(sim_hseSlow > 0)
+	{
+		sim_hseSlow--;
+		Sim_Advance(SIM_NS_HSE_TIMEOUT);
+		sim_hseReady = sim_now + SIM_NS_HSE_START;
+		return ERROR;
+	}
+	if(sim_now < sim_hseReady)
+		Sim_Advance(sim_hseReady - sim_now);
+	return SUCCESS;
+}
+
+void RCC_PLLCmd(FunctionalState NewState)
+{
+	if(NewState != DISABLE && !sim_pllOn)
+	{
+		sim_pllOn = 1;
+		sim_pllReady = sim_now + SIM_NS_PLL_LOCK;
+	}
+}
+
+FlagStatus RCC_GetFlagStatus(uint8_t RCC_FLAG)
+{
+	Sim_Advance(SIM_NS_GPIO);
+	if(RCC_FLAG == RCC_FLAG_PLLRDY)
+		return (sim_pllOn && sim_now >= sim_pllReady) ? SET : RESET;
+	if(RCC_FLAG == RCC_FLAG_HSERDY)
+		return (sim_hseOn && sim_now >= sim_hseReady) ? SET : RESET;
+	return RESET;
+}
+
+void RCC_SYSCLKConfig(uint32_t RCC_SYSCLKSource)
+{
+	if(RCC_SYSCLKSource == RCC_SYSCLKSource_PLLCLK && sim_pllOn)
+		Sim_Clock(72);
+}
+
+uint8_t RCC_GetSYSCLKSource(void)
+{
+	return sim_mhz == 72 ? 0x08 : 0x00;
+}
+
+//==========================================================
+//	RCC / NVIC / EXTI
+//==========================================================
+void RCC_APB2PeriphClockCmd(uint32_t RCC_APB2Periph, FunctionalState NewState)
+{
+	(void)RCC_APB2Periph; (void)NewState;
+}
+
+void RCC_APB1PeriphClockCmd(uint32_t RCC_APB1Periph, FunctionalState NewState)
+{
+	(void)RCC_APB1Periph; (void)NewState;
+}
+
+void RCC_AHBPeriphClockCmd(uint32_t RCC_AHBPeriph, FunctionalState NewState)
+{
+	(void)RCC_AHBPeriph; (void)NewState;
+}
+
+void NVIC_Init(NVIC_InitTypeDef* NVIC_InitStruct)
+{
+	int irq = NVIC_InitStruct->NVIC_IRQChannel;
+
+	if(NVIC_InitStruct->NVIC_IRQChannelCmd != DISABLE)
+		sim_nvicEn[irq >> 5] |= 1u << (irq & 31);
+	else
+		sim_nvicEn[irq >> 5] &= ~(1u << (irq & 31));
+}
+
+void EXTI_Init(EXTI_InitTypeDef* EXTI_InitStruct)
+{
+	if(EXTI_InitStruct->EXTI_LineCmd != DISABLE)
+		sim_extiEn |= EXTI_InitStruct->EXTI_Line;
+	else
+		sim_extiEn &= ~EXTI_InitStruct->EXTI_Line;
+}
+
+ITStatus EXTI_GetITStatus(uint32_t EXTI_Line)
+{
+	return (sim_extiPending & EXTI_Line) ? SET : RESET;
+}
+
+void EXTI_ClearITPendingBit(uint32_t EXTI_Line)
+{
+	sim_extiPending &= ~EXTI_Line;
+}
+
+void GPIO_EXTILineConfig(uint8_t GPIO_PortSource, uint8_t GPIO_PinSource)
+{
+	(void)GPIO_PortSource; (void)GPIO_PinSource;
+}
+
+//==========================================================
+//	GPIO
+//==========================================================
+static void Sim_Usart2_Start(void);
+
+static void Sim_GpioWrite(GPIO_TypeDef *GPIOx, uint32_t odr)
+{
+	uint32_t changed = GPIOx->ODR ^ odr;
+
+	GPIOx->ODR = odr;
+	if(GPIOx == GPIOA && (changed & GPIO_Pin_1))
+	{
+		Sim_Esp_Cts(!!(odr & GPIO_Pin_1));				//PA1当RTS接模块的CTS
+		Sim_Usart2_Start();
+	}
+	if(GPIOx == GPIOA && (changed & (GPIO_Pin_4 | GPIO_Pin_5 | GPIO_Pin_7)))
+		Sim_Rc522_Spi(!!(odr & GPIO_Pin_4), !!(odr & GPIO_Pin_5), !!(odr & GPIO_Pin_7));
+	if(GPIOx == GPIOB && (changed & GPIO_Pin_0))
+		Sim_Rc522_Rst(!!(odr & GPIO_Pin_0));
+	if(GPIOx == GPIOB && (changed & (GPIO_Pin_10 | GPIO_Pin_11)))
+		Sim_Oled_I2c(!!(odr & GPIO_Pin_11), !!(odr & GPIO_Pin_10));
+	Sim_Advance(SIM_NS_GPIO);
+}
+
+void GPIO_Init(GPIO_TypeDef* GPIOx, GPIO_InitTypeDef* GPIO_InitStruct)
+{
+	(void)GPIOx; (void)GPIO_InitStruct;
+	Sim_Advance(SIM_NS_GPIO);
+}
+
+void GPIO_SetBits(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+	Sim_GpioWrite(GPIOx, GPIOx->ODR | GPIO_Pin);
+}
+
+void GPIO_ResetBits(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+	Sim_GpioWrite(GPIOx, GPIOx->ODR & ~GPIO_Pin);
+}
+
+void GPIO_WriteBit(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, BitAction BitVal)
+{
+	if(BitVal != Bit_RESET)
+		GPIO_SetBits(GPIOx, GPIO_Pin);
+	else
+		GPIO_ResetBits(GPIOx, GPIO_Pin);
+}
+
+uint8_t GPIO_ReadOutputDataBit(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+	Sim_Advance(SIM_NS_GPIO);
+	return (GPIOx->ODR & GPIO_Pin) ? Bit_SET : Bit_RESET;
+}
+
+uint8_t GPIO_ReadInputDataBit(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+	Sim_Advance(SIM_NS_GPIO);
+	if(GPIOx == GPIOA && GPIO_Pin == GPIO_Pin_6)
+		return Sim_Rc522_Miso();
+	return (GPIOx->IDR & GPIO_Pin) ? Bit_SET : Bit_RESET;
+}
+
+//==========================================================
+//	USART
+//	USART1是调试串口，按行输出(-v)；USART2接仿真ESP8266
+//==========================================================
+typedef struct
+{
+	uint32_t baud;
+	_Bool rxneIe, dmaTx;
+	unsigned long txBytes, rxBytes, rxLost, garbled;
+} Sim_UsartState;
+
+static Sim_UsartState sim_usart[2];
+static char sim_logLine[512];
+static unsigned int sim_logLen = 0;
+
+static Sim_UsartState *Sim_Usart(USART_TypeDef *USARTx)
+{
+	return &sim_usart[USARTx == USART2];
+}
+
+//一个字节(8N1共10位)的传输时间
+static uint64_t Sim_UsartByteNs(Sim_UsartState *u)
+{
+	return 10ULL * 1000000000ULL / (u->baud ? u->baud : 115200);
+}
+
+void USART_Init(USART_TypeDef* USARTx, USART_InitTypeDef* USART_InitStruct)
+{
+	Sim_Usart(USARTx)->baud = USART_InitStruct->USART_BaudRate;
+}
+
+void USART_Cmd(USART_TypeDef* USARTx, FunctionalState NewState)
+{
+	(void)USARTx; (void)NewState;
+}
+
+void USART_ITConfig(USART_TypeDef* USARTx, uint16_t USART_IT, FunctionalState NewState)
+{
+	if(USART_IT == USART_IT_RXNE)
+		Sim_Usart(USARTx)->rxneIe = (NewState != DISABLE);
+}
+
+static void Sim_LogByte(unsigned char c)
+{
+	if(c == '\n' || sim_logLen >= sizeof(sim_logLine) - 1)
+	{
+		while(sim_logLen > 0 && sim_logLine[sim_logLen - 1] == '\r')
+			sim_logLen--;
+		sim_logLine[sim_logLen] = 0;
+		if(sim_verbose)
+			printf("[%9.3f] | %s\n", sim_now / 1e6, sim_logLine);
+		sim_logLen = 0;
+		if(c == '\n')
+			return;
+	}
+	sim_logLine[sim_logLen++] = c;
+}
+
+//USART2线上的一个字节：两端波特率不同时对方收到的是乱码
+static unsigned char Sim_Usart2_Line(unsigned char c)
+{
+	if(sim_usart[1].baud == Sim_Esp_Baud())
+		return c;
+	sim_usart[1].garbled++;
+	return 0xFF;
+}
+
+//发送一个字节，调用者随后查询TC/TXE，这里直接把整字节时间算进去
+void USART_SendData(USART_TypeDef* USARTx, uint16_t Data)
+{
+	Sim_UsartState *u = Sim_Usart(USARTx);
+
+	u->txBytes++;
+	if(USARTx == USART1)
+		Sim_LogByte((unsigned char)Data);
+	else
+		Sim_Esp_Tx(Sim_Usart2_Line((unsigned char)Data));
+	Sim_Advance(Sim_UsartByteNs(u));
+}
+
+void USART_DMACmd(USART_TypeDef* USARTx, uint16_t USART_DMAReq, FunctionalState NewState)
+{
+	if(USART_DMAReq & USART_DMAReq_Tx)
+		Sim_Usart(USARTx)->dmaTx = (NewState != DISABLE);
+}
+
+unsigned int Sim_Usart2_Baud(void)
+{
+	return sim_usart[1].baud;
+}
+
+//==========================================================
+//	DMA1通道4/7：内存到USART1/USART2->DR，按波特率每个字节一个事件
+//==========================================================
+typedef struct
+{
+	DMA_Channel_TypeDef *ch;
+	Sim_UsartState *u;
+	int irq;
+	uint32_t tcFlags;
+	void (*handler)(void);
+	uint32_t pos;									//本次已发送的字节数
+} Sim_DmaState;
+
+static uint32_t sim_dmaIsr = 0;
+static void Sim_Spi_DmaBurst(void);
+static Sim_DmaState sim_dma[2] =
+{
+	{&Sim_DMA1_Channel4, &sim_usart[0], DMA1_Channel4_IRQn, DMA1_IT_TC4 | DMA1_IT_GL4, DMA1_Channel4_IRQHandler},
+	{&Sim_DMA1_Channel7, &sim_usart[1], DMA1_Channel7_IRQn, DMA1_IT_TC7 | DMA1_IT_GL7, DMA1_Channel7_IRQHandler},
+};
+
+static void Sim_Dma_Pump(void *p, int a)
+{
+	Sim_DmaState *d = p;
+	DMA_Channel_TypeDef *ch = d->ch;
+	unsigned char c;
+
+	(void)a;
+	if(!(ch->CCR & DMA_CCR1_EN) || ch->CNDTR == 0)
+		return;
+	c = ((const unsigned char *)(uintptr_t)ch->CMAR)[d->pos++];
+	d->u->txBytes++;
+	if(d->u == &sim_usart[0])
+		Sim_LogByte(c);
+	else
+		Sim_Esp_Tx(Sim_Usart2_Line(c));
+	if(--ch->CNDTR > 0)
+	{
+		Sim_Schedule(sim_now + Sim_UsartByteNs(d->u), Sim_Dma_Pump, d, 0);
+		return;
+	}
+	sim_dmaIsr |= d->tcFlags;
+	if((ch->CCR & DMA_CCR1_TCIE) && Sim_NvicEnabled(d->irq))
+		d->handler();
+}
+
+static Sim_DmaState *Sim_Dma(DMA_Channel_TypeDef *ch)
+{
+	return ch == sim_dma[0].ch ? &sim_dma[0] : ch == sim_dma[1].ch ? &sim_dma[1] : NULL;
+}
+
+//取消某个通道的在途事件(Sim_Cancel按函数取消，两个通道共用Sim_Dma_Pump，所以重排)
+static void Sim_DmaStop(Sim_DmaState *d)
+{
+	Sim_DmaState *other = d == &sim_dma[0] ? &sim_dma[1] : &sim_dma[0];
+	DMA_Channel_TypeDef *och = other->ch;
+
+	Sim_Cancel(Sim_Dma_Pump);
+	if((och->CCR & DMA_CCR1_EN) && och->CNDTR > 0)
+		Sim_Schedule(sim_now + Sim_UsartByteNs(other->u), Sim_Dma_Pump, other, 0);
+}
+
+void DMA_DeInit(DMA_Channel_TypeDef* DMAy_Channelx)
+{
+	memset(DMAy_Channelx, 0, sizeof(*DMAy_Channelx));
+}
+
+void DMA_Init(DMA_Channel_TypeDef* DMAy_Channelx, DMA_InitTypeDef* DMA_InitStruct)
+{
+	DMAy_Channelx->CPAR = DMA_InitStruct->DMA_PeripheralBaseAddr;
+	DMAy_Channelx->CMAR = DMA_InitStruct->DMA_MemoryBaseAddr;
+	DMAy_Channelx->CNDTR = DMA_InitStruct->DMA_BufferSize;
+}
+
+void DMA_ITConfig(DMA_Channel_TypeDef* DMAy_Channelx, uint32_t DMA_IT, FunctionalState NewState)
+{
+	if(NewState != DISABLE)
+		DMAy_Channelx->CCR |= DMA_IT;
+	else
+		DMAy_Channelx->CCR &= ~DMA_IT;
+}
+
+void DMA_SetCurrDataCounter(DMA_Channel_TypeDef* DMAy_Channelx, uint16_t DataNumber)
+{
+	DMAy_Channelx->CNDTR = DataNumber;
+}
+
+uint16_t DMA_GetCurrDataCounter(DMA_Channel_TypeDef* DMAy_Channelx)
+{
+	return DMAy_Channelx->CNDTR;
+}
+
+void DMA_Cmd(DMA_Channel_TypeDef* DMAy_Channelx, FunctionalState NewState)
+{
+	Sim_DmaState *d = Sim_Dma(DMAy_Channelx);
+
+	if(NewState == DISABLE)
+	{
+		if(d != NULL && (DMAy_Channelx->CCR & DMA_CCR1_EN) && DMAy_Channelx->CNDTR > 0)
+		{
+			DMAy_Channelx->CCR &= ~DMA_CCR1_EN;
+			Sim_DmaStop(d);
+		}
+		DMAy_Channelx->CCR &= ~DMA_CCR1_EN;
+		return;
+	}
+	DMAy_Channelx->CCR |= DMA_CCR1_EN;
+	if(DMAy_Channelx == &Sim_DMA1_Channel3)
+		Sim_Spi_DmaBurst();
+	if(d != NULL && d->u->dmaTx && DMAy_Channelx->CNDTR > 0)
+	{
+		d->pos = 0;
+		Sim_Schedule(sim_now + Sim_UsartByteNs(d->u), Sim_Dma_Pump, d, 0);
+	}
+}
+
+ITStatus DMA_GetITStatus(uint32_t DMAy_IT)
+{
+	return (sim_dmaIsr & DMAy_IT) ? SET : RESET;
+}
+
+void DMA_ClearITPendingBit(uint32_t DMAy_IT)
+{
+	sim_dmaIsr &= ~DMAy_IT;
+}
+
+FlagStatus DMA_GetFlagStatus(uint32_t DMAy_FLAG)
+{
+	return (sim_dmaIsr & DMAy_FLAG) ? SET : RESET;
+}
+
+void DMA_ClearFlag(uint32_t DMAy_FLAG)
+{
+	sim_dmaIsr &= ~DMAy_FLAG;
+}
+
+//==========================================================
+//	SPI1：RC522硬件SPI，模式0、高位先出；片选仍是PA4的GPIO
+//	发一个字节就地按位驱动RC522，收到的字节放进DR并置RXNE，BSY不会出现
+//==========================================================
+static unsigned long sim_spiBytes = 0, sim_spiBursts = 0, sim_spiBurstBytes = 0;
+
+static unsigned char Sim_Spi_Byte(unsigned char b)
+{
+	int cs = !!(GPIOA->ODR & GPIO_Pin_4);
+	unsigned char in = 0;
+	int i;
+
+	for(i = 7; i >= 0; i--)
+	{
+		Sim_Rc522_Spi(cs, 0, (b >> i) & 1);
+		Sim_Rc522_Spi(cs, 1, (b >> i) & 1);
+		in = (in << 1) | Sim_Rc522_Miso();
+	}
+	Sim_Rc522_Spi(cs, 0, 0);
+	Sim_Advance(SIM_NS_SPI_BYTE);
+	sim_spiBytes++;
+	return in;
+}
+
+void SPI_Init(SPI_TypeDef* SPIx, SPI_InitTypeDef* SPI_InitStruct)
+{
+	(void)SPIx; (void)SPI_InitStruct;
+}
+
+void SPI_Cmd(SPI_TypeDef* SPIx, FunctionalState NewState)
+{
+	if(NewState != DISABLE)
+		SPIx->CR1 |= SPI_CR1_SPE;
+	else
+		SPIx->CR1 &= ~SPI_CR1_SPE;
+}
+
+void SPI_I2S_DMACmd(SPI_TypeDef* SPIx, uint16_t SPI_I2S_DMAReq, FunctionalState NewState)
+{
+	if(NewState != DISABLE)
+		SPIx->CR2 |= SPI_I2S_DMAReq;
+	else
+		SPIx->CR2 &= ~SPI_I2S_DMAReq;
+}
+
+void SPI_I2S_SendData(SPI_TypeDef* SPIx, uint16_t Data)
+{
+	SPIx->DR = Sim_Spi_Byte(Data);
+	SPIx->SR |= SPI_I2S_FLAG_RXNE;
+}
+
+uint16_t SPI_I2S_ReceiveData(SPI_TypeDef* SPIx)
+{
+	SPIx->SR &= ~SPI_I2S_FLAG_RXNE;
+	return SPIx->DR;
+}
+
+FlagStatus SPI_I2S_GetFlagStatus(SPI_TypeDef* SPIx, uint16_t SPI_I2S_FLAG)
+{
+	return (SPIx->SR & SPI_I2S_FLAG) ? SET : RESET;
+}
+
+//通道3(发)使能时整段传输：通道3从内存取字节发出，收到的字节由通道2写回内存
+static void Sim_Spi_DmaBurst(void)
+{
+	DMA_Channel_TypeDef *rx = &Sim_DMA1_Channel2, *tx = &Sim_DMA1_Channel3;
+	const unsigned char *src = (const unsigned char *)(uintptr_t)tx->CMAR;
+	unsigned char *dst = (unsigned char *)(uintptr_t)rx->CMAR;
+	uint32_t i, n = tx->CNDTR;
+
+	if(!(Sim_SPI1.CR1 & SPI_CR1_SPE) || (Sim_SPI1.CR2 & (SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx)) !=
+	   (SPI_I2S_DMAReq_Rx | SPI_I2S_DMAReq_Tx) || !(rx->CCR & DMA_CCR1_EN) || rx->CNDTR != n)
+	{
+		Sim_Log("sim: SPI1 DMA burst without SPI/RX channel set up");
+		exit(1);
+	}
+	for(i = 0; i < n; i++)
+		dst[i] = Sim_Spi_Byte(src[i]);
+	rx->CNDTR = tx->CNDTR = 0;
+	sim_spiBursts++;
+	sim_spiBurstBytes += n;
+	sim_dmaIsr |= DMA1_FLAG_TC2 | DMA1_FLAG_GL2 | DMA1_FLAG_TC3 | DMA1_FLAG_GL3;
+}
+
+uint16_t USART_ReceiveData(USART_TypeDef* USARTx)
+{
+	USARTx->SR &= ~USART_FLAG_RXNE;
+	return USARTx->DR;
+}
+
+FlagStatus USART_GetFlagStatus(USART_TypeDef* USARTx, uint16_t USART_FLAG)
+{
+	return (USARTx->SR & USART_FLAG) ? SET : RESET;
+}
+
+void USART_ClearFlag(USART_TypeDef* USARTx, uint16_t USART_FLAG)
+{
+	USARTx->SR &= ~USART_FLAG;
+}
+
+ITStatus USART_GetITStatus(USART_TypeDef* USARTx, uint16_t USART_IT)
+{
+	if(USART_IT == USART_IT_RXNE)
+		return (Sim_Usart(USARTx)->rxneIe && (USARTx->SR & USART_FLAG_RXNE)) ? SET : RESET;
+	return RESET;
+}
+
+//printf：格式化后逐字节走usart.c的fputc
+int Sim_Printf(const char *fmt, ...)
+{
+	char buf[512];
+	va_list ap;
+	int n, i;
+
+	va_start(ap, fmt);
+	n = vsnprintf(buf, sizeof(buf), fmt, ap);
+	va_end(ap);
+	if(n > (int)sizeof(buf) - 1)
+		n = sizeof(buf) - 1;
+	for(i = 0; i < n; i++)
+		fputc(buf[i], stdout);
+	return n;
+}
+
+//==========================================================
+//	USART2接收：ESP8266的输出按波特率逐字节送进USART2_IRQHandler
+//==========================================================
+#define SIM_U2_RX_SIZE		65536
+static unsigned char sim_u2Rx[SIM_U2_RX_SIZE];
+static unsigned int sim_u2Head = 0, sim_u2Tail = 0;
+static _Bool sim_u2Busy = 0;
+
+//接收的字节按模块那边的波特率计时
+static uint64_t Sim_Usart2_RxByteNs(void)
+{
+	return 10ULL * 1000000000ULL / Sim_Esp_Baud();
+}
+
+static void Sim_Usart2_Pump(void *p, int a)
+{
+	Sim_UsartState *u = &sim_usart[1];
+
+	(void)p; (void)a;
+	USART2->DR = Sim_Usart2_Line(sim_u2Rx[sim_u2Tail]);
+	sim_u2Tail = (sim_u2Tail + 1) % SIM_U2_RX_SIZE;
+	USART2->SR |= USART_FLAG_RXNE;
+	Sim_ExtiEdge(EXTI_Line3);							//RX引脚(PA3)的起始位
+	if(u->rxneIe && sim_mhz == 72 && Sim_NvicEnabled(USART2_IRQn))
+	{
+		u->rxBytes++;
+		USART2_IRQHandler();
+	}
+	else
+		u->rxLost++;
+	USART2->SR &= ~USART_FLAG_RXNE;						//读DR清RXNE
+
+	sim_u2Busy = 0;
+	Sim_Usart2_Start();
+}
+
+//模块开始发下一个字节：CTS流控打开且RTS为高时停在字节之间，RTS拉低后接着发
+static void Sim_Usart2_Start(void)
+{
+	if(!sim_u2Busy && sim_u2Head != sim_u2Tail && Sim_Esp_CanSend())
+	{
+		sim_u2Busy = 1;
+		Sim_Schedule(sim_now + Sim_Usart2_RxByteNs(), Sim_Usart2_Pump, NULL, 0);
+	}
+}
+
+void Sim_Usart2_Rx(const void *data, unsigned int len)
+{
+	const unsigned char *d = data;
+
+	while(len--)
+	{
+		sim_u2Rx[sim_u2Head] = *d++;
+		sim_u2Head = (sim_u2Head + 1) % SIM_U2_RX_SIZE;
+	}
+	Sim_Usart2_Start();
+}
+
+//还没送进USART2的字节数(含正在传输的一个)
+unsigned int Sim_Usart2_RxPending(void)
+{
+	return (sim_u2Head + SIM_U2_RX_SIZE - sim_u2Tail) % SIM_U2_RX_SIZE;
+}
+
+void Sim_Hal_Report(void)
+{
+	printf("cpu     : idle(WFI) %.1f%% of %.3f s\n",
+		   sim_now ? 100.0 * sim_idleNs / sim_now : 0.0, sim_now / 1e9);
+	printf("usart1  : %lu bytes logged, %u log lines dropped\n", sim_usart[0].txBytes, Log_Dropped());
+	printf("usart2  : %u baud, tx %lu bytes, rx %lu bytes, rx lost %lu, garbled %lu\n",
+		   sim_usart[1].baud, sim_usart[1].txBytes, sim_usart[1].rxBytes, sim_usart[1].rxLost,
+		   sim_usart[1].garbled);
+	if(sim_spiBytes)
+		printf("spi1    : %lu bytes, %lu DMA bursts (%lu bytes)\n", sim_spiBytes, sim_spiBursts, sim_spiBurstBytes);
+	if(sim_stops)
+		printf("power   : stop %.1f%%, %lu stops, %.1f ms on HSI, ticks %+.3f ms off\n",
+			   100.0 * sim_stopNs / sim_now, sim_stops, sim_hsiNs / 1e6, -(double)sim_tickLost / 1e6);
+}
+
+//STOP占的时间百分比
+double Sim_StopPercent(void)
+{
+	return sim_now ? 100.0 * sim_stopNs / sim_now : 0.0;
+}
@@ -0,0 +1,352 @@
+//==========================================================
+//	主机仿真：入口和场景脚本
+//
+//	用法：rfid2_sim [-v] 场景文件
+//	  -v  同时输出固件经USART1打印的日志
+//
+//	场景文件每行一条：at <毫秒> <动作> [参数]，#开头为注释
+//	  card <UID> [blank|legacy N|value N]   卡片放到天线区，UID为4/7/10字节；已经在的卡不拿走
+//	  remove [UID]                          拿走这张卡，不给UID时拿走全部
+//	  drop_reqa <次数>                      之后这么多次REQA卡片都收不到(干扰)
+//	  taps <次数> <间隔ms> <UID> [UID...]     轮流刷这些卡，每次在场半个间隔
+//	  downlink <json>                       平台向订阅主题下发消息
+//	  tcp_close                             服务器断开TCP
+//	  wifi_drop [毫秒]                      WiFi断开，期间无法重新加入
+//	  wifi_delay <毫秒>                     之后AT+CWJAP的耗时
+//	  esp_baud_max <波特率>                 模块AT+UART_CUR能接受的最高波特率，0=不支持该命令
+//	  oled                                  把OLED内容画到终端
+//	  expect balance <UID> <N>              卡上余额应为N
+//	  expect publish <文本>                 服务器收到过包含该文本的消息
+//	  expect online                         设备已连上服务器并订阅
+//	  expect baud <N>                       USART2两端都是N波特
+//	  expect stop <N>                       到此为止至少N%的时间在STOP模式
+//	  end                                   结束仿真
+//	有expect失败时退出码为1；结束时输出bsp_perf统计的各阶段耗时p50/p99
+//==========================================================
+
+#include "sim.h"
+#include "bsp_perf.h"
+#include "MqttKit.h"
+#include "MFRC522.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_DEFAULT_END_MS		60000
+
+typedef struct
+{
+	int line;
+	char *cmd;
+	char *arg;
+} Sim_Step;
+
+static const char *sim_script = "";
+static int sim_expects = 0, sim_fails = 0;
+
+int firmware_main(void);
+
+//十六进制UID，返回字节数(4、7或10)，格式不对返回0；*end指向UID后面
+static int Sim_ParseUid(const char *s, unsigned char uid[MFRC522_UID_MAX], const char **end)
+{
+	int n = 0;
+	char hex[3] = {0};
+
+	while(isxdigit((unsigned char)s[n * 2]) && isxdigit((unsigned char)s[n * 2 + 1]) && n < MFRC522_UID_MAX)
+	{
+		hex[0] = s[n * 2];
+		hex[1] = s[n * 2 + 1];
+		uid[n++] = (unsigned char)strtoul(hex, NULL, 16);
+	}
+	if(isxdigit((unsigned char)s[n * 2]) || (n != 4 && n != 7 && n != 10))
+		return 0;
+	if(end != NULL)
+		*end = s + n * 2;
+	return n;
+}
+
+static void Sim_Expect(const Sim_Step *st, int ok, const char *what)
+{
+	sim_expects++;
+	if(ok)
+		Sim_Log("expect %s: ok", what);
+	else
+	{
+		sim_fails++;
+		Sim_Log("expect %s: FAILED (%s:%d)", what, sim_script, st->line);
+	}
+}
+
+static void Sim_PerfReport(void)
+{
+	PERF_STAT st;
+	unsigned char i;
+
+	for(i = 0; i < PERF_STAGE_NUM; i++)
+	{
+		if(PERF_Stat(i, &st))
+			printf("perf    : %-10s n=%-5u p50 %8u us  p99 %8u us  max %8u us\n",
+				   PERF_Name(i), st.n, st.p50_us, st.p99_us, st.max_us);
+	}
+}
+
+static void Sim_PoolReport(void)
+{
+	MQTT_POOL_STAT st;
+
+	MQTT_PoolStat(&st);
+	printf("mqtt    : pool high %u/%u blocks, used %u, allocs %u, fails %u, max request %u bytes\n",
+		   st.high, MQTT_POOL_BLOCK_NUM, st.used, st.allocs, st.fails, st.maxSize);
+}
+
+static void Sim_Report(void)
+{
+	printf("==== %s ====\n", sim_script);
+	Sim_Hal_Report();
+	Sim_Rc522_Report();
+	Sim_Oled_Report();
+	Sim_Esp_Report();
+	Sim_PerfReport();
+	Sim_PoolReport();
+	printf("expect  : %d checked, %d failed\n", sim_expects, sim_fails);
+	fflush(stdout);
+}
+
+static void Sim_RunStep(void *p, int a)
+{
+	Sim_Step *st = p;
+	unsigned char uid[MFRC522_UID_MAX];
+	const char *rest;
+	char kind[16];
+	int32_t v;
+	long n = 0;
+	int ok, len;
+
+	(void)a;
+	if(strcmp(st->cmd, "card") == 0)
+	{
+		len = Sim_ParseUid(st->arg, uid, &rest);
+		if(!len)
+		{
+			Sim_Log("sim: %s:%d bad UID", sim_script, st->line);
+			return;
+		}
+		kind[0] = 0;
+		sscanf(rest, "%15s %ld", kind, &n);
+		if(strcmp(kind, "blank") == 0)
+			Sim_Card_Enter(uid, len, SIM_CARD_BLANK, 0);
+		else if(strcmp(kind, "legacy") == 0)
+			Sim_Card_Enter(uid, len, SIM_CARD_LEGACY, n);
+		else if(strcmp(kind, "value") == 0)
+			Sim_Card_Enter(uid, len, SIM_CARD_VALUE, n);
+		else
+			Sim_Card_Enter(uid, len, SIM_CARD_KEEP, 0);
+	}
+	else if(strcmp(st->cmd, "remove") == 0)
+	{
+		len = Sim_ParseUid(st->arg, uid, NULL);
+		Sim_Card_Remove(len ? uid : NULL, len);
+	}
+	else if(strcmp(st->cmd, "drop_reqa") == 0)
+		Sim_Card_DropReqa(atoi(st->arg));
+	else if(strcmp(st->cmd, "downlink") == 0)
+		Sim_Esp_Downlink(st->arg);
+	else if(strcmp(st->cmd, "tcp_close") == 0)
+		Sim_Esp_TcpClose();
+	else if(strcmp(st->cmd, "wifi_drop") == 0)
+		Sim_Esp_WifiDrop(st->arg[0] ? atoi(st->arg) : 3000);
+	else if(strcmp(st->cmd, "wifi_delay") == 0)
+		Sim_Esp_SetJoinDelay(atoi(st->arg));
+	else if(strcmp(st->cmd, "esp_baud_max") == 0)
+		Sim_Esp_SetBaudMax(strtoul(st->arg, NULL, 10));
+	else if(strcmp(st->cmd, "hse_slow") == 0)
+		Sim_HseSlow(atoi(st->arg));
+	else if(strcmp(st->cmd, "oled") == 0)
+	{
+		Sim_Log("oled:");
+		Sim_Oled_Dump();
+	}
+	else if(strcmp(st->cmd, "expect") == 0)
+	{
+		if(strncmp(st->arg, "balance ", 8) == 0 && (len = Sim_ParseUid(st->arg + 8, uid, &rest)) != 0)
+		{
+			n = atol(rest);
+			ok = Sim_Card_Balance(uid, len, &v) && v == n;
+			if(!ok && Sim_Card_Balance(uid, len, &v))
+				Sim_Log("sim: card balance is %ld", (long)v);
+			Sim_Expect(st, ok, st->arg);
+		}
+		else if(strncmp(st->arg, "publish ", 8) == 0)
+			Sim_Expect(st, Sim_Esp_Published(st->arg + 8), st->arg);
+		else if(strcmp(st->arg, "online") == 0)
+			Sim_Expect(st, Sim_Esp_Online(), st->arg);
+		else if(strncmp(st->arg, "baud ", 5) == 0)
+		{
+			n = atol(st->arg + 5);
+			ok = Sim_Usart2_Baud() == (unsigned int)n && Sim_Esp_Baud() == (unsigned int)n;
+			if(!ok)
+				Sim_Log("sim: baud mcu %u, esp %u", Sim_Usart2_Baud(), Sim_Esp_Baud());
+			Sim_Expect(st, ok, st->arg);
+		}
+		else if(strncmp(st->arg, "clock ", 6) == 0)
+		{
+			ok = Sim_Mhz() == (unsigned int)atoi(st->arg + 6);
+			if(!ok)
+				Sim_Log("sim: clock %u MHz", Sim_Mhz());
+			Sim_Expect(st, ok, st->arg);
+		}
+		else if(strncmp(st->arg, "stop_below ", 11) == 0)
+		{
+			ok = Sim_StopPercent() < atof(st->arg + 11);
+			if(!ok)
+				Sim_Log("sim: stop %.1f%%", Sim_StopPercent());
+			Sim_Expect(st, ok, st->arg);
+		}
+		else if(strncmp(st->arg, "stop ", 5) == 0)
+		{
+			ok = Sim_StopPercent() >= atof(st->arg + 5);
+			if(!ok)
+				Sim_Log("sim: stop %.1f%%", Sim_StopPercent());
+			Sim_Expect(st, ok, st->arg);
+		}
+		else
+			Sim_Log("sim: %s:%d unknown expect", sim_script, st->line);
+	}
+	else if(strcmp(st->cmd, "end") == 0)
+	{
+		Sim_Report();
+		exit(sim_fails ? 1 : 0);
+	}
+	else
+		Sim_Log("sim: %s:%d unknown action %s", sim_script, st->line, st->cmd);
+}
+
+static Sim_Step *Sim_NewStep(int line, const char *cmd, const char *arg)
+{
+	Sim_Step *st = malloc(sizeof(Sim_Step));
+
+	st->line = line;
+	st->cmd = strdup(cmd);
+	st->arg = strdup(arg);
+	return st;
+}
+
+//taps展开成一串card/remove
+static int Sim_LoadTaps(int line, uint64_t at, const char *arg)
+{
+	char uid[16][MFRC522_UID_MAX * 2 + 1];
+	int count, period, n = 0, used, i;
+
+	if(sscanf(arg, "%d %d%n", &count, &period, &used) != 2 || count <= 0 || period <= 0)
+		return 0;
+	arg += used;
+	while(n < 16 && sscanf(arg, " %20s%n", uid[n], &used) == 1)
+	{
+		arg += used;
+		n++;
+	}
+	if(n == 0)
+		return 0;
+	for(i = 0; i < count; i++)
+	{
+		Sim_Schedule(at, Sim_RunStep, Sim_NewStep(line, "card", uid[i % n]), 0);
+		Sim_Schedule(at + period * SIM_NS_PER_MS / 2, Sim_RunStep, Sim_NewStep(line, "remove", ""), 0);
+		at += period * SIM_NS_PER_MS;
+	}
+	return 1;
+}
+
+static int Sim_Load(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char buf[1024], *s, *cmd, *arg, *end;
+	unsigned long ms;
+	int line = 0, hasEnd = 0;
+	uint64_t last = 0;
+	Sim_Step *st;
+
+	if(f == NULL)
+	{
+		perror(path);
+		return 0;
+	}
+	while(fgets(buf, sizeof(buf), f) != NULL)
+	{
+		line++;
+		s = buf;
+		while(isspace((unsigned char)*s))
+			s++;
+		end = s + strlen(s);
+		while(end > s && isspace((unsigned char)end[-1]))
+			*--end = 0;
+		if(*s == 0 || *s == '#')
+			continue;
+		if(strncmp(s, "at ", 3) != 0)
+		{
+			fprintf(stderr, "%s:%d: expected 'at <ms> <action>'\n", path, line);
+			fclose(f);
+			return 0;
+		}
+		ms = strtoul(s + 3, &cmd, 10);
+		while(isspace((unsigned char)*cmd))
+			cmd++;
+		arg = cmd;
+		while(*arg && !isspace((unsigned char)*arg))
+			arg++;
+		if(*arg)
+			*arg++ = 0;
+		while(isspace((unsigned char)*arg))
+			arg++;
+
+		if(strcmp(cmd, "taps") == 0)
+		{
+			if(!Sim_LoadTaps(line, ms * SIM_NS_PER_MS, arg))
+			{
+				fprintf(stderr, "%s:%d: expected 'taps <count> <period_ms> <UID>...'\n", path, line);
+				fclose(f);
+				return 0;
+			}
+		}
+		else
+			Sim_Schedule(ms * SIM_NS_PER_MS, Sim_RunStep, Sim_NewStep(line, cmd, arg), 0);
+		if(ms * SIM_NS_PER_MS > last)
+			last = ms * SIM_NS_PER_MS;
+		if(strcmp(cmd, "end") == 0)
+			hasEnd = 1;
+	}
+	fclose(f);
+
+	if(!hasEnd)
+	{
+		st = calloc(1, sizeof(Sim_Step));
+		st->cmd = "end";
+		st->arg = "";
+		Sim_Schedule(last > SIM_DEFAULT_END_MS * SIM_NS_PER_MS ? last + SIM_NS_PER_MS * 1000 : SIM_DEFAULT_END_MS * SIM_NS_PER_MS,
+					 Sim_RunStep, st, 0);
+	}
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-v") == 0)
+			sim_verbose = 1;
+		else
+			sim_script = argv[i];
+	}
+	if(sim_script[0] == 0)
+	{
+		fprintf(stderr, "usage: %s [-v] scenario.txt\n", argv[0]);
+		return 2;
+	}
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	if(!Sim_Load(sim_script))
+		return 2;
+
+	firmware_main();
+	return 0;
+}
@@ -0,0 +1,949 @@
+//==========================================================
+//	主机仿真：MFRC522读卡芯片和MIFARE Classic 1K卡片
+//
+//	芯片部分：GPIO模拟SPI(模式0)解码、寄存器、64字节FIFO、CRC协处理器、
+//	定时器(含自动重装和计数值)、IRQ引脚(ComIEnReg/DivIEnReg与中断请求位)、Transceive和MFAuthent
+//	卡片部分：REQA/WUPA、按位防冲突和4/7/10字节UID的级联选卡、认证(只比较密钥，不做Crypto1)、
+//	读写块、值块增减/恢复/传送、HALT；卡片内容按UID保存，拿走再放回不丢。
+//	天线区里可以同时有多张卡，各卡的应答按位叠加，第一个不一致的位报位冲突
+//	空中传输按106kbit/s计时(每位128/13.56MHz，每字节加1位奇偶校验)
+//==========================================================
+
+#include "sim.h"
+#include "MFRC522.h"
+#include <string.h>
+
+#define RC_FIFO_SIZE		64
+#define RC_ETU_NS			9440		//128/13.56MHz
+#define RC_FDT_NS			86000		//卡片帧延迟时间
+#define RC_AUTH_NS			1900000		//MFAuthent四次交互
+
+static unsigned char rc_reg[64];
+static unsigned char rc_cmd = PCD_IDLE;
+static unsigned char rc_fifo[RC_FIFO_SIZE];
+static int rc_fifoLen = 0;
+static _Bool rc_inReset = 0;
+static int rc_irqLevel = 1;
+
+//SPI解码
+static int rc_cs = 1, rc_sck = 0;
+static int rc_bit = 0, rc_byteIdx = 0, rc_miso = 1;
+static unsigned char rc_in = 0, rc_out = 0, rc_addr = 0;
+static _Bool rc_isRead = 0;
+
+//进行中的空中帧
+static unsigned char rc_resp[RC_FIFO_SIZE];
+static int rc_respBits = 0;
+static int rc_respColl = -1;										//第一个冲突位在应答里的位置，-1=没有冲突
+
+static unsigned long rc_spiBytes = 0, rc_frames = 0, rc_noResp = 0, rc_auths = 0, rc_resets = 0;
+
+//==========================================================
+//	卡片
+//==========================================================
+#define SIM_CARD_MAX		16
+#define SIM_BALANCE_BLOCK	5			//与main.c的BALANCE_BLOCK_ADDR一致
+
+#define CARD_IDLE			0
+#define CARD_READY			1
+#define CARD_ACTIVE			2
+#define CARD_HALT			3
+
+#define CARD_PEND_NONE		0
+#define CARD_PEND_WRITE		1
+#define CARD_PEND_VALUE		2
+
+typedef struct
+{
+	unsigned char uid[MFRC522_UID_MAX];
+	int uidLen;							//4、7或10
+	_Bool inField;
+	unsigned char mem[64][16];
+	int state;
+	int level;							//READY状态下正在进行的级联级别，0起
+	int authSector;						//-1表示未认证
+	int pend;							//两段式命令等待第二帧
+	unsigned char pendCmd, pendAddr;
+	int32_t xfer;						//值块运算结果(卡内传送缓冲)
+	_Bool xferValid;
+} Sim_Card;
+
+static Sim_Card sim_cards[SIM_CARD_MAX];
+static int sim_cardNum = 0;
+static _Bool sim_fieldOn = 0;
+static uint64_t sim_fieldSince, sim_fieldNs;	//射频场开着的累计时间
+
+//发现延迟：卡片进场到第一次应答REQA/WUPA
+static uint64_t sim_enterNs;
+static _Bool sim_detectWait = 0;
+static unsigned long sim_detects = 0;
+static uint64_t sim_detectSum = 0, sim_detectMax = 0;
+
+static int sim_dropReqa = 0;				//之后这么多次REQA卡片都没收到(干扰)
+
+//ISO14443A CRC_A，初值0x6363，低字节在前
+static unsigned short Rc_Crc(const unsigned char *d, int len)
+{
+	unsigned short crc = 0x6363;
+	unsigned char b;
+
+	while(len--)
+	{
+		b = *d++ ^ (unsigned char)crc;
+		b ^= (unsigned char)(b << 4);
+		crc = (crc >> 8) ^ ((unsigned short)b << 8) ^ ((unsigned short)b << 3) ^ (b >> 4);
+	}
+	return crc;
+}
+
+static int Rc_CrcOk(const unsigned char *d, int len)
+{
+	unsigned short crc;
+
+	if(len < 3)
+		return 0;
+	crc = Rc_Crc(d, len - 2);
+	return d[len - 2] == (crc & 0xFF) && d[len - 1] == (crc >> 8);
+}
+
+static int Card_AppendCrc(unsigned char *d, int len)
+{
+	unsigned short crc = Rc_Crc(d, len);
+
+	d[len] = crc & 0xFF;
+	d[len + 1] = crc >> 8;
+	return len + 2;
+}
+
+static int Card_ParseValue(const unsigned char *b, int32_t *value)
+{
+	int i;
+
+	for(i = 0; i < 4; i++)
+	{
+		if(b[i] != b[i + 8] || (unsigned char)~b[i] != b[i + 4])
+			return 0;
+	}
+	if(b[12] != b[14] || b[13] != b[15] || (unsigned char)~b[12] != b[13])
+		return 0;
+	*value = (int32_t)((uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24));
+	return 1;
+}
+
+static void Card_FormatValue(unsigned char *b, int32_t value, unsigned char addr)
+{
+	int i;
+
+	for(i = 0; i < 4; i++)
+	{
+		b[i] = (unsigned char)((uint32_t)value >> (i * 8));
+		b[i + 4] = ~b[i];
+		b[i + 8] = b[i];
+	}
+	b[12] = addr; b[13] = ~addr; b[14] = addr; b[15] = ~addr;
+}
+
+static Sim_Card *Card_Find(const unsigned char *uid, int len)
+{
+	int i;
+
+	for(i = 0; i < sim_cardNum; i++)
+	{
+		if(sim_cards[i].uidLen == len && memcmp(sim_cards[i].uid, uid, len) == 0)
+			return &sim_cards[i];
+	}
+	return NULL;
+}
+
+static const char *Card_Name(const Sim_Card *card)
+{
+	static char name[MFRC522_UID_MAX * 2 + 1];
+	int i;
+
+	for(i = 0; i < card->uidLen; i++)
+		sprintf(&name[i * 2], "%02X", card->uid[i]);
+	return name;
+}
+
+static void Card_Reset(Sim_Card *card)
+{
+	card->state = CARD_IDLE;
+	card->level = 0;
+	card->authSector = -1;
+	card->pend = CARD_PEND_NONE;
+	card->xferValid = 0;
+}
+
+//卡片进入天线区(已经在的卡不动)，新卡按fmt初始化余额块
+void Sim_Card_Enter(const unsigned char *uid, int len, int fmt, int32_t value)
+{
+	static const unsigned char trailer[16] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x07, 0x80, 0x69,
+											  0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+	Sim_Card *card = Card_Find(uid, len);
+	unsigned char *b;
+	int i;
+
+	if(card == NULL)
+	{
+		if(sim_cardNum >= SIM_CARD_MAX)
+		{
+			Sim_Log("sim: too many cards");
+			return;
+		}
+		card = &sim_cards[sim_cardNum++];
+		memset(card, 0, sizeof(*card));
+		memcpy(card->uid, uid, len);
+		card->uidLen = len;
+		memcpy(card->mem[0], uid, len);
+		if(len == 4)
+		{
+			card->mem[0][4] = uid[0] ^ uid[1] ^ uid[2] ^ uid[3];
+			card->mem[0][5] = 0x08;
+			card->mem[0][6] = 0x04;
+		}
+		for(i = 3; i < 64; i += 4)
+			memcpy(card->mem[i], trailer, 16);
+		if(fmt == SIM_CARD_KEEP)
+			fmt = SIM_CARD_BLANK;
+	}
+
+	b = card->mem[SIM_BALANCE_BLOCK];
+	if(fmt == SIM_CARD_BLANK)
+		memset(b, 0, 16);
+	else if(fmt == SIM_CARD_LEGACY)
+	{
+		memset(b, 0, 16);
+		b[0] = (unsigned char)value;
+		b[1] = 0xAA;
+	}
+	else if(fmt == SIM_CARD_VALUE)
+		Card_FormatValue(b, value, SIM_BALANCE_BLOCK);
+
+	Card_Reset(card);
+	card->inField = 1;
+	sim_enterNs = sim_now;
+	sim_detectWait = 1;
+	Sim_Log("card: %s enters field", Card_Name(card));
+}
+
+//拿走一张卡，uid为NULL时拿走全部
+void Sim_Card_Remove(const unsigned char *uid, int len)
+{
+	int i;
+
+	for(i = 0; i < sim_cardNum; i++)
+	{
+		if(sim_cards[i].inField && (uid == NULL || &sim_cards[i] == Card_Find(uid, len)))
+		{
+			sim_cards[i].inField = 0;
+			Sim_Log("card: %s leaves field", Card_Name(&sim_cards[i]));
+		}
+	}
+	sim_detectWait = 0;
+}
+
+void Sim_Card_DropReqa(int n)
+{
+	sim_dropReqa = n;
+}
+
+//读卡上余额：值块返回值，旧格式返回第一个字节
+int Sim_Card_Balance(const unsigned char *uid, int len, int32_t *value)
+{
+	Sim_Card *card = Card_Find(uid, len);
+	unsigned char *b;
+
+	if(card == NULL)
+		return 0;
+	b = card->mem[SIM_BALANCE_BLOCK];
+	if(Card_ParseValue(b, value))
+		return 1;
+	if(b[1] == 0xAA)
+	{
+		*value = b[0];
+		return 1;
+	}
+	return 0;
+}
+
+static void Card_Field(_Bool on)
+{
+	int i;
+
+	if(on == sim_fieldOn)
+		return;
+	sim_fieldOn = on;
+	if(on)
+		sim_fieldSince = sim_now;
+	else
+		sim_fieldNs += sim_now - sim_fieldSince;
+	if(!on)												//断场即掉电
+	{
+		for(i = 0; i < sim_cardNum; i++)
+			Card_Reset(&sim_cards[i]);
+	}
+}
+
+static int Card_Ack(unsigned char *resp, int *respBits, unsigned char code)
+{
+	resp[0] = code;
+	*respBits = 4;
+	return 1;
+}
+
+//这一级的CLn：UID没完时第一个字节是级联标志，最后一级是4字节UID，再加BCC
+static int Card_Cln(const Sim_Card *c, unsigned char cln[5])
+{
+	int last = c->level == (c->uidLen - 1) / 3 - 1;
+
+	if(last)
+		memcpy(cln, &c->uid[c->level * 3], 4);
+	else
+	{
+		cln[0] = PICC_CT;
+		memcpy(&cln[1], &c->uid[c->level * 3], 3);
+	}
+	cln[4] = cln[0] ^ cln[1] ^ cln[2] ^ cln[3];
+	return last;
+}
+
+static int Bit_Get(const unsigned char *d, int n)
+{
+	return (d[n / 8] >> (n % 8)) & 1;
+}
+
+static void Bit_Set(unsigned char *d, int n, int v)
+{
+	if(v)
+		d[n / 8] |= 1 << (n % 8);
+	else
+		d[n / 8] &= ~(1 << (n % 8));
+}
+
+//READY状态：按位防冲突和SELECT
+static int Card_Anticoll(Sim_Card *c, const unsigned char *f, int bits, unsigned char *resp, int *respBits)
+{
+	unsigned char cln[5];
+	int last = Card_Cln(c, cln);
+	int known, i;
+
+	if(bits < 16 || f[0] != PICC_ANTICOLL1 + 2 * c->level)
+		return -1;
+	if(f[1] == 0x70)												//SELECT
+	{
+		if(bits != 72 || !Rc_CrcOk(f, 9) || memcmp(&f[2], cln, 5) != 0)
+			return -1;
+		if(last)
+		{
+			c->state = CARD_ACTIVE;
+			resp[0] = 0x08;											//SAK：MIFARE Classic 1K
+		}
+		else
+		{
+			c->level++;
+			resp[0] = 0x04;											//SAK：UID没完
+		}
+		*respBits = Card_AppendCrc(resp, 1) * 8;
+		return 1;
+	}
+	if(bits != (f[1] >> 4) * 8 + (f[1] & 0x0F) || bits >= 56)		//NVB和帧长不符
+		return -1;
+	known = bits - 16;
+	for(i = 0; i < known; i++)
+	{
+		if(Bit_Get(&f[2], i) != Bit_Get(cln, i))
+			return 0;												//前缀不同的卡不应答，仍在READY
+	}
+	memset(resp, 0, 5);
+	for(i = known; i < 40; i++)
+		Bit_Set(resp, i - known, Bit_Get(cln, i));
+	*respBits = 40 - known;
+	return 1;
+}
+
+//一张卡处理一帧，返回1表示有应答
+static int Card_Frame(Sim_Card *c, const unsigned char *f, int bits, unsigned char *resp, int *respBits)
+{
+	int len = bits / 8;
+	int32_t v, operand;
+	int i;
+
+	if(bits == 7)													//短帧
+	{
+		if((f[0] == PICC_REQIDL && c->state == CARD_IDLE) ||
+		   (f[0] == PICC_REQALL && (c->state == CARD_IDLE || c->state == CARD_HALT)))
+		{
+			c->state = CARD_READY;
+			c->level = 0;
+			resp[0] = c->uidLen == 4 ? 0x04 : c->uidLen == 7 ? 0x44 : 0x84;	//ATQA：UID长度和MIFARE Classic 1K
+			resp[1] = 0x00;
+			*respBits = 16;
+			if(sim_detectWait)
+			{
+				uint64_t ns = sim_now - sim_enterNs;
+
+				sim_detectWait = 0;
+				sim_detects++;
+				sim_detectSum += ns;
+				if(ns > sim_detectMax)
+					sim_detectMax = ns;
+			}
+			return 1;
+		}
+		if(c->state == CARD_READY || c->state == CARD_ACTIVE)		//ISO14443-3：其它命令回到IDLE，不应答
+		{
+			c->state = CARD_IDLE;
+			c->authSector = -1;
+		}
+		return 0;
+	}
+	if(c->state == CARD_IDLE || c->state == CARD_HALT)
+		return 0;
+
+	if(c->state == CARD_READY)
+	{
+		i = Card_Anticoll(c, f, bits, resp, respBits);
+		if(i < 0)													//其它命令、UID不符的SELECT：回到IDLE
+			c->state = CARD_IDLE;
+		return i > 0;
+	}
+
+	//ACTIVE
+	if(bits % 8 || !Rc_CrcOk(f, len))
+		return Card_Ack(resp, respBits, 0x05);						//传输错误NAK
+
+	if(c->pend != CARD_PEND_NONE)									//两段式命令的第二帧
+	{
+		int pend = c->pend;
+
+		c->pend = CARD_PEND_NONE;
+		if(pend == CARD_PEND_WRITE && len == 18)
+		{
+			memcpy(c->mem[c->pendAddr], f, 16);
+			return Card_Ack(resp, respBits, 0x0A);
+		}
+		if(pend == CARD_PEND_VALUE && len == 6)
+		{
+			Card_ParseValue(c->mem[c->pendAddr], &v);
+			operand = (int32_t)((uint32_t)f[0] | ((uint32_t)f[1] << 8) | ((uint32_t)f[2] << 16) | ((uint32_t)f[3] << 24));
+			if(c->pendCmd == PICC_INCREMENT)
+				v += operand;
+			else if(c->pendCmd == PICC_DECREMENT)
+				v -= operand;
+			c->xfer = v;
+			c->xferValid = 1;
+			return 0;												//成功不应答
+		}
+		c->state = CARD_IDLE;
+		return Card_Ack(resp, respBits, 0x04);
+	}
+
+	i = f[1];
+	switch(f[0])
+	{
+		case PICC_HALT:
+			c->state = CARD_HALT;
+			c->authSector = -1;
+			return 0;
+
+		case PICC_READ:
+			if(len == 4 && i < 64 && c->authSector == i / 4)
+			{
+				memcpy(resp, c->mem[i], 16);
+				*respBits = Card_AppendCrc(resp, 16) * 8;
+				return 1;
+			}
+			break;
+
+		case PICC_WRITE:
+			if(len == 4 && i > 0 && i < 64 && c->authSector == i / 4)
+			{
+				c->pend = CARD_PEND_WRITE;
+				c->pendAddr = i;
+				return Card_Ack(resp, respBits, 0x0A);
+			}
+			break;
+
+		case PICC_INCREMENT:
+		case PICC_DECREMENT:
+		case PICC_RESTORE:
+			if(len == 4 && i < 64 && c->authSector == i / 4 && Card_ParseValue(c->mem[i], &v))
+			{
+				c->pend = CARD_PEND_VALUE;
+				c->pendCmd = f[0];
+				c->pendAddr = i;
+				return Card_Ack(resp, respBits, 0x0A);
+			}
+			break;
+
+		case PICC_TRANSFER:
+			if(len == 4 && i > 0 && i < 64 && c->authSector == i / 4 && c->xferValid)
+			{
+				Card_FormatValue(c->mem[i], c->xfer, c->mem[i][12]);
+				c->xferValid = 0;
+				return Card_Ack(resp, respBits, 0x0A);
+			}
+			break;
+	}
+
+	c->state = CARD_IDLE;											//非法命令：NAK后回到IDLE
+	c->authSector = -1;
+	return Card_Ack(resp, respBits, 0x04);
+}
+
+//天线区里各卡处理一帧，应答按位叠加(线与之后读到的是或)，记下第一个不一致的位
+static int Card_Transceive(const unsigned char *f, int bits, unsigned char *resp, int *respBits)
+{
+	unsigned char r[RC_FIFO_SIZE];
+	int rBits, n = 0, i, j;
+
+	rc_respColl = -1;
+	if(!sim_fieldOn)
+		return 0;
+	if(bits == 7 && f[0] == PICC_REQIDL && sim_dropReqa > 0)
+	{
+		sim_dropReqa--;
+		return 0;
+	}
+	for(i = 0; i < sim_cardNum; i++)
+	{
+		if(!sim_cards[i].inField || !Card_Frame(&sim_cards[i], f, bits, r, &rBits))
+			continue;
+		if(n++ == 0)
+		{
+			memcpy(resp, r, (rBits + 7) / 8);
+			*respBits = rBits;
+			continue;
+		}
+		for(j = 0; j < rBits && j < *respBits; j++)
+		{
+			if(Bit_Get(r, j) != Bit_Get(resp, j))
+			{
+				if(rc_respColl < 0 || j < rc_respColl)
+					rc_respColl = j;
+				break;
+			}
+		}
+		for(j = 0; j < rBits; j++)
+		{
+			if(j >= *respBits)
+				Bit_Set(resp, j, 0);
+			if(Bit_Get(r, j))
+				Bit_Set(resp, j, 1);
+		}
+		if(rBits > *respBits)
+			*respBits = rBits;
+	}
+	return n > 0;
+}
+
+//ACTIVE的卡，同一时刻最多一张
+static Sim_Card *Card_Active(void)
+{
+	int i;
+
+	for(i = 0; i < sim_cardNum; i++)
+	{
+		if(sim_cards[i].inField && sim_cards[i].state == CARD_ACTIVE)
+			return &sim_cards[i];
+	}
+	return NULL;
+}
+
+//MFAuthent：FIFO里是 命令 块地址 密钥(6) UID(4)，7字节UID用后4字节
+static int Card_Auth(const unsigned char *f, int len)
+{
+	Sim_Card *c = Card_Active();
+	const unsigned char *trailer;
+	int block = f[1];
+
+	if(c == NULL || !sim_fieldOn || len < 12 || block >= 64)
+		return 0;
+	trailer = c->mem[block | 3];
+	if(memcmp(&f[8], &c->uid[c->uidLen - 4], 4) != 0 ||
+	   memcmp(&f[2], f[0] == PICC_AUTHENT1A ? &trailer[0] : &trailer[10], 6) != 0)
+	{
+		c->state = CARD_IDLE;
+		return 0;
+	}
+	c->authSector = block / 4;
+	return 1;
+}
+
+//==========================================================
+//	芯片
+//==========================================================
+static void Rc_UpdateIrq(void)
+{
+	int active = (rc_reg[ComIEnReg] & rc_reg[ComIrqReg] & 0x7F) ||
+				 (rc_reg[DivlEnReg] & rc_reg[DivIrqReg] & 0x14);
+	int level = (rc_reg[ComIEnReg] & 0x80) ? !active : active;
+
+	if(rc_irqLevel && !level)
+		Sim_ExtiEdge(EXTI_Line1);									//IRQ接PB1，下降沿
+	rc_irqLevel = level;
+}
+
+static void Rc_SetIrq(unsigned char com)
+{
+	rc_reg[ComIrqReg] |= com;
+	Rc_UpdateIrq();
+}
+
+static uint64_t Rc_FrameNs(int bits)
+{
+	return (uint64_t)(bits + bits / 8 + 2) * RC_ETU_NS;			//数据位+奇偶校验+SOF/EOF
+}
+
+//定时器超时时间：(TReload+1)*(2*TPrescaler+1)/13.56MHz
+static uint64_t Rc_TimerNs(void)
+{
+	uint64_t presc = ((rc_reg[TModeReg] & 0x0F) << 8) | rc_reg[TPrescalerReg];
+	uint64_t reload = (rc_reg[TReloadRegH] << 8) | rc_reg[TReloadRegL];
+
+	return (reload + 1) * (2 * presc + 1) * 1000000000ULL / 13560000ULL;
+}
+
+static uint64_t rc_timerStart;										//计数器上次从TReload开始减的时刻
+static _Bool rc_timerRun = 0;
+
+static void Rc_TimerFire(void *p, int a)
+{
+	(void)p; (void)a;
+	Rc_SetIrq(0x01);												//TimerIRq
+	if(rc_reg[TModeReg] & 0x10)										//TAutoRestart
+	{
+		rc_timerStart = sim_now;
+		Sim_Schedule(sim_now + Rc_TimerNs(), Rc_TimerFire, NULL, 0);
+	}
+	else
+		rc_timerRun = 0;
+}
+
+static void Rc_TimerStart(void)
+{
+	Sim_Cancel(Rc_TimerFire);
+	rc_timerStart = sim_now;
+	rc_timerRun = 1;
+	Sim_Schedule(sim_now + Rc_TimerNs(), Rc_TimerFire, NULL, 0);
+}
+
+static void Rc_TimerStop(void)
+{
+	Sim_Cancel(Rc_TimerFire);
+	rc_timerRun = 0;
+}
+
+//TCounterValueReg：从TReload按预分频后的节拍减到0
+static unsigned short Rc_TimerCounter(void)
+{
+	uint64_t reload = (rc_reg[TReloadRegH] << 8) | rc_reg[TReloadRegL];
+	uint64_t tick, n;
+
+	if(!rc_timerRun)
+		return 0;
+	tick = Rc_TimerNs() / (reload + 1);
+	n = (sim_now - rc_timerStart) / (tick ? tick : 1);
+	return n > reload ? 0 : (unsigned short)(reload - n);
+}
+
+//收到的位按RxAlign从FIFO第一个字节的该位开始放；位冲突时CollPos也从这里数起
+static void Rc_RxDone(void *p, int a)
+{
+	int align = (rc_reg[BitFramingReg] >> 4) & 0x07;
+	int i, bits = rc_respBits;
+
+	(void)p; (void)a;
+	Rc_TimerStop();													//TAuto：收到第一位即停定时器
+	if(rc_respColl >= 0)
+	{
+		rc_reg[ErrorReg] |= 0x08;									//CollErr
+		i = align + rc_respColl + 1;
+		rc_reg[CollReg] = (rc_reg[CollReg] & 0x80) | (i > 32 ? 0x20 : (i & 0x1F));
+		if(!(rc_reg[CollReg] & 0x80))								//ValuesAfterColl=0：冲突位起都清0
+		{
+			for(i = rc_respColl; i < bits; i++)
+				Bit_Set(rc_resp, i, 0);
+		}
+	}
+	bits += align;
+	rc_fifoLen = (bits + 7) / 8;
+	memset(rc_fifo, 0, rc_fifoLen);
+	for(i = align; i < bits; i++)
+		Bit_Set(rc_fifo, i, Bit_Get(rc_resp, i - align));
+	if((rc_reg[RxModeReg] & 0x80) && rc_fifoLen >= 3)				//RxCRCEn
+	{
+		if(!Rc_CrcOk(rc_fifo, rc_fifoLen))
+			rc_reg[ErrorReg] |= 0x04;
+		rc_fifoLen -= 2;
+	}
+	rc_reg[ControlReg] = (rc_reg[ControlReg] & ~0x07) | (bits % 8);
+	Rc_SetIrq(0x20);												//RxIRq
+}
+
+static void Rc_TxDone(void *p, int a)
+{
+	(void)p;
+	Rc_SetIrq(0x40);												//TxIRq
+	if(rc_reg[TModeReg] & 0x80)										//TAuto：发送结束启动定时器
+		Rc_TimerStart();
+	if(a)
+		Sim_Schedule(sim_now + RC_FDT_NS + Rc_FrameNs(rc_respBits), Rc_RxDone, NULL, 0);
+	else
+		rc_noResp++;
+}
+
+static void Rc_StartTransceive(void)
+{
+	unsigned char frame[RC_FIFO_SIZE + 2];
+	int len = rc_fifoLen, lastBits = rc_reg[BitFramingReg] & 0x07;
+	int bits, resp;
+
+	memcpy(frame, rc_fifo, len);
+	rc_fifoLen = 0;
+	if((rc_reg[TxModeReg] & 0x80) && len > 0)						//TxCRCEn
+		len = Card_AppendCrc(frame, len);
+	bits = lastBits ? (len - 1) * 8 + lastBits : len * 8;
+	rc_reg[ErrorReg] &= 0x10;
+	rc_frames++;
+
+	resp = Card_Transceive(frame, bits, rc_resp, &rc_respBits);
+	Sim_Schedule(sim_now + Rc_FrameNs(bits), Rc_TxDone, NULL, resp);
+}
+
+static void Rc_AuthDone(void *p, int a)
+{
+	(void)p;
+	if(a)
+	{
+		rc_reg[Status2Reg] |= 0x08;									//MFCrypto1On
+		rc_cmd = PCD_IDLE;
+		Rc_SetIrq(0x10);											//IdleIRq
+	}
+	else if(rc_reg[TModeReg] & 0x80)								//卡不应答，等定时器
+		Rc_TimerStart();
+}
+
+static void Rc_Reset(void)
+{
+	Sim_Cancel(Rc_TxDone);
+	Sim_Cancel(Rc_RxDone);
+	Sim_Cancel(Rc_AuthDone);
+	Rc_TimerStop();
+	memset(rc_reg, 0, sizeof(rc_reg));
+	rc_reg[ComIEnReg] = 0x80;
+	rc_reg[ComIrqReg] = 0x14;
+	rc_reg[Status1Reg] = 0x21;
+	rc_reg[WaterLevelReg] = 0x08;
+	rc_reg[ControlReg] = 0x10;
+	rc_reg[CollReg] = 0x80;
+	rc_reg[ModeReg] = 0x3F;
+	rc_reg[TxControlReg] = 0x80;
+	rc_reg[CRCResultRegM] = 0xFF;
+	rc_reg[CRCResultRegL] = 0xFF;
+	rc_reg[VersionReg] = 0x92;
+	rc_cmd = PCD_IDLE;
+	rc_fifoLen = 0;
+	rc_irqLevel = 1;
+	Card_Field(0);
+}
+
+static void Rc_Command(unsigned char cmd)
+{
+	unsigned short crc;
+
+	Sim_Cancel(Rc_TxDone);
+	Sim_Cancel(Rc_RxDone);
+	Sim_Cancel(Rc_AuthDone);
+	rc_cmd = cmd;
+	switch(cmd)
+	{
+		case PCD_CALCCRC:
+			crc = Rc_Crc(rc_fifo, rc_fifoLen);
+			rc_fifoLen = 0;
+			rc_reg[CRCResultRegL] = crc & 0xFF;
+			rc_reg[CRCResultRegM] = crc >> 8;
+			rc_reg[DivIrqReg] |= 0x04;								//CRCIRq
+			break;
+
+		case PCD_AUTHENT:
+			rc_auths++;
+			Sim_Schedule(sim_now + RC_AUTH_NS, Rc_AuthDone, NULL, Card_Auth(rc_fifo, rc_fifoLen));
+			rc_fifoLen = 0;
+			break;
+
+		case PCD_RESETPHASE:
+			rc_resets++;
+			Rc_Reset();
+			break;
+
+		default:
+			break;
+	}
+}
+
+static unsigned char Rc_Read(unsigned char a)
+{
+	unsigned char v;
+
+	switch(a)
+	{
+		case CommandReg:
+			return (rc_reg[CommandReg] & 0x30) | rc_cmd;
+		case FIFODataReg:
+			if(rc_fifoLen == 0)
+				return 0;
+			v = rc_fifo[0];
+			memmove(rc_fifo, rc_fifo + 1, --rc_fifoLen);
+			return v;
+		case FIFOLevelReg:
+			return rc_fifoLen;
+		case Status1Reg:
+			return (rc_reg[Status1Reg] & ~0x10) | (rc_irqLevel == !(rc_reg[ComIEnReg] & 0x80) ? 0x10 : 0);
+		case TCounterValueRegH:
+			return Rc_TimerCounter() >> 8;
+		case TCounterValueRegL:
+			return Rc_TimerCounter() & 0xFF;
+		default:
+			return rc_reg[a];
+	}
+}
+
+static void Rc_Write(unsigned char a, unsigned char v)
+{
+	switch(a)
+	{
+		case CommandReg:
+			rc_reg[CommandReg] = v & 0x30;
+			Rc_Command(v & 0x0F);
+			break;
+		case ComIrqReg:
+			if(v & 0x80)
+				rc_reg[ComIrqReg] |= v & 0x7F;
+			else
+				rc_reg[ComIrqReg] &= ~v;
+			break;
+		case DivIrqReg:
+			if(v & 0x80)
+				rc_reg[DivIrqReg] |= v & 0x14;
+			else
+				rc_reg[DivIrqReg] &= ~v;
+			break;
+		case FIFODataReg:
+			if(rc_fifoLen < RC_FIFO_SIZE)
+				rc_fifo[rc_fifoLen++] = v;
+			else
+				rc_reg[ErrorReg] |= 0x10;							//BufferOvfl
+			break;
+		case FIFOLevelReg:
+			if(v & 0x80)
+			{
+				rc_fifoLen = 0;
+				rc_reg[ErrorReg] &= ~0x10;
+			}
+			break;
+		case BitFramingReg:
+			rc_reg[BitFramingReg] = v & 0x7F;
+			if((v & 0x80) && rc_cmd == PCD_TRANSCEIVE)
+				Rc_StartTransceive();
+			break;
+		case ControlReg:
+			if(v & 0x80)
+				Rc_TimerStop();										//TStopNow
+			if(v & 0x40)
+				Rc_TimerStart();									//TStartNow
+			break;
+		case TxControlReg:
+			rc_reg[TxControlReg] = v;
+			Card_Field((v & 0x03) != 0);
+			break;
+		default:
+			rc_reg[a] = v;
+			break;
+	}
+	Rc_UpdateIrq();
+}
+
+//片选期间第一个字节是地址；读时每个后续字节是下一个地址，写时后续字节都写入同一地址
+static void Rc_SpiByte(unsigned char b)
+{
+	if(rc_byteIdx == 0)
+	{
+		rc_isRead = (b & 0x80) != 0;
+		rc_addr = (b >> 1) & 0x3F;
+		rc_out = rc_isRead ? Rc_Read(rc_addr) : 0;
+	}
+	else if(rc_isRead)
+		rc_out = (b & 0x80) ? Rc_Read((b >> 1) & 0x3F) : 0;
+	else
+		Rc_Write(rc_addr, b);
+	rc_byteIdx++;
+	rc_spiBytes++;
+}
+
+//SPI模式0：上升沿采样MOSI，MISO在SCK高电平期间有效
+void Sim_Rc522_Spi(int cs, int sck, int mosi)
+{
+	if(rc_inReset)
+		return;
+	if(!cs && rc_cs)
+	{
+		rc_bit = 0;
+		rc_byteIdx = 0;
+		rc_out = 0;
+	}
+	if(!cs && sck && !rc_sck)
+	{
+		rc_in = (rc_in << 1) | mosi;
+		rc_miso = (rc_out >> (7 - rc_bit)) & 1;
+		if(++rc_bit == 8)
+		{
+			rc_bit = 0;
+			Rc_SpiByte(rc_in);
+		}
+	}
+	rc_cs = cs;
+	rc_sck = sck;
+}
+
+int Sim_Rc522_Miso(void)
+{
+	return rc_cs ? 1 : rc_miso;
+}
+
+//NRSTPD低电平掉电，上升沿硬复位
+void Sim_Rc522_Rst(int level)
+{
+	if(!level)
+	{
+		rc_inReset = 1;
+		Rc_Reset();
+	}
+	else if(rc_inReset)
+	{
+		rc_inReset = 0;
+		Rc_Reset();
+	}
+}
+
+void Sim_Rc522_Report(void)
+{
+	int i;
+	int32_t v;
+
+	printf("rc522   : %lu SPI bytes, %lu frames (%lu unanswered), %lu auths, %lu resets\n",
+		   rc_spiBytes, rc_frames, rc_noResp, rc_auths, rc_resets);
+	if(sim_detects)
+		printf("rc522   : %lu cards detected, latency avg %.1f ms, max %.1f ms\n", sim_detects,
+			   (double)sim_detectSum / sim_detects / SIM_NS_PER_MS, (double)sim_detectMax / SIM_NS_PER_MS);
+	printf("rc522   : field on %.1f%% of the time\n",
+		   sim_now ? 100.0 * (sim_fieldNs + (sim_fieldOn ? sim_now - sim_fieldSince : 0)) / sim_now : 0.0);
+	for(i = 0; i < sim_cardNum; i++)
+	{
+		printf("card    : %s ", Card_Name(&sim_cards[i]));
+		if(Sim_Card_Balance(sim_cards[i].uid, sim_cards[i].uidLen, &v))
+			printf("balance %ld\n", (long)v);
+		else
+			printf("no balance\n");
+	}
+}
@@ -0,0 +1,140 @@
+//==========================================================
+//	主机仿真：SSD1306 128x64 OLED(软件I2C，地址0x78)
+//
+//	按SCL/SDA电平变化解码起始/停止条件和字节，控制字节0x00后是命令，
+//	0x40后是显存数据；页寻址模式下写显存，oled事件把屏幕内容画到终端
+//==========================================================
+
+#include "sim.h"
+#include <string.h>
+
+#define OL_ADDR				0x78
+
+static int ol_scl = 1, ol_sda = 1;
+static _Bool ol_active = 0;
+static int ol_bit = 0, ol_idx = 0;
+static unsigned char ol_byte = 0, ol_ctrl = 0;
+
+static unsigned char ol_ram[8][128];
+static int ol_page = 0, ol_col = 0;
+static _Bool ol_on = 0;
+static int ol_argLeft = 0;
+
+static unsigned long ol_bytes = 0, ol_xfers = 0, ol_dataBytes = 0;
+
+//带参数的命令，返回参数个数
+static int Ol_ArgCount(unsigned char cmd)
+{
+	switch(cmd)
+	{
+		case 0x81: case 0x8D: case 0xA8: case 0xD3: case 0xD5:
+		case 0xD9: case 0xDA: case 0xDB: case 0x20:
+			return 1;
+		case 0x21: case 0x22: case 0xA3:
+			return 2;
+		case 0x29: case 0x2A:
+			return 5;
+		case 0x26: case 0x27:
+			return 6;
+		default:
+			return 0;
+	}
+}
+
+static void Ol_Command(unsigned char cmd)
+{
+	if(ol_argLeft > 0)
+	{
+		ol_argLeft--;
+		return;
+	}
+	if(cmd >= 0xB0 && cmd <= 0xB7)
+		ol_page = cmd & 0x07;
+	else if(cmd <= 0x0F)
+		ol_col = (ol_col & 0xF0) | cmd;
+	else if(cmd >= 0x10 && cmd <= 0x1F)
+		ol_col = ((cmd & 0x0F) << 4) | (ol_col & 0x0F);
+	else if(cmd == 0xAE || cmd == 0xAF)
+		ol_on = cmd & 1;
+	else
+		ol_argLeft = Ol_ArgCount(cmd);
+}
+
+static void Ol_Byte(unsigned char b)
+{
+	ol_bytes++;
+	if(ol_idx == 0)
+		ol_active = (b == OL_ADDR);
+	else if(ol_idx == 1)
+		ol_ctrl = b & 0x40;
+	else if(ol_ctrl)
+	{
+		ol_ram[ol_page][ol_col & 0x7F] = b;
+		ol_col = (ol_col + 1) & 0x7F;
+		ol_dataBytes++;
+	}
+	else
+		Ol_Command(b);
+	ol_idx++;
+}
+
+void Sim_Oled_I2c(int scl, int sda)
+{
+	if(ol_scl && scl && ol_sda != sda)								//SCL高时SDA变化：起始/停止
+	{
+		if(!sda)
+		{
+			ol_active = 1;
+			ol_bit = 0;
+			ol_idx = 0;
+			ol_xfers++;
+		}
+		else
+			ol_active = 0;
+	}
+	else if(!ol_scl && scl && ol_active)							//SCL上升沿采样，第9个时钟是应答
+	{
+		if(ol_bit < 8)
+		{
+			ol_byte = (ol_byte << 1) | sda;
+			if(++ol_bit == 8)
+				Ol_Byte(ol_byte);
+		}
+		else
+			ol_bit = 0;
+	}
+	ol_scl = scl;
+	ol_sda = sda;
+}
+
+//上下两个像素合成一个字符
+void Sim_Oled_Dump(void)
+{
+	static const char *glyph[4] = {" ", "\xE2\x96\x80", "\xE2\x96\x84", "\xE2\x96\x88"};
+	int row, x, top, bottom;
+
+	printf("+");
+	for(x = 0; x < 128; x++)
+		printf("-");
+	printf("+%s\n", ol_on ? "" : " (display off)");
+	for(row = 0; row < 32; row++)
+	{
+		printf("|");
+		for(x = 0; x < 128; x++)
+		{
+			top = (ol_ram[row / 4][x] >> ((row % 4) * 2)) & 1;
+			bottom = (ol_ram[row / 4][x] >> ((row % 4) * 2 + 1)) & 1;
+			printf("%s", glyph[top | (bottom << 1)]);
+		}
+		printf("|\n");
+	}
+	printf("+");
+	for(x = 0; x < 128; x++)
+		printf("-");
+	printf("+\n");
+}
+
+void Sim_Oled_Report(void)
+{
+	printf("oled    : %lu I2C transfers, %lu bytes (%lu GDDRAM)\n", ol_xfers, ol_bytes, ol_dataBytes);
+}
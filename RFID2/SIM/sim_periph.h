@@ -0,0 +1,60 @@
+#ifndef _SIM_PERIPH_H_
+#define _SIM_PERIPH_H_
+
+//==========================================================
+//	主机仿真外设映射
+//
+//	固件源文件编译时用 -include 强制最先包含本文件：
+//	寄存器块指针换成仿真对象，__WFI换成推进虚拟时钟，复位按失败退出，DWT周期数由虚拟时钟换算，
+//	DMA地址寄存器是32位，仿真程序按-no-pie链接，静态数据的地址放得下；
+//	printf按fputc重定向到USART1的方式逐字节发送
+//==========================================================
+
+#define __WFI		__cmsis_real_WFI		//core_cm3.h里的内联汇编版本改名后不再使用
+#define NVIC_SystemReset	__cmsis_real_NVIC_SystemReset
+#include "stm32f10x.h"
+#undef __WFI
+#undef NVIC_SystemReset
+
+void Sim_WFI(void);
+#define __WFI		Sim_WFI
+void Sim_SystemReset(void);
+#define NVIC_SystemReset	Sim_SystemReset
+
+extern GPIO_TypeDef Sim_GPIOA, Sim_GPIOB, Sim_GPIOC;
+extern USART_TypeDef Sim_USART1, Sim_USART2;
+extern SPI_TypeDef Sim_SPI1;
+extern DMA_Channel_TypeDef Sim_DMA1_Channel2, Sim_DMA1_Channel3, Sim_DMA1_Channel4, Sim_DMA1_Channel7;
+
+#undef GPIOA
+#undef GPIOB
+#undef GPIOC
+#undef USART1
+#undef USART2
+#define GPIOA		(&Sim_GPIOA)
+#define GPIOB		(&Sim_GPIOB)
+#define GPIOC		(&Sim_GPIOC)
+#define USART1		(&Sim_USART1)
+#define USART2		(&Sim_USART2)
+#undef SPI1
+#define SPI1		(&Sim_SPI1)
+#undef DMA1_Channel2
+#undef DMA1_Channel3
+#define DMA1_Channel2	(&Sim_DMA1_Channel2)
+#define DMA1_Channel3	(&Sim_DMA1_Channel3)
+#undef DMA1_Channel4
+#undef DMA1_Channel7
+#define DMA1_Channel4	(&Sim_DMA1_Channel4)
+#define DMA1_Channel7	(&Sim_DMA1_Channel7)
+
+unsigned int Sim_Cycles(void);
+#define PERF_CYCLES()	Sim_Cycles()
+#define PERF_SAMPLES	1024				//仿真里窗口放大，p99才有意义
+
+#ifndef SIM_INTERNAL
+#include <stdio.h>
+int Sim_Printf(const char *fmt, ...);
+#define printf		Sim_Printf
+#endif
+
+#endif
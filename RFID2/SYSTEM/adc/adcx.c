@@ -1,32 +1,32 @@
 #include "adcx.h"
 
 /**
-  * @brief  ADCʼ
+  * @brief  ADC初始化程序
   * @param  
   * @retval 
   */
 void ADCx_Init(void)
 {
-	//ADCʱ
+	//开启ADC时钟
 	RCC_APB2PeriphClockCmd(ADC_CLK, ENABLE);
 	
-	//ADCƵʽ6Ƶ
+	//ADC频率进行6分频
 	RCC_ADCCLKConfig(RCC_PCLK2_Div6);
 	
-	//ADCṹ
+	//配置ADC结构体
 	ADC_InitTypeDef ADC_InitStructure;
-	ADC_InitStructure.ADC_Mode = ADC_Mode_Independent;	//ģʽ
-	ADC_InitStructure.ADC_DataAlign = ADC_DataAlign_Right;	//Ҷ
-	ADC_InitStructure.ADC_ExternalTrigConv = ADC_ExternalTrigConv_None;	//
-	ADC_InitStructure.ADC_ContinuousConvMode = DISABLE;	//ת
-	ADC_InitStructure.ADC_ScanConvMode = DISABLE;	//ɨģʽ
-	ADC_InitStructure.ADC_NbrOfChannel = 1;	//ͨ
-	ADC_Init(ADCx, &ADC_InitStructure);	//ʼADC1
+	ADC_InitStructure.ADC_Mode = ADC_Mode_Independent;	//独立模式
+	ADC_InitStructure.ADC_DataAlign = ADC_DataAlign_Right;	//数据右对齐
+	ADC_InitStructure.ADC_ExternalTrigConv = ADC_ExternalTrigConv_None;	//软件触发
+	ADC_InitStructure.ADC_ContinuousConvMode = DISABLE;	//单次转换
+	ADC_InitStructure.ADC_ScanConvMode = DISABLE;	//非扫描模式
+	ADC_InitStructure.ADC_NbrOfChannel = 1;	//总通道数
+	ADC_Init(ADCx, &ADC_InitStructure);	//初始化ADC1
 	
-	//ADCx
+	//开启ADCx
 	ADC_Cmd(ADCx, ENABLE);
 	
-	//ADCУ׼
+	//进行ADC校准
 	ADC_ResetCalibration(ADCx);
 	while(ADC_GetResetCalibrationStatus(ADCx) == SET);
 	ADC_StartCalibration(ADCx);
@@ -34,17 +34,17 @@ void ADCx_Init(void)
 }
 
 /**
-  * @brief  ȡADCת
-  * @param  ADC_Channel 	ѡҪɼADCͨ
-  * @param  ADC_SampleTime  ѡҪʱ
-  * @retval תģźֵ
+  * @brief  获取ADC转换后的数据
+  * @param  ADC_Channel 	选择需要采集的ADC通道
+  * @param  ADC_SampleTime  选择需要采样时间
+  * @retval 返回转换后的模拟信号数值
   */
 u16 ADC_GetValue(uint8_t ADC_Channel,uint8_t ADC_SampleTime)
 {
-	//ADCͨ
+	//配置ADC通道
 	ADC_RegularChannelConfig(ADCx, ADC_Channel, 1, ADC_SampleTime);
 	
-	ADC_SoftwareStartConvCmd(ADCx, ENABLE); //ADCת
-	while(ADC_GetFlagStatus(ADCx, ADC_FLAG_EOC) == RESET); //ȡADCתɱ־λ
+	ADC_SoftwareStartConvCmd(ADCx, ENABLE); //软件触发ADC转换
+	while(ADC_GetFlagStatus(ADCx, ADC_FLAG_EOC) == RESET); //读取ADC转换完成标志位
 	return ADC_GetConversionValue(ADCx);
 }
@@ -2,8 +2,8 @@
 #define _ADCX_H_
 #include "stm32f10x.h"                  // Device header
 
-// ADC ѡ
-//  ADC1/2/3
+// ADC 编号选择
+// 可以是 ADC1/2/3
 #define    ADCx                          ADC1
 #define    ADC_CLK                       RCC_APB2Periph_ADC1
 
@@ -1,75 +1,115 @@
 /***************STM32F103C8T6**********************
- * ļ  delay.c
- *     delayȷʱ	
- * ע    ϵͳʱSysTick  
+ * 文件名  ：delay.c
+ * 描述    ：delay精确延时	
+ * 备注    ：采用系统定时器SysTick  
 
 ********************LIGEN*************************/
 
 #include "delay.h"
 #include "misc.h"
 //////////////////////////////////////////////////////////////////////////////////	 
-//ֻѧϰʹãδɣκ;
-//Mini STM32
-//ʹSysTickͨģʽӳٽй
-//delay_us,delay_ms
-//ԭ@ALIENTEK
-//̳:www.openedv.com
-//޸:2010/5/27
-//汾V1.2
-//ȨУؾ
-//Copyright(C) ԭ 2009-2019
+//本程序只供学习使用，未经作者许可，不得用于其它任何用途
+//Mini STM32开发板
+//使用SysTick的普通计数模式对延迟进行管理
+//包括delay_us,delay_ms
+//正点原子@ALIENTEK
+//技术论坛:www.openedv.com
+//修改日期:2010/5/27
+//版本：V1.2
+//版权所有，盗版必究。
+//Copyright(C) 正点原子 2009-2019
 //All rights reserved
 //********************************************************************************
-//V1.2޸˵
-//жеóѭĴ
-//ֹʱ׼ȷ,do whileṹ!
+//V1.2修改说明
+//修正了中断中调用出现死循环的错误
+//防止延时不准确,采用do while结构!
+//V2.0修改说明
+//SysTick改为1ms周期中断自由运行(HCLK)，提供millis/micros和超时判断，
+//delay_ms期间WFI休眠，delay_us按DWT周期计数忙等
+//V2.1修改说明
+//STOP模式下SysTick和DWT都停止，唤醒后用delay_skip补上节拍
 //////////////////////////////////////////////////////////////////////////////////	 
-static u8  fac_us=0;//usʱ
-static u16 fac_ms=0;//msʱ
-//ʼӳٺ
-//SYSTICKʱӹ̶ΪHCLKʱӵ1/8
-//SYSCLK:ϵͳʱ
+static u8  fac_us=0;//us延时倍乘数(每us的周期数)
+static u32 fac_ms=0;//每ms的周期数,SysTick重装值
+static volatile u32 tick_ms=0;//上电以来的ms数
+static volatile u32 tick_cyc=0;//最近一次节拍时的DWT周期数
+
+//DWT周期计数器,core_cm3.h里没有DWT定义,按地址访问
+#define DWT_CTRL    (*(volatile u32 *)0xE0001000)
+#define DWT_CYCCNT  (*(volatile u32 *)0xE0001004)
+
+//初始化延迟函数
+//SYSTICK的时钟为HCLK,每1ms中断一次,之后一直运行不再改动
+//SYSCLK:系统时钟(MHz)
 void delay_init(u8 SYSCLK)
 {
-//	SysTick->CTRL&=0xfffffffb;//bit2,ѡⲿʱ  HCLK/8
-	SysTick_CLKSourceConfig(SysTick_CLKSource_HCLK_Div8);	//ѡⲿʱ  HCLK/8
-	fac_us=SYSCLK/8;		    
-	fac_ms=(u16)fac_us*1000;
-}								    
-//ʱnms
-//עnmsķΧ
-//SysTick->LOADΪ24λĴ,,ʱΪ:
-//nms<=0xffffff*8*1000/SYSCLK
-//SYSCLKλΪHz,nmsλΪms
-//72M,nms<=1864 
+	fac_us=SYSCLK;
+	fac_ms=(u32)fac_us*1000;
+	CoreDebug->DEMCR|=CoreDebug_DEMCR_TRCENA_Msk;//打开DWT
+	DWT_CTRL|=1;                                 //CYCCNTENA
+	tick_cyc=DWT_CYCCNT;
+	SysTick_Config(fac_ms);                      //HCLK,使能中断,最低优先级
+}
+
+//1ms节拍
+void SysTick_Handler(void)
+{
+	tick_cyc=DWT_CYCCNT;
+	tick_ms++;
+}
+
+//补上SysTick停止期间(STOP模式)的节拍,经过的时间由外部计时器给出
+//关中断改节拍,防止和SysTick中断里的自增交错
+void delay_skip(u32 nms)
+{
+	__disable_irq();
+	tick_ms+=nms;
+	tick_cyc=DWT_CYCCNT;
+	__enable_irq();
+}
+
+//上电以来的ms数,32位回绕(约49天)
+u32 millis(void)
+{
+	return tick_ms;
+}
+
+//上电以来的us数,32位回绕(约71分钟)
+//节拍数*1000加上节拍以来的DWT周期数;节拍中断被推迟时限制在999,保证不倒退
+u32 micros(void)
+{
+	u32 ms,cyc,us;
+	do
+	{
+		ms=tick_ms;
+		cyc=tick_cyc;
+		us=(DWT_CYCCNT-cyc)/fac_us;
+	}
+	while(ms!=tick_ms);//读的过程中来了节拍,重读
+	if(us>999)us=999;
+	return ms*1000+us;
+}
+
+//延时nms
+//剩余超过1ms时WFI休眠,下一个节拍中断唤醒;最后不足1ms忙等
+//依赖SysTick中断,不能在优先级不低于SysTick的中断里调用
 void delay_ms(u16 nms)
 {	 		  	  
-	u32 temp;		   
-	SysTick->LOAD=(u32)nms*fac_ms;//ʱ(SysTick->LOADΪ24bit)
-	SysTick->VAL =0x00;           //ռ
-	SysTick->CTRL=0x01 ;          //ʼ  
-	do
+	u32 start=micros();
+	u32 total=(u32)nms*1000;
+	u32 used;
+	while((used=micros()-start)<total)
 	{
-		temp=SysTick->CTRL;
+		if(total-used>1000)
+			__WFI();
 	}
-	while(temp&0x01&&!(temp&(1<<16)));//ȴʱ䵽   
-	SysTick->CTRL=0x00;       //رռ
-	SysTick->VAL =0X00;       //ռ	  	    
 }   
-//ʱnus
-//nusΪҪʱus.		    								   
+//延时nus
+//按DWT周期计数忙等,不占用SysTick,中断里也可以调用
+//nus<=0xffffffff/SYSCLK,72M条件下约59秒
 void delay_us(u32 nus)
 {		
-	u32 temp;	    	 
-	SysTick->LOAD=nus*fac_us; //ʱ	  		 
-	SysTick->VAL=0x00;        //ռ
-	SysTick->CTRL=0x01 ;      //ʼ 	 
-	do
-	{
-		temp=SysTick->CTRL;
-	}
-	while(temp&0x01&&!(temp&(1<<16)));//ȴʱ䵽   
-	SysTick->CTRL=0x00;       //رռ
-	SysTick->VAL =0X00;       //ռ	 
+	u32 start=DWT_CYCCNT;
+	u32 cycles=nus*fac_us;
+	while(DWT_CYCCNT-start<cycles);
 }
-
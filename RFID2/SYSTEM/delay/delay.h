@@ -2,24 +2,40 @@
 #define __DELAY_H 			   
 #include "stm32f10x.h"
 //////////////////////////////////////////////////////////////////////////////////	 
-//ֻѧϰʹãδɣκ;
-//Mini STM32
-//ʹSysTickͨģʽӳٽй
-//delay_us,delay_ms
-//ԭ@ALIENTEK
-//̳:www.openedv.com
-//޸:2010/5/27
-//汾V1.2
-//ȨУؾ
-//Copyright(C) ԭ 2009-2019
+//本程序只供学习使用，未经作者许可，不得用于其它任何用途
+//Mini STM32开发板
+//使用SysTick的普通计数模式对延迟进行管理
+//包括delay_us,delay_ms
+//正点原子@ALIENTEK
+//技术论坛:www.openedv.com
+//修改日期:2010/5/27
+//版本：V1.2
+//版权所有，盗版必究。
+//Copyright(C) 正点原子 2009-2019
 //All rights reserved
 //********************************************************************************
-//V1.2޸˵
-//жеóѭĴ
-//ֹʱ׼ȷ,do whileṹ!
+//V1.2修改说明
+//修正了中断中调用出现死循环的错误
+//防止延时不准确,采用do while结构!
+//V2.0修改说明
+//SysTick改为1ms周期中断自由运行，提供millis/micros和超时判断，
+//delay_ms期间WFI休眠，delay_us按DWT周期计数忙等，都不再改动SysTick
+//V2.1修改说明
+//STOP模式下SysTick停止，唤醒后用delay_skip补上节拍
 ////////////////////////////////////////////////////////////////////////////////// 
+
+//超时判断：t = deadline_ms(100); ... if(deadline_passed(t)) 超时
+//节拍32位回绕(约49天)，按有符号差比较，间隔不超过2^31ms都正确
+#define deadline_ms(ms)        (millis() + (ms))
+#define deadline_passed(t)     ((int)(millis() - (t)) >= 0)
+#define deadline_us(us)        (micros() + (us))
+#define deadline_us_passed(t)  ((int)(micros() - (t)) >= 0)
+
 void delay_init(u8 SYSCLK);
+u32 millis(void);
+u32 micros(void);
 void delay_ms(u16 nms);
 void delay_us(u32 nus);
+void delay_skip(u32 nms);
 
 #endif
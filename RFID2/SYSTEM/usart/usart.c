@@ -1,15 +1,16 @@
 /***************STM32F103C8T6**********************
- * ļ  usart1.c
- *     printfضUSART1
- * Ӳӣ------------------------
+ * 文件名  ：usart1.c
+ * 描述    ：将printf函数重定向到USART1。
+ * 硬件连接：------------------------
  *          | PA9  - USART1(Tx)      |
  *          | PA10 - USART1(Rx)      |
  *           ------------------------
- * 汾  ST3.0.0  *
+ * 库版本  ：ST3.0.0  *
 
 ********************LIGEN*************************/
 
 #include "usart.h"
+#include "bsp_log.h"
 #include <stdarg.h>
 
 
@@ -18,37 +19,35 @@ void USART1_Config(void)
 	GPIO_InitTypeDef GPIO_InitStructure;
 	USART_InitTypeDef USART_InitStructure;
 
-	/* ʹ USART1 ʱ*/
+	/* 使能 USART1 时钟*/
 	RCC_APB2PeriphClockCmd(RCC_APB2Periph_USART1 | RCC_APB2Periph_GPIOA, ENABLE); 
 
-	/* USART1 ʹIO˿ */    
+	/* USART1 使用IO端口配置 */    
   GPIO_InitStructure.GPIO_Pin = GPIO_Pin_9;
-  GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF_PP; //
+  GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AF_PP; //复用推挽输出
   GPIO_InitStructure.GPIO_Speed = GPIO_Speed_50MHz;
   GPIO_Init(GPIOA, &GPIO_InitStructure);    
   
   GPIO_InitStructure.GPIO_Pin = GPIO_Pin_10;
-  GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN_FLOATING;	//
-  GPIO_Init(GPIOA, &GPIO_InitStructure);   //ʼGPIOA
+  GPIO_InitStructure.GPIO_Mode = GPIO_Mode_IN_FLOATING;	//浮空输入
+  GPIO_Init(GPIOA, &GPIO_InitStructure);   //初始化GPIOA
 	  
-	/* USART1 ģʽ */
-	USART_InitStructure.USART_BaudRate = 115200;	//ã115200
-	USART_InitStructure.USART_WordLength = USART_WordLength_8b;	//λã8λ
-	USART_InitStructure.USART_StopBits = USART_StopBits_1; 	//ֹͣλã1λ
-	USART_InitStructure.USART_Parity = USART_Parity_No ;  //ǷżУ飺
-	USART_InitStructure.USART_HardwareFlowControl = USART_HardwareFlowControl_None;	//Ӳģʽãûʹ
-	USART_InitStructure.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;//뷢Ͷʹ
-	USART_Init(USART1, &USART_InitStructure);  //ʼUSART1
-	USART_Cmd(USART1, ENABLE);// USART1ʹ
+	/* USART1 工作模式配置 */
+	USART_InitStructure.USART_BaudRate = 115200;	//波特率设置：115200
+	USART_InitStructure.USART_WordLength = USART_WordLength_8b;	//数据位数设置：8位
+	USART_InitStructure.USART_StopBits = USART_StopBits_1; 	//停止位设置：1位
+	USART_InitStructure.USART_Parity = USART_Parity_No ;  //是否奇偶校验：无
+	USART_InitStructure.USART_HardwareFlowControl = USART_HardwareFlowControl_None;	//硬件流控制模式设置：没有使能
+	USART_InitStructure.USART_Mode = USART_Mode_Rx | USART_Mode_Tx;//接收与发送都使能
+	USART_Init(USART1, &USART_InitStructure);  //初始化USART1
+	USART_Cmd(USART1, ENABLE);// USART1使能
 }
 
 
- /*   ضc⺯printfUSART1*/ 
+ /* 描述  ：重定向c库函数printf到USART1，经日志缓冲由DMA发出，不等串口*/ 
 int fputc(int ch, FILE *f)
 {
-/* Printfݷ */
-  USART_SendData(USART1, (unsigned char) ch);
-  while (!(USART1->SR & USART_FLAG_TXE));
+  Log_Putc((char) ch);
  
   return (ch);
 }
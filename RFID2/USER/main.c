@@ -7,14 +7,22 @@
 #include "stdio.h"
 #include "esp8266.h"
 #include "onenet.h"
+#include "bsp_perf.h"
+#include "bsp_sched.h"
+#include "bsp_log.h"
+#include "bsp_power.h"
 #include <string.h>
 #include <stdint.h>
 
 
+#if MFRC522_LPCD && !ESP8266_FLOW_CTRL
+#error "低功耗寻卡要用RTS让ESP8266在STOP期间先别发，否则唤醒恢复时钟时收到的字节会丢"
+#endif
+
 unsigned char buf[20];  // 卡片数据缓冲区
 
 // 全局变量用于存储显示状态
-unsigned char last_card_id[4] = {0, 0, 0, 0};  // 上次显示的卡号
+MFRC522_Uid last_card;  // 上次处理的卡，size为0表示还没刷过卡
 
 // Mifare卡默认密钥（通常出厂默认值）
 unsigned char default_key[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
@@ -23,7 +31,8 @@ unsigned char default_key[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
 #define BALANCE_BLOCK_ADDR  5
 #define INITIAL_BALANCE     100  // 初始余额
 #define DEDUCT_AMOUNT       10   // 每次扣费金额
-#define INIT_FLAG           0xAA // 初始化标识（存储在第二个字节）
+#define INIT_FLAG           0xAA // 旧格式初始化标识（第一个字节余额，第二个字节标识）
+#define MAX_BALANCE         99999999L  // 余额上限（OLED一行能显示的位数）
 
 // 提供给 onenet.c 的告警标志变量定义（默认关闭）
 uint8_t Alarm_flag = 0;
@@ -45,7 +54,6 @@ static const unsigned char CARD3_ID[4] = {0x61, 0x8E, 0xC9, 0x01};  // 618EC901
 static unsigned char registered_cards[MAX_CARDS_TRACKED][4];
 static unsigned char registered_card_count = 0;
 
-static char publish_buf[128];
 static const char devPubTopic[] = "$sys/TdTlyD3CtQ/Test1/thing/property/post";
 const char *devSubTopic[] = {"$sys/TdTlyD3CtQ/Test1/thing/property/set"};
 // 将十六进制数字转换为ASCII字符
@@ -59,213 +67,259 @@ char hex_to_char(u8 hex)
 
 unsigned char *dataPtr = NULL;
 
-// 显示searching和卡号ID（只在卡号改变时调用）
-void OLED_ShowSearchingAndID(unsigned char *card_id, unsigned char balance)
+// 显示searching和卡号ID（只在处理新卡时调用）
+void OLED_ShowSearchingAndID(const MFRC522_Uid *card, int32_t balance)
 {
-	char display_str[20];
+	char display_str[MFRC522_UID_MAX * 2 + 1];
 	unsigned char i;
 	
-	// 将4字节卡号转换为十六进制字符串显示
-	display_str[0] = hex_to_char((card_id[0] >> 4) & 0x0F);
-	display_str[1] = hex_to_char(card_id[0] & 0x0F);
-	display_str[2] = hex_to_char((card_id[1] >> 4) & 0x0F);
-	display_str[3] = hex_to_char(card_id[1] & 0x0F);
-	display_str[4] = hex_to_char((card_id[2] >> 4) & 0x0F);
-	display_str[5] = hex_to_char(card_id[2] & 0x0F);
-	display_str[6] = hex_to_char((card_id[3] >> 4) & 0x0F);
-	display_str[7] = hex_to_char(card_id[3] & 0x0F);
-	display_str[8] = '\0';  // 字符串结束符
+	// 将卡号转换为十六进制字符串显示
+	for(i = 0; i < card->size; i++)
+	{
+		display_str[i * 2] = hex_to_char((card->uid[i] >> 4) & 0x0F);
+		display_str[i * 2 + 1] = hex_to_char(card->uid[i] & 0x0F);
+	}
+	display_str[i * 2] = '\0';  // 字符串结束符
 	
 	// 将余额转换为字符串
-	char balance_str[10];
-	unsigned char temp_balance = balance;
-	balance_str[0] = 'B';
-	balance_str[1] = ':';
-	if(temp_balance >= 100)
+	char balance_str[12];
+	snprintf(balance_str, sizeof(balance_str), "B:%ld", (long)balance);
+	
+	// 清屏并同时显示searching、ID和余额（只改显存，改动部分由OLED任务刷新）
+	OLED_Clear();
+	OLED_ShowString(0, 0, "searching", 16, 1);  // 显示"searching"
+	// 4字节卡号用16号字接在"ID:"后面；7字节卡号换12号字，10字节的连"ID:"也放不下，占满一行
+	if(card->size == 4)
 	{
-		balance_str[2] = (temp_balance / 100) + '0';
-		balance_str[3] = ((temp_balance / 10) % 10) + '0';
-		balance_str[4] = (temp_balance % 10) + '0';
-		balance_str[5] = '\0';
+		OLED_ShowString(0, 20, "ID:", 16, 1);
+		OLED_ShowString(40, 20, display_str, 16, 1);
 	}
-	else if(temp_balance >= 10)
+	else if(card->size == 7)
 	{
-		balance_str[2] = (temp_balance / 10) + '0';
-		balance_str[3] = (temp_balance % 10) + '0';
-		balance_str[4] = '\0';
+		OLED_ShowString(0, 20, "ID:", 16, 1);
+		OLED_ShowString(40, 22, display_str, 12, 1);
 	}
 	else
 	{
-		balance_str[2] = temp_balance + '0';
-		balance_str[3] = '\0';
+		OLED_ShowString(0, 22, display_str, 12, 1);
 	}
-	
-	// 清屏并同时显示searching、ID和余额
-	OLED_Clear();
-	OLED_ShowString(0, 0, "searching", 16, 1);  // 显示"searching"
-	OLED_ShowString(0, 20, "ID:", 16, 1);  // 显示"ID:"
-	OLED_ShowString(40, 20, display_str, 16, 1);  // 在"ID:"后面显示卡号
 	OLED_ShowString(0, 40, balance_str, 16, 1);  // 显示余额
 }
 
-// 余额管理函数：处理卡片余额（初始化为100或扣费10）
-// 返回值：0=成功，1=余额不足，2=验证失败，3=读写失败
-unsigned char ProcessCardBalance(unsigned char *card_id, unsigned char *new_balance)
+// 卡片会话：一次刷卡只选卡、认证、读块各一次，算好新余额后一次写入
+// 写入成功以卡片的ACK(0x0A)为准，不再延时后重新认证回读
+// 余额块格式
+#define CARD_FMT_NEW        0    // 未初始化的卡
+#define CARD_FMT_LEGACY     1    // 旧格式：第一个字节余额，第二个字节INIT_FLAG
+#define CARD_FMT_VALUE      2    // MIFARE值块，用卡片的增值/减值命令更新
+
+typedef struct
+{
+	MFRC522_Uid *card;
+	unsigned char block[16];     // 余额块内容
+	unsigned char format;        // CARD_FMT_xxx
+	unsigned char first_use;     // 1=未初始化的卡
+	int32_t balance;             // 卡上当前余额
+} CardSession;
+
+// 打开会话：认证余额块所在扇区→读余额块，卡片已经由防冲突选中
+// 读出的余额不在[0, MAX_BALANCE]内(块损坏或被改写)按读失败处理，后面的充值/扣费不会用到它
+// 返回值：0=成功，2=验证失败，3=读写失败
+static unsigned char CardSession_Open(CardSession *session, MFRC522_Uid *card)
 {
 	unsigned char status;
-	unsigned char read_data[16];
-	unsigned char write_data[16];
-	unsigned char current_balance;
-	unsigned char i;
 	
-	// 1. 选择卡片
-	status = MFRC522_SelectTag(card_id);
-	if(status != MI_OK)
+	session->card = card;
+	
+	// SAK没有0x08位的不是Mifare_One(例如UltraLight)，没有扇区密钥
+	if(!(card->sak & 0x08))
 	{
-		printf("Select card failed\r\n");
-		return 3;
+		LOG_W("Not a Mifare One card, SAK %X\r\n", card->sak);
+		MFRC522_Halt();
+		return 2;
 	}
 	
-	// 2. 验证密码（使用默认密钥）
-	status = MFRC522_AuthState(PICC_AUTHENT1A, BALANCE_BLOCK_ADDR, default_key, card_id);
+	PERF_Begin(PERF_AUTH);
+	status = MFRC522_AuthState(PICC_AUTHENT1A, BALANCE_BLOCK_ADDR, default_key, MFRC522_UID_AUTH(card));
 	if(status != MI_OK)
 	{
-		printf("Auth failed\r\n");
+		LOG_W("Auth failed\r\n");
+		MFRC522_Halt();
 		return 2;
 	}
+	PERF_End(PERF_AUTH);
 	
-	// 3. 读取余额块
-	status = MFRC522_Read(BALANCE_BLOCK_ADDR, read_data);
+	PERF_Begin(PERF_READ);
+	status = MFRC522_Read(BALANCE_BLOCK_ADDR, session->block);
 	if(status != MI_OK)
 	{
-		printf("Read failed\r\n");
+		LOG_W("Read failed\r\n");
+		MFRC522_Halt();
 		return 3;
 	}
+	PERF_End(PERF_READ);
 	
 	// 调试：打印读取到的数据
-	printf("Read data: ");
-	for(i = 0; i < 16; i++)
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+	Log_Printf("Read data: ");
+	for(unsigned char i = 0; i < 16; i++)
 	{
-		printf("%02X ", read_data[i]);
+		Log_Printf("%02X ", session->block[i]);
 	}
-	printf("\r\n");
+	Log_Printf("\r\n");
+#endif
 	
-	// 4. 检查是否是第一次使用
-	// 判断条件：第二个字节不是初始化标识，或者余额块全为0xFF/0x00
-	unsigned char is_first_use = 0;
+	session->first_use = 0;
+	if(MFRC522_ParseValueBlock(session->block, &session->balance) == MI_OK)
+	{
+		session->format = CARD_FMT_VALUE;
+		LOG_D("Current balance: %ld\r\n", (long)session->balance);
+	}
+	else if(session->block[1] == INIT_FLAG)
+	{
+		// 旧格式，下次写入时转换成值块
+		session->format = CARD_FMT_LEGACY;
+		session->balance = session->block[0];
+		LOG_D("Legacy balance: %ld\r\n", (long)session->balance);
+	}
+	else
+	{
+		// 既不是值块也没有初始化标识（全0xFF、全0x00等），按第一次使用处理
+		session->format = CARD_FMT_NEW;
+		session->first_use = 1;
+		session->balance = INITIAL_BALANCE;
+		LOG_I("First use detected, init balance: %d\r\n", INITIAL_BALANCE);
+	}
 	
-	// 检查初始化标识（第二个字节）
-	if(read_data[1] != INIT_FLAG)
+	if(session->balance < 0 || session->balance > MAX_BALANCE)
 	{
-		// 没有初始化标识，检查是否全为0xFF或0x00
-		unsigned char all_ff = 1;
-		unsigned char all_00 = 1;
-		
-		for(i = 0; i < 16; i++)
-		{
-			if(read_data[i] != 0xFF)
-			{
-				all_ff = 0;
-			}
-			if(read_data[i] != 0x00)
-			{
-				all_00 = 0;
-			}
-		}
-		
-		// 如果全为0xFF或全为0x00，认为是第一次使用（未初始化）
-		if(all_ff || all_00)
-		{
-			is_first_use = 1;
-		}
-		else
-		{
-			// 有数据但没有标识，可能是旧格式，也认为是第一次使用
-			is_first_use = 1;
-		}
+		LOG_W("Balance out of range: %ld\r\n", (long)session->balance);
+		MFRC522_Halt();
+		return 3;
 	}
 	
-	if(is_first_use)
+	return 0;
+}
+
+// 提交会话：把新余额写回余额块（认证仍然有效，无需重新认证）
+// 值块用增值/减值+Transfer在卡内原子完成；新卡和旧格式整块写成值块
+// 返回值：0=成功，3=写失败
+static unsigned char CardSession_Commit(CardSession *session, int32_t new_balance)
+{
+	char status;
+	
+	PERF_Begin(PERF_WRITE);
+	if(session->format == CARD_FMT_VALUE)
 	{
-		// 第一次使用，初始化余额为100
-		printf("First use detected, init balance: %d\r\n", INITIAL_BALANCE);
-		for(i = 0; i < 16; i++)
-		{
-			write_data[i] = 0x00;
-		}
-		write_data[0] = INITIAL_BALANCE;  // 在第一个字节存储余额
-		write_data[1] = INIT_FLAG;         // 在第二个字节存储初始化标识
-		current_balance = INITIAL_BALANCE;
+		status = MFRC522_ValueAdd(BALANCE_BLOCK_ADDR, new_balance - session->balance);
 	}
 	else
 	{
-		// 读取当前余额（存储在第一个字节）
-		current_balance = read_data[0];
-		printf("Current balance: %d\r\n", current_balance);
-		
-		// 检查余额是否充足
-		if(current_balance < DEDUCT_AMOUNT)
+		status = MFRC522_WriteValue(BALANCE_BLOCK_ADDR, new_balance);
+	}
+	
+	if(status != MI_OK)
+	{
+		LOG_W("Write failed\r\n");
+		return 3;
+	}
+	PERF_End(PERF_WRITE);
+	
+	LOG_D("Write acknowledged, balance: %ld\r\n", (long)new_balance);
+	session->format = CARD_FMT_VALUE;
+	session->first_use = 0;
+	session->balance = new_balance;
+	return 0;
+}
+
+// 结束会话：让卡片休眠
+static void CardSession_Close(CardSession *session)
+{
+	(void)session;
+	PERF_Begin(PERF_HALT);
+	MFRC522_Halt();
+	PERF_End(PERF_HALT);
+}
+
+// 余额管理函数：一次会话内完成初始化、充值和扣费
+// 第一次使用的卡初始化为100；有待充值金额时先加上（最大MAX_BALANCE）；
+// 已初始化的卡或本次有充值时再扣费10，余额不足则不扣
+// 参数：card - 已选中的卡片，add_amount - 待充值金额（0=无充值）
+// 返回值：0=成功，1=余额不足，2=验证失败，3=读写失败
+unsigned char ProcessCardBalance(MFRC522_Uid *card, int32_t add_amount, int32_t *new_balance)
+{
+	CardSession session;
+	unsigned char status;
+	unsigned char result = 0;
+	int32_t balance;
+	
+	status = CardSession_Open(&session, card);
+	if(status != 0)
+	{
+		return status;
+	}
+	
+	balance = session.balance;
+	
+	// 1. 充值（防止溢出）
+	if(add_amount > 0)
+	{
+		if(add_amount > MAX_BALANCE - balance)
 		{
-			printf("Insufficient balance: %d\r\n", current_balance);
-			*new_balance = current_balance;
-			MFRC522_Halt();  // 让卡片休眠
-			return 1;  // 余额不足
+			balance = MAX_BALANCE;
+			LOG_W("AddBalance: Balance overflow, set to max %ld\r\n", (long)MAX_BALANCE);
 		}
-		
-		// 扣费：余额减去10
-		current_balance -= DEDUCT_AMOUNT;
-		
-		// 准备写入数据
-		for(i = 0; i < 16; i++)
+		else
 		{
-			write_data[i] = read_data[i];
+			balance += add_amount;
 		}
-		write_data[0] = current_balance;  // 更新余额
-		
-		printf("Deduct %d, new balance: %d\r\n", DEDUCT_AMOUNT, current_balance);
+		LOG_I("AddBalance: Current=%ld, Add=%ld, New=%ld\r\n", (long)session.balance, (long)add_amount, (long)balance);
 	}
 	
-	// 5. 写入更新后的余额
-	status = MFRC522_Write(BALANCE_BLOCK_ADDR, write_data);
-	if(status != MI_OK)
+	// 2. 扣费：第一次使用且没有充值时只初始化，不扣费
+	if(!session.first_use || add_amount > 0)
 	{
-		printf("Write failed\r\n");
-		MFRC522_Halt();
-		return 3;
+		if(balance < DEDUCT_AMOUNT)
+		{
+			LOG_W("Insufficient balance: %ld\r\n", (long)balance);
+			result = 1;  // 余额不足
+		}
+		else
+		{
+			balance -= DEDUCT_AMOUNT;
+			LOG_I("Deduct %d, new balance: %ld\r\n", DEDUCT_AMOUNT, (long)balance);
+		}
 	}
 	
-	// 6. 验证写入是否成功（重新读取验证）
-	delay_ms(10);  // 等待写入完成
-	status = MFRC522_AuthState(PICC_AUTHENT1A, BALANCE_BLOCK_ADDR, default_key, card_id);
-	if(status == MI_OK)
+	// 3. 余额有变化（或需要初始化/转换格式）时写一次
+	if(session.format != CARD_FMT_VALUE || balance != session.balance)
 	{
-		unsigned char verify_data[16];
-		status = MFRC522_Read(BALANCE_BLOCK_ADDR, verify_data);
-		if(status == MI_OK)
+		if(CardSession_Commit(&session, balance) != 0)
 		{
-			if(verify_data[0] == current_balance)
-			{
-				printf("Write verified successfully\r\n");
-			}
-			else
-			{
-				printf("Write verification failed: expected %d, got %d\r\n", current_balance, verify_data[0]);
-			}
+			CardSession_Close(&session);
+			return 3;
 		}
 	}
 	
-	// 7. 让卡片休眠
-	MFRC522_Halt();
+	CardSession_Close(&session);
 	
-	*new_balance = current_balance;
-	return 0;  // 成功
+	*new_balance = balance;
+	return result;
 }
 
 // 根据卡片ID获取固定的卡号（0=Card1, 1=Card2, 2=Card3, -1=未识别）
-static int get_card_index_by_id(const unsigned char *card_id)
+// 固定的卡都是4字节UID，7/10字节UID的卡不比较
+static int get_card_index_by_id(const MFRC522_Uid *card)
 {
+	const unsigned char *card_id = card->uid;
+	
+	if(card->size != 4)
+	{
+		return -1;
+	}
+	
 	// 调试：打印实际读取的卡片ID字节
-	printf("Checking card ID: %02X%02X%02X%02X\r\n", 
+	LOG_D("Checking card ID: %02X%02X%02X%02X\r\n", 
 	       card_id[0], card_id[1], card_id[2], card_id[3]);
 	
 	// 检查是否是Card1: 40E9D961
@@ -285,336 +339,574 @@ static int get_card_index_by_id(const unsigned char *card_id)
 	}
 	
 	// 调试：打印期望的ID用于对比
-	printf("Expected Card1: %02X%02X%02X%02X\r\n", 
+	LOG_D("Expected Card1: %02X%02X%02X%02X\r\n", 
 	       CARD1_ID[0], CARD1_ID[1], CARD1_ID[2], CARD1_ID[3]);
-	printf("Expected Card2: %02X%02X%02X%02X\r\n", 
+	LOG_D("Expected Card2: %02X%02X%02X%02X\r\n", 
 	       CARD2_ID[0], CARD2_ID[1], CARD2_ID[2], CARD2_ID[3]);
-	printf("Expected Card3: %02X%02X%02X%02X\r\n", 
+	LOG_D("Expected Card3: %02X%02X%02X%02X\r\n", 
 	       CARD3_ID[0], CARD3_ID[1], CARD3_ID[2], CARD3_ID[3]);
 	
 	return -1;  // 未识别的卡片
 }
 
 // 兼容函数：register_card现在直接返回固定卡号
-static int register_card(const unsigned char *card_id)
+static int register_card(const MFRC522_Uid *card)
 {
-	int idx = get_card_index_by_id(card_id);
+	const unsigned char *card_id = card->uid;
+	int idx = get_card_index_by_id(card);
 	if(idx >= 0)
 	{
-		printf("Card%d detected (ID: %02X%02X%02X%02X)\r\n", idx + 1, 
+		LOG_D("Card%d detected (ID: %02X%02X%02X%02X)\r\n", idx + 1, 
 		       card_id[0], card_id[1], card_id[2], card_id[3]);
 		return idx;
 	}
 	
-	printf("Unknown card (ID: %02X%02X%02X%02X)\r\n", 
+	LOG_W("Unknown card (ID: %02X%02X%02X%02X)\r\n", 
 	       card_id[0], card_id[1], card_id[2], card_id[3]);
 	return -1;
 }
 
-static void PublishCardBalance(const unsigned char *card_id, unsigned char balance)
+// 待发布的余额：每张卡只保留最新值，由发布任务在线时合并发出，离线期间不丢
+#define PUBLISH_CARD_NUM    3
+#define PUBLISH_ALL         ((1 << PUBLISH_CARD_NUM) - 1)
+#define PUBLISH_WINDOW_MS   300   // 第一条改动之后最多等这么久，窗口内各卡的改动合成一条发出
+static int32_t publish_balance[PUBLISH_CARD_NUM];
+static unsigned char publish_pending;  // 位i=Card(i+1)有待发布的余额
+static unsigned int publish_since;     // 窗口开始(第一条待发布改动)的时刻
+// 已交给ESP8266、还没有结果的发布，按发送顺序记下各自包含的卡；发送失败(含断线丢弃)时放回待发布
+#define PUBLISH_INFLIGHT_NUM 4
+static unsigned char publish_inflight[PUBLISH_INFLIGHT_NUM];
+static unsigned char publish_inflightRd, publish_inflightNum;
+
+// 属性上报报文启动时组好一次(固定头部、topic、"params":{之前的部分)，
+// 发布时只在"params":{之后写各卡的属性，按实际长度发送。骨架末尾的空格给最长的消息体占位
+#define PUBLISH_SKELETON    "{\"id\":\"123\",\"params\":{" \
+                            "                              " \
+                            "                              " \
+                            "                              "   // 每项最长29字节："CardN":{"value":-2147483648},
+static ONENET_TEMPLATE publish_tpl;
+static char *publish_params;  // "params":{之后
+
+static void Publish_TemplateInit(void)
 {
-	int card_index = register_card(card_id);
-	if(card_index < 0)
-		return;
+	if(OneNet_TemplateInit(&publish_tpl, devPubTopic, PUBLISH_SKELETON) == 0)
+		publish_params = OneNet_TemplateFind(&publish_tpl, "\"params\":{");
+	if(publish_params == NULL)
+		LOG_E("ERR: publish template\r\n");
+}
 
-	memset(publish_buf, 0, sizeof(publish_buf));
-	snprintf(publish_buf, sizeof(publish_buf), "{\"id\":\"123\",\"params\":{\"Card%d\":{\"value\":%d}}}", card_index + 1, balance);
+static char *Publish_PutInt(char *p, int32_t value)
+{
+	char digits[10];
+	uint32_t v = value < 0 ? 0 - (uint32_t)value : (uint32_t)value;
+	unsigned char n = 0;
 
-	printf("Publish payload: %s\r\n", publish_buf);
-	OneNet_Publish(devPubTopic, publish_buf);
-	
-	// 不在这里主动检查订阅数据，让主循环统一处理
-	// 这样可以避免读取不完整数据导致解析失败
+	do
+	{
+		digits[n++] = '0' + v % 10;
+		v /= 10;
+	} while(v);
+	if(value < 0)
+		*p++ = '-';
+	while(n)
+		*p++ = digits[--n];
+	return p;
 }
 
-// 充值函数：给指定卡片增加余额
-// 参数：card_id - 卡片ID，add_amount - 增加的金额
-// 返回值：0=成功，1=卡片不存在，2=验证失败，3=读写失败
-unsigned char AddCardBalance(unsigned char *card_id, unsigned char add_amount)
+// 把mask里各卡的余额写进模板，返回消息体长度；不格式化整个JSON
+static unsigned short Publish_TemplatePatch(unsigned char mask)
 {
-	unsigned char status;
-	unsigned char read_data[16];
-	unsigned char write_data[16];
-	unsigned char current_balance;
+	static const char item_head[] = "\"Card1\":{\"value\":";
+	char *p = publish_params;
 	unsigned char i;
-	unsigned char new_balance;
-	
-	// 1. 选择卡片
-	status = MFRC522_SelectTag(card_id);
-	if(status != MI_OK)
-	{
-		printf("AddBalance: Select card failed\r\n");
-		return 3;
-	}
-	
-	// 2. 验证密码（使用默认密钥）
-	status = MFRC522_AuthState(PICC_AUTHENT1A, BALANCE_BLOCK_ADDR, default_key, card_id);
-	if(status != MI_OK)
+
+	for(i = 0; i < PUBLISH_CARD_NUM; i++)
 	{
-		printf("AddBalance: Auth failed\r\n");
-		MFRC522_Halt();
-		return 2;
+		if(!(mask & (1 << i)))
+			continue;
+		memcpy(p, item_head, sizeof(item_head) - 1);
+		p[5] = '1' + i;
+		p = Publish_PutInt(p + sizeof(item_head) - 1, publish_balance[i]);
+		*p++ = '}';
+		*p++ = ',';
 	}
-	
-	// 3. 读取余额块
-	status = MFRC522_Read(BALANCE_BLOCK_ADDR, read_data);
-	if(status != MI_OK)
+	p[-1] = '}';     // 最后一项的','换成params的'}'
+	*p++ = '}';
+	return p - ((char *)publish_tpl.buf + publish_tpl.msg);
+}
+
+static void PublishCardBalance(const MFRC522_Uid *card, int32_t balance)
+{
+	int card_index = register_card(card);
+	if(card_index < 0 || card_index >= PUBLISH_CARD_NUM)
+		return;
+
+	if(publish_pending == 0)
+		publish_since = millis();
+	publish_balance[card_index] = balance;
+	publish_pending |= 1 << card_index;
+}
+
+// 根据卡片索引取对应的待充值金额（0=Card1, 1=Card2, 2=Card3），未识别返回NULL
+static int *GetPendingCharge(int card_index)
+{
+	if(card_index == 0)
+		return &c1c_value;
+	else if(card_index == 1)
+		return &c2c_value;
+	else if(card_index == 2)
+		return &c3c_value;
+	
+	return NULL;
+}
+
+#define NET_LINK_WAIT       0    // 等待WiFi/TCP就绪
+#define NET_LINK_CONNACK    1    // 已发CONNECT，等平台响应
+#define NET_LINK_ONLINE     2    // 已连接并订阅
+#define NET_CONNACK_TIMEOUT 5000 // ms
+#define MQTT_PING_MS        120000 // 心跳间隔，CONNECT里的keepalive是256s
+
+static unsigned char net_state = NET_LINK_WAIT;
+static unsigned int net_tick;
+static unsigned int ping_tick;
+
+#define RFID_ERR_RESET      8    // 连续这么多次寻卡/防冲突出错才复位RC522
+static unsigned char rfid_errors;
+
+// RC522复位并重新打开天线：启动时一次，之后只在通讯连续出错时
+static void RFID_Restart(void)
+{
+	MFRC522_Reset();
+	MFRC522_AntennaOn();
+	rfid_errors = 0;
+}
+
+// 通讯出错计数，连续出错说明芯片状态不对，复位恢复
+static void RFID_Error(void)
+{
+	if(++rfid_errors >= RFID_ERR_RESET)
 	{
-		printf("AddBalance: Read failed\r\n");
-		MFRC522_Halt();
-		return 3;
+		LOG_W("RC522 errors, reset\r\n");
+		RFID_Restart();
 	}
+}
+
+#if MFRC522_LPCD
+#define RFID_LPCD_MISSES    3    // 开着场连续这么多次没有卡才关场，回到低功耗寻卡
+static unsigned char rfid_misses;
+static unsigned int rfid_probe_tick;    // 上次开场探测的时刻
+static unsigned int rfid_probes;
+static unsigned int rfid_hits;
+
+// 低功耗寻卡：场关着时按间隔开一下场探测，探到卡后场一直开着，卡拿走了再关
+static unsigned char RFID_Request(void)
+{
+	unsigned char status;
 	
-	// 4. 检查是否已初始化
-	if(read_data[1] != INIT_FLAG)
+	if(!MFRC522_FieldOn())
 	{
-		// 未初始化，先初始化为100
-		printf("AddBalance: Card not initialized, init first\r\n");
-		for(i = 0; i < 16; i++)
+		if(millis() - rfid_probe_tick < MFRC522_LPCD_INTERVAL_MS)
+			return MI_NOTAGERR;
+		rfid_probe_tick = millis();
+		rfid_probes++;
+		status = MFRC522_LpcdProbe(PICC_REQALL, buf);
+		if(status == MI_OK)
 		{
-			write_data[i] = 0x00;
+			rfid_hits++;
+			rfid_misses = 0;
 		}
-		write_data[0] = INITIAL_BALANCE;
-		write_data[1] = INIT_FLAG;
-		current_balance = INITIAL_BALANCE;
+		return status;
 	}
-	else
+	
+	status = MFRC522_Request(PICC_REQALL, buf);
+	if(status == MI_OK)
+		rfid_misses = 0;
+	else if(++rfid_misses >= RFID_LPCD_MISSES)
+		MFRC522_AntennaOff();
+	return status;
+}
+#else
+#define RFID_Request()      MFRC522_Request(PICC_REQALL, buf)
+#endif
+
+#define RFID_CARD_MAX       4    // 一次寻卡最多处理的卡片数，天线区里再多的卡不处理
+#define RFID_GONE_MISSES    3    // 连续这么多次寻不到卡，才认为之前的卡都拿走了
+static MFRC522_Uid rfid_seen[RFID_CARD_MAX];  // 上一次寻到的卡，一直放着的不重复处理
+static unsigned char rfid_seenNum;
+static unsigned char rfid_gone;
+
+static unsigned char RFID_SameUid(const MFRC522_Uid *a, const MFRC522_Uid *b)
+{
+	return a->size == b->size && memcmp(a->uid, b->uid, a->size) == 0;
+}
+
+// 新放上来的卡才处理：上一次寻卡时不在，也不是上次处理的那张（同一张卡连续刷只处理一次）
+static unsigned char RFID_IsNew(const MFRC522_Uid *card)
+{
+	unsigned char i;
+	
+	if(RFID_SameUid(card, &last_card))
+		return 0;
+	for(i = 0; i < rfid_seenNum; i++)
 	{
-		// 已初始化，读取当前余额
-		current_balance = read_data[0];
+		if(RFID_SameUid(card, &rfid_seen[i]))
+			return 0;
 	}
+	return 1;
+}
+
+// 记下这一次寻到的卡；没有寻完（选卡出错、REQA没寻到、到了RFID_CARD_MAX）时
+// 只往里加，不去掉没寻到的，否则还放着的卡下一次会被当成新卡再扣一次
+static void RFID_Seen(const MFRC522_Uid *cards, unsigned char num, unsigned char complete)
+{
+	unsigned char i, j;
 	
-	// 5. 增加余额（防止溢出）
-	if((unsigned int)current_balance + (unsigned int)add_amount > 255)
+	if(complete)
+		rfid_seenNum = 0;
+	for(i = 0; i < num; i++)
 	{
-		new_balance = 255;  // 最大255
-		printf("AddBalance: Balance overflow, set to max 255\r\n");
+		for(j = 0; j < rfid_seenNum && !RFID_SameUid(&cards[i], &rfid_seen[j]); j++)
+			;
+		if(j == rfid_seenNum && rfid_seenNum < RFID_CARD_MAX)
+			rfid_seen[rfid_seenNum++] = cards[i];
 	}
-	else
+}
+
+// 处理一张新卡：一次会话里完成充值/扣费，会话结束时卡片HALT
+static void RFID_Process(MFRC522_Uid *card, unsigned int tap_start)
+{
+	last_card = *card;
+	PERF_BeginAt(PERF_TAP, tap_start);  // 发布完成(SEND OK)时结束
+	
+	// 注册卡片并获取索引
+	int card_index = register_card(card);
+	
+	// 待充值金额与扣费在同一次卡片会话中完成
+	int *pending = GetPendingCharge(card_index);
+	int32_t add_amount = 0;
+	if(pending != NULL && *pending > 0)
 	{
-		new_balance = current_balance + add_amount;
+		add_amount = *pending;
+		LOG_I("Charging Card%d with %d\r\n", card_index + 1, *pending);
 	}
 	
-	printf("AddBalance: Current=%d, Add=%d, New=%d\r\n", current_balance, add_amount, new_balance);
+	// 处理卡片余额（初始化、充值、扣费）
+	int32_t new_balance = 0;
+	unsigned char balance_status = ProcessCardBalance(card, add_amount, &new_balance);
 	
-	// 6. 准备写入数据
-	for(i = 0; i < 16; i++)
+	if(balance_status == 0 || balance_status == 1)
 	{
-		write_data[i] = read_data[i];
+		// 清零避免重复充值；会话期间平台又下发了新金额则保留到下次
+		if(add_amount > 0 && *pending == add_amount)
+		{
+			*pending = 0;
+		}
+		// 显示卡号和余额
+		OLED_ShowSearchingAndID(card, new_balance);
+		if(balance_status == 0)
+			LOG_I("Balance processed successfully: %ld\r\n", (long)new_balance);
+		else
+			LOG_W("Insufficient balance!\r\n");
+		PublishCardBalance(card, new_balance);
 	}
-	write_data[0] = new_balance;  // 更新余额
-	
-	// 7. 写入更新后的余额
-	status = MFRC522_Write(BALANCE_BLOCK_ADDR, write_data);
-	if(status != MI_OK)
+	else
 	{
-		printf("AddBalance: Write failed\r\n");
-		MFRC522_Halt();
-		return 3;
+		// 验证或读写失败，只显示卡号，余额显示为0
+		// 失败时不发布余额，避免发送错误数据
+		OLED_ShowSearchingAndID(card, 0);
+		LOG_W("Balance process failed!\r\n");
 	}
+}
+
+// 寻卡任务：寻卡→逐张防冲突选卡，新放上来的卡在一次会话里完成充值/扣费，
+// 显示和发布交给OLED任务和发布任务。
+// 防冲突遇到过冲突说明还有别的卡：当前的卡处理完(或跳过)后已经HALT，
+// 再用REQA寻还没HALT的卡，直到某一张选卡时不再有冲突
+static void RFID_Task(void)
+{
+	MFRC522_Uid cards[RFID_CARD_MAX];  // 这一次寻到的卡
+	unsigned char num = 0;
+	unsigned char complete = 0;        // 天线区里的卡都寻到了
+	unsigned char status;		// RFID操作状态
+	unsigned int tap_start;          // 寻卡成功时的周期数，刷卡总耗时从这里算
+	
+	PERF_Begin(PERF_REQUEST);
+	status = RFID_Request();  // 寻卡
+		if (status != MI_OK)
+		{    
+				// 没有卡是常态：芯片保持配置，下次只再发一次WUPA，不更新显示
+				if (status == MI_ERR)
+					RFID_Error();
+				else if (rfid_seenNum && ++rfid_gone >= RFID_GONE_MISSES)
+					rfid_seenNum = 0;
+				return;
+		}
+		PERF_End(PERF_REQUEST);
+		tap_start = PERF_Now();
+		rfid_gone = 0;
+
+		LOG_D("card type:%X%X", buf[0], buf[1]);
 	
-	// 8. 验证写入
-	delay_ms(10);
-	status = MFRC522_AuthState(PICC_AUTHENT1A, BALANCE_BLOCK_ADDR, default_key, card_id);
-	if(status == MI_OK)
-	{
-		unsigned char verify_data[16];
-		status = MFRC522_Read(BALANCE_BLOCK_ADDR, verify_data);
-		if(status == MI_OK && verify_data[0] == new_balance)
+		while (1)
 		{
-			printf("AddBalance: Write verified successfully\r\n");
+			status = MFRC522_Select(&cards[num]);
+			if (status != MI_OK)
+			{    
+						if (num == 0)
+							RFID_Error();
+						break;    
+			}
+			rfid_errors = 0;
+			
+			LOG_D("card id%X%X%X%X, %d bytes, SAK %X\r\n", cards[num].uid[0], cards[num].uid[1],
+			      cards[num].uid[2], cards[num].uid[3], cards[num].size, cards[num].sak);
+			
+			// 只有，仅限，唯一条件：新放上来的卡才更新显示和处理余额
+			if (RFID_IsNew(&cards[num]))
+				RFID_Process(&cards[num], tap_start);
+			else
+				MFRC522_Halt();
+			
+			// 选这张卡时没有冲突，说明它是最后一张
+			if (!cards[num++].multi)
+			{
+				complete = 1;
+				break;
+			}
+			if (num >= RFID_CARD_MAX || MFRC522_Request(PICC_REQIDL, buf) != MI_OK)
+				break;
 		}
+		
+		RFID_Seen(cards, num, complete);
+}
+
+// 模块接收任务：推进AT命令队列，每次最多处理一条平台下发的报文
+static void Modem_Task(void)
+{
+	unsigned char *ipd;
+	
+	ESP8266_Process();
+	
+	ipd = ESP8266_GetIPD(0);  // 不等待
+	if(ipd != NULL)
+		OneNet_RevPro(ipd);
+}
+
+// 云平台连接管理（不等待）：TCP就绪后发CONNECT，收到CONNACK后订阅；
+// TCP断开或平台无响应时重新连接
+static void Link_Task(void)
+{
+	switch(net_state)
+	{
+		case NET_LINK_WAIT:
+			if(ESP8266_IsReady() && OneNet_DevLink() == 0)
+			{
+				net_tick = millis();
+				net_state = NET_LINK_CONNACK;
+			}
+			break;
+		case NET_LINK_CONNACK:
+			if(OneNet_IsOnline())
+			{
+				OneNet_Subscribe(devSubTopic, 1);
+				net_state = NET_LINK_ONLINE;
+				ping_tick = millis();
+				// 还没有刷过卡时把"connecting"换成"searching"
+				if(last_card.size == 0)
+				{
+					OLED_Clear();
+					OLED_ShowString(0, 0, "searching", 16, 1);
+				}
+			}
+			else if(!ESP8266_IsReady() || millis() - net_tick >= NET_CONNACK_TIMEOUT)
+			{
+				net_state = NET_LINK_WAIT;
+			}
+			break;
+		default:
+			if(!OneNet_IsOnline())
+			{
+				LOG_W("Cloud link lost, reconnecting\r\n");
+				net_state = NET_LINK_WAIT;
+			}
+			else if(OneNet_PingOverdue())
+			{
+				// 心跳没有应答：链路已断但模块没报(透传时收不到CLOSED)，主动重连
+				LOG_W("No PINGRESP, reconnecting\r\n");
+				ESP8266_Reconnect();
+				net_state = NET_LINK_WAIT;
+			}
+			break;
 	}
+}
+
+// MQTT心跳：在线时按MQTT_PING_MS发PINGREQ
+static void Ping_Task(void)
+{
+	if(net_state != NET_LINK_ONLINE || millis() - ping_tick < MQTT_PING_MS)
+		return;
+	if(OneNet_Ping() == 0)
+		ping_tick = millis();
+}
+
+// 把显存改动的部分刷到OLED
+static void Oled_Task(void)
+{
+	// 只统计真正有改动要刷的那次，不算等任务调度的时间
+	if(!OLED_Dirty())
+		return;
+	PERF_Begin(PERF_OLED);
+	OLED_Flush();
+	PERF_End(PERF_OLED);
+}
+
+// 一条发布的发送结果：ESP8266按发送顺序回调
+static void Publish_Done(unsigned char result)
+{
+	unsigned char mask = publish_inflight[publish_inflightRd];
 	
-	// 9. 发布新余额到平台（不在此处休眠，避免紧接着的扣费流程重新选卡失败）
-	PublishCardBalance(card_id, new_balance);
+	publish_inflightRd = (publish_inflightRd + 1) % PUBLISH_INFLIGHT_NUM;
+	publish_inflightNum--;
+	if(result == ESP8266_AT_OK)
+		return;
 	
-	return 0;  // 成功
+	LOG_W("Publish failed, retry Card mask %02X\r\n", mask);
+	if(publish_pending == 0)
+		publish_since = millis();
+	publish_pending |= mask;  // 这期间有新余额的卡本来就在待发布里，发的是最新值
 }
 
-// 处理充值：检查当前卡片对应的c值，如果大于0则充值
-// 参数：card_id - 当前卡片ID，card_index - 卡片索引（0=Card1, 1=Card2, 2=Card3）
-// 返回值：1=已充值（已发布），0=未充值
-static unsigned char ProcessChargeForCard(unsigned char *card_id, int card_index)
+// 发布任务：窗口到期或各卡都有改动时，把待发布的余额合成一条发出，ESP8266发送队列满就下次再发
+static void Publish_Task(void)
 {
-	if(card_index < 0 || card_index >= 3)
-		return 0;
+	unsigned char mask = publish_pending;
+	unsigned short len;
+	
+	if(mask == 0 || !OneNet_IsOnline() || publish_params == NULL ||
+	   publish_inflightNum >= PUBLISH_INFLIGHT_NUM)
+		return;
+	if(mask != PUBLISH_ALL && millis() - publish_since < PUBLISH_WINDOW_MS)
+		return;  // 窗口没到，也没攒满
+	
+	PERF_Begin(PERF_MQTT_PACK);
+	len = Publish_TemplatePatch(mask);
+	PERF_End(PERF_MQTT_PACK);
 	
-	// 根据卡片索引检查对应的c值
-	if(card_index == 0 && c1c_value > 0)
+	LOG_I("Publish payload: %.*s\r\n", len, (char *)publish_tpl.buf + publish_tpl.msg);
+	if(OneNet_PublishTemplate(&publish_tpl, len, Publish_Done) == 0)
 	{
-		printf("Charging Card1 with %d\r\n", c1c_value);
-		if(AddCardBalance(card_id, (unsigned char)c1c_value) == 0)
-		{
-			c1c_value = 0;  // 清零，避免重复充值
-			return 1;  // 已充值并发布
-		}
+		publish_inflight[(publish_inflightRd + publish_inflightNum) % PUBLISH_INFLIGHT_NUM] = mask;
+		publish_inflightNum++;
+		publish_pending &= ~mask;
 	}
-	else if(card_index == 1 && c2c_value > 0)
+}
+
+#if MFRC522_LPCD
+#define SLEEP_QUIET_MS      100   // 各项都空闲这么久之后才进STOP
+#define SLEEP_MIN_MS        10    // 离下次探测不到这么久就不睡了
+static unsigned int sleep_until;  // 这之前不进STOP
+static _Bool sleep_off;           // 唤醒后HSE重试才起振，晶振不可靠，不再进STOP
+
+// 能进STOP：没有待发布的余额，链路在线，模块、日志、OLED都没有进行中的传输
+static _Bool Sleep_Ready(void)
+{
+	return publish_pending == 0 && net_state == NET_LINK_ONLINE &&
+		   !OneNet_PingPending() && ESP8266_IsIdle() && Log_Idle() && !OLED_Dirty();
+}
+
+// 低功耗任务：空闲时在两次探测之间进STOP，由RC522定时器唤醒
+// 睡之前拉高RTS，平台的下发留在ESP8266里，恢复时钟后再放开，下发最多晚一个探测间隔；
+// 模块没打开流控就不睡
+static void Sleep_Task(void)
+{
+	unsigned int now = millis();
+	unsigned int since = now - rfid_probe_tick;
+	
+	if(sleep_off || MFRC522_FieldOn())
+		return;                 // 正在探测或读卡，卡拿走后场会关掉
+	if(!Sleep_Ready())
 	{
-		printf("Charging Card2 with %d\r\n", c2c_value);
-		if(AddCardBalance(card_id, (unsigned char)c2c_value) == 0)
-		{
-			c2c_value = 0;  // 清零，避免重复充值
-			return 1;  // 已充值并发布
-		}
+		sleep_until = now + SLEEP_QUIET_MS;
+		return;
 	}
-	else if(card_index == 2 && c3c_value > 0)
+	if((int)(now - sleep_until) < 0 || since + SLEEP_MIN_MS >= MFRC522_LPCD_INTERVAL_MS)
+		return;
+	
+	if(!ESP8266_Hold(1))
 	{
-		printf("Charging Card3 with %d\r\n", c3c_value);
-		if(AddCardBalance(card_id, (unsigned char)c3c_value) == 0)
-		{
-			c3c_value = 0;  // 清零，避免重复充值
-			return 1;  // 已充值并发布
-		}
+		sleep_until = now + SLEEP_QUIET_MS;
+		return;
 	}
+	MFRC522_WakeTimerStart(MFRC522_LPCD_INTERVAL_MS - since + 1);  // 多1ms，醒来时探测一定到期
+	if(Power_Stop(MFRC522_WakeTimerStop) != SUCCESS)
+	{
+		sleep_off = 1;
+		LOG_W("HSE slow to restart after STOP, sleep disabled\r\n");
+	}
+	ESP8266_Hold(0);
+	SCHED_Resume();
+}
+
+// 每分钟报告一次STOP和射频场的占空比
+static void Lpcd_Report(void)
+{
+	unsigned int up = millis();
+	unsigned int permille = up ? (unsigned int)((unsigned long long)MFRC522_FieldTime() * 1000 / up) : 0;
 	
-	return 0;  // 未充值
+	Power_Report();
+	printf("lpcd: interval %u ms, %u probes, %u cards, field on %u.%u%%\r\n",
+		   MFRC522_LPCD_INTERVAL_MS, rfid_probes, rfid_hits, permille / 10, permille % 10);
 }
+#endif
 
+// 任务表：排在前面的优先；周期和截止时间单位ms
+static SCHED_TASK main_tasks[] =
+{
+	{"rfid",    RFID_Task,    50,   20},
+	{"modem",   Modem_Task,   1,    5},
+	{"link",    Link_Task,    10,   50},
+	{"publish", Publish_Task, 10,   50},
+	{"oled",    Oled_Task,    20,   50},
+	{"ping",    Ping_Task,    1000, 1000},
+	{"perf",    PERF_Process, 1000, 1000},
+#if MFRC522_LPCD
+	{"sleep",   Sleep_Task,   10,   1000},
+	{"lpcd",    Lpcd_Report,  60000, 1000},
+#endif
+};
 
 int main(void)
 { 
-	unsigned char status;		// RFID操作状态
-	unsigned int temp,i;
-	unsigned char card_changed = 0;  // 卡号是否改变标志
-	
   SystemInit();  // 系统初始化，时钟为72MHz	
-	delay_init(72);
+	delay_init(72);      // SysTick 1ms节拍，超时判断和调度用
 	LED_Init();
 	LED_On();
 	USART1_Config();
+	Log_Init();          // 日志经USART1 TX DMA在后台发出
+	PERF_Init();         // DWT周期计数，统计刷卡各阶段耗时
 	OLED_Init();  // 初始化OLED
 	OLED_Clear(); // 清屏
 	MFRC522_Init();
-	printf ( "MFRC522 Test\r\n" );
+	RFID_Restart();      // 只在这里配置一次，空闲寻卡不再复位
+#if MFRC522_LPCD
+	Power_Init();        // STOP唤醒：RC522 IRQ(EXTI1)和USART2 RX(EXTI3)
+#endif
+	LOG_I("MFRC522 Test\r\n");
 	
-	// 初始化ESP8266（会在内部初始化USART2）
+	// 启动ESP8266初始化（会在内部初始化USART2），连接过程由任务推进
 	ESP8266_Init();
+	Publish_TemplateInit();
 	
-	// 连接云平台（OneNet）
 	OLED_Clear();
 	OLED_ShowString(0, 0, "connecting", 16, 1);
-	while(OneNet_DevLink())
-	{
-		delay_ms(500);
-	}
-	OLED_Clear();
-	OLED_ShowString(0, 0, "connected", 16, 1);
-	delay_ms(1000);
-	
-	delay_ms(1000);
+	OLED_Flush();
 	
-	// 初始显示"searching"（在循环外显示）
-	OLED_Clear();
-	OLED_ShowString(0, 0, "searching", 16, 1);
-	OneNet_Subscribe(devSubTopic,1);
+	// 等待卡片应答期间让其它任务先跑(寻卡任务本身不会重入)
+	MFRC522_SetWaitHook(SCHED_Run);
+	SCHED_Init(main_tasks, sizeof(main_tasks) / sizeof(main_tasks[0]));
   while (1)
   {
-		// 处理云平台下发数据（非阻塞检查，超时50ms）
-		dataPtr = ESP8266_GetIPD(15);  // 10 * 5ms = 50ms，兼顾RFID响应速度和数据接收可靠性
-		if(dataPtr != NULL)
-			OneNet_RevPro(dataPtr);
-		
-		status = MFRC522_Request(PICC_REQALL, buf);  // 寻卡
-			if (status != MI_OK)
-			{    
-					// 寻卡失败，不做任何显示更新，保持当前显示
-					MFRC522_Reset();
-					MFRC522_AntennaOff(); 
-					MFRC522_AntennaOn(); 
-					continue;
-			}
-
-			printf("card type:");
-			for(i=0;i<2;i++)
-			{
-					temp=buf[i];
-					printf("%X",temp);
-
-			}
-		
-			status = MFRC522_Anticoll(buf);
-			if (status != MI_OK)
-			{    
-						continue;    
-			}
-			
-			
-			printf("card id");	
-			for(i=0;i<4;i++)
-			{
-					temp=buf[i];
-					printf("%X",temp);
-
-			}
-			
-			printf("\r\n");
-			
-			card_changed = 0;
-			for(i=0; i<4; i++)
-			{
-				if(buf[i] != last_card_id[i])
-				{
-					card_changed = 1;
-					break;
-				}
-			}
-			
-			// 只有，仅限，唯一条件：卡号改变时才更新显示和处理余额
-			if(card_changed)
-			{
-				// 更新储存的卡号
-				for(i=0; i<4; i++)
-				{
-					last_card_id[i] = buf[i];
-				}
-				
-				// 注册卡片并获取索引
-				int card_index = register_card(buf);
-				
-				// 先检查是否需要充值（在扣费之前）
-				unsigned char charged = 0;  // 标记是否已充值并发布
-				if(card_index >= 0 && card_index < 3)
-				{
-					charged = ProcessChargeForCard(buf, card_index);
-				}
-				
-				// 处理卡片余额（初始化或扣费）
-				unsigned char new_balance = 0;
-				unsigned char balance_status = ProcessCardBalance(buf, &new_balance);
-				
-				if(balance_status == 0)
-				{
-					// 成功，显示卡号和余额
-					OLED_ShowSearchingAndID(buf, new_balance);
-					printf("Balance processed successfully: %d\r\n", new_balance);
-					// 如果充值时已经发布过，这里就不重复发布了
-					if(!charged)
-					{
-						PublishCardBalance(buf, new_balance);
-					}
-				}
-				else if(balance_status == 1)
-				{
-					// 余额不足，显示卡号和余额
-					OLED_ShowSearchingAndID(buf, new_balance);
-					printf("Insufficient balance!\r\n");
-					// 如果充值时已经发布过，这里就不重复发布了
-					if(!charged)
-					{
-						PublishCardBalance(buf, new_balance);
-					}
-				}
-				else
-				{
-					// 验证或读写失败，只显示卡号，余额显示为0
-					// 失败时不发布余额，避免发送错误数据
-					OLED_ShowSearchingAndID(buf, 0);
-					printf("Balance process failed!\r\n");
-				}
-			}
-
+		SCHED_Run();
   }
 }
 
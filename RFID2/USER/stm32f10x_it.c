@@ -75,9 +75,7 @@ void PendSV_Handler(void)
 {
 }
  
-void SysTick_Handler(void)
-{
-}
+//SysTick_Handler在delay.c里，作为1ms节拍
 
 /******************************************************************************/
 /*                 STM32F10x Peripherals Interrupt Handlers                   */
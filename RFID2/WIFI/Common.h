@@ -1,6 +1,8 @@
 #ifndef __COMMON_H__
 #define __COMMON_H__
 
+#include <stddef.h>
+
 /*---------------------------------------------------------------------------*/
 /* Type Definition Macros                                                    */
 /*---------------------------------------------------------------------------*/
@@ -12,6 +14,5 @@
     typedef short			int16;
     typedef unsigned int    uint32;
     typedef int				int32;
-	typedef unsigned int	size_t;
 	
 #endif /* __COMMON_H__ */
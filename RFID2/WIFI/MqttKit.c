@@ -2,36 +2,38 @@
 	************************************************************
 	************************************************************
 	************************************************************
-	*	ļ 	MqttKit.c
+	*	文件名： 	MqttKit.c
 	*
-	*	ߣ 		ż
+	*	作者： 		张继瑞
 	*
-	*	ڣ 		2018-04-27
+	*	日期： 		2018-04-27
 	*
-	*	汾 		V1.6
+	*	版本： 		V1.6
 	*
-	*	˵ 		MQTTЭ
+	*	说明： 		MQTT协议
 	*
-	*	޸ļ¼	V1.1MQTT_PacketSubscribeĲΪ2topic
-	*						ʱЭbug
-	*				V1.2޸MQTT_PacketCmdRespbug
-	*				V1.3strncpy滻ΪmemcpyǱbug
-	*				V1.4޸	MQTT_PacketPublishAck
+	*	修改记录：	V1.1：解决MQTT_PacketSubscribe订阅不为2个topic
+	*						个数时协议错误的bug
+	*				V1.2：修复MQTT_PacketCmdResp的bug
+	*				V1.3：将strncpy替换为memcpy，解决潜在bug
+	*				V1.4：修复	MQTT_PacketPublishAck
 	*							MQTT_PacketPublishRel
-	*							bug
-	*				V1.5	MQTT_UnPacketCmd
+	*							函数封包错误的bug
+	*				V1.5：增加	MQTT_UnPacketCmd
 	*							MQTT_UnPacketPublish
-	*							ӿڶϢݳȵȡ
-	*				V1.6Ӷļϴӿ
+	*							接口对消息内容长度的提取参数
+	*				V1.6：增加二进制文件上传接口
+	*				V1.7：内存改用固定块内存池，不再依赖堆；
+	*						strncat替换为memcpy，缓存只清零一次
 	************************************************************
 	************************************************************
 	************************************************************
 **/
 
-//Эͷļ
+//协议头文件
 #include "MqttKit.h"
 
-//C
+//C库
 #include <string.h>
 #include <stdio.h>
 
@@ -39,24 +41,123 @@
 #define CMD_TOPIC_PREFIX		"$creq"
 
 
+//内存池：按uint32对齐，空闲块串成单链表，分配释放都是O(1)
+static uint32 mqtt_pool[MQTT_POOL_BLOCK_NUM][MQTT_POOL_BLOCK_SIZE / 4];
+static void *mqtt_poolFree;				//空闲链表头，块的前4字节存下一个空闲块
+static _Bool mqtt_poolInit;
+static MQTT_POOL_STAT mqtt_poolStat;
+
+
+//topic以CMD_TOPIC_PREFIX开头即为命令下发，只看topic本身，不越过长度
+static _Bool MQTT_IsCmdTopic(const uint8 *topic, uint16 len)
+{
+	return len >= sizeof(CMD_TOPIC_PREFIX) - 1 &&
+			memcmp(topic, CMD_TOPIC_PREFIX, sizeof(CMD_TOPIC_PREFIX) - 1) == 0;
+}
+
+
 //==========================================================
-//	ƣ	EDP_NewBuffer
+//	函数名称：	MQTT_PoolMalloc
 //
-//	ܣ	ڴ
+//	函数功能：	从内存池申请一块
 //
-//	ڲ	edpPacketṹ
-//				sizeС
+//	入口参数：	size：大小
 //
-//	ز	
+//	返回参数：	块地址，size超过MQTT_POOL_BLOCK_SIZE或没有空闲块时为NULL
 //
-//	˵		1.ʹö̬ڴ
-//				2.ʹþֲȫָڴ
+//	说明：		内容不清零
 //==========================================================
-void MQTT_NewBuffer(MQTT_PACKET_STRUCTURE *mqttPacket, uint32 size)
+void *MQTT_PoolMalloc(uint32 size)
+{
+
+	void *p;
+	uint16 i;
+	
+	if(!mqtt_poolInit)
+	{
+		for(i = 0; i < MQTT_POOL_BLOCK_NUM; i++)
+			*(void **)mqtt_pool[i] = i + 1 < MQTT_POOL_BLOCK_NUM ? mqtt_pool[i + 1] : NULL;
+		mqtt_poolFree = mqtt_pool[0];
+		mqtt_poolInit = 1;
+	}
+	
+	if(size > mqtt_poolStat.maxSize)
+		mqtt_poolStat.maxSize = size;
+	
+	if(size > MQTT_POOL_BLOCK_SIZE || mqtt_poolFree == NULL)
+	{
+		mqtt_poolStat.fails++;
+		return NULL;
+	}
+	
+	p = mqtt_poolFree;
+	mqtt_poolFree = *(void **)p;
+	
+	mqtt_poolStat.allocs++;
+	if(++mqtt_poolStat.used > mqtt_poolStat.high)
+		mqtt_poolStat.high = mqtt_poolStat.used;
+	
+	return p;
+
+}
+
+//==========================================================
+//	函数名称：	MQTT_PoolFree
+//
+//	函数功能：	归还一块到内存池
+//
+//	入口参数：	p：MQTT_PoolMalloc返回的地址，NULL时不处理
+//
+//	返回参数：	无
+//
+//	说明：		
+//==========================================================
+void MQTT_PoolFree(void *p)
 {
+
+	if(p == NULL)
+		return;
 	
-	uint32 i = 0;
+	*(void **)p = mqtt_poolFree;
+	mqtt_poolFree = p;
+	mqtt_poolStat.used--;
+
+}
+
+//==========================================================
+//	函数名称：	MQTT_PoolStat
+//
+//	函数功能：	读取内存池统计
+//
+//	入口参数：	stat：统计结果
+//
+//	返回参数：	无
+//
+//	说明：		high接近MQTT_POOL_BLOCK_NUM或fails不为0时应加大块数
+//==========================================================
+void MQTT_PoolStat(MQTT_POOL_STAT *stat)
+{
+
+	*stat = mqtt_poolStat;
+
+}
 
+//==========================================================
+//	函数名称：	EDP_NewBuffer
+//
+//	函数功能：	申请内存
+//
+//	入口参数：	edpPacket：包结构体
+//				size：大小
+//
+//	返回参数：	无
+//
+//	说明：		1.可使用动态分配来分配内存
+//				2.可使用局部或全局数组来指定内存
+//==========================================================
+void MQTT_NewBuffer(MQTT_PACKET_STRUCTURE *mqttPacket, uint32 size)
+{
+	
 	if(mqttPacket->_data == NULL)
 	{
 		mqttPacket->_memFlag = MEM_FLAG_ALLOC;
@@ -68,16 +169,12 @@ void MQTT_NewBuffer(MQTT_PACKET_STRUCTURE *mqttPacket, uint32 size)
 			
 			mqttPacket->_size = size;
 			
-			for(; i < mqttPacket->_size; i++)
-				mqttPacket->_data[i] = 0;
 		}
 	}
 	else
 	{
 		mqttPacket->_memFlag = MEM_FLAG_STATIC;
 		
-		for(; i < mqttPacket->_size; i++)
-			mqttPacket->_data[i] = 0;
 		
 		mqttPacket->_len = 0;
 		
@@ -88,15 +185,15 @@ void MQTT_NewBuffer(MQTT_PACKET_STRUCTURE *mqttPacket, uint32 size)
 }
 
 //==========================================================
-//	ƣ	MQTT_DeleteBuffer
+//	函数名称：	MQTT_DeleteBuffer
 //
-//	ܣ	ͷڴ
+//	函数功能：	释放数据内存
 //
-//	ڲ	edpPacketṹ
+//	入口参数：	edpPacket：包结构体
 //
-//	ز	
+//	返回参数：	无
 //
-//	˵		
+//	说明：		
 //==========================================================
 void MQTT_DeleteBuffer(MQTT_PACKET_STRUCTURE *mqttPacket)
 {
@@ -163,21 +260,21 @@ int32 MQTT_ReadLength(const uint8 *stream, int32 size, uint32 *len)
 }
 
 //==========================================================
-//	ƣ	MQTT_UnPacketRecv
+//	函数名称：	MQTT_UnPacketRecv
 //
-//	ܣ	MQTTݽж
+//	函数功能：	MQTT数据接收类型判断
 //
-//	ڲ	dataPtrյָ
+//	入口参数：	dataPtr：接收的数据指针
 //
-//	ز	0-ɹ		-ʧԭ
+//	返回参数：	0-成功		其他-失败原因
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint8 MQTT_UnPacketRecv(uint8 *dataPtr)
 {
 	
 	uint8 status = 255;
-	uint8 type = dataPtr[0] >> 4;				//ͼ
+	uint8 type = dataPtr[0] >> 4;				//类型检查
 	
 	if(type < 1 || type > 14)
 		return status;
@@ -195,7 +292,7 @@ uint8 MQTT_UnPacketRecv(uint8 *dataPtr)
 		if(remain_len < ((uint16)msgPtr[0] << 8 | msgPtr[1]) + 2)
 			return 255;
 		
-		if(strstr((int8 *)msgPtr + 2, CMD_TOPIC_PREFIX) != NULL)	//·
+		if(MQTT_IsCmdTopic(msgPtr + 2, (uint16)msgPtr[0] << 8 | msgPtr[1]))	//如果是命令下发
 			status = MQTT_PKT_CMD;
 		else
 			status = MQTT_PKT_PUBLISH;
@@ -208,24 +305,24 @@ uint8 MQTT_UnPacketRecv(uint8 *dataPtr)
 }
 
 //==========================================================
-//	ƣ	MQTT_PacketConnect
+//	函数名称：	MQTT_PacketConnect
 //
-//	ܣ	Ϣ
+//	函数功能：	连接消息组包
 //
-//	ڲ	userûƷID
-//				password룺ȨϢapikey
-//				devid豸ID
-//				cTimeӱʱ
-//				clean_sessionϢ־
-//				qosط־
-//				will_topic쳣topic
-//				will_msg쳣Ϣ
-//				will_retainϢͱ־
-//				mqttPacketָ
+//	入口参数：	user：用户名：产品ID
+//				password：密码：鉴权信息或apikey
+//				devid：设备ID
+//				cTime：连接保持时间
+//				clean_session：离线消息清除标志
+//				qos：重发标志
+//				will_topic：异常离线topic
+//				will_msg：异常离线消息
+//				will_retain：消息推送标志
+//				mqttPacket：包指针
 //
-//	ز	0-ɹ		-ʧ
+//	返回参数：	0-成功		其他-失败
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint8 MQTT_PacketConnect(const int8 *user, const int8 *password, const int8 *devid,
 						uint16 cTime, uint1 clean_session, uint1 qos,
@@ -243,13 +340,13 @@ uint8 MQTT_PacketConnect(const int8 *user, const int8 *password, const int8 *dev
 	
 	total_len += devid_len + 2;
 	
-	//ߺǷϢ1-	0---------------------------------------------
+	//断线后，是否清理离线消息：1-清理	0-不清理--------------------------------------------
 	if(clean_session)
 	{
 		flags |= MQTT_CONNECT_CLEAN_SESSION;
 	}
 	
-	//쳣£topic------------------------------------------------------
+	//异常掉线情况下，服务器发布的topic------------------------------------------------------
 	if(will_topic)
 	{
 		flags |= MQTT_CONNECT_WILL_FLAG;
@@ -257,32 +354,32 @@ uint8 MQTT_PacketConnect(const int8 *user, const int8 *password, const int8 *dev
 		total_len += 4 + will_topic_len + strlen(will_msg);
 	}
 	
-	//qos--ҪPUBLISH̬Ϣģ֤ϢݵĴ-----------------------------
+	//qos级别--主要用于PUBLISH（发布态）消息的，保证消息传递的次数-----------------------------
 	switch((unsigned char)qos)
 	{
 		case MQTT_QOS_LEVEL0:
-			flags |= MQTT_CONNECT_WILL_QOS0;							//һ
+			flags |= MQTT_CONNECT_WILL_QOS0;							//最多一次
 		break;
 		
 		case MQTT_QOS_LEVEL1:
-			flags |= (MQTT_CONNECT_WILL_FLAG | MQTT_CONNECT_WILL_QOS1);	//һ
+			flags |= (MQTT_CONNECT_WILL_FLAG | MQTT_CONNECT_WILL_QOS1);	//最少一次
 		break;
 		
 		case MQTT_QOS_LEVEL2:
-			flags |= (MQTT_CONNECT_WILL_FLAG | MQTT_CONNECT_WILL_QOS2);	//ֻһ
+			flags |= (MQTT_CONNECT_WILL_FLAG | MQTT_CONNECT_WILL_QOS2);	//只有一次
 		break;
 		
 		default:
 		return 2;
 	}
 	
-	//ҪPUBLISH(̬)ϢʾҪ͵ϢµĶ֣߳ͰϢ͸ôǰĵľͷ
+	//主要用于PUBLISH(发布态)的消息，表示服务器要保留这次推送的信息，如果有新的订阅者出现，就把这消息推送给它。如果不设那么推送至当前订阅的就释放了
 	if(will_retain)
 	{
 		flags |= (MQTT_CONNECT_WILL_FLAG | MQTT_CONNECT_WILL_RETAIN);
 	}
 	
-	//˺Ϊ Ϊ---------------------------------------------------------------------
+	//账号为空 密码为空---------------------------------------------------------------------
 	if(!user || !password)
 	{
 		return 3;
@@ -291,19 +388,17 @@ uint8 MQTT_PacketConnect(const int8 *user, const int8 *password, const int8 *dev
 	
 	total_len += strlen(user) + strlen(password) + 4;
 	
-	//ڴ-----------------------------------------------------------------------------
+	//分配内存-----------------------------------------------------------------------------
 	MQTT_NewBuffer(mqttPacket, total_len);
 	if(mqttPacket->_data == NULL)
 		return 4;
 	
-	memset(mqttPacket->_data, 0, total_len);
+/*************************************固定头部***********************************************/
 	
-/*************************************̶ͷ***********************************************/
-	
-	//̶ͷ-------------------------------------------------------------------
+	//固定头部----------------------连接请求类型---------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = MQTT_PKT_CONNECT << 4;
 	
-	//̶ͷ----------------------ʣ೤ֵ-----------------------------------------------
+	//固定头部----------------------剩余长度值-----------------------------------------------
 	len = MQTT_DumpLength(total_len - 5, mqttPacket->_data + mqttPacket->_len);
 	if(len < 0)
 	{
@@ -313,9 +408,9 @@ uint8 MQTT_PacketConnect(const int8 *user, const int8 *password, const int8 *dev
 	else
 		mqttPacket->_len += len;
 	
-/*************************************ɱͷ***********************************************/
+/*************************************可变头部***********************************************/
 	
-	//ɱͷ----------------------Э  Э--------------------------------------
+	//可变头部----------------------协议名长度 和 协议名--------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = 0;
 	mqttPacket->_data[mqttPacket->_len++] = 4;
 	mqttPacket->_data[mqttPacket->_len++] = 'M';
@@ -323,26 +418,26 @@ uint8 MQTT_PacketConnect(const int8 *user, const int8 *password, const int8 *dev
 	mqttPacket->_data[mqttPacket->_len++] = 'T';
 	mqttPacket->_data[mqttPacket->_len++] = 'T';
 	
-	//ɱͷ----------------------protocol level 4-----------------------------------------
+	//可变头部----------------------protocol level 4-----------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = 4;
 	
-	//ɱͷ----------------------ӱ־(úͷ)-----------------------------
+	//可变头部----------------------连接标志(该函数开头处理的数据)-----------------------------
     mqttPacket->_data[mqttPacket->_len++] = flags;
 	
-	//ɱͷ----------------------ӵʱ()----------------------------------------
+	//可变头部----------------------保持连接的时间(秒)----------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = MOSQ_MSB(cTime);
 	mqttPacket->_data[mqttPacket->_len++] = MOSQ_LSB(cTime);
 	 
-/*************************************Ϣ************************************************/
+/*************************************消息体************************************************/
 
-	//Ϣ----------------------------devidȡdevid-------------------------------------
+	//消息体----------------------------devid长度、devid-------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = MOSQ_MSB(devid_len);
 	mqttPacket->_data[mqttPacket->_len++] = MOSQ_LSB(devid_len);
 	
-	strncat((int8 *)mqttPacket->_data + mqttPacket->_len, devid, devid_len);
+	memcpy((int8 *)mqttPacket->_data + mqttPacket->_len, devid, devid_len);
 	mqttPacket->_len += devid_len;
 	
-	//Ϣ----------------------------will_flag  will_msg---------------------------------
+	//消息体----------------------------will_flag 和 will_msg---------------------------------
 	if(flags & MQTT_CONNECT_WILL_FLAG)
 	{
 		unsigned short mLen = 0;
@@ -353,35 +448,35 @@ uint8 MQTT_PacketConnect(const int8 *user, const int8 *password, const int8 *dev
 		mLen = strlen(will_topic);
 		mqttPacket->_data[mqttPacket->_len++] = MOSQ_MSB(mLen);
 		mqttPacket->_data[mqttPacket->_len++] = MOSQ_LSB(mLen);
-		strncat((int8 *)mqttPacket->_data + mqttPacket->_len, will_topic, mLen);
+		memcpy((int8 *)mqttPacket->_data + mqttPacket->_len, will_topic, mLen);
 		mqttPacket->_len += mLen;
 		
 		mLen = strlen(will_msg);
 		mqttPacket->_data[mqttPacket->_len++] = MOSQ_MSB(mLen);
 		mqttPacket->_data[mqttPacket->_len++] = MOSQ_LSB(mLen);
-		strncat((int8 *)mqttPacket->_data + mqttPacket->_len, will_msg, mLen);
+		memcpy((int8 *)mqttPacket->_data + mqttPacket->_len, will_msg, mLen);
 		mqttPacket->_len += mLen;
 	}
 	
-	//Ϣ----------------------------use---------------------------------------------------
+	//消息体----------------------------use---------------------------------------------------
 	if(flags & MQTT_CONNECT_USER_NAME)
 	{
 		unsigned short user_len = strlen(user);
 		
 		mqttPacket->_data[mqttPacket->_len++] = MOSQ_MSB(user_len);
 		mqttPacket->_data[mqttPacket->_len++] = MOSQ_LSB(user_len);
-		strncat((int8 *)mqttPacket->_data + mqttPacket->_len, user, user_len);
+		memcpy((int8 *)mqttPacket->_data + mqttPacket->_len, user, user_len);
 		mqttPacket->_len += user_len;
 	}
 
-	//Ϣ----------------------------password----------------------------------------------
+	//消息体----------------------------password----------------------------------------------
 	if(flags & MQTT_CONNECT_PASSORD)
 	{
 		unsigned short psw_len = strlen(password);
 		
 		mqttPacket->_data[mqttPacket->_len++] = MOSQ_MSB(psw_len);
 		mqttPacket->_data[mqttPacket->_len++] = MOSQ_LSB(psw_len);
-		strncat((int8 *)mqttPacket->_data + mqttPacket->_len, password, psw_len);
+		memcpy((int8 *)mqttPacket->_data + mqttPacket->_len, password, psw_len);
 		mqttPacket->_len += psw_len;
 	}
 
@@ -390,15 +485,15 @@ uint8 MQTT_PacketConnect(const int8 *user, const int8 *password, const int8 *dev
 }
 
 //==========================================================
-//	ƣ	MQTT_PacketDisConnect
+//	函数名称：	MQTT_PacketDisConnect
 //
-//	ܣ	ϿϢ
+//	函数功能：	断开连接消息组包
 //
-//	ڲ	mqttPacketָ
+//	入口参数：	mqttPacket：包指针
 //
-//	ز	0-ɹ		1-ʧ
+//	返回参数：	0-成功		1-失败
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint1 MQTT_PacketDisConnect(MQTT_PACKET_STRUCTURE *mqttPacket)
 {
@@ -407,12 +502,12 @@ uint1 MQTT_PacketDisConnect(MQTT_PACKET_STRUCTURE *mqttPacket)
 	if(mqttPacket->_data == NULL)
 		return 1;
 	
-/*************************************̶ͷ***********************************************/
+/*************************************固定头部***********************************************/
 	
-	//̶ͷ----------------------ͷϢ-------------------------------------------------
+	//固定头部----------------------头部消息-------------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = MQTT_PKT_DISCONNECT << 4;
 	
-	//̶ͷ----------------------ʣ೤ֵ-----------------------------------------------
+	//固定头部----------------------剩余长度值-----------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = 0;
 	
 	return 0;
@@ -420,15 +515,15 @@ uint1 MQTT_PacketDisConnect(MQTT_PACKET_STRUCTURE *mqttPacket)
 }
 
 //==========================================================
-//	ƣ	MQTT_UnPacketConnectAck
+//	函数名称：	MQTT_UnPacketConnectAck
 //
-//	ܣ	Ϣ
+//	函数功能：	连接消息解包
 //
-//	ڲ	rev_dataյ
+//	入口参数：	rev_data：接收的数据
 //
-//	ز	1255-ʧ		-ƽ̨ķ
+//	返回参数：	1、255-失败		其他-平台的返回码
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint8 MQTT_UnPacketConnectAck(uint8 *rev_data)
 {
@@ -444,19 +539,19 @@ uint8 MQTT_UnPacketConnectAck(uint8 *rev_data)
 }
 
 //==========================================================
-//	ƣ	MQTT_PacketSaveData
+//	函数名称：	MQTT_PacketSaveData
 //
-//	ܣ	ݵϴ
+//	函数功能：	数据点上传组包
 //
-//	ڲ	pro_idƷID(Ϊ)
-//				dev_name豸
-//				send_bufjsonbuf
-//				send_lenjsonܳ
-//				type_bin_headbinļϢͷ
+//	入口参数：	pro_id：产品ID(可为空)
+//				dev_name：设备名
+//				send_buf：json缓存buf
+//				send_len：json总长
+//				type_bin_head：bin文件的消息头
 //
-//	ز	0-ɹ		1-ʧ
+//	返回参数：	0-成功		1-失败
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint1 MQTT_PacketSaveData(const int8 *pro_id, const char *dev_name,
 								int16 send_len, int8 *type_bin_head, MQTT_PACKET_STRUCTURE *mqttPacket)
@@ -468,7 +563,7 @@ uint1 MQTT_PacketSaveData(const int8 *pro_id, const char *dev_name,
 	
 	if(MQTT_PacketPublish(MQTT_PUBLISH_ID, topic_buf, NULL, send_len + 0, MQTT_QOS_LEVEL1, 0, 1, mqttPacket) == 0)
 	{
-//		mqttPacket->_data[mqttPacket->_len++] = type;					//
+//		mqttPacket->_data[mqttPacket->_len++] = type;					//类型
 //		
 //		mqttPacket->_data[mqttPacket->_len++] = MOSQ_MSB(send_len);
 //		mqttPacket->_data[mqttPacket->_len++] = MOSQ_LSB(send_len);
@@ -481,17 +576,17 @@ uint1 MQTT_PacketSaveData(const int8 *pro_id, const char *dev_name,
 }
 
 //==========================================================
-//	ƣ	MQTT_PacketSaveBinData
+//	函数名称：	MQTT_PacketSaveBinData
 //
-//	ܣ	Ϊֹļϴ
+//	函数功能：	为禁止文件上传组包
 //
-//	ڲ	name
-//				file_lenļ
-//				mqttPacketָ
+//	入口参数：	name：数据流名字
+//				file_len：文件长度
+//				mqttPacket：包指针
 //
-//	ز	0-ɹ		1-ʧ
+//	返回参数：	0-成功		1-失败
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint1 MQTT_PacketSaveBinData(const int8 *name, int16 file_len, MQTT_PACKET_STRUCTURE *mqttPacket)
 {
@@ -519,7 +614,7 @@ uint1 MQTT_PacketSaveBinData(const int8 *name, int16 file_len, MQTT_PACKET_STRUC
 		return result;
 	}
 	
-	payload[0] = 2;						//
+	payload[0] = 2;						//类型
 		
 	payload[1] = MOSQ_MSB(bin_head_len);
 	payload[2] = MOSQ_LSB(bin_head_len);
@@ -542,66 +637,67 @@ uint1 MQTT_PacketSaveBinData(const int8 *name, int16 file_len, MQTT_PACKET_STRUC
 }
 
 //==========================================================
-//	ƣ	MQTT_UnPacketCmd
+//	函数名称：	MQTT_UnPacketCmd
 //
-//	ܣ	·
+//	函数功能：	命令下发解包
 //
-//	ڲ	rev_dataյָ
-//				cmdidcmdid-uuid
-//				req
+//	入口参数：	rev_data：接收的数据指针
+//				cmdid：cmdid-uuid
+//				req：命令
 //
-//	ز	0-ɹ		-ʧԭ
+//	返回参数：	0-成功		其他-失败原因
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint8 MQTT_UnPacketCmd(uint8 *rev_data, int8 **cmdid, int8 **req, uint16 *req_len)
 {
 
-	int8 *dataPtr = strchr((int8 *)rev_data + 6, '/');	//6ͷϢ
+	int8 *dataPtr = strchr((int8 *)rev_data + 6, '/');	//加6是跳过头信息
 	
 	uint32 remain_len = 0;
 	
-	if(dataPtr == NULL)									//δҵ'/'
+	if(dataPtr == NULL)									//未找到'/'
 		return 1;
-	dataPtr++;											//'/'
+	dataPtr++;											//跳过'/'
 	
-	MQTT_ReadLength(rev_data + 1, 4, &remain_len);		//ȡʣֽ
+	MQTT_ReadLength(rev_data + 1, 4, &remain_len);		//读取剩余字节
 	
-	*cmdid = (int8 *)MQTT_MallocBuffer(37);				//cmdid̶36ֽڣһλ
+	*cmdid = (int8 *)MQTT_MallocBuffer(37);				//cmdid固定36字节，多分配一个结束符的位置
 	if(*cmdid == NULL)
 		return 2;
 	
-	memset(*cmdid, 0, 37);								//ȫ
-	memcpy(*cmdid, (const int8 *)dataPtr, 36);			//cmdid
+	memset(*cmdid, 0, 37);								//全部清零
+	memcpy(*cmdid, (const int8 *)dataPtr, 36);			//复制cmdid
 	dataPtr += 36;
 	
-	*req_len = remain_len - 44;							// = ʣ೤(remain_len) - 2 - 5($creq) - 1(\) - cmdid
-	*req = (int8 *)MQTT_MallocBuffer(*req_len + 1);		//+1
+	*req_len = remain_len - 44;							//命令长度 = 剩余长度(remain_len) - 2 - 5($creq) - 1(\) - cmdid长度
+	*req = (int8 *)MQTT_MallocBuffer(*req_len + 1);		//分配命令长度+1
 	if(*req == NULL)
 	{
 		MQTT_FreeBuffer(*cmdid);
+		*cmdid = NULL;
 		return 3;
 	}
 	
-	memset(*req, 0, *req_len + 1);						//
-	memcpy(*req, (const int8 *)dataPtr, *req_len);		//
+	memset(*req, 0, *req_len + 1);						//清零
+	memcpy(*req, (const int8 *)dataPtr, *req_len);		//复制命令
 	
 	return 0;
 
 }
 
 //==========================================================
-//	ƣ	MQTT_PacketCmdResp
+//	函数名称：	MQTT_PacketCmdResp
 //
-//	ܣ	ظ
+//	函数功能：	命令回复组包
 //
-//	ڲ	cmdidcmdid
-//				req
-//				mqttPacketָ
+//	入口参数：	cmdid：cmdid
+//				req：命令
+//				mqttPacket：包指针
 //
-//	ز	0-ɹ		1-ʧ
+//	返回参数：	0-成功		1-失败
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint1 MQTT_PacketCmdResp(const int8 *cmdid, const int8 *req, MQTT_PACKET_STRUCTURE *mqttPacket)
 {
@@ -614,9 +710,9 @@ uint1 MQTT_PacketCmdResp(const int8 *cmdid, const int8 *req, MQTT_PACKET_STRUCTU
 	if(payload == NULL)
 		return 1;
 	
-	memset(payload, 0, cmdid_len + 7);
 	memcpy(payload, "$crsp/", 6);
-	strncat(payload, cmdid, cmdid_len);
+	memcpy(payload + 6, cmdid, cmdid_len);
+	payload[cmdid_len + 6] = 0;
 
 	if(MQTT_PacketPublish(MQTT_PUBLISH_ID, payload, req, strlen(req), MQTT_QOS_LEVEL0, 0, 1, mqttPacket) == 0)
 		status = 0;
@@ -630,19 +726,19 @@ uint1 MQTT_PacketCmdResp(const int8 *cmdid, const int8 *req, MQTT_PACKET_STRUCTU
 }
 
 //==========================================================
-//	ƣ	MQTT_PacketSubscribe
+//	函数名称：	MQTT_PacketSubscribe
 //
-//	ܣ	SubscribeϢ
+//	函数功能：	Subscribe消息组包
 //
-//	ڲ	pkt_idpkt_id
-//				qosϢط
-//				topicsĵϢ
-//				topics_cntĵϢ
-//				mqttPacketָ
+//	入口参数：	pkt_id：pkt_id
+//				qos：消息重发次数
+//				topics：订阅的消息
+//				topics_cnt：订阅的消息个数
+//				mqttPacket：包指针
 //
-//	ز	0-ɹ		-ʧ
+//	返回参数：	0-成功		其他-失败
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint8 MQTT_PacketSubscribe(uint16 pkt_id, enum MqttQosLevel qos, const int8 *topics[], uint8 topics_cnt, MQTT_PACKET_STRUCTURE *mqttPacket)
 {
@@ -654,7 +750,7 @@ uint8 MQTT_PacketSubscribe(uint16 pkt_id, enum MqttQosLevel qos, const int8 *top
 	if(pkt_id == 0)
 		return 1;
 	
-	//topic-------------------------------------------------------------------------
+	//计算topic长度-------------------------------------------------------------------------
 	for(; i < topics_cnt; i++)
 	{
 		if(topics[i] == NULL)
@@ -666,17 +762,17 @@ uint8 MQTT_PacketSubscribe(uint16 pkt_id, enum MqttQosLevel qos, const int8 *top
 	//2 bytes packet id + topic filter(2 bytes topic + topic length + 1 byte reserve)------
 	remain_len = 2 + 3 * topics_cnt + topic_len;
 	
-	//ڴ------------------------------------------------------------------------------
+	//分配内存------------------------------------------------------------------------------
 	MQTT_NewBuffer(mqttPacket, remain_len + 5);
 	if(mqttPacket->_data == NULL)
 		return 3;
 	
-/*************************************̶ͷ***********************************************/
+/*************************************固定头部***********************************************/
 	
-	//̶ͷ----------------------ͷϢ-------------------------------------------------
+	//固定头部----------------------头部消息-------------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = MQTT_PKT_SUBSCRIBE << 4 | 0x02;
 	
-	//̶ͷ----------------------ʣ೤ֵ-----------------------------------------------
+	//固定头部----------------------剩余长度值-----------------------------------------------
 	len = MQTT_DumpLength(remain_len, mqttPacket->_data + mqttPacket->_len);
 	if(len < 0)
 	{
@@ -699,7 +795,7 @@ uint8 MQTT_PacketSubscribe(uint16 pkt_id, enum MqttQosLevel qos, const int8 *top
 		mqttPacket->_data[mqttPacket->_len++] = MOSQ_MSB(topic_len);
 		mqttPacket->_data[mqttPacket->_len++] = MOSQ_LSB(topic_len);
 		
-		strncat((int8 *)mqttPacket->_data + mqttPacket->_len, topics[i], topic_len);
+		memcpy((int8 *)mqttPacket->_data + mqttPacket->_len, topics[i], topic_len);
 		mqttPacket->_len += topic_len;
 		
 		mqttPacket->_data[mqttPacket->_len++] = qos & 0xFF;
@@ -710,15 +806,15 @@ uint8 MQTT_PacketSubscribe(uint16 pkt_id, enum MqttQosLevel qos, const int8 *top
 }
 
 //==========================================================
-//	ƣ	MQTT_UnPacketSubscrebe
+//	函数名称：	MQTT_UnPacketSubscrebe
 //
-//	ܣ	SubscribeĻظϢ
+//	函数功能：	Subscribe的回复消息解包
 //
-//	ڲ	rev_dataյϢ
+//	入口参数：	rev_data：接收到的信息
 //
-//	ز	0-ɹ		-ʧ
+//	返回参数：	0-成功		其他-失败
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint8 MQTT_UnPacketSubscribe(uint8 *rev_data)
 {
@@ -753,19 +849,19 @@ uint8 MQTT_UnPacketSubscribe(uint8 *rev_data)
 }
 
 //==========================================================
-//	ƣ	MQTT_PacketUnSubscribe
+//	函数名称：	MQTT_PacketUnSubscribe
 //
-//	ܣ	UnSubscribeϢ
+//	函数功能：	UnSubscribe消息组包
 //
-//	ڲ	pkt_idpkt_id
-//				qosϢط
-//				topicsĵϢ
-//				topics_cntĵϢ
-//				mqttPacketָ
+//	入口参数：	pkt_id：pkt_id
+//				qos：消息重发次数
+//				topics：订阅的消息
+//				topics_cnt：订阅的消息个数
+//				mqttPacket：包指针
 //
-//	ز	0-ɹ		-ʧ
+//	返回参数：	0-成功		其他-失败
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint8 MQTT_PacketUnSubscribe(uint16 pkt_id, const int8 *topics[], uint8 topics_cnt, MQTT_PACKET_STRUCTURE *mqttPacket)
 {
@@ -777,7 +873,7 @@ uint8 MQTT_PacketUnSubscribe(uint16 pkt_id, const int8 *topics[], uint8 topics_c
 	if(pkt_id == 0)
 		return 1;
 	
-	//topic-------------------------------------------------------------------------
+	//计算topic长度-------------------------------------------------------------------------
 	for(; i < topics_cnt; i++)
 	{
 		if(topics[i] == NULL)
@@ -789,17 +885,17 @@ uint8 MQTT_PacketUnSubscribe(uint16 pkt_id, const int8 *topics[], uint8 topics_c
 	//2 bytes packet id, 2 bytes topic length + topic + 1 byte reserve---------------------
 	remain_len = 2 + (topics_cnt << 1) + topic_len;
 	
-	//ڴ------------------------------------------------------------------------------
+	//分配内存------------------------------------------------------------------------------
 	MQTT_NewBuffer(mqttPacket, remain_len + 5);
 	if(mqttPacket->_data == NULL)
 		return 3;
 	
-/*************************************̶ͷ***********************************************/
+/*************************************固定头部***********************************************/
 	
-	//̶ͷ----------------------ͷϢ-------------------------------------------------
+	//固定头部----------------------头部消息-------------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = MQTT_PKT_UNSUBSCRIBE << 4 | 0x02;
 	
-	//̶ͷ----------------------ʣ೤ֵ-----------------------------------------------
+	//固定头部----------------------剩余长度值-----------------------------------------------
 	len = MQTT_DumpLength(remain_len, mqttPacket->_data + mqttPacket->_len);
 	if(len < 0)
 	{
@@ -822,7 +918,7 @@ uint8 MQTT_PacketUnSubscribe(uint16 pkt_id, const int8 *topics[], uint8 topics_c
 		mqttPacket->_data[mqttPacket->_len++] = MOSQ_MSB(topic_len);
 		mqttPacket->_data[mqttPacket->_len++] = MOSQ_LSB(topic_len);
 		
-		strncat((int8 *)mqttPacket->_data + mqttPacket->_len, topics[i], topic_len);
+		memcpy((int8 *)mqttPacket->_data + mqttPacket->_len, topics[i], topic_len);
 		mqttPacket->_len += topic_len;
 	}
 
@@ -831,15 +927,15 @@ uint8 MQTT_PacketUnSubscribe(uint16 pkt_id, const int8 *topics[], uint8 topics_c
 }
 
 //==========================================================
-//	ƣ	MQTT_UnPacketUnSubscribe
+//	函数名称：	MQTT_UnPacketUnSubscribe
 //
-//	ܣ	UnSubscribeĻظϢ
+//	函数功能：	UnSubscribe的回复消息解包
 //
-//	ڲ	rev_dataյϢ
+//	入口参数：	rev_data：接收到的信息
 //
-//	ز	0-ɹ		-ʧ
+//	返回参数：	0-成功		其他-失败
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint1 MQTT_UnPacketUnSubscribe(uint8 *rev_data)
 {
@@ -856,22 +952,22 @@ uint1 MQTT_UnPacketUnSubscribe(uint8 *rev_data)
 }
 
 //==========================================================
-//	ƣ	MQTT_PacketPublish
+//	函数名称：	MQTT_PacketPublish
 //
-//	ܣ	PulishϢ
+//	函数功能：	Pulish消息组包
 //
-//	ڲ	pkt_idpkt_id
-//				topictopic
-//				payloadϢ
-//				payload_lenϢ峤
-//				qosط
-//				retainϢ
-//				own
-//				mqttPacketָ
+//	入口参数：	pkt_id：pkt_id
+//				topic：发布的topic
+//				payload：消息体
+//				payload_len：消息体长度
+//				qos：重发次数
+//				retain：离线消息推送
+//				own：
+//				mqttPacket：包指针
 //
-//	ز	0-ɹ		-ʧ
+//	返回参数：	0-成功		其他-失败
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint8 MQTT_PacketPublish(uint16 pkt_id, const int8 *topic,
 						const int8 *payload, uint32 payload_len,
@@ -884,41 +980,41 @@ uint8 MQTT_PacketPublish(uint16 pkt_id, const int8 *topic,
 	int32 len = 0;
 	uint8 flags = 0;
 	
-	//pkt_id----------------------------------------------------------------------------
+	//pkt_id检查----------------------------------------------------------------------------
 	if(pkt_id == 0)
 		return 1;
 	
-	//$dpΪϵͳϴݵָ--------------------------------------------------------------
+	//$dp为系统上传数据点的指令--------------------------------------------------------------
 	for(topic_len = 0; topic[topic_len] != '\0'; ++topic_len)
 	{
 		if((topic[topic_len] == '#') || (topic[topic_len] == '+'))
 			return 2;
 	}
 	
-	//PublishϢ---------------------------------------------------------------------------
+	//Publish消息---------------------------------------------------------------------------
 	flags |= MQTT_PKT_PUBLISH << 4;
 	
-	//retain־----------------------------------------------------------------------------
+	//retain标志----------------------------------------------------------------------------
 	if(retain)
 		flags |= 0x01;
 	
-	//ܳ--------------------------------------------------------------------------------
+	//总长度--------------------------------------------------------------------------------
 	total_len = topic_len + payload_len + 2;
 	
-	//qos--ҪPUBLISH̬Ϣģ֤ϢݵĴ-----------------------------
+	//qos级别--主要用于PUBLISH（发布态）消息的，保证消息传递的次数-----------------------------
 	switch(qos)
 	{
 		case MQTT_QOS_LEVEL0:
-			flags |= MQTT_CONNECT_WILL_QOS0;	//һ
+			flags |= MQTT_CONNECT_WILL_QOS0;	//最多一次
 		break;
 		
 		case MQTT_QOS_LEVEL1:
-			flags |= 0x02;						//һ
+			flags |= 0x02;						//最少一次
 			total_len += 2;
 		break;
 		
 		case MQTT_QOS_LEVEL2:
-			flags |= 0x04;						//ֻһ
+			flags |= 0x04;						//只有一次
 			total_len += 2;
 		break;
 		
@@ -926,7 +1022,7 @@ uint8 MQTT_PacketPublish(uint16 pkt_id, const int8 *topic,
 		return 3;
 	}
 	
-	//ڴ------------------------------------------------------------------------------
+	//分配内存------------------------------------------------------------------------------
 	if(payload != NULL)
 	{
 		if(payload[0] == 2)
@@ -942,8 +1038,6 @@ uint8 MQTT_PacketPublish(uint16 pkt_id, const int8 *topic,
 			
 			if(mqttPacket->_data == NULL)
 				return 4;
-			
-			memset(mqttPacket->_data, 0, total_len + 3 - data_len_t);
 		}
 		else
 		{
@@ -951,8 +1045,6 @@ uint8 MQTT_PacketPublish(uint16 pkt_id, const int8 *topic,
 			
 			if(mqttPacket->_data == NULL)
 				return 4;
-			
-			memset(mqttPacket->_data, 0, total_len + 5);
 		}
 	}
 	else
@@ -961,16 +1053,14 @@ uint8 MQTT_PacketPublish(uint16 pkt_id, const int8 *topic,
 		
 		if(mqttPacket->_data == NULL)
 			return 4;
-		
-		memset(mqttPacket->_data, 0, total_len + 5);
 	}
 	
-/*************************************̶ͷ***********************************************/
+/*************************************固定头部***********************************************/
 	
-	//̶ͷ----------------------ͷϢ-------------------------------------------------
+	//固定头部----------------------头部消息-------------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = flags;
 	
-	//̶ͷ----------------------ʣ೤ֵ-----------------------------------------------
+	//固定头部----------------------剩余长度值-----------------------------------------------
 	len = MQTT_DumpLength(total_len, mqttPacket->_data + mqttPacket->_len);
 	if(len < 0)
 	{
@@ -980,13 +1070,13 @@ uint8 MQTT_PacketPublish(uint16 pkt_id, const int8 *topic,
 	else
 		mqttPacket->_len += len;
 	
-/*************************************ɱͷ***********************************************/
+/*************************************可变头部***********************************************/
 	
-	//ɱͷ----------------------дtopicȡtopic-------------------------------------
+	//可变头部----------------------写入topic长度、topic-------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = MOSQ_MSB(topic_len);
 	mqttPacket->_data[mqttPacket->_len++] = MOSQ_LSB(topic_len);
 	
-	strncat((int8 *)mqttPacket->_data + mqttPacket->_len, topic, topic_len);
+	memcpy((int8 *)mqttPacket->_data + mqttPacket->_len, topic, topic_len);
 	mqttPacket->_len += topic_len;
 	if(qos != MQTT_QOS_LEVEL0)
 	{
@@ -994,7 +1084,7 @@ uint8 MQTT_PacketPublish(uint16 pkt_id, const int8 *topic,
 		mqttPacket->_data[mqttPacket->_len++] = MOSQ_LSB(pkt_id);
 	}
 	
-	//ɱͷ----------------------дpayload----------------------------------------------
+	//可变头部----------------------写入payload----------------------------------------------
 	if(payload != NULL)
 	{
 		if(payload[0] == 2)
@@ -1014,95 +1104,69 @@ uint8 MQTT_PacketPublish(uint16 pkt_id, const int8 *topic,
 }
 
 //==========================================================
-//	ƣ	MQTT_UnPacketPublish
+//	函数名称：	MQTT_UnPacketPublishView
 //
-//	ܣ	PublishϢ
+//	函数功能：	Publish消息解包，不复制
 //
-//	ڲ	flagsMQTTر־Ϣ
-//				pktָɱͷ
-//				size̶ͷеʣ೤Ϣ
+//	入口参数：	rev_data：收到的数据
+//				topic：topic在rev_data里的位置和长度
+//				payload：消息体在rev_data里的位置和长度
+//				qos：qos等级
+//				pkt_id：qos1、2时的包ID
 //
-//	ز	0-ɹ		-ʧԭ
+//	返回参数：	0-成功		其他-失败原因
 //
-//	˵		
+//	说明：		topic、payload指向rev_data，rev_data释放前有效；
+//				不分配内存，消息体长度只受接收缓存限制
 //==========================================================
-uint8 MQTT_UnPacketPublish(uint8 *rev_data, int8 **topic, uint16 *topic_len, int8 **payload, uint16 *payload_len, uint8 *qos, uint16 *pkt_id)
+uint8 MQTT_UnPacketPublishView(const uint8 *rev_data, MQTT_SLICE *topic, MQTT_SLICE *payload, uint8 *qos, uint16 *pkt_id)
 {
 	
 	const int8 flags = rev_data[0] & 0x0F;
-	uint8 *msgPtr;
+	const uint8 *msgPtr;
 	uint32 remain_len = 0;
-
-	const int8 dup = flags & 0x08;
-
+	uint32 head_len;
+	int32 len_bytes;
+	
 	*qos = (flags & 0x06) >> 1;
+	*pkt_id = 0;
 	
-	msgPtr = rev_data + MQTT_ReadLength(rev_data + 1, 4, &remain_len) + 1;
+	len_bytes = MQTT_ReadLength(rev_data + 1, 4, &remain_len);
+	if(len_bytes < 0)
+		return 255;
+	msgPtr = rev_data + len_bytes + 1;
 	
 	if(remain_len < 2 || flags & 0x01)							//retain
 		return 255;
 	
-	*topic_len = (uint16)msgPtr[0] << 8 | msgPtr[1];
-	if(remain_len < *topic_len + 2)
+	topic->ptr = msgPtr + 2;
+	topic->len = (uint16)msgPtr[0] << 8 | msgPtr[1];
+	head_len = 2 + topic->len;
+	if(head_len > remain_len)
 		return 255;
 	
-	if(strstr((int8 *)msgPtr + 2, CMD_TOPIC_PREFIX) != NULL)	//·
+	if(MQTT_IsCmdTopic(topic->ptr, topic->len))					//如果是命令下发
 		return MQTT_PKT_CMD;
 	
 	switch(*qos)
 	{
 		case MQTT_QOS_LEVEL0:									// qos0 have no packet identifier
 			
-			if(0 != dup)
+			if(flags & 0x08)									//dup
 				return 255;
-
-			*topic = MQTT_MallocBuffer(*topic_len + 1);			//Ϊtopicڴ
-			if(*topic == NULL)
-				return 255;
-			
-			memset(*topic, 0, *topic_len + 1);
-			memcpy(*topic, (int8 *)msgPtr + 2, *topic_len);		//
-			
-			*payload_len = remain_len - 2 - *topic_len;			//Ϊpayloadڴ
-			*payload = MQTT_MallocBuffer(*payload_len + 1);
-			if(*payload == NULL)								//ʧ
-			{
-				MQTT_FreeBuffer(*topic);						//Ҫtopicڴͷŵ
-				return 255;
-			}
-			
-			memset(*payload, 0, *payload_len + 1);
-			memcpy(*payload, (int8 *)msgPtr + 2 + *topic_len, *payload_len);
 			
 		break;
 
 		case MQTT_QOS_LEVEL1:
 		case MQTT_QOS_LEVEL2:
 			
-			if(*topic_len + 2 > remain_len)
+			if(head_len + 2 > remain_len)
 				return 255;
 			
-			*pkt_id = (uint16)msgPtr[*topic_len + 2] << 8 | msgPtr[*topic_len + 3];
-			if(pkt_id == 0)
+			*pkt_id = (uint16)msgPtr[head_len] << 8 | msgPtr[head_len + 1];
+			if(*pkt_id == 0)
 				return 255;
-			
-			*topic = MQTT_MallocBuffer(*topic_len + 1);			//Ϊtopicڴ
-			if(*topic == NULL)
-				return 255;
-			
-			memset(*topic, 0, *topic_len + 1);
-			memcpy(*topic, (int8 *)msgPtr + 2, *topic_len);		//
-			
-			*payload_len = remain_len - 4 - *topic_len;
-			*payload = MQTT_MallocBuffer(*payload_len + 1);		//Ϊpayloadڴ
-			if(*payload == NULL)								//ʧ
-			{
-				MQTT_FreeBuffer(*topic);						//Ҫtopicڴͷŵ
-				return 255;
-			}
-			
-			memset(*payload, 0, *payload_len + 1);
-			memcpy(*payload, (int8 *)msgPtr + 4 + *topic_len, *payload_len);
+			head_len += 2;
 			
 		break;
 
@@ -1110,24 +1174,74 @@ uint8 MQTT_UnPacketPublish(uint8 *rev_data, int8 **topic, uint16 *topic_len, int
 			return 255;
 	}
 	
-	if(strchr((int8 *)topic, '+') || strchr((int8 *)topic, '#'))
+	if(memchr(topic->ptr, '+', topic->len) || memchr(topic->ptr, '#', topic->len))
 		return 255;
+	
+	payload->ptr = msgPtr + head_len;
+	payload->len = remain_len - head_len;
+	
+	return 0;
 
+}
+
+//==========================================================
+//	函数名称：	MQTT_UnPacketPublish
+//
+//	函数功能：	Publish消息解包
+//
+//	入口参数：	rev_data：收到的数据
+//				topic、payload：复制出来的topic和消息体，以'\0'结尾，用完MQTT_FreeBuffer
+//				topic_len、payload_len：长度
+//				qos：qos等级
+//				pkt_id：qos1、2时的包ID
+//
+//	返回参数：	0-成功		其他-失败原因
+//
+//	说明：		在MQTT_UnPacketPublishView基础上复制一份，不需要复制时用后者
+//==========================================================
+uint8 MQTT_UnPacketPublish(uint8 *rev_data, int8 **topic, uint16 *topic_len, int8 **payload, uint16 *payload_len, uint8 *qos, uint16 *pkt_id)
+{
+	
+	MQTT_SLICE t, p;
+	uint8 result;
+	
+	result = MQTT_UnPacketPublishView(rev_data, &t, &p, qos, pkt_id);
+	if(result != 0)
+		return result;
+	
+	*topic_len = t.len;
+	*topic = MQTT_MallocBuffer(t.len + 1);						//为topic分配内存
+	if(*topic == NULL)
+		return 255;
+	memcpy(*topic, t.ptr, t.len);								//复制数据
+	(*topic)[t.len] = 0;
+	
+	*payload_len = p.len;
+	*payload = MQTT_MallocBuffer(p.len + 1);					//为payload分配内存
+	if(*payload == NULL)										//如果失败
+	{
+		MQTT_FreeBuffer(*topic);								//则需要把topic的内存释放掉
+		*topic = NULL;											//调用者还会释放一次
+		return 255;
+	}
+	memcpy(*payload, p.ptr, p.len);
+	(*payload)[p.len] = 0;
+	
 	return 0;
 
 }
 
 //==========================================================
-//	ƣ	MQTT_PacketPublishAck
+//	函数名称：	MQTT_PacketPublishAck
 //
-//	ܣ	Publish AckϢ
+//	函数功能：	Publish Ack消息组包
 //
-//	ڲ	pkt_idpacket id
-//				mqttPacketָ
+//	入口参数：	pkt_id：packet id
+//				mqttPacket：包指针
 //
-//	ز	0-ɹ		1-ʧԭ
+//	返回参数：	0-成功		1-失败原因
 //
-//	˵		յPublishϢQoSȼΪ1ʱҪAckظ
+//	说明：		当收到的Publish消息的QoS等级为1时，需要Ack回复
 //==========================================================
 uint1 MQTT_PacketPublishAck(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket)
 {
@@ -1136,17 +1250,17 @@ uint1 MQTT_PacketPublishAck(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket)
 	if(mqttPacket->_data == NULL)
 		return 1;
 	
-/*************************************̶ͷ***********************************************/
+/*************************************固定头部***********************************************/
 	
-	//̶ͷ----------------------ͷϢ-------------------------------------------------
+	//固定头部----------------------头部消息-------------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = MQTT_PKT_PUBACK << 4;
 	
-	//̶ͷ----------------------ʣ೤-------------------------------------------------
+	//固定头部----------------------剩余长度-------------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = 2;
 	
-/*************************************ɱͷ***********************************************/
+/*************************************可变头部***********************************************/
 	
-	//ɱͷ----------------------pkt_id-----------------------------------------------
+	//可变头部----------------------pkt_id长度-----------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = pkt_id >> 8;
 	mqttPacket->_data[mqttPacket->_len++] = pkt_id & 0xff;
 	
@@ -1155,15 +1269,15 @@ uint1 MQTT_PacketPublishAck(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket)
 }
 
 //==========================================================
-//	ƣ	MQTT_UnPacketPublishAck
+//	函数名称：	MQTT_UnPacketPublishAck
 //
-//	ܣ	Publish AckϢ
+//	函数功能：	Publish Ack消息解包
 //
-//	ڲ	rev_dataյ
+//	入口参数：	rev_data：收到的数据
 //
-//	ز	0-ɹ		1-ʧԭ
+//	返回参数：	0-成功		1-失败原因
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint1 MQTT_UnPacketPublishAck(uint8 *rev_data)
 {
@@ -1179,16 +1293,16 @@ uint1 MQTT_UnPacketPublishAck(uint8 *rev_data)
 }
 
 //==========================================================
-//	ƣ	MQTT_PacketPublishRec
+//	函数名称：	MQTT_PacketPublishRec
 //
-//	ܣ	Publish RecϢ
+//	函数功能：	Publish Rec消息组包
 //
-//	ڲ	pkt_idpacket id
-//				mqttPacketָ
+//	入口参数：	pkt_id：packet id
+//				mqttPacket：包指针
 //
-//	ز	0-ɹ		1-ʧԭ
+//	返回参数：	0-成功		1-失败原因
 //
-//	˵		յPublishϢQoSȼΪ2ʱյrec
+//	说明：		当收到的Publish消息的QoS等级为2时，先收到rec
 //==========================================================
 uint1 MQTT_PacketPublishRec(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket)
 {
@@ -1197,17 +1311,17 @@ uint1 MQTT_PacketPublishRec(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket)
 	if(mqttPacket->_data == NULL)
 		return 1;
 	
-/*************************************̶ͷ***********************************************/
+/*************************************固定头部***********************************************/
 	
-	//̶ͷ----------------------ͷϢ-------------------------------------------------
+	//固定头部----------------------头部消息-------------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = MQTT_PKT_PUBREC << 4;
 	
-	//̶ͷ----------------------ʣ೤-------------------------------------------------
+	//固定头部----------------------剩余长度-------------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = 2;
 	
-/*************************************ɱͷ***********************************************/
+/*************************************可变头部***********************************************/
 	
-	//ɱͷ----------------------pkt_id-----------------------------------------------
+	//可变头部----------------------pkt_id长度-----------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = pkt_id >> 8;
 	mqttPacket->_data[mqttPacket->_len++] = pkt_id & 0xff;
 	
@@ -1216,15 +1330,15 @@ uint1 MQTT_PacketPublishRec(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket)
 }
 
 //==========================================================
-//	ƣ	MQTT_UnPacketPublishRec
+//	函数名称：	MQTT_UnPacketPublishRec
 //
-//	ܣ	Publish RecϢ
+//	函数功能：	Publish Rec消息解包
 //
-//	ڲ	rev_dataյ
+//	入口参数：	rev_data：接收到的数据
 //
-//	ز	0-ɹ		1-ʧ
+//	返回参数：	0-成功		1-失败
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint1 MQTT_UnPacketPublishRec(uint8 *rev_data)
 {
@@ -1240,16 +1354,16 @@ uint1 MQTT_UnPacketPublishRec(uint8 *rev_data)
 }
 
 //==========================================================
-//	ƣ	MQTT_PacketPublishRel
+//	函数名称：	MQTT_PacketPublishRel
 //
-//	ܣ	Publish RelϢ
+//	函数功能：	Publish Rel消息组包
 //
-//	ڲ	pkt_idpacket id
-//				mqttPacketָ
+//	入口参数：	pkt_id：packet id
+//				mqttPacket：包指针
 //
-//	ز	0-ɹ		1-ʧԭ
+//	返回参数：	0-成功		1-失败原因
 //
-//	˵		յPublishϢQoSȼΪ2ʱյrecٻظrel
+//	说明：		当收到的Publish消息的QoS等级为2时，先收到rec，再回复rel
 //==========================================================
 uint1 MQTT_PacketPublishRel(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket)
 {
@@ -1258,17 +1372,17 @@ uint1 MQTT_PacketPublishRel(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket)
 	if(mqttPacket->_data == NULL)
 		return 1;
 	
-/*************************************̶ͷ***********************************************/
+/*************************************固定头部***********************************************/
 	
-	//̶ͷ----------------------ͷϢ-------------------------------------------------
+	//固定头部----------------------头部消息-------------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = MQTT_PKT_PUBREL << 4 | 0x02;
 	
-	//̶ͷ----------------------ʣ೤-------------------------------------------------
+	//固定头部----------------------剩余长度-------------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = 2;
 	
-/*************************************ɱͷ***********************************************/
+/*************************************可变头部***********************************************/
 	
-	//ɱͷ----------------------pkt_id-----------------------------------------------
+	//可变头部----------------------pkt_id长度-----------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = pkt_id >> 8;
 	mqttPacket->_data[mqttPacket->_len++] = pkt_id & 0xff;
 	
@@ -1277,15 +1391,15 @@ uint1 MQTT_PacketPublishRel(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket)
 }
 
 //==========================================================
-//	ƣ	MQTT_UnPacketPublishRel
+//	函数名称：	MQTT_UnPacketPublishRel
 //
-//	ܣ	Publish RelϢ
+//	函数功能：	Publish Rel消息解包
 //
-//	ڲ	rev_dataյ
+//	入口参数：	rev_data：接收到的数据
 //
-//	ز	0-ɹ		1-ʧ
+//	返回参数：	0-成功		1-失败
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint1 MQTT_UnPacketPublishRel(uint8 *rev_data, uint16 pkt_id)
 {
@@ -1301,16 +1415,16 @@ uint1 MQTT_UnPacketPublishRel(uint8 *rev_data, uint16 pkt_id)
 }
 
 //==========================================================
-//	ƣ	MQTT_PacketPublishComp
+//	函数名称：	MQTT_PacketPublishComp
 //
-//	ܣ	Publish CompϢ
+//	函数功能：	Publish Comp消息组包
 //
-//	ڲ	pkt_idpacket id
-//				mqttPacketָ
+//	入口参数：	pkt_id：packet id
+//				mqttPacket：包指针
 //
-//	ز	0-ɹ		1-ʧԭ
+//	返回参数：	0-成功		1-失败原因
 //
-//	˵		յPublishϢQoSȼΪ2ʱյrecٻظrel
+//	说明：		当收到的Publish消息的QoS等级为2时，先收到rec，再回复rel
 //==========================================================
 uint1 MQTT_PacketPublishComp(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket)
 {
@@ -1319,17 +1433,17 @@ uint1 MQTT_PacketPublishComp(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket)
 	if(mqttPacket->_data == NULL)
 		return 1;
 	
-/*************************************̶ͷ***********************************************/
+/*************************************固定头部***********************************************/
 	
-	//̶ͷ----------------------ͷϢ-------------------------------------------------
+	//固定头部----------------------头部消息-------------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = MQTT_PKT_PUBCOMP << 4;
 	
-	//̶ͷ----------------------ʣ೤-------------------------------------------------
+	//固定头部----------------------剩余长度-------------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = 2;
 	
-/*************************************ɱͷ***********************************************/
+/*************************************可变头部***********************************************/
 	
-	//ɱͷ----------------------pkt_id-----------------------------------------------
+	//可变头部----------------------pkt_id长度-----------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = pkt_id >> 8;
 	mqttPacket->_data[mqttPacket->_len++] = pkt_id & 0xff;
 	
@@ -1338,15 +1452,15 @@ uint1 MQTT_PacketPublishComp(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket)
 }
 
 //==========================================================
-//	ƣ	MQTT_UnPacketPublishComp
+//	函数名称：	MQTT_UnPacketPublishComp
 //
-//	ܣ	Publish CompϢ
+//	函数功能：	Publish Comp消息解包
 //
-//	ڲ	rev_dataյ
+//	入口参数：	rev_data：接收到的数据
 //
-//	ز	0-ɹ		1-ʧ
+//	返回参数：	0-成功		1-失败
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint1 MQTT_UnPacketPublishComp(uint8 *rev_data)
 {
@@ -1362,15 +1476,15 @@ uint1 MQTT_UnPacketPublishComp(uint8 *rev_data)
 }
 
 //==========================================================
-//	ƣ	MQTT_PacketPing
+//	函数名称：	MQTT_PacketPing
 //
-//	ܣ	
+//	函数功能：	心跳请求组包
 //
-//	ڲ	mqttPacketָ
+//	入口参数：	mqttPacket：包指针
 //
-//	ز	0-ɹ		1-ʧ
+//	返回参数：	0-成功		1-失败
 //
-//	˵		
+//	说明：		
 //==========================================================
 uint1 MQTT_PacketPing(MQTT_PACKET_STRUCTURE *mqttPacket)
 {
@@ -1379,12 +1493,12 @@ uint1 MQTT_PacketPing(MQTT_PACKET_STRUCTURE *mqttPacket)
 	if(mqttPacket->_data == NULL)
 		return 1;
 	
-/*************************************̶ͷ***********************************************/
+/*************************************固定头部***********************************************/
 	
-	//̶ͷ----------------------ͷϢ-------------------------------------------------
+	//固定头部----------------------头部消息-------------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = MQTT_PKT_PINGREQ << 4;
 	
-	//̶ͷ----------------------ʣ೤-------------------------------------------------
+	//固定头部----------------------剩余长度-------------------------------------------------
 	mqttPacket->_data[mqttPacket->_len++] = 0;
 	
 	return 0;
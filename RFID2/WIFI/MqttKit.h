@@ -5,14 +5,15 @@
 #include "Common.h"
 
 
-//===========================================================
-//===========ṩRTOSڴҲʹC=========
-//RTOS
-#include <stdlib.h>
+//=============================配置==============================
+//===========可以提供RTOS的内存管理方案，也可以使用C库的=========
+//固定块内存池：启动文件里Heap_Size为0，不用C库malloc
+#define MQTT_POOL_BLOCK_SIZE	256		//每块字节数，不小于ESP8266_PKT_SIZE，收到的topic/payload放得下
+#define MQTT_POOL_BLOCK_NUM		4		//块数，命令响应时cmdid、req、响应topic、响应包同时在用
 
-#define MQTT_MallocBuffer	malloc
+#define MQTT_MallocBuffer	MQTT_PoolMalloc
 
-#define MQTT_FreeBuffer		free
+#define MQTT_FreeBuffer		MQTT_PoolFree
 //==========================================================
 
 
@@ -20,64 +21,90 @@
 #define MOSQ_LSB(A)         (uint8)(A & 0x00FF)
 
 
-/*--------------------------------ڴ䷽־--------------------------------*/
+/*--------------------------------内存分配方案标志--------------------------------*/
 #define MEM_FLAG_NULL		0
 #define MEM_FLAG_ALLOC		1
 #define MEM_FLAG_STATIC		2
 
 
+typedef struct
+{
+	
+	uint16	used;		//当前占用块数
+	
+	uint16	high;		//占用块数的最大值
+	
+	uint32	allocs;		//累计分配次数
+	
+	uint32	fails;		//块不够或申请过大失败的次数
+	
+	uint32	maxSize;	//申请过的最大字节数
+	
+} MQTT_POOL_STAT;
+
+
 typedef struct Buffer
 {
 	
-	uint8	*_data;		//Э
+	uint8	*_data;		//协议数据
 	
-	uint32	_len;		//дݳ
+	uint32	_len;		//写入的数据长度
 	
-	uint32	_size;		//ܴС
+	uint32	_size;		//缓存总大小
 	
-	uint8	_memFlag;	//ڴʹõķ0-δ	1-ʹõĶ̬		2-ʹõĹ̶ڴ
+	uint8	_memFlag;	//内存使用的方案：0-未分配	1-使用的动态分配		2-使用的固定内存
 	
 } MQTT_PACKET_STRUCTURE;
 
 
-/*--------------------------------̶ͷϢ--------------------------------*/
+typedef struct
+{
+	
+	const uint8	*ptr;	//指向接收缓存里的数据，不以'\0'结尾
+	
+	uint16	len;		//长度
+	
+} MQTT_SLICE;
+
+
+/*--------------------------------固定头部消息类型--------------------------------*/
 enum MqttPacketType
 {
 	
-    MQTT_PKT_CONNECT = 1, /**< ݰ */
-    MQTT_PKT_CONNACK,     /**< ȷݰ */
-    MQTT_PKT_PUBLISH,     /**< ݰ */
-    MQTT_PKT_PUBACK,      /**< ȷݰ */
-    MQTT_PKT_PUBREC,      /**< ѽݰQos 2ʱظMQTT_PKT_PUBLISH */
-    MQTT_PKT_PUBREL,      /**< ͷݰ Qos 2ʱظMQTT_PKT_PUBREC */
-    MQTT_PKT_PUBCOMP,     /**< ݰ Qos 2ʱظMQTT_PKT_PUBREL */
-    MQTT_PKT_SUBSCRIBE,   /**< ݰ */
-    MQTT_PKT_SUBACK,      /**< ȷݰ */
-    MQTT_PKT_UNSUBSCRIBE, /**< ȡݰ */
-    MQTT_PKT_UNSUBACK,    /**< ȡȷݰ */
-    MQTT_PKT_PINGREQ,     /**< ping ݰ */
-    MQTT_PKT_PINGRESP,    /**< ping Ӧݰ */
-    MQTT_PKT_DISCONNECT,  /**< Ͽݰ */
-	
-	//
-	
-	MQTT_PKT_CMD  		 /**< ·ݰ */
+    MQTT_PKT_CONNECT = 1, /**< 连接请求数据包 */
+    MQTT_PKT_CONNACK,     /**< 连接确认数据包 */
+    MQTT_PKT_PUBLISH,     /**< 发布数据数据包 */
+    MQTT_PKT_PUBACK,      /**< 发布确认数据包 */
+    MQTT_PKT_PUBREC,      /**< 发布数据已接收数据包，Qos 2时，回复MQTT_PKT_PUBLISH */
+    MQTT_PKT_PUBREL,      /**< 发布数据释放数据包， Qos 2时，回复MQTT_PKT_PUBREC */
+    MQTT_PKT_PUBCOMP,     /**< 发布完成数据包， Qos 2时，回复MQTT_PKT_PUBREL */
+    MQTT_PKT_SUBSCRIBE,   /**< 订阅数据包 */
+    MQTT_PKT_SUBACK,      /**< 订阅确认数据包 */
+    MQTT_PKT_UNSUBSCRIBE, /**< 取消订阅数据包 */
+    MQTT_PKT_UNSUBACK,    /**< 取消订阅确认数据包 */
+    MQTT_PKT_PINGREQ,     /**< ping 数据包 */
+    MQTT_PKT_PINGRESP,    /**< ping 响应数据包 */
+    MQTT_PKT_DISCONNECT,  /**< 断开连接数据包 */
+	
+	//新增
+	
+	MQTT_PKT_CMD  		 /**< 命令下发数据包 */
 	
 };
 
 
-/*--------------------------------MQTT QOSȼ--------------------------------*/
+/*--------------------------------MQTT QOS等级--------------------------------*/
 enum MqttQosLevel
 {
 	
-    MQTT_QOS_LEVEL0,  /**< ෢һ */
-    MQTT_QOS_LEVEL1,  /**< ٷһ  */
-    MQTT_QOS_LEVEL2   /**< ֻһ */
+    MQTT_QOS_LEVEL0,  /**< 最多发送一次 */
+    MQTT_QOS_LEVEL1,  /**< 最少发送一次  */
+    MQTT_QOS_LEVEL2   /**< 只发送一次 */
 	
 };
 
 
-/*--------------------------------MQTT ־λڲʹ--------------------------------*/
+/*--------------------------------MQTT 连接请求标志位，内部使用--------------------------------*/
 enum MqttConnectFlag
 {
 	
@@ -93,7 +120,7 @@ enum MqttConnectFlag
 };
 
 
-/*--------------------------------Ϣpacket IDԶ--------------------------------*/
+/*--------------------------------消息的packet ID，可自定义--------------------------------*/
 #define MQTT_PUBLISH_ID			10
 
 #define MQTT_SUBSCRIBE_ID		20
@@ -101,83 +128,99 @@ enum MqttConnectFlag
 #define MQTT_UNSUBSCRIBE_ID		30
 
 
-/*--------------------------------ɾ--------------------------------*/
+/*--------------------------------删包--------------------------------*/
 void MQTT_DeleteBuffer(MQTT_PACKET_STRUCTURE *mqttPacket);
 
-/*----------------------------------------------------------------*/
+
+/*--------------------------------剩余长度编码、解码--------------------------------*/
+int32 MQTT_DumpLength(size_t len, uint8 *buf);
+
+int32 MQTT_ReadLength(const uint8 *stream, int32 size, uint32 *len);
+
+
+/*--------------------------------内存池--------------------------------*/
+void *MQTT_PoolMalloc(uint32 size);
+
+void MQTT_PoolFree(void *p);
+
+void MQTT_PoolStat(MQTT_POOL_STAT *stat);
+
+/*--------------------------------解包--------------------------------*/
 uint8 MQTT_UnPacketRecv(uint8 *dataPtr);
 
-/*--------------------------------¼--------------------------------*/
+/*--------------------------------登录组包--------------------------------*/
 uint8 MQTT_PacketConnect(const int8 *user, const int8 *password, const int8 *devid,
 						uint16 cTime, uint1 clean_session, uint1 qos,
 						const int8 *will_topic, const int8 *will_msg, int32 will_retain,
 						MQTT_PACKET_STRUCTURE *mqttPacket);
 
-/*--------------------------------Ͽ--------------------------------*/
+/*--------------------------------断开连接组包--------------------------------*/
 uint1 MQTT_PacketDisConnect(MQTT_PACKET_STRUCTURE *mqttPacket);
 
-/*--------------------------------Ӧ--------------------------------*/
+/*--------------------------------连接响应解包--------------------------------*/
 uint8 MQTT_UnPacketConnectAck(uint8 *rev_data);
 
-/*--------------------------------ݵϴ--------------------------------*/
+/*--------------------------------数据点上传组包--------------------------------*/
 uint1 MQTT_PacketSaveData(const int8 *pro_id, const char *dev_name,
 								int16 send_len, int8 *type_bin_head, MQTT_PACKET_STRUCTURE *mqttPacket);
 
-/*--------------------------------ļϴ--------------------------------*/
+/*--------------------------------二进制文件上传组包--------------------------------*/
 uint1 MQTT_PacketSaveBinData(const int8 *name, int16 file_len, MQTT_PACKET_STRUCTURE *mqttPacket);
 
-/*--------------------------------·--------------------------------*/
+/*--------------------------------命令下发解包--------------------------------*/
 uint8 MQTT_UnPacketCmd(uint8 *rev_data, int8 **cmdid, int8 **req, uint16 *req_len);
 
-/*--------------------------------ظ--------------------------------*/
+/*--------------------------------命令回复组包--------------------------------*/
 uint1 MQTT_PacketCmdResp(const int8 *cmdid, const int8 *req, MQTT_PACKET_STRUCTURE *mqttPacket);
 
-/*----------------------------------------------------------------*/
+/*--------------------------------订阅主题组包--------------------------------*/
 uint8 MQTT_PacketSubscribe(uint16 pkt_id, enum MqttQosLevel qos, const int8 *topics[], uint8 topics_cnt, MQTT_PACKET_STRUCTURE *mqttPacket);
 
-/*--------------------------------ظ--------------------------------*/
+/*--------------------------------订阅主题回复解包--------------------------------*/
 uint8 MQTT_UnPacketSubscribe(uint8 *rev_data);
 
-/*--------------------------------ȡ--------------------------------*/
+/*--------------------------------取消订阅组包--------------------------------*/
 uint8 MQTT_PacketUnSubscribe(uint16 pkt_id, const int8 *topics[], uint8 topics_cnt, MQTT_PACKET_STRUCTURE *mqttPacket);
 
-/*--------------------------------ȡĻظ--------------------------------*/
+/*--------------------------------取消订阅回复解包--------------------------------*/
 uint1 MQTT_UnPacketUnSubscribe(uint8 *rev_data);
 
-/*----------------------------------------------------------------*/
+/*--------------------------------发布主题组包--------------------------------*/
 uint8 MQTT_PacketPublish(uint16 pkt_id, const int8 *topic,
 						const int8 *payload, uint32 payload_len,
 						enum MqttQosLevel qos, int32 retain, int32 own,
 						MQTT_PACKET_STRUCTURE *mqttPacket);
 
-/*--------------------------------Ϣظ--------------------------------*/
+/*--------------------------------发布消息回复解包--------------------------------*/
 uint8 MQTT_UnPacketPublish(uint8 *rev_data, int8 **topic, uint16 *topic_len, int8 **payload, uint16 *payload_len, uint8 *qos, uint16 *pkt_id);
 
-/*--------------------------------ϢAck--------------------------------*/
+uint8 MQTT_UnPacketPublishView(const uint8 *rev_data, MQTT_SLICE *topic, MQTT_SLICE *payload, uint8 *qos, uint16 *pkt_id);
+
+/*--------------------------------发布消息的Ack组包--------------------------------*/
 uint1 MQTT_PacketPublishAck(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket);
 
-/*--------------------------------ϢAck--------------------------------*/
+/*--------------------------------发布消息的Ack解包--------------------------------*/
 uint1 MQTT_UnPacketPublishAck(uint8 *rev_data);
 
-/*--------------------------------ϢRec--------------------------------*/
+/*--------------------------------发布消息的Rec组包--------------------------------*/
 uint1 MQTT_PacketPublishRec(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket);
 
-/*--------------------------------ϢRec--------------------------------*/
+/*--------------------------------发布消息的Rec解包--------------------------------*/
 uint1 MQTT_UnPacketPublishRec(uint8 *rev_data);
 
-/*--------------------------------ϢRel--------------------------------*/
+/*--------------------------------发布消息的Rel组包--------------------------------*/
 uint1 MQTT_PacketPublishRel(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket);
 
-/*--------------------------------ϢRel--------------------------------*/
+/*--------------------------------发布消息的Rel解包--------------------------------*/
 uint1 MQTT_UnPacketPublishRel(uint8 *rev_data, uint16 pkt_id);
 
-/*--------------------------------ϢComp--------------------------------*/
+/*--------------------------------发布消息的Comp组包--------------------------------*/
 uint1 MQTT_PacketPublishComp(uint16 pkt_id, MQTT_PACKET_STRUCTURE *mqttPacket);
 
-/*--------------------------------ϢComp--------------------------------*/
+/*--------------------------------发布消息的Comp解包--------------------------------*/
 uint1 MQTT_UnPacketPublishComp(uint8 *rev_data);
 
-/*----------------------------------------------------------------*/
+/*--------------------------------心跳请求组包--------------------------------*/
 uint1 MQTT_PacketPing(MQTT_PACKET_STRUCTURE *mqttPacket);
 
 
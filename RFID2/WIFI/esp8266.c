@@ -8,6 +8,7 @@
 //Ӳ������
 #include "delay.h"
 #include "bsp_usart.h"
+#include "bsp_perf.h"
 
 //C��
 #include <string.h>
@@ -17,8 +18,128 @@
 #define ESP8266_WIFI_INFO		"AT+CWJAP=\"Your-WIFI\",\"Your-WIFI-PW\"\r\n"
 #define ESP8266_ONENET_INFO		"AT+CIPSTART=\"TCP\",\"mqtts.heclouds.com\",1883\r\n"
 
-unsigned char esp8266_buf[512];
-unsigned short esp8266_cnt = 0, esp8266_cntPre = 0;
+unsigned char esp8266_buf[512];							//AT应答文本行，不含+IPD数据
+unsigned short esp8266_cnt = 0;
+
+//USART2接收环形缓冲：中断只写head，主循环只写tail(单生产者单消费者，无需关中断)
+#define ESP8266_RING_SIZE		512		//必须是2的幂
+static unsigned char esp8266_ring[ESP8266_RING_SIZE];
+static volatile unsigned short esp8266_ringHead = 0;
+static volatile unsigned short esp8266_ringTail = 0;
+volatile unsigned short esp8266_ovfCnt = 0;			//环形缓冲满时丢弃的字节数
+static unsigned short esp8266_ovfSeen = 0;
+
+//接收解析状态
+#define ESP8266_PARSE_LINE		0		//AT应答文本
+#define ESP8266_PARSE_IPD_LEN	1		//"+IPD,"之后的长度字段
+#define ESP8266_PARSE_IPD_DATA	2		//+IPD数据
+#define ESP8266_PARSE_RAW		3		//透传：全部是MQTT字节
+static unsigned char esp8266_parseState = ESP8266_PARSE_LINE;
+static unsigned short esp8266_lineStart = 0;			//当前行在esp8266_buf中的起点
+static unsigned short esp8266_ipdLeft = 0;				//当前+IPD还剩多少字节
+static _Bool esp8266_lineReady = 0;					//有新的完整应答行
+
+//+IPD数据按MQTT报文切分后放入队列，一个+IPD里有多个报文或一个报文跨多个+IPD都能处理
+#define ESP8266_PKT_NUM			4
+#define ESP8266_PKT_SIZE		256
+typedef struct
+{
+	unsigned short len;
+	unsigned char data[ESP8266_PKT_SIZE];
+} ESP8266_PKT;
+static ESP8266_PKT esp8266_pkt[ESP8266_PKT_NUM];
+static unsigned char esp8266_pktRd = 0, esp8266_pktWr = 0, esp8266_pktNum = 0;
+static _Bool esp8266_pktOut = 0;						//队头报文已交给调用者
+unsigned short esp8266_pktDrop = 0;						//队列满或报文过长丢弃的报文数
+
+#define MQTT_FRAME_HEADER		0
+#define MQTT_FRAME_LENGTH		1
+#define MQTT_FRAME_BODY			2
+static unsigned char esp8266_mqttState = MQTT_FRAME_HEADER;
+static unsigned int esp8266_mqttLeft = 0;				//剩余长度
+static unsigned int esp8266_mqttMul = 1;
+static unsigned short esp8266_mqttPos = 0;
+static _Bool esp8266_mqttDrop = 0;
+
+//AT命令队列
+#define ESP8266_AT_NUM			6
+#define ESP8266_AT_IDLE			0		//队头命令还没发
+#define ESP8266_AT_WAIT_PROMPT	1		//AT+CIPSEND已发，等'>'
+#define ESP8266_AT_WAIT_RES		2		//等应答关键字
+typedef struct
+{
+	const char *cmd;					//NULL表示发送数据(AT+CIPSEND)
+	const char *res;
+	unsigned short len;					//发送数据的长度，数据在esp8266_txBuf中
+	unsigned short timeOut;				//ms
+	ESP8266_AT_CB cb;
+} ESP8266_AT;
+static ESP8266_AT esp8266_at[ESP8266_AT_NUM];
+static unsigned char esp8266_atRd = 0, esp8266_atWr = 0, esp8266_atNum = 0;
+static unsigned char esp8266_atState = ESP8266_AT_IDLE;
+static unsigned char esp8266_atCancel = 0;				//队头之后这么多条不再发，直接按失败结束
+static unsigned int esp8266_atTick = 0;
+
+//待发送数据，按命令顺序存放
+#define ESP8266_TX_SIZE			512
+#define ESP8266_SEND_TIMEOUT	2000
+static unsigned char esp8266_txBuf[ESP8266_TX_SIZE];
+static unsigned short esp8266_txRd = 0, esp8266_txWr = 0, esp8266_txUsed = 0;
+static unsigned short esp8266_txHold = 0;				//已交给DMA、发完之前不能被覆盖的字节数
+static volatile unsigned short esp8266_txNext = 0;		//回绕后从缓冲开头发的第二段，第一段发完在中断里接着发
+
+//初始化步骤，失败后隔ESP8266_RETRY_MS重试本步
+#define ESP8266_RETRY_MS		500
+#define ESP8266_STEP_AT			0
+#define ESP8266_STEP_UART		1		//AT+UART_CUR
+#define ESP8266_STEP_UART_CHECK	2		//换到新波特率后的AT
+#define ESP8266_STEP_CWJAP		5
+#define ESP8266_STEP_CIPSTART	6
+#define ESP8266_STEP_RAW		8		//透传时的AT+CIPSEND，收到'>'后进入透传
+#define ESP8266_BAUD_SETTLE_MS	20		//模块回OK后切换波特率，等它切完再发
+#define ESP8266_STR_(x)			#x
+#define ESP8266_STR(x)			ESP8266_STR_(x)
+#if ESP8266_FLOW_CTRL
+#define ESP8266_UART_FLOW		"2"		//AT+UART_CUR的流控参数：只开模块的CTS
+#else
+#define ESP8266_UART_FLOW		"0"
+#endif
+static const struct
+{
+	const char *cmd;
+	const char *res;
+	unsigned short timeOut;
+} esp8266_initStep[] =
+{
+	{"AT\r\n",				"OK",		2000},
+	{"AT+UART_CUR=" ESP8266_STR(ESP8266_BAUD_FAST) ",8,1,0," ESP8266_UART_FLOW "\r\n",	"OK",	2000},
+	{"AT\r\n",				"OK",		500},
+	{"AT+CWMODE=1\r\n",		"OK",		2000},
+	{"AT+CWDHCP=1,1\r\n",	"OK",		2000},
+	{ESP8266_WIFI_INFO,		"GOT IP",	20000},
+	{ESP8266_ONENET_INFO,	"CONNECT",	10000},
+#if ESP8266_PASSTHROUGH
+	{"AT+CIPMODE=1\r\n",	"OK",		2000},
+	{"AT+CIPSEND\r\n",		">",		2000},
+#endif
+};
+static unsigned char esp8266_step = 0;
+static _Bool esp8266_stepBusy = 0;
+static unsigned int esp8266_stepTick = 0;
+static _Bool esp8266_ready = 0;
+static unsigned int esp8266_baud = ESP8266_BAUD;		//单片机这边当前的波特率
+static _Bool esp8266_baudFail = 0;						//协商失败过，不再协商
+static _Bool esp8266_flow = 0;							//模块已打开CTS流控，ESP8266_Hold能让它停下
+
+//退出透传："+++"前后各有一段时间不能发别的数据，之后模块回到AT命令模式
+#define ESP8266_ESC_GUARD_MS	20		//最后一次发数据到"+++"
+#define ESP8266_ESC_WAIT_MS		1000	//"+++"到可以发AT命令
+#define ESP8266_ESC_NONE		0
+#define ESP8266_ESC_GUARD		1
+#define ESP8266_ESC_WAIT		2
+static unsigned char esp8266_escape = ESP8266_ESC_NONE;
+static unsigned int esp8266_escTick = 0;
+static unsigned int esp8266_txTick = 0;						//最后一次发数据的时刻
 
 
 //==========================================================
@@ -30,13 +151,189 @@ unsigned short esp8266_cnt = 0, esp8266_cntPre = 0;
 //
 //	���ز�����	��
 //
-//	˵����		
+//	˵����		还没收完的一行(例如刚收到一半的"+IPD,")挪到开头保留
 //==========================================================
 void ESP8266_Clear(void)
 {
 
-	memset(esp8266_buf, 0, sizeof(esp8266_buf));
-	esp8266_cnt = 0;
+	unsigned short tail = esp8266_cnt - esp8266_lineStart;
+
+	memmove(esp8266_buf, &esp8266_buf[esp8266_lineStart], tail);
+	memset(&esp8266_buf[tail], 0, sizeof(esp8266_buf) - tail);
+	esp8266_cnt = tail;
+	esp8266_lineStart = 0;
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_MqttByte
+//
+//	函数功能：	把+IPD数据按MQTT报文切分
+//
+//	入口参数：	c：一个字节
+//
+//	返回参数：	无
+//
+//	说明：		按固定头和剩余长度判断报文边界，完整报文进入队列
+//==========================================================
+static void ESP8266_MqttByte(unsigned char c)
+{
+
+	ESP8266_PKT *pkt = &esp8266_pkt[esp8266_pktWr];
+	
+	if(esp8266_mqttState == MQTT_FRAME_HEADER)
+	{
+		esp8266_mqttDrop = (esp8266_pktNum >= ESP8266_PKT_NUM);
+		esp8266_mqttPos = 0;
+		esp8266_mqttLeft = 0;
+		esp8266_mqttMul = 1;
+		esp8266_mqttState = MQTT_FRAME_LENGTH;
+	}
+	else if(esp8266_mqttState == MQTT_FRAME_LENGTH)
+	{
+		esp8266_mqttLeft += (c & 0x7F) * esp8266_mqttMul;
+		esp8266_mqttMul *= 128;
+		if(!(c & 0x80))
+			esp8266_mqttState = MQTT_FRAME_BODY;
+		else if(esp8266_mqttMul > 128 * 128 * 128)				//剩余长度最多4字节
+			esp8266_mqttDrop = 1;
+	}
+	else
+	{
+		esp8266_mqttLeft--;
+	}
+	
+	if(!esp8266_mqttDrop)
+	{
+		if(esp8266_mqttPos < ESP8266_PKT_SIZE)
+			pkt->data[esp8266_mqttPos++] = c;
+		else
+			esp8266_mqttDrop = 1;
+	}
+	
+	if(esp8266_mqttState == MQTT_FRAME_BODY && esp8266_mqttLeft == 0)	//报文结束
+	{
+		if(!esp8266_mqttDrop)
+		{
+			pkt->len = esp8266_mqttPos;
+			esp8266_pktWr = (esp8266_pktWr + 1) % ESP8266_PKT_NUM;
+			esp8266_pktNum++;
+		}
+		else
+			esp8266_pktDrop++;
+		
+		esp8266_mqttState = MQTT_FRAME_HEADER;
+	}
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_ParseByte
+//
+//	函数功能：	逐字节解析ESP8266输出
+//
+//	入口参数：	c：一个字节
+//
+//	返回参数：	无
+//
+//	说明：		"+IPD,<len>:"之后恰好len个字节交给MQTT切分，
+//				其余内容按行存入esp8266_buf；">"提示符单独算一行
+//==========================================================
+static void ESP8266_ParseByte(unsigned char c)
+{
+
+	switch(esp8266_parseState)
+	{
+		case ESP8266_PARSE_LINE:
+		
+			if(esp8266_cnt >= sizeof(esp8266_buf) - 1)				//应答行太多，从头开始
+			{
+				esp8266_cnt = 0;
+				esp8266_lineStart = 0;
+			}
+			esp8266_buf[esp8266_cnt++] = c;
+			esp8266_buf[esp8266_cnt] = 0;
+			
+			if(c == '\n' || (c == '>' && esp8266_cnt - esp8266_lineStart == 1))
+			{
+				esp8266_lineStart = esp8266_cnt;
+				esp8266_lineReady = 1;
+				if(c == '>' && esp8266_stepBusy && esp8266_step == ESP8266_STEP_RAW)
+				{
+					esp8266_mqttState = MQTT_FRAME_HEADER;				//'>'之后的字节都是MQTT报文
+					esp8266_parseState = ESP8266_PARSE_RAW;
+				}
+			}
+			else if(esp8266_cnt - esp8266_lineStart == 5 &&
+					memcmp(&esp8266_buf[esp8266_lineStart], "+IPD,", 5) == 0)
+			{
+				esp8266_cnt = esp8266_lineStart;						//+IPD头不放进应答缓冲
+				esp8266_buf[esp8266_cnt] = 0;
+				esp8266_ipdLeft = 0;
+				esp8266_parseState = ESP8266_PARSE_IPD_LEN;
+			}
+		
+		break;
+		
+		case ESP8266_PARSE_IPD_LEN:
+		
+			if(c >= '0' && c <= '9')
+				esp8266_ipdLeft = esp8266_ipdLeft * 10 + (c - '0');
+			else if(c == ',')											//多连接时"+IPD,id,len:"，取最后一个数
+				esp8266_ipdLeft = 0;
+			else if(c == ':' && esp8266_ipdLeft > 0)
+				esp8266_parseState = ESP8266_PARSE_IPD_DATA;
+			else
+				esp8266_parseState = ESP8266_PARSE_LINE;
+		
+		break;
+		
+		case ESP8266_PARSE_IPD_DATA:
+		
+			ESP8266_MqttByte(c);
+			if(--esp8266_ipdLeft == 0)
+				esp8266_parseState = ESP8266_PARSE_LINE;
+		
+		break;
+		
+		case ESP8266_PARSE_RAW:
+		
+			ESP8266_MqttByte(c);
+		
+		break;
+	}
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_Poll
+//
+//	函数功能：	处理环形缓冲中已收到的数据
+//
+//	入口参数：	无
+//
+//	返回参数：	无
+//
+//	说明：		只在主循环调用，不等待
+//==========================================================
+void ESP8266_Poll(void)
+{
+
+	unsigned short head = esp8266_ringHead;
+	unsigned short tail = esp8266_ringTail;
+	
+	if(esp8266_ovfSeen != esp8266_ovfCnt)							//丢过字节，MQTT报文边界不可信，重新同步
+	{
+		esp8266_ovfSeen = esp8266_ovfCnt;
+		esp8266_mqttState = MQTT_FRAME_HEADER;
+	}
+	
+	while(tail != head)
+	{
+		ESP8266_ParseByte(esp8266_ring[tail]);
+		tail = (tail + 1) & (ESP8266_RING_SIZE - 1);
+	}
+	esp8266_ringTail = tail;
 
 }
 
@@ -54,54 +351,96 @@ void ESP8266_Clear(void)
 _Bool ESP8266_WaitRecive(void)
 {
 
-	if(esp8266_cnt == 0) 							//������ռ���Ϊ0 ��˵��û�д��ڽ��������У�����ֱ����������������
+	ESP8266_Poll();
+	
+	if(!esp8266_lineReady)
 		return REV_WAIT;
-		
-	if(esp8266_cnt == esp8266_cntPre)				//�����һ�ε�ֵ�������ͬ����˵���������
-	{
-		esp8266_cnt = 0;							//��0���ռ���
-			
-		return REV_OK;								//���ؽ�����ɱ�־
-	}
-		
-	esp8266_cntPre = esp8266_cnt;					//��Ϊ��ͬ
 	
-	return REV_WAIT;								//���ؽ���δ��ɱ�־
+	esp8266_lineReady = 0;
+	
+	return REV_OK;
 
 }
 
 //==========================================================
-//	�������ƣ�	ESP8266_SendCmd
+//	函数名称：	ESP8266_QueueCmd
 //
-//	�������ܣ�	��������
+//	函数功能：	AT命令加入发送队列
 //
-//	��ڲ�����	cmd������
-//				res����Ҫ���ķ���ָ��
+//	入口参数：	cmd：命令(必须是常量或全局字符串，发送前不能释放)
+//				res：需要检查的返回指令
+//				timeOut：超时时间(ms)
+//				cb：完成回调，可为NULL
 //
-//	���ز�����	0-�ɹ�	1-ʧ��
+//	返回参数：	0-成功	1-队列满
 //
-//	˵����		
+//	说明：		不等待，由ESP8266_Process发送和检查应答
+//==========================================================
+_Bool ESP8266_QueueCmd(const char *cmd, const char *res, unsigned short timeOut, ESP8266_AT_CB cb)
+{
+
+	ESP8266_AT *at;
+	
+	if(esp8266_atNum >= ESP8266_AT_NUM)
+		return 1;
+	
+	at = &esp8266_at[esp8266_atWr];
+	at->cmd = cmd;
+	at->res = res;
+	at->len = 0;
+	at->timeOut = timeOut;
+	at->cb = cb;
+	esp8266_atWr = (esp8266_atWr + 1) % ESP8266_AT_NUM;
+	esp8266_atNum++;
+	
+	return 0;
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_TxDmaDone
+//
+//	函数功能：	DMA发完一段的回调
+//
+//	入口参数：	无
+//
+//	返回参数：	无
+//
+//	说明：		中断里调用，数据在环形缓冲里回绕时接着发第二段
 //==========================================================
-_Bool ESP8266_SendCmd(char *cmd, char *res)
+static void ESP8266_TxDmaDone(void)
 {
+
+	unsigned short len = esp8266_txNext;
 	
-	unsigned char timeOut = 200;
+	esp8266_txNext = 0;
+	if(len > 0)
+		Usart2_SendDma(esp8266_txBuf, len, NULL);
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_TxIdle
+//
+//	函数功能：	查询USART2的DMA发送是否已结束
+//
+//	入口参数：	无
+//
+//	返回参数：	1-空闲	0-正在发送
+//
+//	说明：		发完后把这次发送占着的数据移出发送缓冲
+//==========================================================
+static _Bool ESP8266_TxIdle(void)
+{
 
-	Usart_SendString(USART2, (unsigned char *)cmd, strlen((const char *)cmd));
+	if(Usart2_TxBusy() || esp8266_txNext > 0)
+		return 0;
 	
-	while(timeOut--)
+	if(esp8266_txHold > 0)
 	{
-		if(ESP8266_WaitRecive() == REV_OK)							//����յ�����
-		{
-			if(strstr((const char *)esp8266_buf, res) != NULL)		//����������ؼ���
-			{
-				ESP8266_Clear();									//��ջ���
-				
-				return 0;
-			}
-		}
-		
-		delay_ms(10);
+		esp8266_txUsed -= esp8266_txHold;
+		esp8266_txHold = 0;
+		esp8266_txTick = millis();
 	}
 	
 	return 1;
@@ -109,28 +448,119 @@ _Bool ESP8266_SendCmd(char *cmd, char *res)
 }
 
 //==========================================================
-//	�������ƣ�	ESP8266_SendData
+//	函数名称：	ESP8266_SendData
 //
-//	�������ܣ�	��������
+//	函数功能：	发送数据
 //
-//	��ڲ�����	data������
-//				len������
+//	入口参数：	data：数据
+//				len：长度
+//				cb：收到SEND OK或失败(含断线时丢弃)后调用，可以为NULL
 //
-//	���ز�����	��
+//	返回参数：	0-已加入队列	1-未连接或缓冲不足
 //
-//	˵����		
+//	说明：		数据先复制到发送缓冲，调用后可立即释放data
 //==========================================================
-void ESP8266_SendData(unsigned char *data, unsigned short len)
+_Bool ESP8266_SendData(unsigned char *data, unsigned short len, ESP8266_AT_CB cb)
 {
 
-	char cmdBuf[32];
+	ESP8266_AT *at;
+	unsigned short i;
 	
-	ESP8266_Clear();								//��ս��ջ���
-	sprintf(cmdBuf, "AT+CIPSEND=%d\r\n", len);		//��������
-	if(!ESP8266_SendCmd(cmdBuf, ">"))				//�յ���>��ʱ���Է�������
+	if(!esp8266_ready || len == 0)
+		return 1;
+	ESP8266_TxIdle();												//已发完的数据先移出缓冲
+	if(esp8266_atNum >= ESP8266_AT_NUM || len > ESP8266_TX_SIZE - esp8266_txUsed)
 	{
-		Usart_SendString(USART2, data, len);		//�����豸������������
+		UsartPrintf(USART_DEBUG, "WARN:	ESP8266 tx queue full, drop %d bytes\r\n", len);
+		return 1;
 	}
+	
+	for(i = 0; i < len; i++)
+	{
+		esp8266_txBuf[esp8266_txWr] = data[i];
+		esp8266_txWr = (esp8266_txWr + 1) % ESP8266_TX_SIZE;
+	}
+	esp8266_txUsed += len;
+	
+	at = &esp8266_at[esp8266_atWr];
+	at->cmd = NULL;													//NULL表示AT+CIPSEND
+	at->res = "SEND OK";
+	at->len = len;
+	at->timeOut = ESP8266_SEND_TIMEOUT;
+	at->cb = cb;
+	esp8266_atWr = (esp8266_atWr + 1) % ESP8266_AT_NUM;
+	esp8266_atNum++;
+	
+	return 0;
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_TxSkip
+//
+//	函数功能：	从发送缓冲移除一段数据
+//
+//	入口参数：	len：长度
+//
+//	返回参数：	无
+//
+//	说明：		send为1时用DMA把这段数据发给ESP8266，发完前数据还占着缓冲，
+//				调用前ESP8266_TxIdle必须返回1
+//==========================================================
+static void ESP8266_TxSkip(unsigned short len, _Bool send)
+{
+
+	unsigned short part = ESP8266_TX_SIZE - esp8266_txRd;				//环形缓冲尾部分两段发
+	
+	if(part > len)
+		part = len;
+	if(send)
+	{
+		esp8266_txHold = len;
+		esp8266_txNext = len - part;
+		Usart2_SendDma(&esp8266_txBuf[esp8266_txRd], part, ESP8266_TxDmaDone);
+	}
+	else
+		esp8266_txUsed -= len;
+	esp8266_txRd = (esp8266_txRd + len) % ESP8266_TX_SIZE;
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_AtDone
+//
+//	函数功能：	结束队头的AT命令
+//
+//	入口参数：	result：ESP8266_AT_OK / ESP8266_AT_ERROR / ESP8266_AT_TIMEOUT
+//
+//	返回参数：	无
+//
+//	说明：		先出队再回调，回调里可以继续加命令
+//==========================================================
+static void ESP8266_AtDone(unsigned char result)
+{
+
+	ESP8266_AT *at = &esp8266_at[esp8266_atRd];
+	ESP8266_AT_CB cb = at->cb;
+	
+	if(at->cmd == NULL && esp8266_atState == ESP8266_AT_WAIT_PROMPT)	//数据还没发出去
+		ESP8266_TxSkip(at->len, 0);
+	if(result != ESP8266_AT_OK)
+		UsartPrintf(USART_DEBUG, "WARN:	AT %s %s\r\n", at->cmd ? at->cmd : "CIPSEND",
+					result == ESP8266_AT_TIMEOUT ? "timeout" : "error");
+	else if(at->cmd == NULL)										//数据已送达模块：发布耗时统计到这里
+	{
+		PERF_End(PERF_AT_SEND);
+		PERF_End(PERF_TAP);
+	}
+	
+	esp8266_atRd = (esp8266_atRd + 1) % ESP8266_AT_NUM;
+	esp8266_atNum--;
+	esp8266_atState = ESP8266_AT_IDLE;
+	ESP8266_Clear();
+	
+	if(cb != NULL)
+		cb(result);
 
 }
 
@@ -149,49 +579,158 @@ void ESP8266_SendData(unsigned char *data, unsigned short len)
 unsigned char *ESP8266_GetIPD(unsigned short timeOut)
 {
 
-	char *ptrIPD = NULL;
+	unsigned int deadline = deadline_ms((unsigned int)timeOut * 5);	//timeOut单位5ms，按实际时间计
+
+	if(esp8266_pktOut)												//上次取走的报文已处理完，出队
+	{
+		esp8266_pktRd = (esp8266_pktRd + 1) % ESP8266_PKT_NUM;
+		esp8266_pktNum--;
+		esp8266_pktOut = 0;
+	}
+	
+	while(1)
+	{
+		ESP8266_Poll();
+		if(esp8266_pktNum > 0)
+		{
+			esp8266_pktOut = 1;
+			return esp8266_pkt[esp8266_pktRd].data;
+		}
+		
+		if(timeOut == 0 || deadline_passed(deadline))					//timeOut为0时只检查一次，不等待
+			break;
+		__WFI();														//等串口接收中断或1ms节拍
+	}
 	
-	do
+	return NULL;														//超时还未收到，返回空指针
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_SetBaud
+//
+//	函数功能：	修改单片机这边USART2的波特率
+//
+//	入口参数：	baud：波特率
+//
+//	返回参数：	无
+//
+//	说明：		
+//==========================================================
+static void ESP8266_SetBaud(unsigned int baud)
+{
+
+	esp8266_baud = baud;
+	Usart2_SetBaud(baud);
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_BaudStep
+//
+//	函数功能：	波特率协商相关步骤的结果处理
+//
+//	入口参数：	result：AT命令结果
+//
+//	返回参数：	1-已处理	0-按通用规则(成功下一步，失败重试)
+//
+//	说明：		第0步没应答时在两种波特率间轮换，单片机复位而模块没断电时
+//				模块还停在协商后的波特率；AT+UART_CUR失败则保持原波特率；
+//				换过去后AT不通就退回，以后不再协商
+//==========================================================
+static _Bool ESP8266_BaudStep(unsigned char result)
+{
+
+	switch(esp8266_step)
 	{
-		if(ESP8266_WaitRecive() == REV_OK)								//����������
-		{	
-			ptrIPD = strstr((char *)esp8266_buf, "IPD,");				//������IPD��ͷ
-			if(ptrIPD == NULL)											//���û�ҵ���������IPDͷ���ӳ٣�������Ҫ�ȴ�һ�ᣬ�����ᳬ���趨��ʱ��
+		case ESP8266_STEP_AT:
+		
+			if(result != ESP8266_AT_OK && ESP8266_BAUD_FAST != ESP8266_BAUD)
+				ESP8266_SetBaud(esp8266_baud == ESP8266_BAUD ? ESP8266_BAUD_FAST : ESP8266_BAUD);
+		
+		break;
+		
+		case ESP8266_STEP_UART:
+		
+			if(result == ESP8266_AT_OK)											//OK的最后几个字节可能还在路上，发下一步前再切换
 			{
-				UsartPrintf(USART_DEBUG, "\"IPD\" not found\r\n");
+				esp8266_step = ESP8266_STEP_UART_CHECK;
+				esp8266_stepTick -= ESP8266_RETRY_MS - ESP8266_BAUD_SETTLE_MS;
 			}
 			else
 			{
-				ptrIPD = strchr(ptrIPD, ':');							//�ҵ�':'
-				if(ptrIPD != NULL)
-				{
-					ptrIPD++;
-					return (unsigned char *)(ptrIPD);
-				}
-				else
-					return NULL;
-				
+				UsartPrintf(USART_DEBUG, "WARN:	ESP8266 keeps %u baud\r\n", esp8266_baud);
+				esp8266_baudFail = 1;
+				esp8266_step = ESP8266_STEP_UART_CHECK + 1;
+				esp8266_stepTick -= ESP8266_RETRY_MS;
 			}
-		}
 		
-		delay_ms(5);
-        timeOut--;		//��ʱ�ȴ�
-	} while(timeOut>0);
+		return 1;
+		
+		case ESP8266_STEP_UART_CHECK:
+		
+			if(result == ESP8266_AT_OK)
+			{
+				UsartPrintf(USART_DEBUG, "Tips:	ESP8266 baud %u\r\n", esp8266_baud);
+				esp8266_flow = ESP8266_FLOW_CTRL;
+				break;
+			}
+			UsartPrintf(USART_DEBUG, "WARN:	ESP8266 no reply at %u baud, back to %u\r\n", esp8266_baud, ESP8266_BAUD);
+			esp8266_baudFail = 1;
+			ESP8266_SetBaud(ESP8266_BAUD);
+			esp8266_step = ESP8266_STEP_AT;
+			esp8266_stepTick -= ESP8266_RETRY_MS;
+		
+		return 1;
+	}
 	
-	return NULL;														//��ʱ��δ�ҵ������ؿ�ָ��
+	return 0;
 
 }
 
 //==========================================================
-//	�������ƣ�	ESP8266_Init
+//	函数名称：	ESP8266_InitDone
 //
-//	�������ܣ�	��ʼ��ESP8266
+//	函数功能：	初始化步骤完成回调
 //
-//	��ڲ�����	��
+//	入口参数：	result：AT命令结果
 //
-//	���ز�����	��
+//	返回参数：	无
 //
-//	˵����		
+//	说明：		成功进入下一步，失败500ms后重试本步
+//==========================================================
+static void ESP8266_InitDone(unsigned char result)
+{
+
+	esp8266_stepBusy = 0;
+	esp8266_stepTick = millis();						//失败时从现在起ESP8266_RETRY_MS后重试
+	
+	if(ESP8266_BaudStep(result))
+		return;
+	if(result != ESP8266_AT_OK)
+		return;
+	
+	esp8266_step++;
+	esp8266_stepTick -= ESP8266_RETRY_MS;							//成功则下一步立即发送
+	if(esp8266_step >= sizeof(esp8266_initStep) / sizeof(esp8266_initStep[0]))
+	{
+		esp8266_ready = 1;
+		UsartPrintf(USART_DEBUG, "%d. ESP8266 Init OK\r\n", esp8266_step + 1);
+	}
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_Init
+//
+//	函数功能：	初始化ESP8266
+//
+//	入口参数：	无
+//
+//	返回参数：	无
+//
+//	说明：		只启动初始化，不等待；各步骤由ESP8266_Process依次发送，
+//				ESP8266_IsReady返回1表示TCP连接已建立
 //==========================================================
 void ESP8266_Init(void)
 {
@@ -199,29 +738,368 @@ void ESP8266_Init(void)
 		ESP8266_Clear();
 		
 		/* Ensure USART2 is initialized for ESP8266 communication */
-		Usart2_Init(115200);
+		Usart2_Init(ESP8266_BAUD);
+		esp8266_baud = ESP8266_BAUD;
+		esp8266_baudFail = 0;
+		esp8266_flow = 0;
+#if ESP8266_FLOW_CTRL
+		{
+			GPIO_InitTypeDef gpioInitStruct;
+			
+			gpioInitStruct.GPIO_Mode = GPIO_Mode_Out_PP;			//RTS，低电平允许模块发送
+			gpioInitStruct.GPIO_Pin = ESP8266_RTS_PIN;
+			gpioInitStruct.GPIO_Speed = GPIO_Speed_50MHz;
+			GPIO_Init(ESP8266_RTS_PORT, &gpioInitStruct);
+			GPIO_ResetBits(ESP8266_RTS_PORT, ESP8266_RTS_PIN);
+		}
+#endif
 	
-		UsartPrintf(USART_DEBUG, "1. AT\r\n");
-		while(ESP8266_SendCmd("AT\r\n", "OK"))
-		delay_ms(500);
+		esp8266_ready = 0;
+		esp8266_step = 0;
+		esp8266_stepBusy = 0;
+		esp8266_stepTick = millis() - ESP8266_RETRY_MS;
+		esp8266_parseState = ESP8266_PARSE_LINE;
+		esp8266_escape = ESP8266_ESC_NONE;
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_IsReady
+//
+//	函数功能：	查询TCP连接是否已建立
+//
+//	入口参数：	无
+//
+//	返回参数：	1-已连接	0-正在初始化或重连
+//
+//	说明：		
+//==========================================================
+_Bool ESP8266_IsReady(void)
+{
+
+	return esp8266_ready;
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_IsIdle
+//
+//	函数功能：	查询模块这边是否没有任何进行中的收发
+//
+//	入口参数：	无
+//
+//	返回参数：	1-已连接，没有排队的命令和数据，收到的都已处理完	0-有事在做
+//
+//	说明：		单片机要进STOP前调用；之后模块只会主动发+IPD或断线提示
+//==========================================================
+_Bool ESP8266_IsIdle(void)
+{
+
+	if(!esp8266_ready || esp8266_atNum > 0 || esp8266_escape != ESP8266_ESC_NONE || !ESP8266_TxIdle())
+		return 0;
+	if(esp8266_ringHead != esp8266_ringTail || esp8266_pktNum > esp8266_pktOut)
+		return 0;
+	if(esp8266_parseState == ESP8266_PARSE_RAW)
+		return esp8266_mqttState == MQTT_FRAME_HEADER;
+	return esp8266_parseState == ESP8266_PARSE_LINE && esp8266_cnt == esp8266_lineStart;
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_Hold
+//
+//	函数功能：	用RTS让模块暂停/继续往单片机发数据
+//
+//	入口参数：	hold：1-暂停	0-继续
+//
+//	返回参数：	1-成功	0-没打开流控，或拉高RTS时有数据进来(RTS已放开)
+//
+//	说明：		模块正在发的字节会发完，拉高RTS后等两个字节的时间再看
+//				接收缓冲；暂停期间单片机可以进STOP，模块那边的数据不会丢
+//==========================================================
+_Bool ESP8266_Hold(_Bool hold)
+{
+
+	unsigned short head = esp8266_ringHead;
 	
-		UsartPrintf(USART_DEBUG, "2. CWMODE\r\n");
-		while(ESP8266_SendCmd("AT+CWMODE=1\r\n", "OK"))
-		delay_ms(500);
+	if(!hold)
+	{
+		if(esp8266_flow)
+			GPIO_ResetBits(ESP8266_RTS_PORT, ESP8266_RTS_PIN);
+		return 1;
+	}
+	if(!esp8266_flow)
+		return 0;
 	
-		UsartPrintf(USART_DEBUG, "3. AT+CWDHCP\r\n");
-		while(ESP8266_SendCmd("AT+CWDHCP=1,1\r\n", "OK"))
-		delay_ms(500);
+	GPIO_SetBits(ESP8266_RTS_PORT, ESP8266_RTS_PIN);
+	delay_us(20000000 / esp8266_baud + 1);
+	if(esp8266_ringHead != head)
+	{
+		GPIO_ResetBits(ESP8266_RTS_PORT, ESP8266_RTS_PIN);
+		return 0;
+	}
+	return 1;
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_AtFlush
+//
+//	函数功能：	丢弃队列中所有的AT命令和待发数据
+//
+//	入口参数：	无
+//
+//	返回参数：	无
+//
+//	说明：		按失败结束，回调照常调用
+//==========================================================
+static void ESP8266_AtFlush(void)
+{
+
+	while(esp8266_atNum > 0)
+	{
+		if(esp8266_at[esp8266_atRd].cmd == NULL && esp8266_atState == ESP8266_AT_IDLE)
+			esp8266_atState = ESP8266_AT_WAIT_PROMPT;					//让ESP8266_AtDone把没发的数据移出缓冲
+		ESP8266_AtDone(ESP8266_AT_ERROR);
+	}
+	esp8266_atCancel = 0;
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_AtCancel
+//
+//	函数功能：	连接断开时取消队列中还没发出的AT命令和待发数据
+//
+//	入口参数：	无
+//
+//	返回参数：	无
+//
+//	说明：		已经发出的队头照常等应答或超时(模块可能已给出'>'在等数据)，
+//				之后的按顺序直接以失败结束、回调照常调用，不会在重连后接着发
+//==========================================================
+static void ESP8266_AtCancel(void)
+{
+
+	esp8266_atCancel = esp8266_atNum;
+	if(esp8266_atNum > 0 && esp8266_atState != ESP8266_AT_IDLE)
+		esp8266_atCancel--;
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_Reconnect
+//
+//	函数功能：	断开TCP连接并重新连接
+//
+//	入口参数：	无
+//
+//	返回参数：	无
+//
+//	说明：		上层发现链路不通(例如心跳没有应答)时调用。透传时模块不报
+//				CLOSED，要先用"+++"退回命令模式；之后AT+CIPCLOSE，
+//				再从AT+CIPSTART重走初始化
+//==========================================================
+void ESP8266_Reconnect(void)
+{
+
+	if(!esp8266_ready)
+		return;
 	
-		UsartPrintf(USART_DEBUG, "4. CWJAP\r\n");
-		while(ESP8266_SendCmd(ESP8266_WIFI_INFO, "GOT IP"))
-		delay_ms(500);
+	UsartPrintf(USART_DEBUG, "WARN:	ESP8266 reconnect\r\n");
+	esp8266_ready = 0;
+	ESP8266_AtFlush();
+	esp8266_step = ESP8266_STEP_CIPSTART;
 	
-		UsartPrintf(USART_DEBUG, "5. CIPSTART\r\n");
-		while(ESP8266_SendCmd(ESP8266_ONENET_INFO, "CONNECT"))
-		delay_ms(500);
+	if(esp8266_parseState == ESP8266_PARSE_RAW)
+		esp8266_escape = ESP8266_ESC_GUARD;								//退出透传后再CIPCLOSE
+	else
+		ESP8266_QueueCmd("AT+CIPCLOSE\r\n", "OK", 2000, NULL);
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_Escape
+//
+//	函数功能：	退出透传
+//
+//	入口参数：	now：当前时刻
+//
+//	返回参数：	无
+//
+//	说明：		"+++"前后都要留出空闲，期间不发送任何数据
+//==========================================================
+static void ESP8266_Escape(unsigned int now)
+{
+
+	switch(esp8266_escape)
+	{
+		case ESP8266_ESC_GUARD:
+		
+			if(now - esp8266_txTick >= ESP8266_ESC_GUARD_MS)
+			{
+				Usart2_SendDma((const unsigned char *)"+++", 3, NULL);
+				esp8266_escTick = now;
+				esp8266_escape = ESP8266_ESC_WAIT;
+			}
+		
+		break;
+		
+		case ESP8266_ESC_WAIT:
+		
+			if(now - esp8266_escTick >= ESP8266_ESC_WAIT_MS)
+			{
+				esp8266_parseState = ESP8266_PARSE_LINE;
+				esp8266_mqttState = MQTT_FRAME_HEADER;
+				ESP8266_Clear();
+				esp8266_escape = ESP8266_ESC_NONE;
+				ESP8266_QueueCmd("AT+CIPCLOSE\r\n", "OK", 2000, NULL);	//模块可能已自动重连，先断开
+			}
+		
+		break;
+	}
+
+}
+
+//==========================================================
+//	函数名称：	ESP8266_Process
+//
+//	函数功能：	AT命令调度
+//
+//	入口参数：	无
+//
+//	返回参数：	无
+//
+//	说明：		主循环调用，不等待。依次发送队列中的命令，按关键字、
+//				ERROR/FAIL和超时结束；初始化和断线重连也在这里推进
+//==========================================================
+void ESP8266_Process(void)
+{
+
+	ESP8266_AT *at;
+	static char cmdBuf[32];											//DMA发完之前不能变
+	_Bool idle = ESP8266_TxIdle();
+	_Bool line = 0;
+	unsigned int now = millis();
+	
+	if(idle)
+		line = (ESP8266_WaitRecive() == REV_OK);
+	else
+		ESP8266_Poll();												//发送中只收数据，应答行发完再处理
+	
+	if(esp8266_escape != ESP8266_ESC_NONE)
+	{
+		if(idle)
+			ESP8266_Escape(now);
+		return;
+	}
+	
+	//已连接时检查断线提示，重新连接
+	if(line && esp8266_ready)
+	{
+		if(strstr((const char *)esp8266_buf, "WIFI DISCONNECT") != NULL)
+		{
+			UsartPrintf(USART_DEBUG, "WARN:	WIFI disconnected, reconnect\r\n");
+			esp8266_ready = 0;
+			ESP8266_AtCancel();
+			esp8266_step = ESP8266_STEP_CWJAP;
+		}
+		else if(strstr((const char *)esp8266_buf, "CLOSED") != NULL)
+		{
+			UsartPrintf(USART_DEBUG, "WARN:	TCP closed, reconnect\r\n");
+			esp8266_ready = 0;
+			ESP8266_AtCancel();
+			esp8266_step = ESP8266_STEP_CIPSTART;
+		}
+	}
+	
+	//初始化/重连：上一步结束且到了重试时间才发下一步
+	if(!esp8266_ready && !esp8266_stepBusy && now - esp8266_stepTick >= ESP8266_RETRY_MS)
+	{
+		if(esp8266_step == ESP8266_STEP_UART &&
+		   (esp8266_baudFail || (ESP8266_BAUD_FAST == ESP8266_BAUD && !ESP8266_FLOW_CTRL)))
+			esp8266_step = ESP8266_STEP_UART_CHECK + 1;				//不协商波特率
+		if(esp8266_step == ESP8266_STEP_UART_CHECK)
+			ESP8266_SetBaud(ESP8266_BAUD_FAST);
+		UsartPrintf(USART_DEBUG, "%d. %s", esp8266_step + 1, esp8266_initStep[esp8266_step].cmd);
+		if(ESP8266_QueueCmd(esp8266_initStep[esp8266_step].cmd, esp8266_initStep[esp8266_step].res,
+							esp8266_initStep[esp8266_step].timeOut, ESP8266_InitDone) == 0)
+			esp8266_stepBusy = 1;
+	}
+	
+	if(esp8266_atNum == 0)
+	{
+		if(line)
+			ESP8266_Clear();											//没有命令在等，丢掉无关的应答行
+		return;
+	}
+	
+	if(!idle)
+		return;
 	
-		UsartPrintf(USART_DEBUG, "6. ESP8266 Init OK\r\n");
+	at = &esp8266_at[esp8266_atRd];
+	switch(esp8266_atState)
+	{
+		case ESP8266_AT_IDLE:
+		
+			ESP8266_Clear();
+			if(esp8266_atCancel > 0)
+			{
+				esp8266_atCancel--;
+				if(at->cmd == NULL)
+					esp8266_atState = ESP8266_AT_WAIT_PROMPT;				//让ESP8266_AtDone把没发的数据移出缓冲
+				ESP8266_AtDone(ESP8266_AT_ERROR);
+				break;
+			}
+			if(at->cmd == NULL && esp8266_parseState == ESP8266_PARSE_RAW)	//透传：直接发，不等应答
+			{
+				ESP8266_TxSkip(at->len, 1);
+				ESP8266_AtDone(ESP8266_AT_OK);
+				break;
+			}
+			if(at->cmd != NULL)
+			{
+				Usart2_SendDma((const unsigned char *)at->cmd, strlen(at->cmd), NULL);
+				esp8266_atState = ESP8266_AT_WAIT_RES;
+			}
+			else
+			{
+				sprintf(cmdBuf, "AT+CIPSEND=%d\r\n", at->len);
+				Usart2_SendDma((const unsigned char *)cmdBuf, strlen(cmdBuf), NULL);
+				esp8266_atState = ESP8266_AT_WAIT_PROMPT;
+			}
+			esp8266_atTick = now;
+		
+		break;
+		
+		case ESP8266_AT_WAIT_PROMPT:
+		
+			if(line && strchr((const char *)esp8266_buf, '>') != NULL)	//收到'>'时可以发送数据
+			{
+				ESP8266_Clear();
+				ESP8266_TxSkip(at->len, 1);
+				esp8266_atState = ESP8266_AT_WAIT_RES;
+				esp8266_atTick = now;
+			}
+			else if(line && strstr((const char *)esp8266_buf, "ERROR") != NULL)
+				ESP8266_AtDone(ESP8266_AT_ERROR);
+			else if(now - esp8266_atTick >= at->timeOut)
+				ESP8266_AtDone(ESP8266_AT_TIMEOUT);
+		
+		break;
+		
+		case ESP8266_AT_WAIT_RES:
+		
+			if(line && strstr((const char *)esp8266_buf, at->res) != NULL)
+				ESP8266_AtDone(ESP8266_AT_OK);
+			else if(line && (strstr((const char *)esp8266_buf, "ERROR") != NULL ||
+							 strstr((const char *)esp8266_buf, "FAIL") != NULL))
+				ESP8266_AtDone(ESP8266_AT_ERROR);
+			else if(now - esp8266_atTick >= at->timeOut)
+				ESP8266_AtDone(ESP8266_AT_TIMEOUT);
+		
+		break;
+	}
 
 }
 
@@ -239,12 +1117,21 @@ void ESP8266_Init(void)
 void USART2_IRQHandler(void)
 {
 
-	if(USART_GetITStatus(USART2, USART_IT_RXNE) != RESET) //�����ж�
+	unsigned short next;
+	
+	if(USART_GetITStatus(USART2, USART_IT_RXNE) != RESET) //接收中断
 	{
-		if(esp8266_cnt >= sizeof(esp8266_buf))	esp8266_cnt = 0; //��ֹ���ڱ�ˢ��
-		esp8266_buf[esp8266_cnt++] = USART2->DR;
-				
-		USART_ClearFlag(USART2, USART_FLAG_RXNE);
+		next = (esp8266_ringHead + 1) & (ESP8266_RING_SIZE - 1);
+		if(next != esp8266_ringTail)
+		{
+			esp8266_ring[esp8266_ringHead] = USART2->DR;
+			esp8266_ringHead = next;
+		}
+		else
+		{
+			(void)USART2->DR;								//缓冲满，丢弃并计数
+			esp8266_ovfCnt++;
+		}
 	}
 
 }
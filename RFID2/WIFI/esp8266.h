@@ -9,15 +9,62 @@
 #define REV_WAIT	1	//����δ��ɱ�־
 
 
+// 1：TCP建立后AT+CIPMODE=1、AT+CIPSEND进入透传，USART2上直接收发MQTT字节，
+//    每个报文省掉AT+CIPSEND=<len>、等'>'和+IPD头；断线靠心跳发现，"+++"退出后重连
+// 0：每个报文走AT+CIPSEND=<len>，下行按+IPD解析(原方式)
+#ifndef ESP8266_PASSTHROUGH
+#define ESP8266_PASSTHROUGH	0
+#endif
+
+
+// USART2波特率：先按ESP8266_BAUD通信，再用AT+UART_CUR协商到ESP8266_BAUD_FAST，
+// 模块不支持或换过去不通时退回ESP8266_BAUD；两者相同则不协商
+#ifndef ESP8266_BAUD
+#define ESP8266_BAUD		115200
+#endif
+#ifndef ESP8266_BAUD_FAST
+#define ESP8266_BAUD_FAST	921600
+#endif
+
+
+// 1：AT+UART_CUR同时打开模块的CTS流控，PA1(USART2_RTS，当普通IO用)接模块的CTS(GPIO13)，
+//    PA1拉高时模块发完当前字节就停下，数据留在模块里，拉低后接着发；低功耗寻卡进STOP前用它
+// 0：不接流控线
+#ifndef ESP8266_FLOW_CTRL
+#define ESP8266_FLOW_CTRL	0
+#endif
+#define ESP8266_RTS_PORT	GPIOA
+#define ESP8266_RTS_PIN		GPIO_Pin_1
+
+
+#define ESP8266_AT_OK		0	//收到期望的应答
+#define ESP8266_AT_ERROR	1	//收到ERROR/FAIL
+#define ESP8266_AT_TIMEOUT	2	//超时
+
+typedef void (*ESP8266_AT_CB)(unsigned char result);
+
+
 void ESP8266_Init(void);
 
+_Bool ESP8266_IsReady(void);
+
+_Bool ESP8266_IsIdle(void);
+
+_Bool ESP8266_Hold(_Bool hold);
+
+void ESP8266_Reconnect(void);
+
+void ESP8266_Process(void);
+
 void ESP8266_Clear(void);
 
-_Bool ESP8266_SendCmd(char *cmd, char *res);
+_Bool ESP8266_QueueCmd(const char *cmd, const char *res, unsigned short timeOut, ESP8266_AT_CB cb);
 
-void ESP8266_SendData(unsigned char *data, unsigned short len);
+_Bool ESP8266_SendData(unsigned char *data, unsigned short len, ESP8266_AT_CB cb);
 
 unsigned char *ESP8266_GetIPD(unsigned short timeOut);
 
+void ESP8266_Poll(void);
+
 
 #endif
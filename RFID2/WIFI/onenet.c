@@ -27,13 +27,16 @@
 
 //协议文件
 #include "onenet.h"
-#include "mqttkit.h"
+#include "MqttKit.h"
 
 //硬件驱动
 #include "bsp_usart.h"
 #include "bsp_delay.h"
+#include "delay.h"
 #include "bsp_led.h"
 #include "bsp_Alarm.h"
+#include "bsp_perf.h"
+#include "bsp_log.h"
 
 //C库
 #include <string.h>
@@ -56,6 +59,12 @@ extern uint8_t Alarm_flag;
 extern int c1c_value;
 extern int c2c_value;
 extern int c3c_value;
+
+static _Bool onenet_online = 0;										//已收到CONNACK
+
+#define ONENET_PINGRESP_MS	10000										//PINGREQ发出后等PINGRESP的时间
+static _Bool onenet_pingWait = 0;										//已发PINGREQ，还没收到PINGRESP
+static unsigned int onenet_pingTick = 0;
 //==========================================================
 //	函数名称：	OneNet_DevLink
 //
@@ -63,45 +72,28 @@ extern int c3c_value;
 //
 //	入口参数：	无
 //
-//	返回参数：	1-成功	0-失败
+//	返回参数：	0-连接请求已发送	1-失败
 //
-//	说明：		连接onenet平台
+//	说明：		不等待平台响应，收到CONNACK后由OneNet_RevPro置在线标志，
+//				用OneNet_IsOnline查询
 //==========================================================
 _Bool OneNet_DevLink(void)
 {
 	
 	MQTT_PACKET_STRUCTURE mqttPacket = {NULL, 0, 0, 0};					//协议包
 
-	unsigned char *dataPtr;
 	_Bool status = 1;
 	
 	UsartPrintf(USART_DEBUG, "OneNet_DevLink\r\n"
 							"PROID: %s,	TOKEN: %s, DEVID:%s\r\n"
                         , PROID, TOKEN, DEVID);
 	
+	onenet_online = 0;
+	onenet_pingWait = 0;
+	
 	if(MQTT_PacketConnect(PROID, TOKEN, DEVID, 256, 1, MQTT_QOS_LEVEL0, NULL, NULL, 0, &mqttPacket) == 0)
 	{
-		ESP8266_SendData(mqttPacket._data, mqttPacket._len);			//上传平台
-		dataPtr = ESP8266_GetIPD(250);									//等待平台响应
-
-		if(dataPtr != NULL)
-		{	
-			if(MQTT_UnPacketRecv(dataPtr) == MQTT_PKT_CONNACK)
-			{
-				switch(MQTT_UnPacketConnectAck(dataPtr))
-				{
-					case 0:UsartPrintf(USART_DEBUG, "Tips:	connected");status = 0;break;
-					
-					case 1:UsartPrintf(USART_DEBUG, "WARN:	连接失败：协议错误\r\n");break;
-					case 2:UsartPrintf(USART_DEBUG, "WARN:	连接失败：非法clientid\r\n");break;
-					case 3:UsartPrintf(USART_DEBUG, "WARN:	连接失败：服务器不可用\r\n");break;
-					case 4:UsartPrintf(USART_DEBUG, "WARN:	连接失败：用户名密码错误\r\n");break;
-					case 5:UsartPrintf(USART_DEBUG, "WARN:	连接失败：未授权(检查token是否)\r\n");break;
-					
-					default:UsartPrintf(USART_DEBUG, "ERR:	连接失败：未知错误\r\n");break;
-				}
-			}
-		}
+		status = ESP8266_SendData(mqttPacket._data, mqttPacket._len, NULL);	//上传平台
 		
 		MQTT_DeleteBuffer(&mqttPacket);								//删除
 	}
@@ -112,6 +104,27 @@ _Bool OneNet_DevLink(void)
 	
 }
 
+//==========================================================
+//	函数名称：	OneNet_IsOnline
+//
+//	函数功能：	查询是否已连接onenet平台
+//
+//	入口参数：	无
+//
+//	返回参数：	1-在线	0-不在线
+//
+//	说明：		TCP断开后同样返回0
+//==========================================================
+_Bool OneNet_IsOnline(void)
+{
+
+	if(!ESP8266_IsReady())
+		onenet_online = 0;
+	
+	return onenet_online;
+
+}
+
 //==========================================================
 //	函数名称：	OneNet_Subscribe
 //
@@ -136,7 +149,7 @@ void OneNet_Subscribe(const char *topics[], unsigned char topic_cnt)
 	
 	if(MQTT_PacketSubscribe(MQTT_SUBSCRIBE_ID, MQTT_QOS_LEVEL0, topics, topic_cnt, &mqttPacket) == 0)
 	{
-		ESP8266_SendData(mqttPacket._data, mqttPacket._len);					//向平台发送订阅请求
+		ESP8266_SendData(mqttPacket._data, mqttPacket._len, NULL);					//向平台发送订阅请求
 		
 		MQTT_DeleteBuffer(&mqttPacket);											//删除
 	}
@@ -151,23 +164,262 @@ void OneNet_Subscribe(const char *topics[], unsigned char topic_cnt)
 //	入口参数：	topic：发布主题
 //				msg：消息内容
 //
-//	返回参数：	SEND_TYPE_OK-成功	SEND_TYPE_PUBLISH-需要重发
+//	返回参数：	0-已交给ESP8266发送	1-不在线或发送队列满，需要重发
 //
 //	说明：		
 //==========================================================
-void OneNet_Publish(const char *topic, const char *msg)
+_Bool OneNet_Publish(const char *topic, const char *msg)
 {
 
 	MQTT_PACKET_STRUCTURE mqttPacket = {NULL, 0, 0, 0};							//协议包
 	
+	_Bool status = 1;
+	
 	UsartPrintf(USART_DEBUG, "Publish Topic: %s, Msg: %s\r\n", topic, msg);
 	
+	if(!OneNet_IsOnline())
+	{
+		UsartPrintf(USART_DEBUG, "WARN:	offline, publish deferred\r\n");
+		return 1;
+	}
+	
+	PERF_Begin(PERF_MQTT_PACK);
 	if(MQTT_PacketPublish(MQTT_PUBLISH_ID, topic, msg, strlen(msg),MQTT_QOS_LEVEL0, 0, 1, &mqttPacket) == 0)
 	{
-		ESP8266_SendData(mqttPacket._data, mqttPacket._len);					//向平台发送发布请求
+		PERF_End(PERF_MQTT_PACK);
+		status = ESP8266_SendData(mqttPacket._data, mqttPacket._len, NULL);			//向平台发送发布请求
+		if(status == 0)
+			PERF_Begin(PERF_AT_SEND);										//收到SEND OK时结束
 		
 		MQTT_DeleteBuffer(&mqttPacket);											//删除
 	}
+	
+	return status;
+
+}
+
+//==========================================================
+//	函数名称：	OneNet_TemplateInit
+//
+//	函数功能：	预先组好PUBLISH报文
+//
+//	入口参数：	tpl：报文模板
+//				topic：发布主题
+//				msg：消息体骨架，长度即以后消息体的最大长度
+//
+//	返回参数：	0-成功	1-报文超过ONENET_TEMPLATE_SIZE
+//
+//	说明：		启动时调用一次，之后用OneNet_TemplateFind找到要改的位置
+//==========================================================
+_Bool OneNet_TemplateInit(ONENET_TEMPLATE *tpl, const char *topic, const char *msg)
+{
+
+	MQTT_PACKET_STRUCTURE mqttPacket = {tpl->buf, 0, sizeof(tpl->buf), 0};		//使用模板里的固定内存
+	uint32 remain_len;
+	
+	tpl->len = 0;
+	if(MQTT_PacketPublish(MQTT_PUBLISH_ID, topic, msg, strlen(msg), MQTT_QOS_LEVEL0, 0, 1, &mqttPacket) != 0)
+		return 1;
+	
+	tpl->len = mqttPacket._len;
+	tpl->head = 1 + MQTT_ReadLength(tpl->buf + 1, 4, &remain_len);
+	tpl->msg = tpl->len - strlen(msg);
+	
+	return 0;
+
+}
+
+//==========================================================
+//	函数名称：	OneNet_TemplateFind
+//
+//	函数功能：	在模板报文里找一段文本
+//
+//	入口参数：	tpl：报文模板
+//				mark：要找的文本
+//
+//	返回参数：	mark之后第一个字节在报文里的地址，没找到为NULL
+//
+//	说明：		从报文末尾的消息体往前找，不会找到topic里
+//==========================================================
+char *OneNet_TemplateFind(ONENET_TEMPLATE *tpl, const char *mark)
+{
+
+	unsigned short mark_len = strlen(mark);
+	unsigned short i;
+	
+	if(mark_len == 0 || mark_len > tpl->len)
+		return NULL;
+	
+	for(i = tpl->len - mark_len + 1; i > 0; i--)
+	{
+		if(memcmp(tpl->buf + i - 1, mark, mark_len) == 0)
+			return (char *)tpl->buf + i - 1 + mark_len;
+	}
+	
+	return NULL;
+
+}
+
+//==========================================================
+//	函数名称：	OneNet_PublishTemplate
+//
+//	函数功能：	发送模板报文
+//
+//	入口参数：	tpl：报文模板
+//				msg_len：消息体实际长度，不超过骨架长度
+//				cb：发送结果回调，见ESP8266_SendData
+//
+//	返回参数：	0-已交给ESP8266发送	1-不在线、长度不对或发送队列满，需要重发
+//
+//	说明：		只重写固定头部；剩余长度字节数变少时报文从后移的位置开始发，
+//				不搬动topic和消息体
+//==========================================================
+_Bool OneNet_PublishTemplate(ONENET_TEMPLATE *tpl, unsigned short msg_len, ESP8266_AT_CB cb)
+{
+
+	unsigned char len_buf[4];
+	unsigned short start;
+	int32 n;
+	_Bool status;
+	
+	if(!OneNet_IsOnline() || tpl->len == 0 || msg_len > tpl->len - tpl->msg)
+	{
+		UsartPrintf(USART_DEBUG, "WARN:	offline, publish deferred\r\n");
+		return 1;
+	}
+	
+	n = MQTT_DumpLength(tpl->msg - tpl->head + msg_len, len_buf);	//不会比骨架的剩余长度字节多
+	start = tpl->head - 1 - n;
+	tpl->buf[start] = tpl->buf[0];									//PUBLISH类型和标志
+	memcpy(tpl->buf + start + 1, len_buf, n);
+	
+	status = ESP8266_SendData(tpl->buf + start, tpl->msg + msg_len - start, cb);
+	if(status == 0)
+		PERF_Begin(PERF_AT_SEND);											//收到SEND OK时结束
+	
+	return status;
+
+}
+
+//==========================================================
+//	函数名称：	OneNet_Ping
+//
+//	函数功能：	发送心跳
+//
+//	入口参数：	无
+//
+//	返回参数：	0-已交给ESP8266发送	1-失败
+//
+//	说明：		keepalive时间内没有其它报文时需要发送，平台回PINGRESP
+//==========================================================
+_Bool OneNet_Ping(void)
+{
+
+	MQTT_PACKET_STRUCTURE mqttPacket = {NULL, 0, 0, 0};							//协议包
+	
+	_Bool status = 1;
+	
+	if(MQTT_PacketPing(&mqttPacket) == 0)
+	{
+		status = ESP8266_SendData(mqttPacket._data, mqttPacket._len, NULL);
+		
+		MQTT_DeleteBuffer(&mqttPacket);											//删除
+	}
+	
+	if(status == 0 && !onenet_pingWait)
+	{
+		onenet_pingWait = 1;
+		onenet_pingTick = millis();
+	}
+	
+	return status;
+
+}
+
+//==========================================================
+//	函数名称：	OneNet_PingOverdue
+//
+//	函数功能：	查询心跳是否超时没有应答
+//
+//	入口参数：	无
+//
+//	返回参数：	1-PINGREQ发出ONENET_PINGRESP_MS后仍没有收到PINGRESP
+//
+//	说明：		透传模式下模块不报CLOSED，链路断了只能这样发现
+//==========================================================
+_Bool OneNet_PingOverdue(void)
+{
+
+	return onenet_pingWait && millis() - onenet_pingTick >= ONENET_PINGRESP_MS;
+
+}
+
+//==========================================================
+//	函数名称：	OneNet_PingPending
+//
+//	函数功能：	查询是否在等PINGRESP
+//
+//	入口参数：	无
+//
+//	返回参数：	1-PINGREQ已发出，还没收到PINGRESP
+//
+//	说明：		
+//==========================================================
+_Bool OneNet_PingPending(void)
+{
+
+	return onenet_pingWait;
+
+}
+
+//==========================================================
+//	函数名称：	OneNet_JsonInt
+//
+//	函数功能：	在JSON文本中取 "key": 后面的非负整数
+//
+//	入口参数：	json：JSON文本，不要求以'\0'结尾
+//				len：文本长度，扫描不越过
+//				key：键名，不含引号
+//				value：取到的值
+//
+//	返回参数：	1-取到		0-没有该键、值不是非负整数或超出int范围
+//
+//	说明：		不做完整JSON解析，只找第一个匹配的键
+//==========================================================
+static _Bool OneNet_JsonInt(const char *json, unsigned short len, const char *key, int *value)
+{
+
+	unsigned short key_len = strlen(key);
+	unsigned short i, pos;
+	int v;
+	
+	for(i = 0; i + key_len + 2 <= len; i++)
+	{
+		if(json[i] != '"' || json[i + key_len + 1] != '"' || memcmp(json + i + 1, key, key_len) != 0)
+			continue;
+		
+		pos = i + key_len + 2;
+		while(pos < len && (json[pos] == ' ' || json[pos] == '\t'))
+			pos++;
+		if(pos >= len || json[pos] != ':')
+			continue;
+		pos++;
+		while(pos < len && (json[pos] == ' ' || json[pos] == '\t'))
+			pos++;
+		if(pos >= len || json[pos] < '0' || json[pos] > '9')
+			return 0;
+		
+		for(v = 0; pos < len && json[pos] >= '0' && json[pos] <= '9'; pos++)
+		{
+			if(v > (0x7FFFFFFF - (json[pos] - '0')) / 10)			//溢出
+				return 0;
+			v = v * 10 + (json[pos] - '0');
+		}
+		*value = v;
+		return 1;
+	}
+	
+	return 0;
 
 }
 
@@ -190,8 +442,8 @@ void OneNet_RevPro(unsigned char *cmd)
 	char *req_payload = NULL;
 	char *cmdid_topic = NULL;
 	
-	unsigned short topic_len = 0;
 	unsigned short req_len = 0;
+	MQTT_SLICE pub_topic, pub_payload;
 	
 	unsigned char type = 0;
 	unsigned char qos = 0;
@@ -203,6 +455,23 @@ void OneNet_RevPro(unsigned char *cmd)
 	type = MQTT_UnPacketRecv(cmd);
 	switch(type)
 	{
+		case MQTT_PKT_CONNACK:														//连接请求的响应
+		
+			switch(MQTT_UnPacketConnectAck(cmd))
+			{
+				case 0:UsartPrintf(USART_DEBUG, "Tips:	connected\r\n");onenet_online = 1;break;
+				
+				case 1:UsartPrintf(USART_DEBUG, "WARN:	连接失败：协议错误\r\n");break;
+				case 2:UsartPrintf(USART_DEBUG, "WARN:	连接失败：非法clientid\r\n");break;
+				case 3:UsartPrintf(USART_DEBUG, "WARN:	连接失败：服务器不可用\r\n");break;
+				case 4:UsartPrintf(USART_DEBUG, "WARN:	连接失败：用户名密码错误\r\n");break;
+				case 5:UsartPrintf(USART_DEBUG, "WARN:	连接失败：未授权(检查token是否)\r\n");break;
+				
+				default:UsartPrintf(USART_DEBUG, "ERR:	连接失败：未知错误\r\n");break;
+			}
+		
+		break;
+		
 		case MQTT_PKT_CMD:															//命令下发
 			
 			result = MQTT_UnPacketCmd(cmd, &cmdid_topic, &req_payload, &req_len);	//解析topic和消息体
@@ -214,7 +483,7 @@ void OneNet_RevPro(unsigned char *cmd)
 				{
 					UsartPrintf(USART_DEBUG, "Tips:	Send CmdResp\r\n");
 					
-					ESP8266_SendData(mqttPacket._data, mqttPacket._len);			//回复响应
+					ESP8266_SendData(mqttPacket._data, mqttPacket._len, NULL);			//回复响应
 					MQTT_DeleteBuffer(&mqttPacket);									//删除
 				}
 			}
@@ -223,118 +492,54 @@ void OneNet_RevPro(unsigned char *cmd)
 			
 		case MQTT_PKT_PUBLISH:														//接收到Publish消息
 		
-			result = MQTT_UnPacketPublish(cmd, &cmdid_topic, &topic_len, &req_payload, &req_len, &qos, &pkt_id);
+			result = MQTT_UnPacketPublishView(cmd, &pub_topic, &pub_payload, &qos, &pkt_id);	//topic和消息体直接指向cmd，不复制
 			if(result == 0)
 			{
-				// 安全打印 topic
-				if(cmdid_topic != NULL && topic_len > 0)
-				{
-					UsartPrintf(USART_DEBUG, "topic: %.*s, topic_len: %d\r\n", topic_len, cmdid_topic, topic_len);
-				}
-				else
-				{
-					UsartPrintf(USART_DEBUG, "WARN: topic is NULL or invalid\r\n");
-				}
+				LOG_D("topic: %.*s, topic_len: %d\r\n", pub_topic.len, pub_topic.ptr, pub_topic.len);
 				
-				// 安全打印 payload（限制长度避免打印过长或二进制数据）
-				if(req_payload != NULL && req_len > 0)
+				// 调试时打印payload（限制长度避免打印过长；二进制内容按原样截断显示）
+				if(pub_payload.len > 0)
 				{
-					unsigned short print_len = req_len < 200 ? req_len : 200;  // 限制打印长度
-					UsartPrintf(USART_DEBUG, "payload_len: %d, payload (first %d bytes): ", req_len, print_len);
-					for(unsigned short i = 0; i < print_len; i++)
+					LOG_D("payload_len: %d, payload: %.*s\r\n", pub_payload.len,
+						  pub_payload.len < 120 ? pub_payload.len : 120, (const char *)pub_payload.ptr);
+					
+					// 在payload中查找 '{'，从JSON开始位置按长度扫描，不复制、不截断
+					const char *json_str = memchr(pub_payload.ptr, '{', pub_payload.len);
+					unsigned short json_len;
+					int value;
+					
+					if(json_str == NULL)
+						json_str = (const char *)pub_payload.ptr;
+					json_len = pub_payload.len - (json_str - (const char *)pub_payload.ptr);
+					
+					LOG_D("Found JSON at offset %d: %.*s\r\n",
+						  (int)(json_str - (const char *)pub_payload.ptr), json_len, json_str);
+					
+					if(OneNet_JsonInt(json_str, json_len, "C1Charge", &value))
 					{
-						if(req_payload[i] >= 32 && req_payload[i] < 127)  // 可打印字符
-						{
-							UsartPrintf(USART_DEBUG, "%c", req_payload[i]);
-						}
-						else
-						{
-							UsartPrintf(USART_DEBUG, "\\x%02X", (unsigned char)req_payload[i]);
-						}
+						c1c_value = value;
+						UsartPrintf(USART_DEBUG, "c1c_value = %d\r\n", c1c_value);
 					}
-					UsartPrintf(USART_DEBUG, "\r\n");
-				}
-				else
-				{
-					UsartPrintf(USART_DEBUG, "WARN: payload is NULL or empty (len=%d)\r\n", req_len);
-				}
-				
-				// 手动解析JSON格式的payload（查找JSON字符串）
-				if(req_payload != NULL && req_len > 0)
-				{
-					// 方法1：在payload中查找 '{' 字符，找到JSON开始位置
-					unsigned short json_start = 0;
-					unsigned short i;
-					for(i = 0; i < req_len; i++)
+					if(OneNet_JsonInt(json_str, json_len, "C2Charge", &value))
 					{
-						if(req_payload[i] == '{')
-						{
-							json_start = i;
-							break;
-						}
+						c2c_value = value;
+						UsartPrintf(USART_DEBUG, "c2c_value = %d\r\n", c2c_value);
 					}
-					
-					// 如果找到JSON开始位置
-					if(json_start < req_len)
+					if(OneNet_JsonInt(json_str, json_len, "C3Charge", &value))
 					{
-						// 提取JSON字符串
-						unsigned short json_len = req_len - json_start;
-						char *json_str = (char *)req_payload + json_start;
-						
-						// 创建临时缓冲区确保字符串null终止
-						char temp_json[256];
-						unsigned short copy_len = json_len < 255 ? json_len : 255;
-						memcpy(temp_json, json_str, copy_len);
-						temp_json[copy_len] = '\0';
-						
-						UsartPrintf(USART_DEBUG, "Found JSON at offset %d: %s\r\n", json_start, temp_json);
-						
-						// 方法2：使用简单的字符串搜索提取值（避免cJSON可能卡死）
-						char *c1c_str = strstr(temp_json, "\"C1Charge\":");
-						char *c2c_str = strstr(temp_json, "\"C2Charge\":");
-						char *c3c_str = strstr(temp_json, "\"C3Charge\":");
-						
-						if(c1c_str != NULL)
-						{
-							char *num_start = c1c_str + 11;  // 跳过 "C1Charge":
-							while(*num_start == ' ' || *num_start == '\t') num_start++;  // 跳过空格
-							if(*num_start >= '0' && *num_start <= '9')
-							{
-								c1c_value = atoi(num_start);
-								UsartPrintf(USART_DEBUG, "c1c_value = %d\r\n", c1c_value);
-							}
-						}
-						
-						if(c2c_str != NULL)
-						{
-							char *num_start = c2c_str + 11;  // 跳过 "C2Charge":
-							while(*num_start == ' ' || *num_start == '\t') num_start++;  // 跳过空格
-							if(*num_start >= '0' && *num_start <= '9')
-							{
-								c2c_value = atoi(num_start);
-								UsartPrintf(USART_DEBUG, "c2c_value = %d\r\n", c2c_value);
-							}
-						}
-						
-						if(c3c_str != NULL)
-						{
-							char *num_start = c3c_str + 11;  // 跳过 "C3Charge":
-							while(*num_start == ' ' || *num_start == '\t') num_start++;  // 跳过空格
-							if(*num_start >= '0' && *num_start <= '9')
-							{
-								c3c_value = atoi(num_start);
-								UsartPrintf(USART_DEBUG, "c3c_value = %d\r\n", c3c_value);
-							}
-						}
+						c3c_value = value;
+						UsartPrintf(USART_DEBUG, "c3c_value = %d\r\n", c3c_value);
 					}
 				}
+				else
+				{
+					UsartPrintf(USART_DEBUG, "WARN: payload is empty\r\n");
+				}
 				
 			}
 			else
 			{
 				UsartPrintf(USART_DEBUG, "ERR: MQTT_UnPacketPublish failed, result=%d\r\n", result);
-				// 解析失败时清空缓冲区，避免影响后续数据接收
-				ESP8266_Clear();
 			}
 		break;
 			
@@ -353,7 +558,7 @@ void OneNet_RevPro(unsigned char *cmd)
 				if(MQTT_PacketPublishRel(MQTT_PUBLISH_ID, &mqttPacket) == 0)
 				{
 					UsartPrintf(USART_DEBUG, "Tips:	Send PublishRel\r\n");
-					ESP8266_SendData(mqttPacket._data, mqttPacket._len);
+					ESP8266_SendData(mqttPacket._data, mqttPacket._len, NULL);
 					MQTT_DeleteBuffer(&mqttPacket);
 				}
 			}
@@ -368,7 +573,7 @@ void OneNet_RevPro(unsigned char *cmd)
 				if(MQTT_PacketPublishComp(MQTT_PUBLISH_ID, &mqttPacket) == 0)
 				{
 					UsartPrintf(USART_DEBUG, "Tips:	Send PublishComp\r\n");
-					ESP8266_SendData(mqttPacket._data, mqttPacket._len);
+					ESP8266_SendData(mqttPacket._data, mqttPacket._len, NULL);
 					MQTT_DeleteBuffer(&mqttPacket);
 				}
 			}
@@ -402,17 +607,21 @@ void OneNet_RevPro(unsigned char *cmd)
 		
 		break;
 		
+		case MQTT_PKT_PINGRESP:
+		
+			onenet_pingWait = 0;
+		
+		break;
+		
 		default:
 			result = -1;
 		break;
 	}
 	
-	ESP8266_Clear();									//清空栈区
-	
 	if(result == -1)
 		return;
 	
-	if(type == MQTT_PKT_CMD || type == MQTT_PKT_PUBLISH)
+	if(type == MQTT_PKT_CMD)
 	{
 		MQTT_FreeBuffer(cmdid_topic);
 		MQTT_FreeBuffer(req_payload);
@@ -1,19 +1,52 @@
 #ifndef _ONENET_H_
 #define _ONENET_H_
 
+#include "esp8266.h"
 
 
+#define ONENET_TEMPLATE_SIZE	192		//预先组好的PUBLISH报文最大长度
+
+
+//预先组好的PUBLISH报文：固定头部、topic、消息体骨架都已写好，发送前只改写消息体，
+//消息体可以比骨架短，发送时按实际长度重写剩余长度字段
+typedef struct
+{
+	
+	unsigned char buf[ONENET_TEMPLATE_SIZE];
+	
+	unsigned short len;			//按骨架组好的报文长度，0表示未初始化
+	
+	unsigned short head;		//可变头部(topic)在buf里的位置
+	
+	unsigned short msg;			//消息体在buf里的位置
+	
+} ONENET_TEMPLATE;
+
 
 
 _Bool OneNET_RegisterDevice(void);
 
 _Bool OneNet_DevLink(void);
 
+_Bool OneNet_IsOnline(void);
+
 void OneNet_Subscribe(const char *topics[], unsigned char topic_cnt);
 
 void OneNet_RevPro(unsigned char *cmd);
 
-void OneNet_Publish(const char *topic, const char *msg);
+_Bool OneNet_Publish(const char *topic, const char *msg);
+
+_Bool OneNet_Ping(void);
+
+_Bool OneNet_PingOverdue(void);
+
+_Bool OneNet_PingPending(void);
+
+_Bool OneNet_TemplateInit(ONENET_TEMPLATE *tpl, const char *topic, const char *msg);
+
+char *OneNet_TemplateFind(ONENET_TEMPLATE *tpl, const char *mark);
+
+_Bool OneNet_PublishTemplate(ONENET_TEMPLATE *tpl, unsigned short msg_len, ESP8266_AT_CB cb);
 
 void OneNet_ParseTLV(unsigned char *data, unsigned short len);
 